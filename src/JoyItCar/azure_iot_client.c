@@ -1,11 +1,10 @@
+#include <time.h>
 
 #include <applibs/gpio.h>
 #include <applibs/eventloop.h>
 #include <applibs/networking.h>
-#include <applibs/log.h>
 
 // Azure IoT SDK
-#include <azure_sphere_provisioning.h>
 #include <iothub_device_client_ll.h>
 #include <iothub_message.h>
 
@@ -13,15 +12,30 @@
 
 #include "utils.h"
 #include "eventloop_timer_utilities.h"
+#include "logger.h"
 
 #include "azure_iot_client.h"
+#include "command_bus.h"
+#include "device_config.h"
+#include "device_operations.h"
+#include "iot_connection.h"
 #include "i2c_motor_driver.h"
+#include "json_tokenizer.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "motion_control.h"
+#include "motion_sequencer.h"
+#include "reported_state.h"
+#include "telemetry.h"
+#include "telemetry_store.h"
 
 static const char networkInterface[] = "wlan0";
 
 static IOTHUB_DEVICE_CLIENT_LL_HANDLE iothubClientHandle = NULL;
 
-static EventLoopTimer *azureTimer = NULL;
+static EventLoopTimer *doWorkTimer = NULL;
+static EventLoopTimer *metricsReportTimer = NULL;
+static EventLoopWorkQueue *deferredWorkQueue = NULL;
 
 /// <summary>
 /// Authentication state of the client with respect to the Azure IoT Hub.
@@ -39,38 +53,129 @@ typedef enum
 // Authentication state with respect to the IoT Hub.
 static IoTHubClientAuthenticationState iotHubClientAuthenticationState = IoTHubClientAuthenticationState_NotAuthenticated;
 
-// Azure IoT poll periods
-static const int AzureIoTDefaultPollPeriodSeconds = 10;       // poll azure iot every second
-static const int AzureIoTMinReconnectPeriodSeconds = 10;      // back off when reconnecting
-static const int AzureIoTMaxReconnectPeriodSeconds = 10 * 60; // back off limit
+// DPS ID scope of the device; the connection manager caches the hub it assigns.
+static const char dpsScopeId[] = "0ne000E0092";
 
-static int azureIoTPollPeriodSeconds = -1;
+// IoTHubDeviceClient_LL_DoWork pump periods, independent from the telemetry period
+static const int AzureIoTFastDoWorkPeriodMs = 50;       // traffic pending or recent method
+static const int AzureIoTConnectedDoWorkPeriodMs = 100; // connected or connecting
+static const int AzureIoTIdleDoWorkPeriodMs = 1000;     // client waiting for a reconnect
+static const uint64_t AzureIoTTrafficHoldUs = 1000 * 1000; // stay fast after traffic
+
+// Period of the "metrics" reported property; unchanged metrics are left out of a report.
+static const struct timespec metricsReportPeriod = {.tv_sec = 60, .tv_nsec = 0};
+
+// A metrics report is cached until the hub acknowledges it; until then the next report
+// repeats its values.
+static bool metricsExportStaged = false;
+
+static int doWorkPeriodMs = -1;
+static uint64_t lastTrafficAtUs = 0;
+
+static AzureIoTStats azureIoTStats;
+
+// Preallocated buffer for serialized telemetry messages
+static char telemetryBuffer[TELEMETRY_BATCH_MAX_BYTES];
+_Static_assert(TELEMETRY_STORE_MAX_MESSAGE_BYTES <= sizeof(telemetryBuffer),
+               "A stored telemetry message is forwarded from telemetryBuffer.");
+
+// Stored telemetry is forwarded one message at a time, at most once per interval.
+static const uint64_t TelemetryForwardIntervalUs = 250 * 1000;
+static uint32_t inFlightTelemetryId = 0;
+static uint64_t lastTelemetryForwardAtUs = 0;
+
+/// <summary>
+///     Arguments of a payload-aware Direct Method, parsed before the method is queued.
+/// </summary>
+typedef struct
+{
+    int left;
+    int right;
+    int linear;
+    int angular;
+    uint32_t durationMs;
+    uint32_t operationId;
+    MotionStep steps[MOTION_SEQUENCE_MAX_STEPS];
+    size_t stepCount;
+} DeviceMethodArgs;
+
+// Longest trace ID carried by a Direct Method: a W3C trace ID is 32 hex digits.
+#define DEVICE_METHOD_TRACE_MAX 32
+
+/// <summary>
+///     Direct Method waiting on the command bus, with its arrival time and, if the sender
+///     stamped it, its send time in Unix milliseconds and its trace ID, or "". inUse holds
+///     the slot from the submission of its command until the bus runs or rejects it.
+/// </summary>
+typedef struct
+{
+    const struct DeviceMethodAction *method;
+    DeviceMethodArgs args;
+    uint64_t arrivedAtUs;
+    int64_t sentAtMs;
+    char trace[DEVICE_METHOD_TRACE_MAX + 1];
+    bool inUse;
+} PendingDeviceMethod;
+
+// One slot per command the bus can queue: a slot is freed as its command leaves the queue.
+static PendingDeviceMethod pendingDeviceMethods[COMMAND_BUS_CAPACITY];
+
+// Direct Method whose trace awaits the motors reaching their target, copied out of its slot.
+static PendingDeviceMethod tracedMethod;
+static uint64_t tracedMethodDispatchedAtUs = 0;
+static uint32_t tracedMethodDispatchUs = 0;
+static bool tracedMethodAwaitingMotors = false;
+
+// Direct Method payloads are tokenized in place; they are small flat objects.
+#define DEVICE_METHOD_MAX_TOKENS 16
+static JsonToken methodPayloadTokens[DEVICE_METHOD_MAX_TOKENS];
+
+// Steps of the sequence started by ExecuteSequence, copied out of its pending slot.
+static MotionStep executedSequence[MOTION_SEQUENCE_MAX_STEPS];
+
+// Hashes of the idempotency keys of the last queued Direct Methods; 0 marks a free slot.
+#define DEVICE_METHOD_RECENT_KEYS 16
+static uint64_t recentMethodKeys[DEVICE_METHOD_RECENT_KEYS];
+static size_t nextRecentMethodKey = 0;
+
+// Preformatted Direct Method responses
+static const char MethodResponseOK[] = "{\"result\":\"OK\"}";
+static const char MethodResponseNotFound[] = "{\"result\":\"NotFound\"}";
+static const char MethodResponseBadRequest[] = "{\"result\":\"BadRequest\"}";
+static const char MethodResponseBusy[] = "{\"result\":\"Busy\"}";
+static const char MethodResponseDuplicate[] = "{\"result\":\"Duplicate\"}";
+
+// Responses carrying operation state are written here before being copied for the SDK.
+static char methodResponseBuffer[256];
+
+// Cloud-to-device commands: last applied command, and the age beyond which one is dropped
+static int64_t lastCloudCommandSeq = -1;
+static int64_t lastCloudCommandTs = -1;
+static uint32_t cloudCommandMaxAgeMs = 1000;
+
+// Timed drives brake when the motion timer expires.
+static const int64_t DriveDefaultDurationMs = 1000;
+static const int64_t DriveMaxDurationMs = 10000;
+
+// Latest device twin update, copied out of the SDK callback and applied on the event loop
+static char deviceTwinBuffer[DEVICE_TWIN_MAX_BYTES];
+static size_t deviceTwinSize = 0;
+static bool deviceTwinIsComplete = false;
+static bool deviceTwinPending = false;
+static bool deviceTwinResyncRequired = false;
+static char desiredPropertiesReport[DEVICE_CONFIG_REPORT_MAX_BYTES];
 
 static int blueLedFd = -1, redLedFd = -1, greenLedFd = -1;
 
+static void UpdateDoWorkPeriod(void);
+
 /// <summary>
-///     Converts AZURE_SPHERE_PROV_RETURN_VALUE to a string.
+///     Records that messages are in flight, so that DoWork is pumped at the fast rate.
 /// </summary>
-static const char *GetAzureSphereProvisioningResultString(
-    AZURE_SPHERE_PROV_RETURN_VALUE provisioningResult)
+static void MarkAzureIoTTraffic(void)
 {
-    switch (provisioningResult.result)
-    {
-    case AZURE_SPHERE_PROV_RESULT_OK:
-        return "AZURE_SPHERE_PROV_RESULT_OK";
-    case AZURE_SPHERE_PROV_RESULT_INVALID_PARAM:
-        return "AZURE_SPHERE_PROV_RESULT_INVALID_PARAM";
-    case AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY:
-        return "AZURE_SPHERE_PROV_RESULT_NETWORK_NOT_READY";
-    case AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY:
-        return "AZURE_SPHERE_PROV_RESULT_DEVICEAUTH_NOT_READY";
-    case AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR:
-        return "AZURE_SPHERE_PROV_RESULT_PROV_DEVICE_ERROR";
-    case AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR:
-        return "AZURE_SPHERE_PROV_RESULT_GENERIC_ERROR";
-    default:
-        return "UNKNOWN_RETURN_VALUE";
-    }
+    lastTrafficAtUs = GetMonotonicMicroseconds();
+    UpdateDoWorkPeriod();
 }
 
 /// <summary>
@@ -119,20 +224,20 @@ static bool IsConnectionReadyToSendTelemetry(void)
     {
         if (errno != EAGAIN)
         {
-            Log_Debug("ERROR: Networking_GetInterfaceConnectionStatus: %d (%s)\n", errno, strerror(errno));
+            LOG_ERROR("Networking_GetInterfaceConnectionStatus: %d (%s)\n", errno, strerror(errno));
             exitCode = IoTDevice_ExitCode_InterfaceConnectionStatus_Failed;
             return false;
         }
-        Log_Debug(
-            "WARNING: Cannot send Azure IoT Hub telemetry because the networking stack isn't ready "
+        LOG_WARNING(
+            "Cannot send Azure IoT Hub telemetry because the networking stack isn't ready "
             "yet.\n");
         return false;
     }
 
     if ((status & Networking_InterfaceConnectionStatus_ConnectedToInternet) == 0)
     {
-        Log_Debug(
-            "WARNING: Cannot send Azure IoT Hub telemetry because the device is not connected to "
+        LOG_WARNING(
+            "Cannot send Azure IoT Hub telemetry because the device is not connected to "
             "the internet.\n");
         return false;
     }
@@ -140,39 +245,196 @@ static bool IsConnectionReadyToSendTelemetry(void)
     return true;
 }
 
+/// <summary>
+///     Marks the staged metrics as exported once the hub holds the latest metrics report.
+/// </summary>
+static void CommitMetricsExportIfAcknowledged(void)
+{
+    if (metricsExportStaged && ReportedState_IsAcknowledged("metrics"))
+    {
+        Metrics_CommitExport();
+        metricsExportStaged = false;
+    }
+}
+
 /// <summary>
 ///     Callback invoked when the Device Twin report state request is processed by Azure IoT Hub
-///     client.
+///     client. The context is the ID of the reported state patch.
 /// </summary>
 static void ReportedStateCallback(int result, void *context)
 {
-    Log_Debug("INFO: Azure IoT Hub Device Twin reported state callback: status code %d.\n", result);
+    LOG_INFO("Azure IoT Hub Device Twin reported state callback: status code %d.\n", result);
+
+    ReportedState_OnResult((uint32_t)(uintptr_t)context, result);
+    CommitMetricsExportIfAcknowledged();
 }
 
 /// <summary>
-///     Enqueues a report containing Device Twin reported properties. The report is not sent
-///     immediately, but it is sent on the next invocation of IoTHubDeviceClient_LL_DoWork().
+///     Caches Device Twin reported properties. The properties which changed are sent in the
+///     reported state patch of the next DoWork cycle, see <see cref="SendReportedStatePatch" />.
 /// </summary>
-static void TwinReportState(const char *jsonState)
+/// <returns>true if every property was cached.</returns>
+static bool TwinReportState(const char *jsonState)
 {
-    if (iothubClientHandle == NULL)
+    return ReportedState_SetPatch(jsonState, strlen(jsonState));
+}
+
+/// <summary>
+///     Sends the reported properties queued since the last DoWork cycle as a single patch.
+/// </summary>
+static void SendReportedStatePatch(void)
+{
+    static char reportedStatePatch[4096];
+    uint32_t patchId;
+
+    if (iotHubClientAuthenticationState != IoTHubClientAuthenticationState_Authenticated)
     {
-        Log_Debug("ERROR: Azure IoT Hub client not initialized.\n");
+        return;
     }
-    else
+
+    size_t length =
+        ReportedState_BuildPatch(reportedStatePatch, sizeof(reportedStatePatch), &patchId);
+    if (length == 0)
     {
-        if (IoTHubDeviceClient_LL_SendReportedState(
-                iothubClientHandle, (const unsigned char *)jsonState, strlen(jsonState),
-                ReportedStateCallback, NULL) != IOTHUB_CLIENT_OK)
-        {
-            Log_Debug("ERROR: Azure IoT Hub client error when reporting state '%s'.\n", jsonState);
-        }
-        else
+        return;
+    }
+
+    if (IoTHubDeviceClient_LL_SendReportedState(
+            iothubClientHandle, (const unsigned char *)reportedStatePatch, length,
+            ReportedStateCallback, (void *)(uintptr_t)patchId) != IOTHUB_CLIENT_OK)
+    {
+        LOG_ERROR("Azure IoT Hub client error when reporting state '%s'.\n", reportedStatePatch);
+        ReportedState_OnResult(patchId, 0);
+        return;
+    }
+
+    LOG_INFO("Azure IoT Hub client accepted request to report state '%s'.\n",
+             reportedStatePatch);
+    MarkAzureIoTTraffic();
+}
+
+/// <summary>
+///     Deferred work: reports the static device twin properties.
+/// </summary>
+static void ReportStaticDeviceProperties(void *context)
+{
+    static char staticPropertiesReport[384];
+
+    IoTConnectionStats connectionStats;
+    IoTConnection_GetStats(&connectionStats);
+
+    JsonWriter writer;
+    JsonWriter_Init(&writer, staticPropertiesReport, sizeof(staticPropertiesReport));
+    JsonWriter_BeginObject(&writer);
+    JsonWriter_Key(&writer, "manufacturer");
+    JsonWriter_String(&writer, "Kevin BEAUGRAND");
+    JsonWriter_Key(&writer, "model");
+    JsonWriter_String(&writer, "Joy-It Car");
+    JsonWriter_Key(&writer, "connection");
+    JsonWriter_BeginObject(&writer);
+    JsonWriter_Key(&writer, "attempts");
+    JsonWriter_UInt(&writer, connectionStats.attempts);
+    JsonWriter_Key(&writer, "provisionings");
+    JsonWriter_UInt(&writer, connectionStats.provisionings);
+    JsonWriter_Key(&writer, "fastPathConnects");
+    JsonWriter_UInt(&writer, connectionStats.fastPathConnects);
+    JsonWriter_Key(&writer, "failures");
+    JsonWriter_UInt(&writer, connectionStats.failures);
+    JsonWriter_Key(&writer, "disconnects");
+    JsonWriter_UInt(&writer, connectionStats.disconnects);
+    JsonWriter_Key(&writer, "lastReconnectMs");
+    JsonWriter_UInt(&writer, connectionStats.lastReconnectMs);
+    JsonWriter_Key(&writer, "maxReconnectMs");
+    JsonWriter_UInt(&writer, connectionStats.maxReconnectMs);
+    JsonWriter_EndObject(&writer);
+    JsonWriter_EndObject(&writer);
+
+    if (JsonWriter_Finish(&writer) > 0)
+    {
+        TwinReportState(staticPropertiesReport);
+    }
+}
+
+static void DeviceTwinCallback(DEVICE_TWIN_UPDATE_STATE updateState,
+                               const unsigned char *payload, size_t payloadSize,
+                               void *userContextCallback);
+
+/// <summary>
+///     Deferred work: applies the latest desired properties and acknowledges them.
+/// </summary>
+static void ApplyDeviceTwinWork(void *context)
+{
+    deviceTwinPending = false;
+
+    if (deviceTwinResyncRequired)
+    {
+        // A patch was overwritten before it was applied: fetch the complete twin instead.
+        deviceTwinResyncRequired = false;
+        if (iothubClientHandle != NULL &&
+            IoTHubDeviceClient_LL_GetTwinAsync(iothubClientHandle, DeviceTwinCallback, NULL) ==
+                IOTHUB_CLIENT_OK)
         {
-            Log_Debug("INFO: Azure IoT Hub client accepted request to report state '%s'.\n",
-                      jsonState);
+            MarkAzureIoTTraffic();
+            return;
         }
     }
+
+    // The hub resets the reported properties when the device is registered again.
+    if (deviceTwinIsComplete && ReportedState_OnCompleteTwin(deviceTwinBuffer, deviceTwinSize))
+    {
+        Metrics_ResetExport();
+        metricsExportStaged = false;
+    }
+
+    size_t reportLength =
+        JoyitCar_ApplyDesiredProperties(deviceTwinBuffer, deviceTwinSize, deviceTwinIsComplete,
+                                        desiredPropertiesReport, sizeof(desiredPropertiesReport));
+    if (reportLength > 0)
+    {
+        TwinReportState(desiredPropertiesReport);
+    }
+}
+
+/// <summary>
+///     Callback invoked when a Device Twin update is received from Azure IoT Hub. This runs
+///     inside IoTHubDeviceClient_LL_DoWork(), so the payload is copied and applied later.
+/// </summary>
+static void DeviceTwinCallback(DEVICE_TWIN_UPDATE_STATE updateState,
+                               const unsigned char *payload, size_t payloadSize,
+                               void *userContextCallback)
+{
+    if (payloadSize > sizeof(deviceTwinBuffer))
+    {
+        LOG_ERROR("Device twin payload of %zu bytes is too large.\n", payloadSize);
+        return;
+    }
+
+    if (deviceTwinPending && updateState != DEVICE_TWIN_UPDATE_COMPLETE)
+    {
+        deviceTwinResyncRequired = true;
+    }
+
+    memcpy(deviceTwinBuffer, payload, payloadSize);
+    deviceTwinSize = payloadSize;
+    deviceTwinIsComplete = updateState == DEVICE_TWIN_UPDATE_COMPLETE;
+
+    if (deviceTwinIsComplete)
+    {
+        deviceTwinResyncRequired = false;
+    }
+
+    if (deviceTwinPending)
+    {
+        return;
+    }
+
+    if (EnqueueEventLoopWork(deferredWorkQueue, ApplyDeviceTwinWork, NULL) != 0)
+    {
+        LOG_ERROR("Could not defer the device twin update.\n");
+        return;
+    }
+
+    deviceTwinPending = true;
 }
 
 /// <summary>
@@ -184,52 +446,83 @@ static void ConnectionStatusCallback(IOTHUB_CLIENT_CONNECTION_STATUS result,
                                      IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
                                      void *userContextCallback)
 {
-    Log_Debug("Azure IoT connection status: %s\n", GetReasonString(reason));
+    LOG_INFO("Azure IoT connection status: %s\n", GetReasonString(reason));
+
+    IoTConnection_OnStatus(result, reason);
 
     if (result != IOTHUB_CLIENT_CONNECTION_AUTHENTICATED)
     {
         iotHubClientAuthenticationState = IoTHubClientAuthenticationState_NotAuthenticated;
+        UpdateDoWorkPeriod();
+        GPIO_SetValue(greenLedFd, GPIO_Value_High);
         return;
     }
 
     iotHubClientAuthenticationState = IoTHubClientAuthenticationState_Authenticated;
+    UpdateDoWorkPeriod();
+
+    GPIO_SetValue(blueLedFd, GPIO_Value_High);
+    GPIO_SetValue(greenLedFd, GPIO_Value_Low);
+    GPIO_SetValue(redLedFd, GPIO_Value_High);
 
-    // Send static device twin properties when connection is established.
-    TwinReportState("{\"manufacturer\":\"Kevin BEAUGRAND\",\"model\":\"Joy-It Car\"}");
+    // Send static device twin properties when connection is established. This callback runs
+    // inside IoTHubDeviceClient_LL_DoWork(), so the report is deferred to the event loop.
+    if (EnqueueEventLoopWork(deferredWorkQueue, ReportStaticDeviceProperties, NULL) != 0)
+    {
+        LOG_ERROR("Could not defer the static device twin report.\n");
+    }
 }
 
 /// <summary>
 ///     Callback invoked when the Azure IoT Hub send event request is processed.
+///     The forwarded message is removed from the store only once IoT Hub confirmed it.
 /// </summary>
 static void SendEventCallback(IOTHUB_CLIENT_CONFIRMATION_RESULT result, void *context)
 {
-    Log_Debug("INFO: Azure IoT Hub send telemetry event callback: status code %d.\n", result);
+    uint32_t telemetryId = (uint32_t)(uintptr_t)context;
 
-    // GPIO_SetValue(blueLedFd, GPIO_Value_High);
-    // GPIO_SetValue(redLedFd, GPIO_Value_High);
+    LOG_INFO("Azure IoT Hub send telemetry event callback: status code %d.\n", result);
 
-    // GPIO_SetValue(greenLedFd, GPIO_Value_Low);
-
-    // struct timespec wait = {.tv_nsec = 50 * 1000 * 1000};
+    if (telemetryId != inFlightTelemetryId)
+    {
+        return;
+    }
 
-    // nanosleep(&wait, &wait);
+    inFlightTelemetryId = 0;
 
-    // GPIO_SetValue(greenLedFd, GPIO_Value_High);
+    if (result == IOTHUB_CLIENT_CONFIRMATION_OK)
+    {
+        TelemetryStore_Acknowledge(telemetryId);
+    }
 }
 
 /// <summary>
-///     Sends telemetry to Azure IoT Hub
+///     Sends the oldest stored telemetry message to Azure IoT Hub, when authenticated and no
+///     other stored message is in flight. Called on every DoWork tick, so a backlog built up
+///     while offline is drained at one message per TelemetryForwardIntervalUs.
 /// </summary>
-void SendTelemetry(const char *jsonMessage)
+static void ForwardStoredTelemetry(void)
 {
-    if (iotHubClientAuthenticationState != IoTHubClientAuthenticationState_Authenticated)
+    if (inFlightTelemetryId != 0 ||
+        iotHubClientAuthenticationState != IoTHubClientAuthenticationState_Authenticated)
+    {
+        return;
+    }
+
+    uint64_t now = GetMonotonicMicroseconds();
+    if (now - lastTelemetryForwardAtUs < TelemetryForwardIntervalUs)
     {
-        // AzureIoT client is not authenticated. Log a warning and return.
-        Log_Debug("WARNING: Azure IoT Hub is not authenticated. Not sending telemetry.\n");
         return;
     }
 
-    Log_Debug("Sending Azure IoT Hub telemetry: %s.\n", jsonMessage);
+    uint32_t telemetryId;
+    size_t messageSize =
+        TelemetryStore_Peek((uint8_t *)telemetryBuffer, sizeof(telemetryBuffer), &telemetryId);
+
+    if (messageSize == 0)
+    {
+        return;
+    }
 
     // Check whether the device is connected to the internet.
     if (IsConnectionReadyToSendTelemetry() == false)
@@ -237,238 +530,1180 @@ void SendTelemetry(const char *jsonMessage)
         return;
     }
 
-    IOTHUB_MESSAGE_HANDLE messageHandle = IoTHubMessage_CreateFromString(jsonMessage);
+    IOTHUB_MESSAGE_HANDLE messageHandle =
+        IoTHubMessage_CreateFromByteArray((const unsigned char *)telemetryBuffer, messageSize);
 
     if (messageHandle == 0)
     {
-        Log_Debug("ERROR: unable to create a new IoTHubMessage.\n");
+        LOG_ERROR("unable to create a new IoTHubMessage.\n");
         return;
     }
 
+    // Stored messages keep no format tag: a JSON batch starts with '{', while a CBOR batch
+    // starts with a map head (0xA0 to 0xBB).
+    if (telemetryBuffer[0] == '{')
+    {
+        // Lets IoT Hub message routing query the telemetry body.
+        IoTHubMessage_SetContentTypeSystemProperty(messageHandle, "application/json");
+        IoTHubMessage_SetContentEncodingSystemProperty(messageHandle, "utf-8");
+    }
+    else
+    {
+        IoTHubMessage_SetContentTypeSystemProperty(messageHandle, "application/cbor");
+    }
+
+    lastTelemetryForwardAtUs = now;
+
     if (IoTHubDeviceClient_LL_SendEventAsync(iothubClientHandle, messageHandle, SendEventCallback,
-                                             /*&callback_param*/ NULL) != IOTHUB_CLIENT_OK)
+                                             (void *)(uintptr_t)telemetryId) != IOTHUB_CLIENT_OK)
     {
-        Log_Debug("ERROR: failure requesting IoTHubClient to send telemetry event.\n");
+        LOG_ERROR("failure requesting IoTHubClient to send telemetry event.\n");
     }
     else
     {
-        Log_Debug("INFO: IoTHubClient accepted the telemetry event for delivery.\n");
+        LOG_INFO("IoTHubClient accepted the telemetry event for delivery.\n");
+        inFlightTelemetryId = telemetryId;
+        azureIoTStats.messagesSent++;
+        Metrics_Increment(MetricCounter_TelemetryMessages);
+        MarkAzureIoTTraffic();
     }
 
     IoTHubMessage_Destroy(messageHandle);
 }
 
 /// <summary>
-///     Callback invoked when a Direct Method is received from Azure IoT Hub.
+///     Serializes a batch of telemetry samples into the store-and-forward ring, from which it
+///     is sent to Azure IoT Hub as one message as soon as the client is authenticated.
 /// </summary>
-static int DeviceMethodCallback(const char *methodName, const unsigned char *payload,
-                                size_t payloadSize, unsigned char **response, size_t *responseSize,
-                                void *userContextCallback)
+void SendTelemetry(const TelemetryBatch *batch)
 {
-    // All methods are ignored
-    int result = 0;
-    char *responseString = "{\"result\":\"OK\"}";
+    size_t messageSize =
+        batch->encoding == TelemetryEncoding_Cbor
+            ? JoyitCar_SerializeTelemetryBatchCbor(batch, (uint8_t *)telemetryBuffer,
+                                                   sizeof(telemetryBuffer))
+            : JoyitCar_SerializeTelemetryBatchJson(batch, telemetryBuffer, sizeof(telemetryBuffer));
 
-    Log_Debug("Received Device Method callback: Method name %s.\n", methodName);
-
-    // if 'response' is non-NULL, the Azure IoT library frees it after use, so copy it to heap
-    *responseSize = strlen(responseString);
-    *response = malloc(*responseSize);
-    memcpy(*response, responseString, *responseSize);
-
-    if (strcmp(methodName, "GoForward") == 0)
-    {
-        JoyitCar_GoForward();
-    }
-    else if (strcmp(methodName, "GoBackward") == 0)
-    {
-        JoyitCar_GoBackward();
-    }
-    else if (strcmp(methodName, "Break") == 0)
-    {
-        JoyitCar_Break();
-    }
-    else if (strcmp(methodName, "TurnRight") == 0)
+    if (messageSize == 0)
     {
-        JoyitCar_TurnRight();
-    }
-    else if (strcmp(methodName, "TurnLeft") == 0)
-    {
-        JoyitCar_TurnLeft();
-    }
-    else if (strcmp(methodName, "StartDemo") == 0)
-    {
-        JoyitCar_StartDemo();
+        LOG_ERROR("telemetry batch does not fit in %zu bytes.\n", sizeof(telemetryBuffer));
+        return;
     }
-    else
+
+    LOG_DEBUG("Queuing Azure IoT Hub telemetry: %u samples, %zu bytes.\n", batch->count,
+              messageSize);
+
+    if (TelemetryStore_Push((const uint8_t *)telemetryBuffer, messageSize) == 0)
     {
-        responseString = "{\"result\":\"NotFound\"}";
-        result = -1;
+        LOG_ERROR("telemetry batch could not be stored.\n");
+        return;
     }
 
-    return result;
+    ForwardStoredTelemetry();
 }
 
 /// <summary>
-///     Sets up the Azure IoT Hub connection (creates the iothubClientHandle)
-///     When the SAS Token for a device expires the connection needs to be recreated
-///     which is why this is not simply a one time call.
+///     Motor action bound to a Direct Method name.
 /// </summary>
-static void SetUpAzureIoTHubClient(void)
+typedef struct DeviceMethodAction
 {
-    bool isClientSetupSuccessful = false;
+    const char *methodName;
+    void (*action)(void);
+    // Payload-aware methods: parse validates the payload before the method is queued, and
+    // actionWithArgs applies the parsed arguments on the event loop.
+    bool (*parse)(const char *payload, size_t payloadSize, DeviceMethodArgs *args);
+    void (*actionWithArgs)(const DeviceMethodArgs *args);
+    // Query methods answer from the callback and queue nothing; returns the method status.
+    int (*respond)(const DeviceMethodArgs *args, JsonWriter *response);
+    // Long-running methods return at once with an operation id; actionWithArgs runs them.
+    bool isLongRunning;
+    // Brakes are applied whichever source owns the motors.
+    bool isBrake;
+} DeviceMethodAction;
 
-    if (iothubClientHandle != NULL)
+/// <summary>
+///     Brakes without ramping down, and sends the pending telemetry so the stop is visible
+///     without delay.
+/// </summary>
+static void EmergencyStop(void)
+{
+    JoyitCar_EmergencyBrake();
+    JoyitCar_RequestTelemetryFlush();
+}
+
+/// <summary>
+///     Reads an integer member of the payload root object, within [min, max].
+///     An absent member takes defaultValue when the member is optional.
+/// </summary>
+static bool ReadIntArgument(const char *payload, int tokenCount, const char *key, int64_t min,
+                            int64_t max, bool isRequired, int64_t defaultValue, int64_t *value)
+{
+    int token = JsonTokenizer_FindMember(payload, methodPayloadTokens, tokenCount, 0, key);
+    if (token < 0)
     {
-        IoTHubDeviceClient_LL_Destroy(iothubClientHandle);
+        *value = defaultValue;
+        return !isRequired;
     }
 
-    AZURE_SPHERE_PROV_RETURN_VALUE provResult =
-        IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning(
-            "0ne000E0092", 10000, &iothubClientHandle);
-    Log_Debug("IoTHubDeviceClient_LL_CreateWithAzureSphereDeviceAuthProvisioning returned '%s'.\n",
-              GetAzureSphereProvisioningResultString(provResult));
+    return JsonTokenizer_GetInt(payload, &methodPayloadTokens[token], value) && *value >= min &&
+           *value <= max;
+}
 
-    if (provResult.result != AZURE_SPHERE_PROV_RESULT_OK)
-    {
-        isClientSetupSuccessful = false;
-    }
-    else
+/// <summary>
+///     Parses the payload of Drive: {"left": -255..255, "right": -255..255, "ms": 1..10000}.
+///     ms is optional.
+/// </summary>
+static bool ParseDriveArguments(const char *payload, size_t payloadSize, DeviceMethodArgs *args)
+{
+    int count = JsonTokenizer_Parse(payload, payloadSize, methodPayloadTokens,
+                                    DEVICE_METHOD_MAX_TOKENS);
+    int64_t left, right, durationMs;
+
+    if (count <= 0 ||
+        !ReadIntArgument(payload, count, "left", -255, 255, true, 0, &left) ||
+        !ReadIntArgument(payload, count, "right", -255, 255, true, 0, &right) ||
+        !ReadIntArgument(payload, count, "ms", 1, DriveMaxDurationMs, false,
+                         DriveDefaultDurationMs, &durationMs))
     {
-        isClientSetupSuccessful = true;
+        return false;
     }
 
-    if (!isClientSetupSuccessful)
-    {
-        // If we fail to connect, reduce the polling frequency, starting at
-        // AzureIoTMinReconnectPeriodSeconds and with a backoff up to
-        // AzureIoTMaxReconnectPeriodSeconds
-        if (azureIoTPollPeriodSeconds == AzureIoTDefaultPollPeriodSeconds)
-        {
-            azureIoTPollPeriodSeconds = AzureIoTMinReconnectPeriodSeconds;
-        }
-        else
-        {
-            azureIoTPollPeriodSeconds *= 2;
-            if (azureIoTPollPeriodSeconds > AzureIoTMaxReconnectPeriodSeconds)
-            {
-                azureIoTPollPeriodSeconds = AzureIoTMaxReconnectPeriodSeconds;
-            }
-        }
+    args->left = (int)left;
+    args->right = (int)right;
+    args->durationMs = (uint32_t)durationMs;
+    return true;
+}
 
-        struct timespec azureTelemetryPeriod = {azureIoTPollPeriodSeconds, 0};
-        SetEventLoopTimerPeriod(azureTimer, &azureTelemetryPeriod);
+/// <summary>
+///     Parses the payload of SetVelocity: {"v": -255..255, "w": -255..255, "ms": 1..10000},
+///     where v is the forward speed and w the turn rate (positive turns left).
+///     The control loop mixes them into wheel speeds; ms is optional.
+/// </summary>
+static bool ParseVelocityArguments(const char *payload, size_t payloadSize,
+                                   DeviceMethodArgs *args)
+{
+    int count = JsonTokenizer_Parse(payload, payloadSize, methodPayloadTokens,
+                                    DEVICE_METHOD_MAX_TOKENS);
+    int64_t v, w, durationMs;
 
-        Log_Debug("ERROR: Failed to create IoTHub Handle - will retry in %i seconds.\n",
-                  azureIoTPollPeriodSeconds);
-        return;
+    if (count <= 0 || !ReadIntArgument(payload, count, "v", -255, 255, true, 0, &v) ||
+        !ReadIntArgument(payload, count, "w", -255, 255, true, 0, &w) ||
+        !ReadIntArgument(payload, count, "ms", 1, DriveMaxDurationMs, false,
+                         DriveDefaultDurationMs, &durationMs))
+    {
+        return false;
     }
 
-    // Successfully connected, so make sure the polling frequency is back to the default
-    azureIoTPollPeriodSeconds = AzureIoTDefaultPollPeriodSeconds;
-    struct timespec azureTelemetryPeriod = {.tv_sec = azureIoTPollPeriodSeconds, .tv_nsec = 0};
-    SetEventLoopTimerPeriod(azureTimer, &azureTelemetryPeriod);
+    args->linear = (int)v;
+    args->angular = (int)w;
+    args->durationMs = (uint32_t)durationMs;
+    return true;
+}
 
-    // Set client authentication state to initiated. This is done to indicate that
-    // SetUpAzureIoTHubClient() has been called (and so should not be called again) while the
-    // client is waiting for a response via the ConnectionStatusCallback().
-    iotHubClientAuthenticationState = IoTHubClientAuthenticationState_AuthenticationInitiated;
+/// <summary>
+///     Drives the wheels; the command bus brakes once the requested duration has passed.
+/// </summary>
+static void DriveForDuration(const DeviceMethodArgs *args)
+{
+    JoyitCar_Drive(args->left, args->right);
+}
 
-    // IoTHubDeviceClient_LL_SetDeviceTwinCallback(iothubClientHandle, DeviceTwinCallback, NULL);
-    IoTHubDeviceClient_LL_SetDeviceMethodCallback(iothubClientHandle, DeviceMethodCallback, NULL);
-    IoTHubDeviceClient_LL_SetConnectionStatusCallback(iothubClientHandle, ConnectionStatusCallback,
-                                                      NULL);
+/// <summary>
+///     Hands the setpoints to the control loop; the command bus stops it once the requested
+///     duration has passed.
+/// </summary>
+static void ApplyVelocity(const DeviceMethodArgs *args)
+{
+    JoyitCar_SetVelocity(args->linear, args->angular);
 }
 
 /// <summary>
-///     Azure timer event:  Check connection status and send telemetry
+///     Parses the payload of GetOperation and CancelOperation: {"id": operation id}.
 /// </summary>
-static void AzureTimerEventHandler(EventLoopTimer *timer)
+static bool ParseOperationArguments(const char *payload, size_t payloadSize,
+                                    DeviceMethodArgs *args)
 {
-    if (ConsumeEventLoopTimerEvent(timer) != 0)
+    int count = JsonTokenizer_Parse(payload, payloadSize, methodPayloadTokens,
+                                    DEVICE_METHOD_MAX_TOKENS);
+    int64_t id;
+
+    if (count <= 0 || !ReadIntArgument(payload, count, "id", 1, UINT32_MAX, true, 0, &id))
     {
-        exitCode = IoTDevice_ExitCode_AzureTimer_Consume;
-        return;
+        return false;
     }
 
-    // Check whether the device is connected to the internet.
-    Networking_InterfaceConnectionStatus status;
-    if (Networking_GetInterfaceConnectionStatus(networkInterface, &status) == 0)
+    args->operationId = (uint32_t)id;
+    return true;
+}
+
+/// <summary>
+///     Reports the state of an operation as the "operation" reported property.
+/// </summary>
+static void ReportOperation(const DeviceOperation *operation)
+{
+    static char operationReport[256];
+
+    JsonWriter writer;
+    JsonWriter_Init(&writer, operationReport, sizeof(operationReport));
+    JsonWriter_BeginObject(&writer);
+    JsonWriter_Key(&writer, "operation");
+    DeviceOperations_Write(operation, &writer);
+    JsonWriter_EndObject(&writer);
+
+    if (JsonWriter_Finish(&writer) > 0)
     {
-        if ((status & Networking_InterfaceConnectionStatus_ConnectedToInternet) &&
-            (iotHubClientAuthenticationState == IoTHubClientAuthenticationState_NotAuthenticated))
-        {
-            SetUpAzureIoTHubClient();
-        }
+        TwinReportState(operationReport);
     }
-    else
+}
+
+/// <summary>
+///     Motion sequence progress: updates and reports the operation which started it.
+/// </summary>
+static void OperationProgressHandler(size_t completedSteps, size_t stepCount,
+                                     MotionSequenceStatus status, void *context)
+{
+    DeviceOperation *operation = DeviceOperations_Find((uint32_t)(uintptr_t)context);
+    if (operation == NULL)
     {
-        if (errno != EAGAIN)
-        {
-            Log_Debug("ERROR: Networking_GetInterfaceConnectionStatus: %d (%s)\n", errno,
-                      strerror(errno));
-            exitCode = IoTDevice_ExitCode_InterfaceConnectionStatus_Failed;
-            return;
-        }
+        return;
     }
 
-    if (iotHubClientAuthenticationState == IoTHubClientAuthenticationState_Authenticated)
+    uint8_t progress = stepCount == 0 ? 100 : (uint8_t)(completedSteps * 100 / stepCount);
+
+    switch (status)
     {
-        GPIO_SetValue(blueLedFd, GPIO_Value_High);
-        GPIO_SetValue(greenLedFd, GPIO_Value_Low);
-        GPIO_SetValue(redLedFd, GPIO_Value_High);
-        
-        SendTelemetry("{\"txt\":\"Hello World\"}");
+    case MotionSequenceStatus_Running:
+        DeviceOperations_Update(operation, DeviceOperationState_Running, progress);
+        break;
+    case MotionSequenceStatus_Completed:
+        DeviceOperations_Update(operation, DeviceOperationState_Succeeded, 100);
+        break;
+    case MotionSequenceStatus_Cancelled:
+        DeviceOperations_Update(operation, DeviceOperationState_Cancelled, progress);
+        break;
     }
 
-    if (iothubClientHandle != NULL)
+    ReportOperation(operation);
+}
+
+/// <summary>
+///     Starts the sequence of an accepted operation, unless it was cancelled while queued.
+/// </summary>
+static void StartOperationSequence(const DeviceMethodArgs *args, const MotionStep *steps,
+                                   size_t stepCount)
+{
+    DeviceOperation *operation = DeviceOperations_Find(args->operationId);
+    if (operation == NULL || operation->state != DeviceOperationState_Pending)
     {
-        IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
+        return;
     }
+
+    JoyitCar_StartMotionSequence(steps, stepCount, OperationProgressHandler,
+                                 (void *)(uintptr_t)operation->id);
+}
+
+/// <summary>
+///     Deferred work: starts the demonstration sequence of an accepted operation.
+/// </summary>
+static void StartDemoOperation(const DeviceMethodArgs *args)
+{
+    size_t stepCount;
+    const MotionStep *steps = JoyitCar_GetDemoSequence(&stepCount);
+
+    StartOperationSequence(args, steps, stepCount);
 }
 
-IoTDevice_ExitCode JoyitCar_InitAzureIoT(EventLoop *eventLoop)
+/// <summary>
+///     Parses the payload of ExecuteSequence: {"steps": "F1500,L400,S0"}, a compact sequence
+///     as read by JoyitCar_ParseMotionSequence().
+/// </summary>
+static bool ParseSequenceArguments(const char *payload, size_t payloadSize,
+                                   DeviceMethodArgs *args)
 {
-    // Open RGBLED_BLUE GPIO and set as output with value GPIO_Value_High (off).
-    Log_Debug("Opening RGBLED_BLUE\n");
-    blueLedFd =
-        GPIO_OpenAsOutput(RGBLED_BLUE, GPIO_OutputMode_PushPull, GPIO_Value_High);
-    if (blueLedFd == -1)
+    int count = JsonTokenizer_Parse(payload, payloadSize, methodPayloadTokens,
+                                    DEVICE_METHOD_MAX_TOKENS);
+    int token = JsonTokenizer_FindMember(payload, methodPayloadTokens, count, 0, "steps");
+
+    if (token < 0 || methodPayloadTokens[token].type != JsonTokenType_String)
     {
-        Log_Debug("ERROR: Could not open RGBLED_BLUE GPIO: %s (%d).\n", strerror(errno),
-                  errno);
-        return IoTDevice_ExitCode_Init_BlueUserLed;
+        return false;
     }
 
-    // Open RGBLED_RED GPIO and set as output with value GPIO_Value_High (off).
-    Log_Debug("Opening RGBLED_RED\n");
+    const JsonToken *steps = &methodPayloadTokens[token];
+
+    return JoyitCar_ParseMotionSequence(payload + steps->start,
+                                        (size_t)(steps->end - steps->start), args->steps,
+                                        MOTION_SEQUENCE_MAX_STEPS, &args->stepCount);
+}
+
+/// <summary>
+///     Deferred work: starts the sequence of an accepted ExecuteSequence operation. The
+///     running sequence, if any, was cancelled already, so its steps can be replaced.
+/// </summary>
+static void StartSequenceOperation(const DeviceMethodArgs *args)
+{
+    memcpy(executedSequence, args->steps, args->stepCount * sizeof(MotionStep));
+
+    StartOperationSequence(args, executedSequence, args->stepCount);
+}
+
+static int GetOperation(const DeviceMethodArgs *args, JsonWriter *response)
+{
+    const DeviceOperation *operation = DeviceOperations_Find(args->operationId);
+    if (operation == NULL)
+    {
+        return 404;
+    }
+
+    DeviceOperations_Write(operation, response);
+    return 200;
+}
+
+/// <summary>
+///     Cancels an operation. A running sequence is cancelled from the callback rather than
+///     queued, so that the car brakes as soon as the request is received.
+/// </summary>
+static int CancelOperation(const DeviceMethodArgs *args, JsonWriter *response)
+{
+    DeviceOperation *operation = DeviceOperations_Find(args->operationId);
+    if (operation == NULL)
+    {
+        return 404;
+    }
+
+    if (!DeviceOperations_IsFinished(operation))
+    {
+        operation->cancelRequested = true;
+
+        if (operation->state == DeviceOperationState_Running)
+        {
+            // A running operation always owns the sequence: any other maneuver cancels it.
+            JoyitCar_CancelMotionSequence();
+        }
+        else
+        {
+            DeviceOperations_Update(operation, DeviceOperationState_Cancelled, 0);
+            ReportOperation(operation);
+        }
+    }
+
+    DeviceOperations_Write(operation, response);
+    return 200;
+}
+
+static const DeviceMethodAction deviceMethodActions[] = {
+    {.methodName = "GoForward", .action = JoyitCar_GoForward},
+    {.methodName = "GoBackward", .action = JoyitCar_GoBackward},
+    {.methodName = "Break", .action = EmergencyStop, .isBrake = true},
+    {.methodName = "TurnRight", .action = JoyitCar_TurnRight},
+    {.methodName = "TurnLeft", .action = JoyitCar_TurnLeft},
+    {.methodName = "Drive", .parse = ParseDriveArguments, .actionWithArgs = DriveForDuration},
+    {.methodName = "SetVelocity", .parse = ParseVelocityArguments, .actionWithArgs = ApplyVelocity},
+    {.methodName = "StartDemo", .actionWithArgs = StartDemoOperation, .isLongRunning = true},
+    {.methodName = "ExecuteSequence",
+     .parse = ParseSequenceArguments,
+     .actionWithArgs = StartSequenceOperation,
+     .isLongRunning = true},
+    {.methodName = "GetOperation", .parse = ParseOperationArguments, .respond = GetOperation},
+    {.methodName = "CancelOperation",
+     .parse = ParseOperationArguments,
+     .respond = CancelOperation},
+};
+
+
+/// <summary>
+///     Returns the wall-clock time in milliseconds since the Unix epoch, or 0 while the clock
+///     has not been synchronized yet.
+/// </summary>
+static uint64_t GetUnixTimeMilliseconds(void)
+{
+    // 2021-01-01T00:00:00Z: earlier times mean the clock was not set by NTP yet.
+    static const time_t SynchronizedClockMinimum = 1609459200;
+
+    struct timespec now;
+    if (clock_gettime(CLOCK_REALTIME, &now) != 0 || now.tv_sec < SynchronizedClockMinimum)
+    {
+        return 0;
+    }
+
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / (1000 * 1000);
+}
+
+/// <summary>
+///     Reports the hops of a traced Direct Method as the "lastTrace" reported property: the
+///     send and arrival times in Unix milliseconds, then the dispatch and I2C durations.
+/// </summary>
+static void ReportMethodTrace(const PendingDeviceMethod *pending, uint32_t dispatchUs,
+                              uint32_t i2cUs)
+{
+    static char traceReport[256];
+
+    uint64_t nowMs = GetUnixTimeMilliseconds();
+    uint64_t sinceArrivalMs = (GetMonotonicMicroseconds() - pending->arrivedAtUs) / 1000;
+
+    JsonWriter writer;
+    JsonWriter_Init(&writer, traceReport, sizeof(traceReport));
+    JsonWriter_BeginObject(&writer);
+    JsonWriter_Key(&writer, "lastTrace");
+    JsonWriter_BeginObject(&writer);
+    JsonWriter_Key(&writer, "trace");
+    JsonWriter_String(&writer, pending->trace);
+    JsonWriter_Key(&writer, "method");
+    JsonWriter_String(&writer, pending->method->methodName);
+    JsonWriter_Key(&writer, "sentAt");
+    JsonWriter_Int(&writer, pending->sentAtMs);
+    JsonWriter_Key(&writer, "receivedAt");
+    JsonWriter_UInt(&writer, nowMs != 0 ? nowMs - sinceArrivalMs : 0);
+    JsonWriter_Key(&writer, "dispatchUs");
+    JsonWriter_UInt(&writer, dispatchUs);
+    JsonWriter_Key(&writer, "i2cUs");
+    JsonWriter_UInt(&writer, i2cUs);
+    JsonWriter_EndObject(&writer);
+    JsonWriter_EndObject(&writer);
+
+    if (JsonWriter_Finish(&writer) > 0)
+    {
+        TwinReportState(traceReport);
+    }
+}
+
+/// <summary>
+///     Motor target reached event: completes the I2C hop of the Direct Method which last set
+///     the motors. The writes of a ramp run on the ramp timer, after the action returned.
+/// </summary>
+static void MotorTargetReachedEventHandler(uint64_t lastWriteAtUs)
+{
+    if (!tracedMethodAwaitingMotors)
+    {
+        return;
+    }
+
+    tracedMethodAwaitingMotors = false;
+
+    // A sequence step which keeps the motors as they are writes nothing.
+    uint32_t i2cUs = lastWriteAtUs > tracedMethodDispatchedAtUs
+                         ? (uint32_t)(lastWriteAtUs - tracedMethodDispatchedAtUs)
+                         : 0;
+
+    Metrics_Record(MetricHistogram_MethodI2cUs, i2cUs);
+    if (i2cUs > azureIoTStats.maxMethodI2cUs)
+    {
+        azureIoTStats.maxMethodI2cUs = i2cUs;
+    }
+
+    if (tracedMethod.trace[0] != '\0')
+    {
+        ReportMethodTrace(&tracedMethod, tracedMethodDispatchUs, i2cUs);
+    }
+}
+
+/// <summary>
+///     Command bus action: runs the motor action of a Direct Method on the event loop. The
+///     bus has stopped the timed drive or the sequence which ran before. Its I2C hop, and
+///     its trace, complete once the motors reach their target.
+/// </summary>
+static void RunDeviceMethodAction(void *context)
+{
+    PendingDeviceMethod *pending = (PendingDeviceMethod *)context;
+    uint64_t dispatchedAtUs = GetMonotonicMicroseconds();
+    uint32_t dispatchUs = (uint32_t)(dispatchedAtUs - pending->arrivedAtUs);
+
+    // Set before the action: a target which needs no ramp is reached within it. A method
+    // still awaiting the motors is superseded and left out of the I2C hop.
+    tracedMethod = *pending;
+    tracedMethodDispatchedAtUs = dispatchedAtUs;
+    tracedMethodDispatchUs = dispatchUs;
+    tracedMethodAwaitingMotors = true;
+
+    if (pending->method->actionWithArgs != NULL)
+    {
+        pending->method->actionWithArgs(&pending->args);
+    }
+    else
+    {
+        pending->method->action();
+    }
+
+    uint32_t latencyUs = (uint32_t)(GetMonotonicMicroseconds() - pending->arrivedAtUs);
+
+    azureIoTStats.lastMethodLatencyUs = latencyUs;
+    Metrics_Record(MetricHistogram_MethodLatencyUs, latencyUs);
+    Metrics_Record(MetricHistogram_MethodDispatchUs, dispatchUs);
+    if (latencyUs > azureIoTStats.maxMethodLatencyUs)
+    {
+        azureIoTStats.maxMethodLatencyUs = latencyUs;
+    }
+    if (dispatchUs > azureIoTStats.maxMethodDispatchUs)
+    {
+        azureIoTStats.maxMethodDispatchUs = dispatchUs;
+    }
+
+    uint64_t nowMs = GetUnixTimeMilliseconds();
+    int sinceSentMs =
+        nowMs != 0 && pending->sentAtMs > 0 ? (int)((int64_t)nowMs - pending->sentAtMs) : -1;
+
+    LOG_DEFERRED_INFO("Direct Method %s applied %u us after arrival, %d ms after sending "
+                      "(DoWork period %d ms).\n",
+                      (intptr_t)pending->method->methodName, latencyUs, sinceSentMs,
+                      doWorkPeriodMs);
+
+    // The trace kept its own copy, and sequences copy their steps: the slot can be reused.
+    pending->inUse = false;
+}
+
+/// <summary>
+///     Command bus rejection: a higher priority source owns the motors. The operation of a
+///     long-running method fails.
+/// </summary>
+static void RejectDeviceMethodAction(void *context)
+{
+    PendingDeviceMethod *pending = (PendingDeviceMethod *)context;
+
+    if (pending->method->isLongRunning)
+    {
+        DeviceOperation *operation = DeviceOperations_Find(pending->args.operationId);
+        if (operation != NULL && operation->state == DeviceOperationState_Pending)
+        {
+            DeviceOperations_Update(operation, DeviceOperationState_Failed, 0);
+            ReportOperation(operation);
+        }
+    }
+
+    LOG_DEFERRED_INFO("Direct Method %s rejected, the motors are owned by another source.\n",
+                      (intptr_t)pending->method->methodName);
+
+    pending->inUse = false;
+}
+
+/// <summary>
+///     Hands a copy of a response template to the Azure IoT library, which frees it after use.
+/// </summary>
+static void SetDeviceMethodResponse(const char *responseString, size_t length,
+                                    unsigned char **response, size_t *responseSize)
+{
+    *response = malloc(length);
+    if (*response == NULL)
+    {
+        *responseSize = 0;
+        return;
+    }
+
+    memcpy(*response, responseString, length);
+    *responseSize = length;
+}
+
+static const DeviceMethodAction *FindDeviceMethod(const char *name, size_t length)
+{
+    for (size_t i = 0; i < sizeof(deviceMethodActions) / sizeof(deviceMethodActions[0]); i++)
+    {
+        if (strncmp(name, deviceMethodActions[i].methodName, length) == 0 &&
+            deviceMethodActions[i].methodName[length] == '\0')
+        {
+            return &deviceMethodActions[i];
+        }
+    }
+
+    return NULL;
+}
+
+/// <summary>
+///     Copies the trace ID of a payload, if it is made of at most DEVICE_METHOD_TRACE_MAX hex
+///     digits; otherwise the trace is "".
+/// </summary>
+static void ReadMethodTrace(const char *payload, const JsonToken *token, char *trace)
+{
+    size_t length = (size_t)(token->end - token->start);
+
+    trace[0] = '\0';
+
+    if (token->type != JsonTokenType_String || length > DEVICE_METHOD_TRACE_MAX)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        char c = payload[token->start + i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F')))
+        {
+            return;
+        }
+    }
+
+    memcpy(trace, payload + token->start, length);
+    trace[length] = '\0';
+}
+
+/// <summary>
+///     Reads the envelope members the Function adds to every Direct Method payload: "key", an
+///     idempotency key, "ts", the send time in Unix milliseconds, and "trace", the trace ID
+///     of the voice command, written into trace.
+/// </summary>
+/// <returns>The hash of the key, never 0, or 0 if the payload has no key.</returns>
+static uint64_t ReadMethodEnvelope(const char *payload, size_t payloadSize, int64_t *sentAtMs,
+                                   char *trace)
+{
+    int count = JsonTokenizer_Parse(payload, payloadSize, methodPayloadTokens,
+                                    DEVICE_METHOD_MAX_TOKENS);
+    int keyToken = JsonTokenizer_FindMember(payload, methodPayloadTokens, count, 0, "key");
+    int tsToken = JsonTokenizer_FindMember(payload, methodPayloadTokens, count, 0, "ts");
+    int traceToken = JsonTokenizer_FindMember(payload, methodPayloadTokens, count, 0, "trace");
+
+    if (tsToken < 0 || !JsonTokenizer_GetInt(payload, &methodPayloadTokens[tsToken], sentAtMs))
+    {
+        *sentAtMs = 0;
+    }
+
+    trace[0] = '\0';
+    if (traceToken >= 0)
+    {
+        ReadMethodTrace(payload, &methodPayloadTokens[traceToken], trace);
+    }
+
+    if (keyToken < 0 || methodPayloadTokens[keyToken].type != JsonTokenType_String)
+    {
+        return 0;
+    }
+
+    const JsonToken *key = &methodPayloadTokens[keyToken];
+    uint64_t hash = HashFnv1a64(payload + key->start, (size_t)(key->end - key->start));
+
+    return hash == 0 ? 1 : hash;
+}
+
+static bool IsRecentMethodKey(uint64_t key)
+{
+    for (size_t i = 0; i < DEVICE_METHOD_RECENT_KEYS; i++)
+    {
+        if (recentMethodKeys[i] == key)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+///     Remembers the key of a queued method, replacing the oldest one.
+/// </summary>
+static void AddRecentMethodKey(uint64_t key)
+{
+    recentMethodKeys[nextRecentMethodKey] = key;
+    nextRecentMethodKey = (nextRecentMethodKey + 1) % DEVICE_METHOD_RECENT_KEYS;
+}
+
+/// <summary>
+///     Finds a pending slot to parse the arguments of a method into.
+/// </summary>
+/// <returns>A free slot, or NULL if every slot holds a queued command.</returns>
+static PendingDeviceMethod *FindFreePendingDeviceMethod(void)
+{
+    for (size_t i = 0; i < sizeof(pendingDeviceMethods) / sizeof(pendingDeviceMethods[0]); i++)
+    {
+        if (!pendingDeviceMethods[i].inUse)
+        {
+            return &pendingDeviceMethods[i];
+        }
+    }
+
+    return NULL;
+}
+
+/// <summary>
+///     Submits the action of a method, whose arguments were parsed into the free slot pending,
+///     to the command bus. A timed action is braked by the bus. The slot is held until the
+///     bus runs or rejects the command.
+/// </summary>
+/// <returns>0 on success, -1 if the command bus is full.</returns>
+static int QueueDeviceMethod(PendingDeviceMethod *pending, const DeviceMethodAction *method,
+                             uint64_t arrivedAtUs, int64_t sentAtMs, const char *trace)
+{
+    pending->method = method;
+    pending->arrivedAtUs = arrivedAtUs;
+    pending->sentAtMs = sentAtMs;
+    strcpy(pending->trace, trace);
+
+    MotorCommand command = {
+        .source = CommandSource_Cloud,
+        .type = method->isBrake ? MotorCommandType_Brake : MotorCommandType_Action,
+        .action = RunDeviceMethodAction,
+        .rejected = RejectDeviceMethodAction,
+        .context = pending,
+        .durationMs = pending->args.durationMs,
+    };
+
+    if (JoyitCar_SubmitMotorCommand(&command) != 0)
+    {
+        return -1;
+    }
+
+    pending->inUse = true;
+    return 0;
+}
+
+/// <summary>
+///     Callback invoked when a Direct Method is received from Azure IoT Hub.
+///     The payload is validated here, but the motor action is only submitted to the command
+///     bus; it runs on the next event loop iteration so that IoTHubDeviceClient_LL_DoWork() is
+///     not held by I2C writes, unless a button or BLE owns the motors. A command whose
+///     idempotency key was queued recently, e.g. a retry, is answered without being applied
+///     again.
+/// </summary>
+static int DeviceMethodCallback(const char *methodName, const unsigned char *payload,
+                                size_t payloadSize, unsigned char **response, size_t *responseSize,
+                                void *userContextCallback)
+{
+    uint64_t arrivedAtUs = GetMonotonicMicroseconds();
+    const DeviceMethodAction *method = NULL;
+
+    azureIoTStats.methodsReceived++;
+    Metrics_Increment(MetricCounter_MethodsReceived);
+    MarkAzureIoTTraffic();
+
+    LOG_DEBUG("Received Device Method callback: Method name %s.\n", methodName);
+
+    method = FindDeviceMethod(methodName, strlen(methodName));
+
+    if (method == NULL)
+    {
+        SetDeviceMethodResponse(MethodResponseNotFound, sizeof(MethodResponseNotFound) - 1,
+                                response, responseSize);
+        return 404;
+    }
+
+    int64_t sentAtMs;
+    char trace[DEVICE_METHOD_TRACE_MAX + 1];
+    uint64_t key = ReadMethodEnvelope((const char *)payload, payloadSize, &sentAtMs, trace);
+
+    // Queries have no effect to repeat, so they are always answered.
+    if (key != 0 && method->respond == NULL && IsRecentMethodKey(key))
+    {
+        azureIoTStats.methodsDeduplicated++;
+        Metrics_Increment(MetricCounter_MethodsDeduplicated);
+        SetDeviceMethodResponse(MethodResponseDuplicate, sizeof(MethodResponseDuplicate) - 1,
+                                response, responseSize);
+        return 200;
+    }
+
+    PendingDeviceMethod *pending = FindFreePendingDeviceMethod();
+    if (pending == NULL)
+    {
+        SetDeviceMethodResponse(MethodResponseBusy, sizeof(MethodResponseBusy) - 1, response,
+                                responseSize);
+        return 503;
+    }
+
+    pending->args = (DeviceMethodArgs){0};
+
+    if (method->parse != NULL &&
+        !method->parse((const char *)payload, payloadSize, &pending->args))
+    {
+        SetDeviceMethodResponse(MethodResponseBadRequest, sizeof(MethodResponseBadRequest) - 1,
+                                response, responseSize);
+        return 400;
+    }
+
+    JsonWriter writer;
+    JsonWriter_Init(&writer, methodResponseBuffer, sizeof(methodResponseBuffer));
+
+    if (method->respond != NULL)
+    {
+        int status = method->respond(&pending->args, &writer);
+        size_t length = JsonWriter_Finish(&writer);
+
+        if (status == 404 || length == 0)
+        {
+            SetDeviceMethodResponse(MethodResponseNotFound, sizeof(MethodResponseNotFound) - 1,
+                                    response, responseSize);
+        }
+        else
+        {
+            SetDeviceMethodResponse(methodResponseBuffer, length, response, responseSize);
+        }
+
+        return status;
+    }
+
+    DeviceOperation *operation = NULL;
+    if (method->isLongRunning)
+    {
+        operation = DeviceOperations_Create(method->methodName);
+        if (operation == NULL)
+        {
+            SetDeviceMethodResponse(MethodResponseBusy, sizeof(MethodResponseBusy) - 1,
+                                    response, responseSize);
+            return 503;
+        }
+
+        pending->args.operationId = operation->id;
+    }
+
+    if (QueueDeviceMethod(pending, method, arrivedAtUs, sentAtMs, trace) != 0)
+    {
+        if (operation != NULL)
+        {
+            DeviceOperations_Update(operation, DeviceOperationState_Failed, 0);
+        }
+
+        SetDeviceMethodResponse(MethodResponseBusy, sizeof(MethodResponseBusy) - 1, response,
+                                responseSize);
+        return 503;
+    }
+
+    if (key != 0)
+    {
+        AddRecentMethodKey(key);
+    }
+
+    if (operation == NULL && trace[0] == '\0')
+    {
+        SetDeviceMethodResponse(MethodResponseOK, sizeof(MethodResponseOK) - 1, response,
+                                responseSize);
+        return 200;
+    }
+
+    JsonWriter_BeginObject(&writer);
+    JsonWriter_Key(&writer, "result");
+    JsonWriter_String(&writer, operation != NULL ? "Accepted" : "OK");
+    if (operation != NULL)
+    {
+        JsonWriter_Key(&writer, "operationId");
+        JsonWriter_UInt(&writer, operation->id);
+    }
+    if (trace[0] != '\0')
+    {
+        // The rest of the trace is known once the motors reach the target the action set.
+        JsonWriter_Key(&writer, "trace");
+        JsonWriter_String(&writer, trace);
+        JsonWriter_Key(&writer, "receivedAt");
+        JsonWriter_UInt(&writer, GetUnixTimeMilliseconds());
+    }
+    JsonWriter_EndObject(&writer);
+
+    SetDeviceMethodResponse(methodResponseBuffer, JsonWriter_Finish(&writer), response,
+                            responseSize);
+    return operation != NULL ? 202 : 200;
+}
+
+/// <summary>
+///     Callback invoked when a cloud-to-device message is received. Messages are
+///     fire-and-forget drive commands:
+///     {"seq": 42, "ts": unix ms, "method": "Drive", "payload": {"left": 100, ...}}
+///     The method is any maneuver of the Direct Method table. A command is applied only if it
+///     is newer than the last applied one and younger than the maximum age; anything else is
+///     counted and completed without being applied, so that IoT Hub does not redeliver it.
+/// </summary>
+static IOTHUBMESSAGE_DISPOSITION_RESULT CloudCommandMessageCallback(IOTHUB_MESSAGE_HANDLE message,
+                                                                    void *userContextCallback)
+{
+    uint64_t arrivedAtUs = GetMonotonicMicroseconds();
+    const unsigned char *body;
+    size_t bodySize;
+
+    azureIoTStats.cloudCommandsReceived++;
+    MarkAzureIoTTraffic();
+
+    if (IoTHubMessage_GetByteArray(message, &body, &bodySize) != IOTHUB_MESSAGE_OK)
+    {
+        azureIoTStats.cloudCommandsRejected++;
+        Metrics_Increment(MetricCounter_CloudCommandsDropped);
+        return IOTHUBMESSAGE_REJECTED;
+    }
+
+    const char *json = (const char *)body;
+    int count = JsonTokenizer_Parse(json, bodySize, methodPayloadTokens, DEVICE_METHOD_MAX_TOKENS);
+    int seqToken = JsonTokenizer_FindMember(json, methodPayloadTokens, count, 0, "seq");
+    int tsToken = JsonTokenizer_FindMember(json, methodPayloadTokens, count, 0, "ts");
+    int methodToken = JsonTokenizer_FindMember(json, methodPayloadTokens, count, 0, "method");
+    int payloadToken = JsonTokenizer_FindMember(json, methodPayloadTokens, count, 0, "payload");
+    int64_t seq, ts;
+
+    if (count <= 0 || seqToken < 0 || tsToken < 0 || methodToken < 0 ||
+        methodPayloadTokens[methodToken].type != JsonTokenType_String ||
+        !JsonTokenizer_GetInt(json, &methodPayloadTokens[seqToken], &seq) ||
+        !JsonTokenizer_GetInt(json, &methodPayloadTokens[tsToken], &ts))
+    {
+        azureIoTStats.cloudCommandsRejected++;
+        Metrics_Increment(MetricCounter_CloudCommandsDropped);
+        return IOTHUBMESSAGE_REJECTED;
+    }
+
+    // Copy out the token positions: the method parser reuses the token array.
+    JsonToken methodName = methodPayloadTokens[methodToken];
+    JsonToken payload = payloadToken >= 0 ? methodPayloadTokens[payloadToken] : (JsonToken){0};
+
+    const DeviceMethodAction *method =
+        FindDeviceMethod(json + methodName.start, (size_t)(methodName.end - methodName.start));
+
+    if (method == NULL || method->respond != NULL || method->isLongRunning)
+    {
+        azureIoTStats.cloudCommandsRejected++;
+        Metrics_Increment(MetricCounter_CloudCommandsDropped);
+        return IOTHUBMESSAGE_REJECTED;
+    }
+
+    // A lower sequence number with a newer timestamp comes from a restarted sender.
+    if (seq <= lastCloudCommandSeq && ts <= lastCloudCommandTs)
+    {
+        azureIoTStats.cloudCommandsOutOfOrder++;
+        Metrics_Increment(MetricCounter_CloudCommandsDropped);
+        return IOTHUBMESSAGE_ACCEPTED;
+    }
+
+    // The age check needs a synchronized clock; before that, only the order is enforced.
+    uint64_t nowMs = GetUnixTimeMilliseconds();
+    if (nowMs != 0 && ts < (int64_t)nowMs - (int64_t)cloudCommandMaxAgeMs)
+    {
+        azureIoTStats.cloudCommandsStale++;
+        Metrics_Increment(MetricCounter_CloudCommandsDropped);
+        return IOTHUBMESSAGE_ACCEPTED;
+    }
+
+    PendingDeviceMethod *pending = FindFreePendingDeviceMethod();
+    if (pending == NULL)
+    {
+        // Every slot holds a queued command: IoT Hub redelivers an abandoned message.
+        return IOTHUBMESSAGE_ABANDONED;
+    }
+
+    pending->args = (DeviceMethodArgs){0};
+
+    if (method->parse != NULL &&
+        (payload.type != JsonTokenType_Object ||
+         !method->parse(json + payload.start, (size_t)(payload.end - payload.start),
+                        &pending->args)))
+    {
+        azureIoTStats.cloudCommandsRejected++;
+        Metrics_Increment(MetricCounter_CloudCommandsDropped);
+        return IOTHUBMESSAGE_REJECTED;
+    }
+
+    if (QueueDeviceMethod(pending, method, arrivedAtUs, ts, "") != 0)
+    {
+        // The command bus is full: IoT Hub redelivers an abandoned message.
+        return IOTHUBMESSAGE_ABANDONED;
+    }
+
+    lastCloudCommandSeq = seq;
+    lastCloudCommandTs = ts;
+    azureIoTStats.cloudCommandsApplied++;
+    Metrics_Increment(MetricCounter_CloudCommandsApplied);
+
+    return IOTHUBMESSAGE_ACCEPTED;
+}
+
+void JoyitCar_SetCloudCommandMaxAge(uint32_t maxAgeMs)
+{
+    cloudCommandMaxAgeMs = maxAgeMs;
+}
+
+/// <summary>
+///     Connection manager notification: registers the callbacks of a new IoT Hub client.
+/// </summary>
+static void AzureIoTClientCreated(IOTHUB_DEVICE_CLIENT_LL_HANDLE client)
+{
+    iothubClientHandle = client;
+
+    // Set client authentication state to initiated. This is done to indicate that the client
+    // is waiting for a response via the ConnectionStatusCallback().
+    iotHubClientAuthenticationState = IoTHubClientAuthenticationState_AuthenticationInitiated;
+
+    IoTHubDeviceClient_LL_SetDeviceTwinCallback(iothubClientHandle, DeviceTwinCallback, NULL);
+    IoTHubDeviceClient_LL_SetDeviceMethodCallback(iothubClientHandle, DeviceMethodCallback, NULL);
+    IoTHubDeviceClient_LL_SetMessageCallback(iothubClientHandle, CloudCommandMessageCallback,
+                                             NULL);
+    IoTHubDeviceClient_LL_SetConnectionStatusCallback(iothubClientHandle, ConnectionStatusCallback,
+                                                      NULL);
+
+    UpdateDoWorkPeriod();
+}
+
+/// <summary>
+///     Connection manager notification: the client is about to be destroyed. Pending sends
+///     are lost with it, so the in-flight telemetry is forwarded again by the next client.
+/// </summary>
+static void AzureIoTClientDestroying(void)
+{
+    iothubClientHandle = NULL;
+    inFlightTelemetryId = 0;
+    ReportedState_OnConnectionLost();
+    iotHubClientAuthenticationState = IoTHubClientAuthenticationState_NotAuthenticated;
+    UpdateDoWorkPeriod();
+}
+
+static const IoTConnectionHandlers connectionHandlers = {
+    .clientCreated = AzureIoTClientCreated, .clientDestroying = AzureIoTClientDestroying};
+
+/// <summary>
+///     Chooses the DoWork pump period from the connection state and pending traffic, and
+///     re-arms the pump timer only when the period changes.
+/// </summary>
+static void UpdateDoWorkPeriod(void)
+{
+    int periodMs = AzureIoTIdleDoWorkPeriodMs;
+
+    if (iothubClientHandle == NULL)
+    {
+        periodMs = 0;
+    }
+    else if (iotHubClientAuthenticationState != IoTHubClientAuthenticationState_NotAuthenticated)
+    {
+        periodMs = AzureIoTConnectedDoWorkPeriodMs;
+
+        IOTHUB_CLIENT_STATUS sendStatus;
+        bool isSending =
+            IoTHubDeviceClient_LL_GetSendStatus(iothubClientHandle, &sendStatus) ==
+                IOTHUB_CLIENT_OK &&
+            sendStatus == IOTHUB_CLIENT_SEND_STATUS_BUSY;
+
+        if (isSending || GetMonotonicMicroseconds() - lastTrafficAtUs < AzureIoTTrafficHoldUs)
+        {
+            periodMs = AzureIoTFastDoWorkPeriodMs;
+        }
+    }
+
+    if (periodMs == doWorkPeriodMs || doWorkTimer == NULL)
+    {
+        return;
+    }
+
+    doWorkPeriodMs = periodMs;
+    azureIoTStats.doWorkPeriodMs = periodMs;
+
+    if (periodMs == 0)
+    {
+        DisarmEventLoopTimer(doWorkTimer);
+        return;
+    }
+
+    struct timespec doWorkPeriod = {.tv_sec = periodMs / 1000,
+                                    .tv_nsec = (periodMs % 1000) * 1000 * 1000};
+    SetEventLoopTimerPeriod(doWorkTimer, &doWorkPeriod);
+}
+
+/// <summary>
+///     DoWork timer event: pumps the Azure IoT client so that Direct Methods, twin updates and
+///     telemetry acknowledgements are processed without waiting for the telemetry period.
+/// </summary>
+static void DoWorkTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0)
+    {
+        exitCode = IoTDevice_ExitCode_DoWorkTimer_Consume;
+        return;
+    }
+
+    if (iothubClientHandle != NULL)
+    {
+        SendReportedStatePatch();
+        IoTHubDeviceClient_LL_DoWork(iothubClientHandle);
+        azureIoTStats.doWorkCalls++;
+    }
+
+    ForwardStoredTelemetry();
+
+    UpdateDoWorkPeriod();
+}
+
+/// <summary>
+///     Metrics report timer event: reports the metrics which changed since the last report
+///     the hub acknowledged, as the "metrics" reported property.
+/// </summary>
+static void MetricsReportTimerEventHandler(EventLoopTimer *timer)
+{
+    static char metricsReport[METRICS_REPORT_MAX_BYTES];
+
+    if (ConsumeEventLoopTimerEvent(timer) != 0)
+    {
+        exitCode = IoTDevice_ExitCode_MetricsReportTimer_Consume;
+        return;
+    }
+
+    if (iotHubClientAuthenticationState != IoTHubClientAuthenticationState_Authenticated)
+    {
+        return;
+    }
+
+    JsonWriter writer;
+    JsonWriter_Init(&writer, metricsReport, sizeof(metricsReport));
+    JsonWriter_BeginObject(&writer);
+    JsonWriter_Key(&writer, "metrics");
+    JsonWriter_BeginObject(&writer);
+    uint32_t changed = Metrics_WriteChanged(&writer);
+    JsonWriter_EndObject(&writer);
+    JsonWriter_EndObject(&writer);
+
+    // Exported once acknowledged, or at once if the hub already holds the same report.
+    if (changed > 0 && JsonWriter_Finish(&writer) > 0 && TwinReportState(metricsReport))
+    {
+        metricsExportStaged = true;
+        CommitMetricsExportIfAcknowledged();
+    }
+}
+
+void JoyitCar_GetAzureIoTStats(AzureIoTStats *stats)
+{
+    *stats = azureIoTStats;
+}
+
+IoTDevice_ExitCode JoyitCar_InitAzureIoT(EventLoop *eventLoop, EventLoopWorkQueue *workQueue)
+{
+    deferredWorkQueue = workQueue;
+
+    JoyitCar_SetMotorTargetReachedHandler(MotorTargetReachedEventHandler);
+
+    // Open RGBLED_BLUE GPIO and set as output with value GPIO_Value_High (off).
+    LOG_DEBUG("Opening RGBLED_BLUE\n");
+    blueLedFd =
+        GPIO_OpenAsOutput(RGBLED_BLUE, GPIO_OutputMode_PushPull, GPIO_Value_High);
+    if (blueLedFd == -1)
+    {
+        LOG_ERROR("Could not open RGBLED_BLUE GPIO: %s (%d).\n", strerror(errno),
+                  errno);
+        return IoTDevice_ExitCode_Init_BlueUserLed;
+    }
+
+    // Open RGBLED_RED GPIO and set as output with value GPIO_Value_High (off).
+    LOG_DEBUG("Opening RGBLED_RED\n");
     redLedFd =
         GPIO_OpenAsOutput(RGBLED_RED, GPIO_OutputMode_PushPull, GPIO_Value_High);
     if (redLedFd == -1)
     {
-        Log_Debug("ERROR: Could not open RGBLED_RED GPIO: %s (%d).\n", strerror(errno),
+        LOG_ERROR("Could not open RGBLED_RED GPIO: %s (%d).\n", strerror(errno),
                   errno);
         return IoTDevice_ExitCode_Init_RedUserLed;
     }
 
     // Open RGBLED_GREEN GPIO and set as output with value GPIO_Value_High (off).
-    Log_Debug("Opening RGBLED_GREEN\n");
+    LOG_DEBUG("Opening RGBLED_GREEN\n");
     greenLedFd =
         GPIO_OpenAsOutput(RGBLED_GREEN, GPIO_OutputMode_PushPull, GPIO_Value_High);
     if (greenLedFd == -1)
     {
-        Log_Debug("ERROR: Could not open RGBLED_GREEN GPIO: %s (%d).\n", strerror(errno),
+        LOG_ERROR("Could not open RGBLED_GREEN GPIO: %s (%d).\n", strerror(errno),
                   errno);
         return IoTDevice_ExitCode_Init_GreenUserLed;
     }
 
-    azureIoTPollPeriodSeconds = AzureIoTDefaultPollPeriodSeconds;
-    struct timespec azureTelemetryPeriod = {.tv_sec = azureIoTPollPeriodSeconds, .tv_nsec = 0};
-    azureTimer = CreateEventLoopPeriodicTimer(eventLoop, &AzureTimerEventHandler, &azureTelemetryPeriod);
+    doWorkTimer = CreateEventLoopDisarmedTimer(eventLoop, &DoWorkTimerEventHandler);
+
+    if (doWorkTimer == NULL)
+    {
+        return IoTDevice_ExitCode_Init_DoWorkTimer;
+    }
+
+    metricsReportTimer = CreateEventLoopPeriodicTimer(eventLoop, &MetricsReportTimerEventHandler,
+                                                      &metricsReportPeriod);
+
+    if (metricsReportTimer == NULL)
+    {
+        return IoTDevice_ExitCode_Init_MetricsReportTimer;
+    }
 
-    if (azureTimer == NULL)
+    if (IoTConnection_Init(eventLoop, dpsScopeId, &connectionHandlers) !=
+        IoTConnection_ExitCode_Success)
     {
-        return IoTDevice_ExitCode_Init_AzureTimer;
+        return IoTDevice_ExitCode_Init_Connection;
     }
 
     return IoTDevice_ExitCode_Success;
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <stdint.h>
+
 #include <applibs/eventloop.h>
 
 #include "eventloop_timer_utilities.h"
+#include "telemetry.h"
 
 typedef enum
 {
@@ -12,9 +15,49 @@ typedef enum
     IoTDevice_ExitCode_Init_BlueUserLed = 303,
     IoTDevice_ExitCode_Init_RedUserLed = 304,
     IoTDevice_ExitCode_Init_GreenUserLed = 305,
-    IoTDevice_ExitCode_Init_AzureTimer = 306
+    IoTDevice_ExitCode_Init_AzureTimer = 306,
+    IoTDevice_ExitCode_Init_DoWorkTimer = 307,
+    IoTDevice_ExitCode_DoWorkTimer_Consume = 308,
+    IoTDevice_ExitCode_Init_Connection = 311,
+    IoTDevice_ExitCode_Init_MetricsReportTimer = 312,
+    IoTDevice_ExitCode_MetricsReportTimer_Consume = 313
 } IoTDevice_ExitCode;
 
-IoTDevice_ExitCode JoyitCar_InitAzureIoT(EventLoop *eventLoop);
+/// <summary>
+///     Counters of the IoT Hub DoWork pump and of the cloud commands. Method latency is
+///     measured from the arrival of a Direct Method in the SDK callback to the return of its
+///     motor action, which sets the target of the motors. Dispatch runs from arrival to the
+///     start of the action on the event loop, and I2C from that start to the last frame
+///     written once the motors reach the target, i.e. the end of the ramp.
+///     Direct Methods answered as duplicates of a recent idempotency key, and cloud-to-device
+///     commands which are not applied, are counted by reason.
+/// </summary>
+typedef struct
+{
+    int doWorkPeriodMs;
+    uint32_t doWorkCalls;
+    uint32_t methodsReceived;
+    uint32_t methodsDeduplicated;
+    uint32_t messagesSent;
+    uint32_t lastMethodLatencyUs;
+    uint32_t maxMethodLatencyUs;
+    uint32_t maxMethodDispatchUs;
+    uint32_t maxMethodI2cUs;
+    uint32_t cloudCommandsReceived;
+    uint32_t cloudCommandsApplied;
+    uint32_t cloudCommandsStale;
+    uint32_t cloudCommandsOutOfOrder;
+    uint32_t cloudCommandsRejected;
+} AzureIoTStats;
+
+IoTDevice_ExitCode JoyitCar_InitAzureIoT(EventLoop *eventLoop, EventLoopWorkQueue *workQueue);
+
+void SendTelemetry(const TelemetryBatch *batch);
+
+void JoyitCar_GetAzureIoTStats(AzureIoTStats *stats);
 
-void SendTelemetry(const char *jsonMessage);
\ No newline at end of file
+/// <summary>
+///     Sets the age, measured from the send timestamp, beyond which a cloud-to-device command
+///     is dropped instead of applied.
+/// </summary>
+void JoyitCar_SetCloudCommandMaxAge(uint32_t maxAgeMs);
\ No newline at end of file
@@ -3,13 +3,16 @@
 #include <unistd.h>
 
 #include <applibs/uart.h>
-#include <applibs/log.h>
 
 #include "libs/ble4_click/ble4.h"
 #include "eventloop_timer_utilities.h"
+#include "logger.h"
+#include "metrics.h"
 
 #include "ble_commands.h"
+#include "command_bus.h"
 #include "i2c_motor_driver.h"
+#include "telemetry.h"
 
 #define PROCESS_COUNTER 5
 #define PROCESS_RX_BUFFER_SIZE 100
@@ -20,7 +23,8 @@ static ble4_t ble4;
 static char current_parser_buf[PROCESS_PARSER_BUFFER_SIZE];
 
 static EventLoopTimer *bleCommandPollTimer = NULL;
-static struct timespec runDuration = {.tv_sec = 0, .tv_nsec = 1000 * 1000 * 100};
+
+static BLECommandStats bleCommandStats;
 
 static void Delay_ms(int ms)
 {
@@ -58,6 +62,12 @@ static int8_t ble4_process(void)
 
         if (rsp_size > 0)
         {
+            if (rsp_size <= PROCESS_RX_BUFFER_SIZE)
+            {
+                bleCommandStats.bytesReceived += (uint32_t)rsp_size;
+                bleCommandStats.framesReceived++;
+            }
+
             // Validation of the received data
             for (check_buf_cnt = 0; check_buf_cnt < rsp_size; check_buf_cnt++)
             {
@@ -100,6 +110,16 @@ static bool has_data(void)
     return ble4_process() == 1;
 }
 
+/// <summary>
+///     Brakes without ramping down, and sends the pending telemetry so the stop is visible
+///     without delay.
+/// </summary>
+static void BrakeAndFlushTelemetry(void)
+{
+    JoyitCar_EmergencyBrake();
+    JoyitCar_RequestTelemetryFlush();
+}
+
 static void BLECommandTimerEventHandler(EventLoopTimer *timer)
 {
     if (ConsumeEventLoopTimerEvent(timer) != 0)
@@ -112,32 +132,51 @@ static void BLECommandTimerEventHandler(EventLoopTimer *timer)
         return;
     }
 
-    Log_Debug("%s\n", current_parser_buf);
+    // The parser buffer is reused, so only the matched command name, a literal, is logged.
+    const char *command = "unknown";
+    // A maneuver runs for the BLE run duration; the command bus brakes afterwards.
+    MotorCommand motorCommand = {.source = CommandSource_Ble, .type = MotorCommandType_Action};
 
     if (strcmp(current_parser_buf, "Forward") == 0)
     {
-        JoyitCar_GoForward();
+        command = "Forward";
+        motorCommand.maneuver = JoyitCar_GoForward;
     }
     else if (strcmp(current_parser_buf, "Backward") == 0)
     {
-        JoyitCar_GoBackward();
+        command = "Backward";
+        motorCommand.maneuver = JoyitCar_GoBackward;
     }
     else if (strcmp(current_parser_buf, "Break") == 0)
     {
-        JoyitCar_Break();
+        command = "Break";
+        motorCommand.type = MotorCommandType_Brake;
+        motorCommand.maneuver = BrakeAndFlushTelemetry;
     }
     else if (strcmp(current_parser_buf, "Right") == 0)
     {
-        JoyitCar_TurnRight();
+        command = "Right";
+        motorCommand.maneuver = JoyitCar_TurnRight;
     }
     else if (strcmp(current_parser_buf, "Left") == 0)
     {
-        JoyitCar_TurnLeft();
+        command = "Left";
+        motorCommand.maneuver = JoyitCar_TurnLeft;
+    }
+    else
+    {
+        bleCommandStats.unknownCommands++;
     }
 
-    nanosleep(&runDuration, &runDuration);
+    LOG_DEFERRED_DEBUG("BLE command %s.\n", (intptr_t)command);
 
-    JoyitCar_Break();
+    bleCommandStats.commands++;
+    Metrics_Increment(MetricCounter_BleCommands);
+
+    if (motorCommand.maneuver != NULL)
+    {
+        JoyitCar_SubmitMotorCommand(&motorCommand);
+    }
 }
 
 BLECommands_ExitCode JoyitCar_InitBLECommandHandlers(EventLoop *eventLoop)
@@ -152,7 +191,7 @@ BLECommands_ExitCode JoyitCar_InitBLECommandHandlers(EventLoop *eventLoop)
     ble4_reset(&ble4);
     Delay_1sec();
 
-    Log_Debug("Configuring the BLE module...\n");
+    LOG_INFO("Configuring the BLE module...\n");
     Delay_1sec();
 
     ble4_set_dsr_pin(&ble4, 1);
@@ -190,7 +229,7 @@ BLECommands_ExitCode JoyitCar_InitBLECommandHandlers(EventLoop *eventLoop)
 
     ble4_set_dsr_pin(&ble4, 0);
     Delay_ms(20);
-    Log_Debug("The BLE module has been configured.\n");
+    LOG_INFO("The BLE module has been configured.\n");
 
     bleCommandPollTimer =
         CreateEventLoopPeriodicTimer(eventLoop, &BLECommandTimerEventHandler, &bleCheckPeriod);
@@ -200,4 +239,21 @@ BLECommands_ExitCode JoyitCar_InitBLECommandHandlers(EventLoop *eventLoop)
     }
 
     return BLECommands_ExitCode_Success;
+}
+
+void JoyitCar_GetBLECommandStats(BLECommandStats *stats)
+{
+    *stats = bleCommandStats;
+}
+
+void JoyitCar_SetBLECommandTiming(uint32_t pollPeriodMs, uint32_t runDurationMs)
+{
+    JoyitCar_SetCommandSourceMaxRun(CommandSource_Ble, runDurationMs);
+
+    if (bleCommandPollTimer != NULL)
+    {
+        struct timespec bleCheckPeriod = {.tv_sec = pollPeriodMs / 1000,
+                                          .tv_nsec = (pollPeriodMs % 1000) * 1000 * 1000};
+        SetEventLoopTimerPeriod(bleCommandPollTimer, &bleCheckPeriod);
+    }
 }
\ No newline at end of file
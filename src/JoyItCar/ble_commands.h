@@ -1,7 +1,16 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "eventloop_timer_utilities.h"
 
+/// <summary>
+///     Default run time of a BLE maneuver before it brakes. It outlasts the ramp to the
+///     default speed, 130 ms at the default limits and 190 ms from the opposite direction,
+///     so that a maneuver reaches its speed rather than braking on the way.
+/// </summary>
+#define BLE_COMMAND_DEFAULT_RUN_MS 300
+
 typedef enum
 {
     BLECommands_ExitCode_Success = 500,
@@ -10,4 +19,22 @@ typedef enum
     BLECommands_ExitCode_TimerConsume = 503,    
 } BLECommands_ExitCode;
 
-BLECommands_ExitCode JoyitCar_InitBLECommandHandlers(EventLoop *eventLoop);
\ No newline at end of file
+/// <summary>
+///     Counters of the BLE command channel. A frame is one UART read which carried data.
+/// </summary>
+typedef struct
+{
+    uint32_t bytesReceived;
+    uint32_t framesReceived;
+    uint32_t commands;
+    uint32_t unknownCommands;
+} BLECommandStats;
+
+BLECommands_ExitCode JoyitCar_InitBLECommandHandlers(EventLoop *eventLoop);
+
+void JoyitCar_GetBLECommandStats(BLECommandStats *stats);
+
+/// <summary>
+///     Sets how often the BLE UART is polled and how long a BLE maneuver runs before braking.
+/// </summary>
+void JoyitCar_SetBLECommandTiming(uint32_t pollPeriodMs, uint32_t runDurationMs);
\ No newline at end of file
@@ -3,19 +3,36 @@
 #include <errno.h>
 #include <string.h>
 
-#include <applibs/log.h>
 #include <applibs/gpio.h>
 
 #include "hw/joyitcar_appliance.h"
 #include "eventloop_timer_utilities.h"
 #include "utils.h"
+#include "logger.h"
+#include "metrics.h"
 
 #include "button_behavior.h"
+#include "command_bus.h"
 #include "i2c_motor_driver.h"
 
 static int userButtonAFd = -1, userButtonBFd = -1;
 static GPIO_Value_Type userButtonAState = GPIO_Value_High, userButtonBState = GPIO_Value_High;
 static EventLoopTimer *userButtonAPollTimer = NULL, *userButtonBPollTimer = NULL;
+static uint32_t buttonCommandCount = 0;
+
+/// <summary>
+///     Submits a button command to the command bus: a maneuver while the button is held,
+///     and a release which brakes unless another source has taken the motors meanwhile.
+/// </summary>
+static void SubmitButtonCommand(MotorCommandType type, void (*maneuver)(void))
+{
+    MotorCommand command = {.source = CommandSource_Button, .type = type, .maneuver = maneuver};
+
+    buttonCommandCount++;
+    Metrics_Increment(MetricCounter_ButtonCommands);
+
+    JoyitCar_SubmitMotorCommand(&command);
+}
 
 /// <summary>
 ///     Check whether a given button has just been pressed.
@@ -29,7 +46,7 @@ static bool IsButtonPressed(int fd, GPIO_Value_Type *oldState)
     int result = GPIO_GetValue(fd, &newState);
     if (result != 0)
     {
-        Log_Debug("ERROR: Could not read button GPIO: %s (%d).\n", strerror(errno), errno);
+        LOG_ERROR("Could not read button GPIO: %s (%d).\n", strerror(errno), errno);
         exitCode = -1;
         return false;
     }
@@ -57,7 +74,7 @@ static bool IsButtonLeased(int fd, GPIO_Value_Type *oldState)
     int result = GPIO_GetValue(fd, &newState);
     if (result != 0)
     {
-        Log_Debug("ERROR: Could not read button GPIO: %s (%d).\n", strerror(errno), errno);
+        LOG_ERROR("Could not read button GPIO: %s (%d).\n", strerror(errno), errno);
         exitCode = -1;
         return false;
     }
@@ -86,12 +103,12 @@ static void ButtonATimerEventHandler(EventLoopTimer *timer)
 
     if (IsButtonPressed(userButtonAFd, &userButtonAState))
     {
-        JoyitCar_GoForward();
+        SubmitButtonCommand(MotorCommandType_Action, JoyitCar_GoForward);
     }
 
     if (IsButtonLeased(userButtonAFd, &userButtonAState))
     {
-        JoyitCar_Break();
+        SubmitButtonCommand(MotorCommandType_Release, NULL);
     }
 }
 
@@ -108,12 +125,12 @@ static void ButtonBTimerEventHandler(EventLoopTimer *timer)
 
     if (IsButtonPressed(userButtonBFd, &userButtonBState))
     {
-        JoyitCar_GoBackward();
+        SubmitButtonCommand(MotorCommandType_Action, JoyitCar_GoBackward);
     }
 
     if (IsButtonLeased(userButtonBFd, &userButtonBState))
     {
-        JoyitCar_Break();
+        SubmitButtonCommand(MotorCommandType_Release, NULL);
     }
 }
 
@@ -122,11 +139,11 @@ ButtonBehaviors_ExitCode JoyitCar_InitButtonsAndHandlers(EventLoop *eventLoop)
     struct timespec buttonPressCheckPeriod = {.tv_sec = 0, .tv_nsec = 200000};
 
     // Open USER_BUTTON_A GPIO as input, and set up a timer to poll it
-    Log_Debug("Opening USER_BUTTON_A as input.\n");
+    LOG_DEBUG("Opening USER_BUTTON_A as input.\n");
     userButtonAFd = GPIO_OpenAsInput(USER_BUTTON_A);
     if (userButtonAFd == -1)
     {
-        Log_Debug("ERROR: Could not open USER_BUTTON_A: %s (%d).\n", strerror(errno), errno);
+        LOG_ERROR("Could not open USER_BUTTON_A: %s (%d).\n", strerror(errno), errno);
 
         return ButtonBehaviors_ExitCode_OpenButtonAError;
     }
@@ -138,11 +155,11 @@ ButtonBehaviors_ExitCode JoyitCar_InitButtonsAndHandlers(EventLoop *eventLoop)
     }
 
     // Open USER_BUTTON_B GPIO as input, and set up a timer to poll it
-    Log_Debug("Opening USER_BUTTON_B as input.\n");
+    LOG_DEBUG("Opening USER_BUTTON_B as input.\n");
     userButtonBFd = GPIO_OpenAsInput(USER_BUTTON_B);
     if (userButtonBFd == -1)
     {
-        Log_Debug("ERROR: Could not open USER_BUTTON_B: %s (%d).\n", strerror(errno), errno);
+        LOG_ERROR("Could not open USER_BUTTON_B: %s (%d).\n", strerror(errno), errno);
         return ButtonBehaviors_ExitCode_OpenButtonBError;
     }
     userButtonBPollTimer =
@@ -154,3 +171,24 @@ ButtonBehaviors_ExitCode JoyitCar_InitButtonsAndHandlers(EventLoop *eventLoop)
 
     return ButtonBehaviors_ExitCode_Success;
 }
+
+uint32_t JoyitCar_GetButtonCommandCount(void)
+{
+    return buttonCommandCount;
+}
+
+void JoyitCar_SetButtonPollPeriod(uint32_t periodUs)
+{
+    struct timespec buttonPressCheckPeriod = {.tv_sec = periodUs / 1000000,
+                                              .tv_nsec = (periodUs % 1000000) * 1000};
+
+    if (userButtonAPollTimer != NULL)
+    {
+        SetEventLoopTimerPeriod(userButtonAPollTimer, &buttonPressCheckPeriod);
+    }
+
+    if (userButtonBPollTimer != NULL)
+    {
+        SetEventLoopTimerPeriod(userButtonBPollTimer, &buttonPressCheckPeriod);
+    }
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h>
+
 #include "eventloop_timer_utilities.h"
 
 typedef enum
@@ -13,4 +15,11 @@ typedef enum
 
 } ButtonBehaviors_ExitCode;
 
-ButtonBehaviors_ExitCode JoyitCar_InitButtonsAndHandlers(EventLoop *eventLoop);
\ No newline at end of file
+ButtonBehaviors_ExitCode JoyitCar_InitButtonsAndHandlers(EventLoop *eventLoop);
+
+uint32_t JoyitCar_GetButtonCommandCount(void);
+
+/// <summary>
+///     Sets the period at which both user buttons are polled, in microseconds.
+/// </summary>
+void JoyitCar_SetButtonPollPeriod(uint32_t periodUs);
\ No newline at end of file
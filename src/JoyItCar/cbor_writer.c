@@ -0,0 +1,123 @@
+#include <string.h>
+
+#include "cbor_writer.h"
+
+#define CBOR_MAJOR_UNSIGNED 0
+#define CBOR_MAJOR_NEGATIVE 1
+#define CBOR_MAJOR_TEXT 3
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+
+#define CBOR_FALSE 0xF4
+#define CBOR_TRUE 0xF5
+
+static void WriteBytes(CborWriter *writer, const uint8_t *bytes, size_t length)
+{
+    if (writer->overflow || writer->length + length > writer->size)
+    {
+        writer->overflow = true;
+        return;
+    }
+
+    memcpy(writer->buffer + writer->length, bytes, length);
+    writer->length += length;
+}
+
+/// <summary>
+///     Writes a major type with its argument in the shortest form: inline below 24, then
+///     1, 2, 4 or 8 big-endian bytes.
+/// </summary>
+static void WriteHead(CborWriter *writer, uint8_t majorType, uint64_t argument)
+{
+    uint8_t head[9];
+    size_t length;
+
+    if (argument < 24)
+    {
+        head[0] = (uint8_t)(majorType << 5 | argument);
+        length = 1;
+    }
+    else if (argument <= UINT8_MAX)
+    {
+        head[0] = (uint8_t)(majorType << 5 | 24);
+        length = 2;
+    }
+    else if (argument <= UINT16_MAX)
+    {
+        head[0] = (uint8_t)(majorType << 5 | 25);
+        length = 3;
+    }
+    else if (argument <= UINT32_MAX)
+    {
+        head[0] = (uint8_t)(majorType << 5 | 26);
+        length = 5;
+    }
+    else
+    {
+        head[0] = (uint8_t)(majorType << 5 | 27);
+        length = 9;
+    }
+
+    for (size_t i = length - 1; i > 0; i--)
+    {
+        head[i] = (uint8_t)argument;
+        argument >>= 8;
+    }
+
+    WriteBytes(writer, head, length);
+}
+
+void CborWriter_Init(CborWriter *writer, uint8_t *buffer, size_t size)
+{
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->overflow = false;
+}
+
+void CborWriter_BeginArray(CborWriter *writer, size_t count)
+{
+    WriteHead(writer, CBOR_MAJOR_ARRAY, count);
+}
+
+void CborWriter_BeginMap(CborWriter *writer, size_t count)
+{
+    WriteHead(writer, CBOR_MAJOR_MAP, count);
+}
+
+void CborWriter_UInt(CborWriter *writer, uint64_t value)
+{
+    WriteHead(writer, CBOR_MAJOR_UNSIGNED, value);
+}
+
+void CborWriter_Int(CborWriter *writer, int64_t value)
+{
+    if (value < 0)
+    {
+        // Negative integers encode -1 - value, which cannot overflow.
+        WriteHead(writer, CBOR_MAJOR_NEGATIVE, (uint64_t)(-(value + 1)));
+    }
+    else
+    {
+        WriteHead(writer, CBOR_MAJOR_UNSIGNED, (uint64_t)value);
+    }
+}
+
+void CborWriter_Bool(CborWriter *writer, bool value)
+{
+    uint8_t simple = value ? CBOR_TRUE : CBOR_FALSE;
+    WriteBytes(writer, &simple, 1);
+}
+
+void CborWriter_String(CborWriter *writer, const char *value)
+{
+    size_t length = strlen(value);
+
+    WriteHead(writer, CBOR_MAJOR_TEXT, length);
+    WriteBytes(writer, (const uint8_t *)value, length);
+}
+
+size_t CborWriter_Finish(const CborWriter *writer)
+{
+    return writer->overflow ? 0 : writer->length;
+}
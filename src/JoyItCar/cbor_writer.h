@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+///     Allocation-free CBOR (RFC 8949) writer over a caller-provided buffer.
+///     Arrays and maps have definite lengths, given when they begin; a map of n entries is
+///     followed by n key and value pairs. Once the buffer is full the writer stops writing
+///     and <see cref="CborWriter_Finish" /> reports the overflow.
+/// </summary>
+typedef struct
+{
+    uint8_t *buffer;
+    size_t size;
+    size_t length;
+    bool overflow;
+} CborWriter;
+
+void CborWriter_Init(CborWriter *writer, uint8_t *buffer, size_t size);
+
+void CborWriter_BeginArray(CborWriter *writer, size_t count);
+
+void CborWriter_BeginMap(CborWriter *writer, size_t count);
+
+void CborWriter_UInt(CborWriter *writer, uint64_t value);
+
+void CborWriter_Int(CborWriter *writer, int64_t value);
+
+void CborWriter_Bool(CborWriter *writer, bool value);
+
+/// <summary>
+///     Writes a NUL-terminated UTF-8 string as a text string.
+/// </summary>
+void CborWriter_String(CborWriter *writer, const char *value);
+
+/// <returns>The encoded length, or 0 if the buffer overflowed.</returns>
+size_t CborWriter_Finish(const CborWriter *writer);
@@ -0,0 +1,314 @@
+#include <stdbool.h>
+
+#include "eventloop_timer_utilities.h"
+#include "utils.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include "ble_commands.h"
+#include "command_bus.h"
+#include "i2c_motor_driver.h"
+#include "motion_control.h"
+#include "motion_sequencer.h"
+
+/// <summary>
+///     Arbitration policy of a source. A source owns the motors while its action runs, then
+///     for holdMs after it stops, during which lower priority sources are rejected. maxRunMs
+///     bounds an action which does not bound itself; 0 leaves it running.
+/// </summary>
+typedef struct
+{
+    uint8_t priority;
+    uint32_t holdMs;
+    uint32_t maxRunMs;
+} CommandSourcePolicy;
+
+typedef struct
+{
+    MotorCommand command;
+    uint64_t submittedAtUs;
+} QueuedMotorCommand;
+
+// A button is held for as long as it drives; a BLE maneuver is a short burst.
+static CommandSourcePolicy policies[CommandSource_Count] = {
+    [CommandSource_Cloud] = {.priority = 1, .holdMs = 0, .maxRunMs = 0},
+    [CommandSource_Ble] = {.priority = 2, .holdMs = 1000, .maxRunMs = BLE_COMMAND_DEFAULT_RUN_MS},
+    [CommandSource_Button] = {.priority = 3, .holdMs = 1000, .maxRunMs = 0},
+};
+
+static const char *const sourceNames[CommandSource_Count] = {
+    [CommandSource_Cloud] = "cloud",
+    [CommandSource_Ble] = "BLE",
+    [CommandSource_Button] = "button",
+};
+
+static const MetricCounter acceptedCounters[CommandSource_Count] = {
+    [CommandSource_Cloud] = MetricCounter_BusCloudAccepted,
+    [CommandSource_Ble] = MetricCounter_BusBleAccepted,
+    [CommandSource_Button] = MetricCounter_BusButtonAccepted,
+};
+
+static const MetricCounter rejectedCounters[CommandSource_Count] = {
+    [CommandSource_Cloud] = MetricCounter_BusCloudRejected,
+    [CommandSource_Ble] = MetricCounter_BusBleRejected,
+    [CommandSource_Button] = MetricCounter_BusButtonRejected,
+};
+
+static EventLoopWorkQueue *busWorkQueue = NULL;
+static EventLoopTimer *runTimer = NULL;
+
+static QueuedMotorCommand queuedCommands[COMMAND_BUS_CAPACITY];
+static size_t queueHead = 0;
+static size_t queueCount = 0;
+static bool drainQueued = false;
+
+// Current owner of the motors; ownedUntilUs is 0 while its action runs.
+static bool hasOwner = false;
+static CommandSource owner = CommandSource_Cloud;
+static uint64_t ownedUntilUs = 0;
+
+static CommandBusStats commandBusStats;
+
+/// <summary>
+///     Releases an ownership whose hold has expired.
+/// </summary>
+static void ExpireOwnership(uint64_t nowUs)
+{
+    if (hasOwner && ownedUntilUs != 0 && nowUs >= ownedUntilUs)
+    {
+        hasOwner = false;
+    }
+}
+
+/// <summary>
+///     Keeps the source as the owner for its hold time, once its action has stopped.
+/// </summary>
+static void HoldOwnership(CommandSource source, uint64_t nowUs)
+{
+    owner = source;
+    hasOwner = policies[source].holdMs != 0;
+    ownedUntilUs = nowUs + (uint64_t)policies[source].holdMs * 1000;
+}
+
+/// <summary>
+///     Stops the timed action, the sequence or the velocity control which runs, without
+///     braking.
+/// </summary>
+static void StopRunningAction(void)
+{
+    DisarmEventLoopTimer(runTimer);
+    JoyitCar_CancelMotionSequence();
+    JoyitCar_StopVelocityControl();
+}
+
+static void RunCommand(const MotorCommand *command)
+{
+    if (command->maneuver != NULL)
+    {
+        command->maneuver();
+    }
+    else if (command->action != NULL)
+    {
+        command->action(command->context);
+    }
+}
+
+/// <summary>
+///     Arbitrates a command against the owner of the motors and applies it if it wins.
+/// </summary>
+/// <returns>true if the command was applied.</returns>
+static bool ApplyCommand(const MotorCommand *command, uint64_t nowUs)
+{
+    ExpireOwnership(nowUs);
+
+    bool owns = hasOwner && owner == command->source;
+    bool outranked =
+        hasOwner && !owns && policies[command->source].priority < policies[owner].priority;
+
+    switch (command->type)
+    {
+    case MotorCommandType_Release:
+        if (!owns)
+        {
+            return false;
+        }
+
+        StopRunningAction();
+        JoyitCar_Break();
+        HoldOwnership(command->source, nowUs);
+        return true;
+
+    case MotorCommandType_Brake:
+        StopRunningAction();
+        RunCommand(command);
+        // An outranked brake stops the owner's action but leaves it the motors.
+        HoldOwnership(outranked ? owner : command->source, nowUs);
+        return true;
+
+    case MotorCommandType_Action:
+    {
+        if (outranked)
+        {
+            return false;
+        }
+
+        StopRunningAction();
+        owner = command->source;
+        hasOwner = true;
+        ownedUntilUs = 0;
+        RunCommand(command);
+
+        uint32_t durationMs = command->durationMs != 0 ? command->durationMs
+                                                       : policies[command->source].maxRunMs;
+        if (durationMs != 0)
+        {
+            struct timespec duration = {.tv_sec = durationMs / 1000,
+                                        .tv_nsec = (durationMs % 1000) * 1000 * 1000};
+            SetEventLoopTimerOneShot(runTimer, &duration);
+        }
+        return true;
+    }
+    }
+
+    return false;
+}
+
+/// <summary>
+///     Deferred work: the single consumer of the bus, which applies the queued commands in
+///     submission order.
+/// </summary>
+static void DrainCommands(void *context)
+{
+    drainQueued = false;
+
+    while (queueCount > 0)
+    {
+        // Copied out: an action or a rejection handler may submit a new command.
+        QueuedMotorCommand queued = queuedCommands[queueHead];
+        queueHead = (queueHead + 1) % COMMAND_BUS_CAPACITY;
+        queueCount--;
+
+        const MotorCommand *command = &queued.command;
+        uint64_t nowUs = GetMonotonicMicroseconds();
+        uint32_t arbitrationUs = (uint32_t)(nowUs - queued.submittedAtUs);
+
+        commandBusStats.lastArbitrationUs = arbitrationUs;
+        Metrics_Record(MetricHistogram_ArbitrationUs, arbitrationUs);
+        if (arbitrationUs > commandBusStats.maxArbitrationUs)
+        {
+            commandBusStats.maxArbitrationUs = arbitrationUs;
+        }
+
+        if (ApplyCommand(command, nowUs))
+        {
+            commandBusStats.accepted[command->source]++;
+            Metrics_Increment(acceptedCounters[command->source]);
+            continue;
+        }
+
+        commandBusStats.rejected[command->source]++;
+        Metrics_Increment(rejectedCounters[command->source]);
+
+        LOG_DEFERRED_DEBUG("Motor command from %s rejected, the motors are owned by %s.\n",
+                           (intptr_t)sourceNames[command->source],
+                           (intptr_t)(hasOwner ? sourceNames[owner] : "nobody"));
+
+        if (command->rejected != NULL)
+        {
+            command->rejected(command->context);
+        }
+    }
+}
+
+/// <summary>
+///     Run timer event: ends an action bounded by its duration or its source's maximum.
+/// </summary>
+static void RunTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0)
+    {
+        exitCode = CommandBus_ExitCode_RunTimer_Consume;
+        return;
+    }
+
+    JoyitCar_StopVelocityControl();
+    JoyitCar_Break();
+
+    if (hasOwner)
+    {
+        HoldOwnership(owner, GetMonotonicMicroseconds());
+    }
+}
+
+CommandBus_ExitCode JoyitCar_InitCommandBus(EventLoop *eventLoop, EventLoopWorkQueue *workQueue)
+{
+    busWorkQueue = workQueue;
+
+    runTimer = CreateEventLoopDisarmedTimer(eventLoop, &RunTimerEventHandler);
+
+    if (runTimer == NULL)
+    {
+        return CommandBus_ExitCode_Init_RunTimer;
+    }
+
+    return CommandBus_ExitCode_Success;
+}
+
+void JoyitCar_CloseCommandBus(void)
+{
+    DisposeEventLoopTimer(runTimer);
+    runTimer = NULL;
+    busWorkQueue = NULL;
+    queueCount = 0;
+}
+
+static int DropCommand(const MotorCommand *command)
+{
+    commandBusStats.dropped++;
+    Metrics_Increment(MetricCounter_BusDropped);
+
+    LOG_DEFERRED_WARNING("The command bus is full, a %s command was dropped.\n",
+                         (intptr_t)sourceNames[command->source]);
+
+    return -1;
+}
+
+int JoyitCar_SubmitMotorCommand(const MotorCommand *command)
+{
+    if (queueCount == COMMAND_BUS_CAPACITY)
+    {
+        return DropCommand(command);
+    }
+
+    // The consumer is scheduled once for all the commands queued before it runs.
+    if (!drainQueued)
+    {
+        if (EnqueueEventLoopWork(busWorkQueue, DrainCommands, NULL) != 0)
+        {
+            return DropCommand(command);
+        }
+
+        drainQueued = true;
+    }
+
+    QueuedMotorCommand *queued =
+        &queuedCommands[(queueHead + queueCount) % COMMAND_BUS_CAPACITY];
+    queued->command = *command;
+    queued->submittedAtUs = GetMonotonicMicroseconds();
+    queueCount++;
+
+    return 0;
+}
+
+void JoyitCar_SetCommandSourceMaxRun(CommandSource source, uint32_t maxRunMs)
+{
+    if (source < CommandSource_Count)
+    {
+        policies[source].maxRunMs = maxRunMs;
+    }
+}
+
+void JoyitCar_GetCommandBusStats(CommandBusStats *stats)
+{
+    *stats = commandBusStats;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+
+#include "eventloop_timer_utilities.h"
+
+/// <summary>
+///     Sources of motor commands, in increasing priority.
+/// </summary>
+typedef enum
+{
+    CommandSource_Cloud = 0,
+    CommandSource_Ble = 1,
+    CommandSource_Button = 2,
+    CommandSource_Count = 3,
+} CommandSource;
+
+typedef enum
+{
+    /// <summary>Arbitrated: applied only if no higher priority source owns the motors.</summary>
+    MotorCommandType_Action = 0,
+    /// <summary>Always applied; stops whatever runs before its maneuver.</summary>
+    MotorCommandType_Brake = 1,
+    /// <summary>Brakes only if the source owns the motors, e.g. a button being released.</summary>
+    MotorCommandType_Release = 2,
+} MotorCommandType;
+
+/// <summary>
+///     A motor command. It runs maneuver if set, else action with context. rejected, if set,
+///     is invoked with context instead when the command loses the arbitration. durationMs
+///     bounds an action; 0 takes the maximum run time of the source, if any.
+/// </summary>
+typedef struct
+{
+    CommandSource source;
+    MotorCommandType type;
+    void (*maneuver)(void);
+    void (*action)(void *context);
+    void (*rejected)(void *context);
+    void *context;
+    uint32_t durationMs;
+} MotorCommand;
+
+// Commands waiting for the consumer; a source submits a few at most per event loop iteration.
+#define COMMAND_BUS_CAPACITY 16
+
+/// <summary>
+///     Counters of the command bus. Arbitration latency is measured from the submission of a
+///     command to the decision to apply or reject it; dropped commands found the bus full.
+/// </summary>
+typedef struct
+{
+    uint32_t accepted[CommandSource_Count];
+    uint32_t rejected[CommandSource_Count];
+    uint32_t dropped;
+    uint32_t lastArbitrationUs;
+    uint32_t maxArbitrationUs;
+} CommandBusStats;
+
+typedef enum
+{
+    CommandBus_ExitCode_Success = 900,
+    CommandBus_ExitCode_Init_RunTimer = 901,
+    CommandBus_ExitCode_RunTimer_Consume = 902,
+} CommandBus_ExitCode;
+
+CommandBus_ExitCode JoyitCar_InitCommandBus(EventLoop *eventLoop, EventLoopWorkQueue *workQueue);
+
+void JoyitCar_CloseCommandBus(void);
+
+/// <summary>
+///     Queues a command for the consumer, which arbitrates and applies the queued commands in
+///     order on the deferred work queue. Must be called from the event loop thread.
+/// </summary>
+/// <returns>0 on success, -1 if the bus is full.</returns>
+int JoyitCar_SubmitMotorCommand(const MotorCommand *command);
+
+/// <summary>
+///     Sets how long an action of the source runs when it does not bound itself; 0 runs it
+///     until the next command.
+/// </summary>
+void JoyitCar_SetCommandSourceMaxRun(CommandSource source, uint32_t maxRunMs);
+
+void JoyitCar_GetCommandBusStats(CommandBusStats *stats);
@@ -0,0 +1,236 @@
+#include <stddef.h>
+
+#include "json_tokenizer.h"
+#include "json_writer.h"
+#include "logger.h"
+
+#include "device_config.h"
+#include "azure_iot_client.h"
+#include "ble_commands.h"
+#include "button_behavior.h"
+#include "i2c_motor_driver.h"
+#include "telemetry.h"
+
+// Only the desired section is tokenized; the service may set properties other than ours.
+#define DESIRED_PROPERTIES_MAX_TOKENS 128
+
+// Status codes of the writable property acknowledgements
+#define CONFIG_ACK_APPLIED 200
+#define CONFIG_ACK_INVALID 400
+
+/// <summary>
+///     Modules whose settings must be re-applied when one of their fields changes.
+/// </summary>
+typedef enum
+{
+    ConfigGroup_Motors = 1 << 0,
+    ConfigGroup_BLE = 1 << 1,
+    ConfigGroup_Buttons = 1 << 2,
+    ConfigGroup_Telemetry = 1 << 3,
+    ConfigGroup_CloudCommands = 1 << 4,
+} ConfigGroup;
+
+typedef struct
+{
+    const char *name;
+    size_t offset;
+    uint32_t min;
+    uint32_t max;
+    ConfigGroup group;
+} DeviceConfigField;
+
+static const DeviceConfigField deviceConfigFields[] = {
+    {"motorSpeed", offsetof(DeviceConfig, motorSpeed), 1, 255, ConfigGroup_Motors},
+    {"motorAccelPerSecond", offsetof(DeviceConfig, motorAccelPerSecond), 0, 10000,
+     ConfigGroup_Motors},
+    {"motorJerkPerSecond2", offsetof(DeviceConfig, motorJerkPerSecond2), 100, 1000000,
+     ConfigGroup_Motors},
+    {"bleRunDurationMs", offsetof(DeviceConfig, bleRunDurationMs), 10, 2000, ConfigGroup_BLE},
+    {"blePollPeriodMs", offsetof(DeviceConfig, blePollPeriodMs), 10, 1000, ConfigGroup_BLE},
+    {"buttonPollPeriodUs", offsetof(DeviceConfig, buttonPollPeriodUs), 100, 100000,
+     ConfigGroup_Buttons},
+    {"telemetrySamplePeriodMs", offsetof(DeviceConfig, telemetrySamplePeriodMs), 100, 60000,
+     ConfigGroup_Telemetry},
+    {"telemetryMaxSamples", offsetof(DeviceConfig, telemetryMaxSamples), 1,
+     TELEMETRY_BATCH_MAX_SAMPLES, ConfigGroup_Telemetry},
+    {"telemetryMaxAgeSeconds", offsetof(DeviceConfig, telemetryMaxAgeSeconds), 1, 3600,
+     ConfigGroup_Telemetry},
+    {"telemetryMaxBytes", offsetof(DeviceConfig, telemetryMaxBytes), 512,
+     TELEMETRY_BATCH_MAX_BYTES, ConfigGroup_Telemetry},
+    {"telemetryEncoding", offsetof(DeviceConfig, telemetryEncoding), TelemetryEncoding_Json,
+     TelemetryEncoding_Cbor, ConfigGroup_Telemetry},
+    {"telemetryHeartbeatSeconds", offsetof(DeviceConfig, telemetryHeartbeatSeconds), 10, 3600,
+     ConfigGroup_Telemetry},
+    {"telemetryMessagesPerHour", offsetof(DeviceConfig, telemetryMessagesPerHour), 1, 3600,
+     ConfigGroup_Telemetry},
+    {"cloudCommandMaxAgeMs", offsetof(DeviceConfig, cloudCommandMaxAgeMs), 50, 60000,
+     ConfigGroup_CloudCommands},
+};
+
+// Defaults match the compile-time values of each module.
+static DeviceConfig deviceConfig = {
+    .motorSpeed = DEFAULT_MOTOR_SPEED,
+    .motorAccelPerSecond = MOTOR_RAMP_DEFAULT_ACCELERATION,
+    .motorJerkPerSecond2 = MOTOR_RAMP_DEFAULT_JERK,
+    .bleRunDurationMs = BLE_COMMAND_DEFAULT_RUN_MS,
+    .blePollPeriodMs = 50,
+    .buttonPollPeriodUs = 200,
+    .telemetrySamplePeriodMs = 1000,
+    .telemetryMaxSamples = 10,
+    .telemetryMaxAgeSeconds = 10,
+    .telemetryMaxBytes = TELEMETRY_BATCH_MAX_BYTES,
+    .telemetryEncoding = TelemetryEncoding_Json,
+    .telemetryHeartbeatSeconds = 300,
+    .telemetryMessagesPerHour = 360,
+    .cloudCommandMaxAgeMs = 1000,
+};
+
+#define DEVICE_CONFIG_FIELD_COUNT (sizeof(deviceConfigFields) / sizeof(deviceConfigFields[0]))
+
+// The object, $version and each field as a key and a value, with room for as many
+// properties unknown to the device.
+_Static_assert(DESIRED_PROPERTIES_MAX_TOKENS >= 1 + 2 * 2 * (1 + DEVICE_CONFIG_FIELD_COUNT),
+               "The desired properties tokens cannot hold every configuration field.");
+
+static JsonToken desiredTokens[DESIRED_PROPERTIES_MAX_TOKENS];
+
+const DeviceConfig *JoyitCar_GetDeviceConfig(void)
+{
+    return &deviceConfig;
+}
+
+static uint32_t *GetFieldValue(const DeviceConfigField *field)
+{
+    return (uint32_t *)((uint8_t *)&deviceConfig + field->offset);
+}
+
+static void ApplyConfigGroups(unsigned int groups)
+{
+    if (groups & ConfigGroup_Motors)
+    {
+        JoyitCar_SetMotorSpeed((int)deviceConfig.motorSpeed);
+        JoyitCar_SetMotorRampLimits(deviceConfig.motorAccelPerSecond,
+                                    deviceConfig.motorJerkPerSecond2);
+    }
+
+    if (groups & ConfigGroup_BLE)
+    {
+        JoyitCar_SetBLECommandTiming(deviceConfig.blePollPeriodMs, deviceConfig.bleRunDurationMs);
+    }
+
+    if (groups & ConfigGroup_Buttons)
+    {
+        JoyitCar_SetButtonPollPeriod(deviceConfig.buttonPollPeriodUs);
+    }
+
+    if (groups & ConfigGroup_Telemetry)
+    {
+        TelemetryBatchConfig batchConfig = {
+            .samplePeriodMs = deviceConfig.telemetrySamplePeriodMs,
+            .maxSamples = deviceConfig.telemetryMaxSamples,
+            .maxAgeSeconds = deviceConfig.telemetryMaxAgeSeconds,
+            .maxBytes = deviceConfig.telemetryMaxBytes,
+            .encoding = (TelemetryEncoding)deviceConfig.telemetryEncoding,
+            .heartbeatSeconds = deviceConfig.telemetryHeartbeatSeconds,
+            .messagesPerHour = deviceConfig.telemetryMessagesPerHour};
+        JoyitCar_SetTelemetryBatchConfig(&batchConfig);
+    }
+
+    if (groups & ConfigGroup_CloudCommands)
+    {
+        JoyitCar_SetCloudCommandMaxAge(deviceConfig.cloudCommandMaxAgeMs);
+    }
+}
+
+size_t JoyitCar_ApplyDesiredProperties(const char *json, size_t size, bool isCompleteTwin,
+                                       char *report, size_t reportSize)
+{
+    // The reported section of a complete twin grows with the metrics: it is skipped over
+    // rather than tokenized.
+    if (isCompleteTwin)
+    {
+        JsonRawMember section;
+        if (!JsonTokenizer_FindRawMember(json, size, "desired", &section))
+        {
+            LOG_ERROR("The device twin has no desired properties.\n");
+            return 0;
+        }
+
+        json += section.valueStart;
+        size = section.valueEnd - section.valueStart;
+    }
+
+    int count = JsonTokenizer_Parse(json, size, desiredTokens, DESIRED_PROPERTIES_MAX_TOKENS);
+    if (count <= 0)
+    {
+        LOG_ERROR("Could not parse the device twin desired properties.\n");
+        return 0;
+    }
+
+    int64_t version = 0;
+    int versionToken = JsonTokenizer_FindMember(json, desiredTokens, count, 0, "$version");
+    if (versionToken >= 0)
+    {
+        JsonTokenizer_GetInt(json, &desiredTokens[versionToken], &version);
+    }
+
+    JsonWriter writer;
+    JsonWriter_Init(&writer, report, reportSize);
+    JsonWriter_BeginObject(&writer);
+
+    unsigned int changedGroups = 0;
+    bool hasAcknowledgements = false;
+
+    for (size_t i = 0; i < DEVICE_CONFIG_FIELD_COUNT; i++)
+    {
+        const DeviceConfigField *field = &deviceConfigFields[i];
+
+        int valueToken = JsonTokenizer_FindMember(json, desiredTokens, count, 0, field->name);
+        if (valueToken < 0)
+        {
+            continue;
+        }
+
+        uint32_t *current = GetFieldValue(field);
+        int64_t value;
+        bool isValid = JsonTokenizer_GetInt(json, &desiredTokens[valueToken], &value) &&
+                       value >= field->min && value <= field->max;
+
+        if (!isValid)
+        {
+            LOG_WARNING("Rejected desired property %s.\n", field->name);
+        }
+        else if ((uint32_t)value != *current)
+        {
+            *current = (uint32_t)value;
+            changedGroups |= field->group;
+        }
+
+        // Unchanged values are acknowledged too: the service waits for every field of this
+        // version to be acknowledged, whether the device applied it before or not.
+        JsonWriter_Key(&writer, field->name);
+        JsonWriter_BeginObject(&writer);
+        JsonWriter_Key(&writer, "value");
+        JsonWriter_UInt(&writer, *current);
+        JsonWriter_Key(&writer, "ac");
+        JsonWriter_UInt(&writer, isValid ? CONFIG_ACK_APPLIED : CONFIG_ACK_INVALID);
+        JsonWriter_Key(&writer, "av");
+        JsonWriter_Int(&writer, version);
+        JsonWriter_Key(&writer, "ad");
+        JsonWriter_String(&writer, isValid ? "applied" : "invalid or out of range");
+        JsonWriter_EndObject(&writer);
+
+        hasAcknowledgements = true;
+    }
+
+    JsonWriter_EndObject(&writer);
+
+    ApplyConfigGroups(changedGroups);
+
+    if (!hasAcknowledgements)
+    {
+        return 0;
+    }
+
+    return JsonWriter_Finish(&writer);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+///     Largest device twin document accepted. A complete twin carries the desired properties
+///     and every reported property, the metrics included: about 4.3 KB at their largest, see
+///     tests/test_device_twin.c.
+/// </summary>
+#define DEVICE_TWIN_MAX_BYTES 8192
+
+/// <summary>
+///     Size of the buffer of the desired properties acknowledgement patch, which holds an
+///     acknowledgement of every field at its largest.
+/// </summary>
+#define DEVICE_CONFIG_REPORT_MAX_BYTES 1536
+
+/// <summary>
+///     Runtime tuning values, set from the device twin desired properties.
+///     Property names in the twin match the field names.
+/// </summary>
+typedef struct
+{
+    uint32_t motorSpeed;
+    uint32_t motorAccelPerSecond;
+    uint32_t motorJerkPerSecond2;
+    uint32_t bleRunDurationMs;
+    uint32_t blePollPeriodMs;
+    uint32_t buttonPollPeriodUs;
+    uint32_t telemetrySamplePeriodMs;
+    uint32_t telemetryMaxSamples;
+    uint32_t telemetryMaxAgeSeconds;
+    uint32_t telemetryMaxBytes;
+    uint32_t telemetryEncoding;
+    uint32_t telemetryHeartbeatSeconds;
+    uint32_t telemetryMessagesPerHour;
+    uint32_t cloudCommandMaxAgeMs;
+} DeviceConfig;
+
+const DeviceConfig *JoyitCar_GetDeviceConfig(void);
+
+/// <summary>
+///     Validates the desired properties of a device twin document and applies the fields
+///     which changed. Every field present in the document is acknowledged, unchanged ones
+///     included, into a caller-provided buffer, as a reported properties patch carrying the
+///     desired version.
+/// </summary>
+/// <param name="json">Twin document; not required to be NUL-terminated.</param>
+/// <param name="size">Size of the twin document.</param>
+/// <param name="isCompleteTwin">true if the document is the complete twin, false if it
+/// is a desired properties patch.</param>
+/// <param name="report">Receives the reported properties patch.</param>
+/// <param name="reportSize">Size of the report buffer.</param>
+/// <returns>The length of the patch, or 0 if there is nothing to report.</returns>
+size_t JoyitCar_ApplyDesiredProperties(const char *json, size_t size, bool isCompleteTwin,
+                                       char *report, size_t reportSize);
@@ -0,0 +1,106 @@
+#include <stddef.h>
+
+#include "utils.h"
+
+#include "device_operations.h"
+
+static DeviceOperation operations[DEVICE_OPERATION_TABLE_SIZE];
+static uint32_t nextOperationId = 1;
+
+static const char *const operationStateNames[] = {
+    [DeviceOperationState_Pending] = "Pending",
+    [DeviceOperationState_Running] = "Running",
+    [DeviceOperationState_Succeeded] = "Succeeded",
+    [DeviceOperationState_Cancelled] = "Cancelled",
+    [DeviceOperationState_Failed] = "Failed",
+};
+
+bool DeviceOperations_IsFinished(const DeviceOperation *operation)
+{
+    return operation->state >= DeviceOperationState_Succeeded;
+}
+
+DeviceOperation *DeviceOperations_Create(const char *name)
+{
+    DeviceOperation *slot = NULL;
+
+    for (size_t i = 0; i < DEVICE_OPERATION_TABLE_SIZE; i++)
+    {
+        DeviceOperation *operation = &operations[i];
+
+        if (operation->id == 0)
+        {
+            slot = operation;
+            break;
+        }
+
+        if (DeviceOperations_IsFinished(operation) &&
+            (slot == NULL || operation->id < slot->id))
+        {
+            slot = operation;
+        }
+    }
+
+    if (slot == NULL)
+    {
+        return NULL;
+    }
+
+    // 0 marks a free slot, so it is never handed out.
+    if (nextOperationId == 0)
+    {
+        nextOperationId = 1;
+    }
+
+    *slot = (DeviceOperation){.id = nextOperationId++,
+                              .name = name,
+                              .state = DeviceOperationState_Pending,
+                              .startedAtUs = GetMonotonicMicroseconds()};
+    return slot;
+}
+
+DeviceOperation *DeviceOperations_Find(uint32_t id)
+{
+    for (size_t i = 0; id != 0 && i < DEVICE_OPERATION_TABLE_SIZE; i++)
+    {
+        if (operations[i].id == id)
+        {
+            return &operations[i];
+        }
+    }
+
+    return NULL;
+}
+
+void DeviceOperations_Update(DeviceOperation *operation, DeviceOperationState state,
+                             uint8_t progress)
+{
+    operation->state = state;
+    operation->progress = progress;
+
+    if (DeviceOperations_IsFinished(operation))
+    {
+        operation->finishedAtUs = GetMonotonicMicroseconds();
+    }
+}
+
+void DeviceOperations_Write(const DeviceOperation *operation, JsonWriter *writer)
+{
+    uint64_t endUs =
+        DeviceOperations_IsFinished(operation) ? operation->finishedAtUs : GetMonotonicMicroseconds();
+
+    JsonWriter_BeginObject(writer);
+    JsonWriter_Key(writer, "id");
+    JsonWriter_UInt(writer, operation->id);
+    JsonWriter_Key(writer, "name");
+    JsonWriter_String(writer, operation->name);
+    JsonWriter_Key(writer, "state");
+    JsonWriter_String(writer, operationStateNames[operation->state]);
+    JsonWriter_Key(writer, "cancelRequested");
+    JsonWriter_Bool(writer, operation->cancelRequested);
+    JsonWriter_Key(writer, "progress");
+    JsonWriter_UInt(writer, operation->progress);
+    JsonWriter_Key(writer, "elapsedMs");
+    JsonWriter_UInt(writer, (endUs - operation->startedAtUs) / 1000);
+    JsonWriter_EndObject(writer);
+}
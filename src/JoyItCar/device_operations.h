@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "json_writer.h"
+
+/// <summary>
+///     Number of operations tracked. Finished operations are kept for GetOperation until
+///     their slot is reused by a newer operation.
+/// </summary>
+#define DEVICE_OPERATION_TABLE_SIZE 8
+
+typedef enum
+{
+    DeviceOperationState_Pending = 0,
+    DeviceOperationState_Running = 1,
+    DeviceOperationState_Succeeded = 2,
+    DeviceOperationState_Cancelled = 3,
+    DeviceOperationState_Failed = 4,
+} DeviceOperationState;
+
+/// <summary>
+///     A long-running Direct Method. progress is a percentage.
+/// </summary>
+typedef struct
+{
+    uint32_t id;
+    const char *name;
+    DeviceOperationState state;
+    bool cancelRequested;
+    uint8_t progress;
+    uint64_t startedAtUs;
+    uint64_t finishedAtUs;
+} DeviceOperation;
+
+/// <summary>
+///     Allocates an operation in the Pending state, reusing the oldest finished slot.
+/// </summary>
+/// <returns>The operation, or NULL when every slot holds an unfinished operation.</returns>
+DeviceOperation *DeviceOperations_Create(const char *name);
+
+/// <returns>The operation with this id, or NULL if it is unknown or was evicted.</returns>
+DeviceOperation *DeviceOperations_Find(uint32_t id);
+
+bool DeviceOperations_IsFinished(const DeviceOperation *operation);
+
+/// <summary>
+///     Moves the operation to a new state, recording its progress and finish time.
+/// </summary>
+void DeviceOperations_Update(DeviceOperation *operation, DeviceOperationState state,
+                             uint8_t progress);
+
+/// <summary>
+///     Writes the operation as a JSON object: {"id","name","state","progress","elapsedMs"}.
+/// </summary>
+void DeviceOperations_Write(const DeviceOperation *operation, JsonWriter *writer);
@@ -7,12 +7,15 @@
 #include <errno.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/eventfd.h>
 #include <sys/timerfd.h>
 
-#include <applibs/log.h>
 #include <applibs/eventloop.h>
 
 #include "eventloop_timer_utilities.h"
+#include "logger.h"
+#include "metrics.h"
+#include "utils.h"
 
 static int SetTimerPeriod(int timerFd, const struct timespec *initial,
                           const struct timespec *repeat);
@@ -25,13 +28,36 @@ static int SetTimerPeriod(int timerFd, const struct timespec *initial,
                                   .it_interval = repeat ? *repeat : nullTimeSpec};
 
     if (timerfd_settime(timerFd, /* flags */ 0, &newValue, /* old_value */ NULL) == -1) {
-        Log_Debug("ERROR: Could not set timer period: %s (%d).\n", strerror(errno), errno);
+        LOG_ERROR("Could not set timer period: %s (%d).\n", strerror(errno), errno);
         return -1;
     }
 
     return 0;
 }
 
+static EventLoopStallStats stallStats;
+
+static void RecordHandlerDuration(uint64_t startedAtUs)
+{
+    uint32_t durationUs = (uint32_t)(GetMonotonicMicroseconds() - startedAtUs);
+
+    Metrics_Record(MetricHistogram_HandlerUs, durationUs);
+
+    if (durationUs > stallStats.maxHandlerUs) {
+        stallStats.maxHandlerUs = durationUs;
+    }
+
+    if (durationUs > EVENTLOOP_STALL_THRESHOLD_US) {
+        stallStats.stalls++;
+        Metrics_Increment(MetricCounter_LoopStalls);
+    }
+}
+
+void GetEventLoopStallStats(EventLoopStallStats *stats)
+{
+    *stats = stallStats;
+}
+
 struct EventLoopTimer {
     EventLoop *eventLoop;
     EventLoopTimerHandler handler;
@@ -43,8 +69,11 @@ struct EventLoopTimer {
 static void TimerCallback(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
 {
     EventLoopTimer *timer = (EventLoopTimer *)context;
+    uint64_t startedAtUs = GetMonotonicMicroseconds();
 
     timer->handler(timer);
+
+    RecordHandlerDuration(startedAtUs);
 }
 
 EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTimerHandler handler,
@@ -69,7 +98,7 @@ EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTime
 
     timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
     if (timer->fd == -1) {
-        Log_Debug("ERROR: Unable to create timer: %s (%d).\n", strerror(errno), errno);
+        LOG_ERROR("Unable to create timer: %s (%d).\n", strerror(errno), errno);
         goto failed;
     }
 
@@ -80,7 +109,7 @@ EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTime
     timer->registration =
         EventLoop_RegisterIo(eventLoop, timer->fd, EventLoop_Input, TimerCallback, timer);
     if (timer->registration == NULL) {
-        Log_Debug("ERROR: Unable to register timer event: %s (%d).\n", strerror(errno), errno);
+        LOG_ERROR("Unable to register timer event: %s (%d).\n", strerror(errno), errno);
         goto failed;
     }
 
@@ -116,7 +145,7 @@ int ConsumeEventLoopTimerEvent(EventLoopTimer *timer)
     uint64_t timerData = 0;
 
     if (read(timer->fd, &timerData, sizeof(timerData)) == -1) {
-        Log_Debug("ERROR: Could not read timerfd %s (%d).\n", strerror(errno), errno);
+        LOG_ERROR("Could not read timerfd %s (%d).\n", strerror(errno), errno);
         return -1;
     }
 
@@ -137,3 +166,141 @@ int DisarmEventLoopTimer(EventLoopTimer *timer)
 {
     return SetTimerPeriod(timer->fd, /* initial */ NULL, /* repeat */ NULL);
 }
+
+typedef struct {
+    EventLoopWorkHandler handler;
+    void *context;
+    uint64_t enqueuedAtUs;
+} EventLoopWorkItem;
+
+struct EventLoopWorkQueue {
+    EventLoop *eventLoop;
+    int fd;
+    EventRegistration *registration;
+    EventLoopWorkItem items[EVENTLOOP_WORK_QUEUE_CAPACITY];
+    size_t head;
+    size_t count;
+    EventLoopWorkQueueStats stats;
+};
+
+// This satisfies the EventLoopIoCallback signature.
+static void WorkQueueCallback(EventLoop *el, int fd, EventLoop_IoEvents events, void *context)
+{
+    EventLoopWorkQueue *queue = (EventLoopWorkQueue *)context;
+    uint64_t signalCount = 0;
+
+    if (read(queue->fd, &signalCount, sizeof(signalCount)) == -1 && errno != EAGAIN) {
+        LOG_ERROR("Could not read work queue eventfd %s (%d).\n", strerror(errno), errno);
+        return;
+    }
+
+    // Only run the items which were pending on entry; anything enqueued by a handler
+    // re-signals the eventfd and runs on the next iteration.
+    size_t pending = queue->count;
+    while (pending-- > 0) {
+        EventLoopWorkItem item = queue->items[queue->head];
+        queue->head = (queue->head + 1) % EVENTLOOP_WORK_QUEUE_CAPACITY;
+        queue->count--;
+
+        uint64_t startedAtUs = GetMonotonicMicroseconds();
+        queue->stats.lastLatencyUs = (uint32_t)(startedAtUs - item.enqueuedAtUs);
+        Metrics_Record(MetricHistogram_WorkQueueLatencyUs, queue->stats.lastLatencyUs);
+        if (queue->stats.lastLatencyUs > queue->stats.maxLatencyUs) {
+            queue->stats.maxLatencyUs = queue->stats.lastLatencyUs;
+        }
+        queue->stats.executed++;
+
+        item.handler(item.context);
+
+        RecordHandlerDuration(startedAtUs);
+    }
+}
+
+EventLoopWorkQueue *CreateEventLoopWorkQueue(EventLoop *eventLoop)
+{
+    EventLoopWorkQueue *queue = calloc(1, sizeof(EventLoopWorkQueue));
+    if (queue == NULL) {
+        return NULL;
+    }
+
+    queue->eventLoop = eventLoop;
+
+    // Initialize to unused values in case have to clean up partially initialized object.
+    queue->fd = -1;
+    queue->registration = NULL;
+
+    queue->fd = eventfd(0, EFD_NONBLOCK);
+    if (queue->fd == -1) {
+        LOG_ERROR("Unable to create work queue eventfd: %s (%d).\n", strerror(errno), errno);
+        goto failed;
+    }
+
+    queue->registration =
+        EventLoop_RegisterIo(eventLoop, queue->fd, EventLoop_Input, WorkQueueCallback, queue);
+    if (queue->registration == NULL) {
+        LOG_ERROR("Unable to register work queue event: %s (%d).\n", strerror(errno),
+                  errno);
+        goto failed;
+    }
+
+    return queue;
+
+failed:
+    DisposeEventLoopWorkQueue(queue);
+    return NULL;
+}
+
+void DisposeEventLoopWorkQueue(EventLoopWorkQueue *queue)
+{
+    if (queue == NULL) {
+        return;
+    }
+
+    EventLoop_UnregisterIo(queue->eventLoop, queue->registration);
+
+    if (queue->fd != -1) {
+        close(queue->fd);
+    }
+
+    free(queue);
+}
+
+int EnqueueEventLoopWork(EventLoopWorkQueue *queue, EventLoopWorkHandler handler, void *context)
+{
+    if (handler == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (queue->count == EVENTLOOP_WORK_QUEUE_CAPACITY) {
+        queue->stats.dropped++;
+        errno = ENOSPC;
+        return -1;
+    }
+
+    uint64_t signal = 1;
+    if (write(queue->fd, &signal, sizeof(signal)) == -1) {
+        LOG_ERROR("Could not signal work queue eventfd %s (%d).\n", strerror(errno), errno);
+        queue->stats.dropped++;
+        return -1;
+    }
+
+    size_t tail = (queue->head + queue->count) % EVENTLOOP_WORK_QUEUE_CAPACITY;
+    queue->items[tail].handler = handler;
+    queue->items[tail].context = context;
+    queue->items[tail].enqueuedAtUs = GetMonotonicMicroseconds();
+    queue->count++;
+
+    queue->stats.enqueued++;
+    if (queue->count > queue->stats.maxDepth) {
+        queue->stats.maxDepth = queue->count;
+    }
+
+    return 0;
+}
+
+void GetEventLoopWorkQueueStats(const EventLoopWorkQueue *queue, EventLoopWorkQueueStats *stats)
+{
+    *stats = queue->stats;
+    stats->depth = queue->count;
+}
@@ -2,6 +2,8 @@
    Licensed under the MIT License. */
 
 #pragma once
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 
 #include <unistd.h>
@@ -100,3 +102,91 @@ int SetEventLoopTimerOneShot(EventLoopTimer *timer, const struct timespec *delay
 /// <seealso cref="SetEventLoopTimerOneShot" />
 /// <seealso cref="SetEventLoopTimerPeriod" />
 int DisarmEventLoopTimer(EventLoopTimer *timer);
+
+/// <summary>
+/// A timer or work handler which runs for longer than this is counted as an event loop stall.
+/// </summary>
+#define EVENTLOOP_STALL_THRESHOLD_US 50000
+
+/// <summary>
+/// Counters describing how long timer and work handlers held the event loop.
+/// </summary>
+typedef struct {
+    uint32_t stalls;
+    uint32_t maxHandlerUs;
+} EventLoopStallStats;
+
+/// <summary>
+/// Read the event loop stall counters, accumulated over all timers and work queues.
+/// </summary>
+/// <param name="stats">Receives the counters.</param>
+void GetEventLoopStallStats(EventLoopStallStats *stats);
+
+/// <summary>
+/// Maximum number of work items which can be pending in an <see cref="EventLoopWorkQueue" />.
+/// </summary>
+#define EVENTLOOP_WORK_QUEUE_CAPACITY 16
+
+/// <summary>
+/// Opaque handle. Obtain via <see cref="CreateEventLoopWorkQueue" /> and dispose of via
+/// <see cref="DisposeEventLoopWorkQueue" />.
+/// </summary>
+typedef struct EventLoopWorkQueue EventLoopWorkQueue;
+
+/// <summary>
+/// Applications implement a function with this signature to run deferred work
+/// on the event loop.
+/// </summary>
+/// <param name="context">The context pointer which was supplied when the work was enqueued.</param>
+/// <seealso cref="EnqueueEventLoopWork" />
+typedef void (*EventLoopWorkHandler)(void *context);
+
+/// <summary>
+/// Counters describing the activity of an <see cref="EventLoopWorkQueue" />.
+/// Latencies are measured from enqueue to the start of the work handler.
+/// </summary>
+typedef struct {
+    size_t depth;
+    size_t maxDepth;
+    uint32_t enqueued;
+    uint32_t executed;
+    uint32_t dropped;
+    uint32_t lastLatencyUs;
+    uint32_t maxLatencyUs;
+} EventLoopWorkQueueStats;
+
+/// <summary>
+/// Create a bounded queue of deferred work items. Enqueued items are run, in order,
+/// on a later iteration of the event loop. This allows callbacks which must return
+/// quickly (such as Azure IoT SDK callbacks) to hand work back to the event loop.
+/// </summary>
+/// <param name="eventLoop">Event loop on which the work will be run.</param>
+/// <returns>On success, pointer to new EventLoopWorkQueue, which should be disposed of
+/// with <see cref="DisposeEventLoopWorkQueue" />. On failure, returns NULL, with more
+/// information available in errno.</returns>
+EventLoopWorkQueue *CreateEventLoopWorkQueue(EventLoop *eventLoop);
+
+/// <summary>
+/// Dispose of a work queue which was allocated with <see cref="CreateEventLoopWorkQueue" />.
+/// Pending work items are discarded. It is safe to call this function with a NULL pointer.
+/// </summary>
+/// <param name="queue">Successfully allocated work queue, or NULL.</param>
+void DisposeEventLoopWorkQueue(EventLoopWorkQueue *queue);
+
+/// <summary>
+/// Add a work item to the queue. The handler is invoked on the next event loop
+/// iteration, never from within this call.
+/// </summary>
+/// <param name="queue">Successfully allocated work queue.</param>
+/// <param name="handler">Function to invoke on the event loop.</param>
+/// <param name="context">Value passed to the handler.</param>
+/// <returns>0 on success; -1 if the queue is full or could not be signalled, in which
+/// case errno contains more information.</returns>
+int EnqueueEventLoopWork(EventLoopWorkQueue *queue, EventLoopWorkHandler handler, void *context);
+
+/// <summary>
+/// Read the current depth and latency counters of a work queue.
+/// </summary>
+/// <param name="queue">Successfully allocated work queue.</param>
+/// <param name="stats">Receives the counters.</param>
+void GetEventLoopWorkQueueStats(const EventLoopWorkQueue *queue, EventLoopWorkQueueStats *stats);
@@ -2,48 +2,115 @@
 #include <unistd.h>
 #include <stdbool.h>
 #include <string.h>
-#include <time.h>
 
 #include <applibs/i2c.h>
-#include <applibs/log.h>
 
 #include "i2c_motor_driver.h"
 #include "hw/joyitcar_appliance.h"
+#include "eventloop_timer_utilities.h"
+#include "logger.h"
+#include "metrics.h"
+#include "motor_ramp.h"
+#include "utils.h"
 
 static uint8_t _buffer[3];
 static int i2cFd = -1;
 
-typedef enum MotorChannel {
-    MOTOR_CHA = 0,
-    MOTOR_CHB = 1,
-} MotorChannel;
+static MotorDriverState motorDriverState;
+static uint64_t lastWriteAtUs = 0;
 
-I2CMotorDriverExitCode JoyitCar_InitMotors(void)
+static int motorSpeed = DEFAULT_MOTOR_SPEED;
+
+static MotorStateChangedHandler motorStateChangedHandler = NULL;
+static MotorTargetReachedHandler motorTargetReachedHandler = NULL;
+
+static const struct timespec rampPeriod = {.tv_sec = 0, .tv_nsec = MOTOR_RAMP_PERIOD_US * 1000};
+
+static EventLoopTimer *rampTimer = NULL;
+static bool rampRunning = false;
+static MotorRampLimits rampLimits;
+static const MotorRampLimits unrampedLimits = {.maxAccelQ8 = 0, .maxJerkQ8 = 0};
+
+// Target and ramp of each channel, and the speed of the last frame written to it. A failed
+// frame is invalid and written again once its back-off has elapsed.
+static int targetSpeeds[MOTOR_CHANNEL_COUNT];
+static MotorRamp channelRamps[MOTOR_CHANNEL_COUNT];
+static int frameSpeeds[MOTOR_CHANNEL_COUNT];
+static bool frameValid[MOTOR_CHANNEL_COUNT];
+static uint32_t writeFailures[MOTOR_CHANNEL_COUNT];
+static uint32_t backoffTicks[MOTOR_CHANNEL_COUNT];
+
+/// <summary>
+///     Records the outcome of a command on a channel and notifies the handler of changes.
+/// </summary>
+static void UpdateChannelState(MotorChannel channel, int direction, int speed, bool failed)
+{
+    MotorChannelState *state = &motorDriverState.channels[channel];
+    bool changed = failed || state->direction != direction || state->speed != speed;
+
+    lastWriteAtUs = GetMonotonicMicroseconds();
+    motorDriverState.i2cWrites++;
+    Metrics_Increment(MetricCounter_I2cWrites);
+    state->direction = direction;
+    state->speed = speed;
+
+    if (failed)
+    {
+        motorDriverState.i2cErrors++;
+        Metrics_Increment(MetricCounter_I2cErrors);
+    }
+
+    if (changed && motorStateChangedHandler != NULL)
+    {
+        motorStateChangedHandler(&motorDriverState);
+    }
+}
+
+static void RampTimerEventHandler(EventLoopTimer *timer);
+
+I2CMotorDriverExitCode JoyitCar_InitMotors(EventLoop *eventLoop)
 {
     i2cFd = I2CMaster_Open(I2C_MOTOR_DRIVER);
     if (i2cFd == -1) {
-        Log_Debug("ERROR: I2CMaster_Open: errno=%d (%s)\n", errno, strerror(errno));
+        LOG_ERROR("I2CMaster_Open: errno=%d (%s)\n", errno, strerror(errno));
         return I2CMotorDriver_ExitCode_Init_OpenMaster;
     }
 
 
     int result = I2CMaster_SetBusSpeed(i2cFd, I2C_BUS_SPEED_STANDARD);
     if (result != 0) {
-        Log_Debug("ERROR: I2CMaster_SetBusSpeed: errno=%d (%s)\n", errno, strerror(errno));
+        LOG_ERROR("I2CMaster_SetBusSpeed: errno=%d (%s)\n", errno, strerror(errno));
         return I2CMotorDriver_ExitCode_Init_SetBusSpeed;
     }
 
     result = I2CMaster_SetTimeout(i2cFd, 100);
     if (result != 0) {
-        Log_Debug("ERROR: I2CMaster_SetTimeout: errno=%d (%s)\n", errno, strerror(errno));
+        LOG_ERROR("I2CMaster_SetTimeout: errno=%d (%s)\n", errno, strerror(errno));
         return I2CMotorDriver_ExitCode_Init_SetTimeout;
     }
 
+    rampTimer = CreateEventLoopDisarmedTimer(eventLoop, &RampTimerEventHandler);
+    if (rampTimer == NULL)
+    {
+        return I2CMotorDriver_ExitCode_Init_RampTimer;
+    }
+
+    JoyitCar_SetMotorRampLimits(MOTOR_RAMP_DEFAULT_ACCELERATION, MOTOR_RAMP_DEFAULT_JERK);
+
     return I2CMotorDriver_ExitCode_Success;
 }
 
+void JoyitCar_StopMotorRamp(void)
+{
+    JoyitCar_EmergencyBrake();
+
+    DisposeEventLoopTimer(rampTimer);
+    rampTimer = NULL;
+    rampRunning = false;
+}
+
 void JoyitCar_CloseMotors(void)
-{    
+{
     if (i2cFd == -1)
     {
         return;
@@ -52,11 +119,11 @@ void JoyitCar_CloseMotors(void)
     int result = close(i2cFd);
 
     if (result != 0) {
-        Log_Debug("ERROR: Could not close fd I2CMaster: %s (%d).\n", strerror(errno), errno);
+        LOG_ERROR("Could not close fd I2CMaster: %s (%d).\n", strerror(errno), errno);
     }
 }
 
-static void JoyitCar_StartMotor(MotorChannel channel, int speed)
+static bool JoyitCar_StartMotor(MotorChannel channel, int speed)
 {
     if(speed > 0)
     {
@@ -71,87 +138,273 @@ static void JoyitCar_StartMotor(MotorChannel channel, int speed)
 
     _buffer[1] = channel;
 
-    Log_Debug("INFO: Starting (%d) motor %d with speed %d\n", _buffer[0], channel, _buffer[2]);
+    LOG_DEFERRED_DEBUG("Starting (%d) motor %d with speed %d\n", _buffer[0], channel, _buffer[2]);
 
     ssize_t written = I2CMaster_Write(i2cFd, GROVE_MOTOR_DRIVER_DEFAULT_I2C_ADDR, _buffer, sizeof(_buffer));
 
+    UpdateChannelState(channel, speed > 0 ? 1 : -1, _buffer[2], written < 0);
+
     if (written < 0)
     {
-        Log_Debug("ERROR: Failed to write to I2C (0x%d). Writing %d bytes ...\n", GROVE_MOTOR_DRIVER_DEFAULT_I2C_ADDR, sizeof(_buffer));
+        LOG_DEFERRED_ERROR("Failed to write to I2C (0x%x). Writing %d bytes ...\n", GROVE_MOTOR_DRIVER_DEFAULT_I2C_ADDR, (int)sizeof(_buffer));
     }
+
+    return written >= 0;
 }
 
-static void JoyitCar_StopMotor(MotorChannel channel)
+static bool JoyitCar_StopMotor(MotorChannel channel)
 {
     _buffer[0] = GROVE_MOTOR_DRIVER_I2C_CMD_STOP;
     _buffer[1] = channel;
 
-    Log_Debug("INFO: Stoping motor %d\n", channel);
+    LOG_DEFERRED_DEBUG("Stoping motor %d\n", channel);
 
     ssize_t written = I2CMaster_Write(i2cFd, GROVE_MOTOR_DRIVER_DEFAULT_I2C_ADDR, _buffer, sizeof(_buffer) - 1);
 
+    UpdateChannelState(channel, 0, 0, written < 0);
+
     if (written < 0)
     {
-        Log_Debug("ERROR: Failed to write to I2C (0x%d). Writing %d bytes ...\n", GROVE_MOTOR_DRIVER_DEFAULT_I2C_ADDR, sizeof(_buffer) - 1);
+        LOG_DEFERRED_ERROR("Failed to write to I2C (0x%x). Writing %d bytes ...\n", GROVE_MOTOR_DRIVER_DEFAULT_I2C_ADDR, (int)sizeof(_buffer) - 1);
+    }
+
+    return written >= 0;
+}
+
+/// <summary>
+///     Writes a speed frame to a channel: a start at the speed, or a stop for 0. A failure
+///     starts the back-off of the channel, or gives it up after too many in a row.
+/// </summary>
+static void WriteFrame(MotorChannel channel, int speed)
+{
+    bool written = speed == 0 ? JoyitCar_StopMotor(channel) : JoyitCar_StartMotor(channel, speed);
+
+    frameSpeeds[channel] = speed;
+    frameValid[channel] = written;
+
+    if (written)
+    {
+        writeFailures[channel] = 0;
+        return;
+    }
+
+    writeFailures[channel]++;
+    backoffTicks[channel] = MOTOR_RAMP_RETRY_BACKOFF_TICKS << (writeFailures[channel] - 1);
+
+    if (writeFailures[channel] == MOTOR_RAMP_MAX_WRITE_FAILURES)
+    {
+        motorDriverState.rampAborts++;
+        Metrics_Increment(MetricCounter_MotorRampAborts);
+        LOG_DEFERRED_ERROR("Motor %d given up after %d failed writes, until its next command.\n",
+                           channel, MOTOR_RAMP_MAX_WRITE_FAILURES);
+    }
+}
+
+/// <summary>
+///     Moves each channel one tick along its ramp. A frame is written once the speed moved
+///     by MOTOR_RAMP_FRAME_STEP since the last one, or reached the target; the intermediate
+///     speeds are not written. A channel waiting to write a failed frame again holds its
+///     speed. The timer stops once every channel runs at its target or was given up.
+/// </summary>
+static void StepRamps(void)
+{
+    bool settled = true;
+
+    for (int channel = 0; channel < MOTOR_CHANNEL_COUNT; channel++)
+    {
+        if (writeFailures[channel] >= MOTOR_RAMP_MAX_WRITE_FAILURES)
+        {
+            continue;
+        }
+
+        if (!frameValid[channel] && backoffTicks[channel] > 0 && rampTimer != NULL)
+        {
+            backoffTicks[channel]--;
+            settled = false;
+            continue;
+        }
+
+        int target = targetSpeeds[channel];
+        // Without the ramp timer to take the next steps, the target is written at once.
+        int speed = MotorRamp_Step(&channelRamps[channel], target,
+                                   rampTimer != NULL ? &rampLimits : &unrampedLimits);
+        int moved = speed - frameSpeeds[channel];
+
+        if (!frameValid[channel] ||
+            (moved != 0 && (speed == target || moved >= MOTOR_RAMP_FRAME_STEP ||
+                            moved <= -MOTOR_RAMP_FRAME_STEP)))
+        {
+            WriteFrame((MotorChannel)channel, speed);
+        }
+
+        settled = settled && speed == target && frameValid[channel] &&
+                  frameSpeeds[channel] == target;
+    }
+
+    if (settled)
+    {
+        if (rampTimer != NULL)
+        {
+            DisarmEventLoopTimer(rampTimer);
+        }
+        rampRunning = false;
+
+        if (motorTargetReachedHandler != NULL)
+        {
+            motorTargetReachedHandler(lastWriteAtUs);
+        }
+    }
+}
+
+static void RampTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0)
+    {
+        exitCode = I2CMotorDriver_ExitCode_RampTimer_Consume;
+        return;
+    }
+
+    StepRamps();
+}
+
+static int ClampSpeed(int speed)
+{
+    if (speed > 255)
+    {
+        return 255;
+    }
+
+    if (speed < -255)
+    {
+        return -255;
+    }
+
+    return speed;
+}
+
+/// <summary>
+///     Sets the target speeds and takes the first step at once; the ramp timer takes the
+///     next ones. Without a ramp timer, or with ramping disabled, the targets are written.
+/// </summary>
+static void SetTargetSpeeds(int speedA, int speedB)
+{
+    targetSpeeds[MOTOR_CHA] = ClampSpeed(speedA);
+    targetSpeeds[MOTOR_CHB] = ClampSpeed(speedB);
+
+    // A new command tries again a channel which was given up.
+    for (int channel = 0; channel < MOTOR_CHANNEL_COUNT; channel++)
+    {
+        if (writeFailures[channel] >= MOTOR_RAMP_MAX_WRITE_FAILURES)
+        {
+            writeFailures[channel] = 0;
+            backoffTicks[channel] = 0;
+        }
+    }
+
+    // A running ramp picks the new targets up on its next tick.
+    if (rampRunning)
+    {
+        return;
+    }
+
+    rampRunning = true;
+    StepRamps();
+
+    if (!rampRunning)
+    {
+        return;
+    }
+
+    if (rampTimer != NULL)
+    {
+        SetEventLoopTimerPeriod(rampTimer, &rampPeriod);
+    }
+    else
+    {
+        rampRunning = false;
     }
 }
 
 void JoyitCar_GoForward(void)
 {
-    JoyitCar_StartMotor(MOTOR_CHA, DEFAULT_MOTOR_SPEED);
-    JoyitCar_StartMotor(MOTOR_CHB, DEFAULT_MOTOR_SPEED);
+    SetTargetSpeeds(motorSpeed, motorSpeed);
 }
 
 void JoyitCar_GoBackward(void)
 {
-    JoyitCar_StartMotor(MOTOR_CHA, -DEFAULT_MOTOR_SPEED);
-    JoyitCar_StartMotor(MOTOR_CHB, -DEFAULT_MOTOR_SPEED);
+    SetTargetSpeeds(-motorSpeed, -motorSpeed);
 }
 
 void JoyitCar_TurnLeft(void)
 {
-    JoyitCar_StartMotor(MOTOR_CHA, -DEFAULT_MOTOR_SPEED);
-    JoyitCar_StartMotor(MOTOR_CHB, DEFAULT_MOTOR_SPEED);
+    SetTargetSpeeds(-motorSpeed, motorSpeed);
 }
 
 void JoyitCar_TurnRight(void)
 {
-    JoyitCar_StartMotor(MOTOR_CHA, DEFAULT_MOTOR_SPEED);
-    JoyitCar_StartMotor(MOTOR_CHB, -DEFAULT_MOTOR_SPEED);
+    SetTargetSpeeds(motorSpeed, -motorSpeed);
 }
 
 void JoyitCar_Break(void)
 {
-    JoyitCar_StopMotor(MOTOR_CHA);
-    JoyitCar_StopMotor(MOTOR_CHB);
+    SetTargetSpeeds(0, 0);
+}
+
+void JoyitCar_EmergencyBrake(void)
+{
+    if (rampTimer != NULL)
+    {
+        DisarmEventLoopTimer(rampTimer);
+    }
+    rampRunning = false;
+
+    for (int channel = 0; channel < MOTOR_CHANNEL_COUNT; channel++)
+    {
+        MotorRamp_Reset(&channelRamps[channel], 0);
+        WriteFrame((MotorChannel)channel, 0);
+    }
+
+    // Only a failed stop frame is written again, by the ramp timer.
+    SetTargetSpeeds(0, 0);
+}
+
+void JoyitCar_DriveChannel(MotorChannel channel, int speed)
+{
+    SetTargetSpeeds(channel == MOTOR_CHA ? speed : targetSpeeds[MOTOR_CHA],
+                    channel == MOTOR_CHB ? speed : targetSpeeds[MOTOR_CHB]);
 }
 
-void JoyitCar_StartDemo(void)
+void JoyitCar_Drive(int leftSpeed, int rightSpeed)
 {
-    struct timespec wait = {.tv_nsec = 250000000};
+    SetTargetSpeeds(leftSpeed, rightSpeed);
+}
 
-    JoyitCar_GoForward();
-    sleep(1);
-    JoyitCar_Break();
-    nanosleep(&wait, &wait);
+void JoyitCar_GetMotorDriverState(MotorDriverState *state)
+{
+    *state = motorDriverState;
+}
 
-    JoyitCar_GoBackward();
-    sleep(1);
-    JoyitCar_Break();
-    nanosleep(&wait, &wait);
+uint64_t JoyitCar_GetLastI2cWriteMicroseconds(void)
+{
+    return lastWriteAtUs;
+}
+
+void JoyitCar_SetMotorStateChangedHandler(MotorStateChangedHandler handler)
+{
+    motorStateChangedHandler = handler;
+}
 
-    JoyitCar_TurnRight();
-    nanosleep(&wait, &wait);
-    JoyitCar_Break();
-    nanosleep(&wait, &wait);
+void JoyitCar_SetMotorTargetReachedHandler(MotorTargetReachedHandler handler)
+{
+    motorTargetReachedHandler = handler;
+}
 
-    JoyitCar_TurnLeft();
-    nanosleep(&wait, &wait);
-    nanosleep(&wait, &wait);
-    JoyitCar_Break();
-    nanosleep(&wait, &wait);
+void JoyitCar_SetMotorSpeed(int speed)
+{
+    motorSpeed = speed;
+}
 
-    JoyitCar_TurnRight();
-    nanosleep(&wait, &wait);
-    JoyitCar_Break();
-}
\ No newline at end of file
+void JoyitCar_SetMotorRampLimits(uint32_t accelPerSecond, uint32_t jerkPerSecond2)
+{
+    MotorRamp_SetLimits(&rampLimits, accelPerSecond, jerkPerSecond2, MOTOR_RAMP_PERIOD_US);
+}
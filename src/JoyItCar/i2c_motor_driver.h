@@ -1,5 +1,9 @@
 #pragma once
 
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+
 #define GROVE_MOTOR_DRIVER_DEFAULT_I2C_ADDR         0x14
 
 #define GROVE_MOTOR_DRIVER_I2C_CMD_BRAKE            0x00
@@ -15,15 +19,79 @@
 
 #define DEFAULT_MOTOR_SPEED 100
 
+#define MOTOR_CHANNEL_COUNT 2
+
+// Speed ramp: ticked at 100 Hz, with limits in speed units per second and per second squared.
+#define MOTOR_RAMP_PERIOD_US 10000
+#define MOTOR_RAMP_DEFAULT_ACCELERATION 2000
+#define MOTOR_RAMP_DEFAULT_JERK 20000
+
+// Smallest change of speed written as an intermediate frame of a ramp.
+#define MOTOR_RAMP_FRAME_STEP 8
+
+// Each write may block for the whole I2C timeout: a failed frame is written again after a
+// back-off in ramp ticks, doubled on each consecutive failure, and after that many failures
+// the channel is given up until its next command.
+#define MOTOR_RAMP_RETRY_BACKOFF_TICKS 5
+#define MOTOR_RAMP_MAX_WRITE_FAILURES 3
+
+typedef enum MotorChannel {
+    MOTOR_CHA = 0,
+    MOTOR_CHB = 1,
+} MotorChannel;
+
+/// <summary>
+///     Last commanded state of a motor channel.
+///     direction is 1 for clockwise, -1 for counter-clockwise and 0 when stopped.
+/// </summary>
+typedef struct
+{
+    int direction;
+    int speed;
+} MotorChannelState;
+
+/// <summary>
+///     Snapshot of the motor driver: per channel state and I2C bus counters. rampAborts
+///     counts the channels given up after MOTOR_RAMP_MAX_WRITE_FAILURES failed frames.
+/// </summary>
+typedef struct
+{
+    MotorChannelState channels[MOTOR_CHANNEL_COUNT];
+    uint32_t i2cWrites;
+    uint32_t i2cErrors;
+    uint32_t rampAborts;
+} MotorDriverState;
+
+/// <summary>
+///     Invoked after a motor command changed the state of a channel or failed on the bus.
+/// </summary>
+typedef void (*MotorStateChangedHandler)(const MotorDriverState *state);
+
+/// <summary>
+///     Invoked once the ramp stops, every channel running at its target or given up after
+///     failed writes, with the time at which the last frame was written, as
+///     <see cref="JoyitCar_GetLastI2cWriteMicroseconds" />. A target which needs no frame is
+///     reached at once, at the time of an earlier write.
+/// </summary>
+typedef void (*MotorTargetReachedHandler)(uint64_t lastWriteAtUs);
+
 typedef enum
 {
     I2CMotorDriver_ExitCode_Success = 200,
     I2CMotorDriver_ExitCode_Init_OpenMaster = 201,
     I2CMotorDriver_ExitCode_Init_SetBusSpeed = 202,
     I2CMotorDriver_ExitCode_Init_SetTimeout = 203,
+    I2CMotorDriver_ExitCode_Init_RampTimer = 204,
+    I2CMotorDriver_ExitCode_RampTimer_Consume = 205,
 } I2CMotorDriverExitCode;
 
-I2CMotorDriverExitCode JoyitCar_InitMotors(void);
+I2CMotorDriverExitCode JoyitCar_InitMotors(EventLoop *eventLoop);
+
+/// <summary>
+///     Stops both channels without ramping and disposes the ramp timer. Must be called
+///     before the event loop is closed; the motors are then written without ramping.
+/// </summary>
+void JoyitCar_StopMotorRamp(void);
 
 void JoyitCar_CloseMotors(void);
 
@@ -35,6 +103,47 @@ void JoyitCar_TurnLeft(void);
 
 void JoyitCar_TurnRight(void);
 
+/// <summary>
+///     Stops both channels along the deceleration ramp.
+/// </summary>
 void JoyitCar_Break(void);
 
-void JoyitCar_StartDemo(void);
\ No newline at end of file
+/// <summary>
+///     Stops both channels at once, bypassing the ramp.
+/// </summary>
+void JoyitCar_EmergencyBrake(void);
+
+/// <summary>
+///     Drives each side independently, from -255 (full backward) to 255 (full forward).
+///     Channel A is the left side, channel B the right side; 0 stops the side. Like the
+///     maneuvers, the speeds are reached along the ramp.
+/// </summary>
+void JoyitCar_Drive(int leftSpeed, int rightSpeed);
+
+/// <summary>
+///     Drives one channel, from -255 to 255; 0 stops it.
+/// </summary>
+void JoyitCar_DriveChannel(MotorChannel channel, int speed);
+
+void JoyitCar_GetMotorDriverState(MotorDriverState *state);
+
+/// <summary>
+///     Monotonic time, as GetMonotonicMicroseconds(), at which the last I2C write to the
+///     driver completed, successfully or not; 0 before the first write.
+/// </summary>
+uint64_t JoyitCar_GetLastI2cWriteMicroseconds(void);
+
+void JoyitCar_SetMotorStateChangedHandler(MotorStateChangedHandler handler);
+
+void JoyitCar_SetMotorTargetReachedHandler(MotorTargetReachedHandler handler);
+
+/// <summary>
+///     Sets the speed used by the maneuvers, from 1 to 255. Defaults to DEFAULT_MOTOR_SPEED.
+/// </summary>
+void JoyitCar_SetMotorSpeed(int speed);
+
+/// <summary>
+///     Sets the limits of the speed ramp, in speed units per second and per second squared.
+///     A zero acceleration disables ramping: speeds are written as commanded.
+/// </summary>
+void JoyitCar_SetMotorRampLimits(uint32_t accelPerSecond, uint32_t jerkPerSecond2);
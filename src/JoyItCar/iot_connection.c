@@ -0,0 +1,479 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+#include <applibs/application.h>
+#include <applibs/networking.h>
+
+// Azure IoT SDK
+#include <azure_sphere_provisioning.h>
+#include <iothub_security_factory.h>
+#include <iothubtransportmqtt.h>
+#include <azure_prov_client/prov_device_ll_client.h>
+#include <azure_prov_client/prov_security_factory.h>
+#include <azure_prov_client/prov_transport_mqtt_client.h>
+
+#include "utils.h"
+#include "eventloop_timer_utilities.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include "iot_connection.h"
+
+/// <summary>
+///     Connection state; every state but Connected has the connection timer armed.
+/// </summary>
+typedef enum
+{
+    /// <summary>Polling until the network and device authentication are ready.</summary>
+    ConnectionState_WaitingForNetwork = 0,
+    /// <summary>Waiting for the back-off delay before the next attempt.</summary>
+    ConnectionState_WaitingToConnect = 1,
+    /// <summary>DPS registration in progress, pumped by the connection timer.</summary>
+    ConnectionState_Provisioning = 2,
+    /// <summary>Client created, waiting for authentication.</summary>
+    ConnectionState_Connecting = 3,
+    /// <summary>Client authenticated by the IoT Hub.</summary>
+    ConnectionState_Connected = 4,
+    /// <summary>Connection lost; the client retries on its own for a while.</summary>
+    ConnectionState_Resuming = 5,
+    /// <summary>The client must be destroyed outside of its own callbacks.</summary>
+    ConnectionState_Disconnecting = 6,
+} ConnectionState;
+
+static const char networkInterface[] = "wlan0";
+static const char dpsGlobalEndpoint[] = "global.azure-devices-provisioning.net";
+
+// A constant used to direct the IoT SDK to use the DAA cert under the hood.
+static const int deviceIdForDaaCertUsage = 1;
+
+static const uint32_t NetworkPollPeriodMs = 1000;   // while offline, detect the network quickly
+static const uint32_t NetworkUpJitterMs = 2000;     // spread a fleet regaining the network
+static const uint32_t ProvisioningPumpPeriodMs = 100;
+static const int ProvisioningTimeoutSeconds = 20;
+static const uint32_t ConnectTimeoutMs = 30 * 1000; // authentication after client creation
+static const uint32_t ResumeTimeoutMs = 60 * 1000;  // client retries before it is recreated
+static const uint32_t MinRetryDelayMs = 1000;
+static const uint32_t BaseRetryDelayMs = 2000;
+static const uint32_t MaxRetryDelayMs = 10 * 60 * 1000;
+
+static EventLoopTimer *connectionTimer = NULL;
+static ConnectionState connectionState = ConnectionState_WaitingForNetwork;
+static const IoTConnectionHandlers *clientHandlers = NULL;
+static const char *dpsScopeId = NULL;
+
+static IOTHUB_DEVICE_CLIENT_LL_HANDLE client = NULL;
+static bool isIoTHubSecurityInitialized = false;
+
+static PROV_DEVICE_LL_HANDLE provisioningHandle = NULL;
+static bool isProvisioningComplete = false;
+static PROV_DEVICE_RESULT provisioningResult = PROV_DEVICE_RESULT_ERROR;
+
+// Hub assigned by DPS, reused on reconnect until the hub rejects the device.
+static char hubHostname[128];
+
+static uint32_t retryCount = 0;
+static uint32_t randomState = 0;
+static uint64_t disconnectedAtUs = 0;
+
+static IoTConnectionStats connectionStats;
+
+/// <summary>
+///     xorshift32: retry jitter only needs to differ between devices, not to be secure.
+/// </summary>
+static uint32_t NextRandom(void)
+{
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState;
+}
+
+static void ArmConnectionTimer(uint32_t delayMs)
+{
+    // A zero timerfd delay disarms the timer.
+    if (delayMs == 0)
+    {
+        delayMs = 1;
+    }
+
+    struct timespec delay = {.tv_sec = delayMs / 1000,
+                             .tv_nsec = (delayMs % 1000) * 1000 * 1000};
+    SetEventLoopTimerOneShot(connectionTimer, &delay);
+}
+
+/// <summary>
+///     Checks that the device is connected to the internet and can authenticate.
+/// </summary>
+static bool IsNetworkReady(void)
+{
+    Networking_InterfaceConnectionStatus status;
+    if (Networking_GetInterfaceConnectionStatus(networkInterface, &status) != 0)
+    {
+        if (errno != EAGAIN)
+        {
+            LOG_ERROR("Networking_GetInterfaceConnectionStatus: %d (%s)\n", errno,
+                      strerror(errno));
+            exitCode = IoTConnection_ExitCode_InterfaceConnectionStatus_Failed;
+        }
+
+        return false;
+    }
+
+    bool isDeviceAuthReady = false;
+    return (status & Networking_InterfaceConnectionStatus_ConnectedToInternet) &&
+           Application_IsDeviceAuthReady(&isDeviceAuthReady) == 0 && isDeviceAuthReady;
+}
+
+static void DestroyClient(void)
+{
+    if (client == NULL)
+    {
+        return;
+    }
+
+    clientHandlers->clientDestroying();
+    IoTHubDeviceClient_LL_Destroy(client);
+    client = NULL;
+}
+
+static void EndProvisioning(void)
+{
+    if (provisioningHandle == NULL)
+    {
+        return;
+    }
+
+    Prov_Device_LL_Destroy(provisioningHandle);
+    provisioningHandle = NULL;
+    prov_dev_security_deinit();
+}
+
+/// <summary>
+///     Waits a random delay between 0 and an exponentially growing ceiling (full jitter),
+///     so that devices failing together do not retry together.
+/// </summary>
+static void ScheduleRetry(void)
+{
+    uint32_t ceilingMs = MaxRetryDelayMs;
+    if (retryCount < 20 && (BaseRetryDelayMs << retryCount) < MaxRetryDelayMs)
+    {
+        ceilingMs = BaseRetryDelayMs << retryCount;
+    }
+
+    uint32_t delayMs = NextRandom() % (ceilingMs + 1);
+    if (delayMs < MinRetryDelayMs)
+    {
+        delayMs = MinRetryDelayMs;
+    }
+
+    retryCount++;
+    connectionStats.nextRetryMs = delayMs;
+    connectionState = ConnectionState_WaitingToConnect;
+    ArmConnectionTimer(delayMs);
+
+    LOG_INFO("IoT Hub connection attempt %u failed - will retry in %u ms.\n", retryCount,
+             delayMs);
+}
+
+static void FailAttempt(void)
+{
+    connectionStats.failures++;
+    Metrics_Increment(MetricCounter_IoTFailures);
+    EndProvisioning();
+    DestroyClient();
+    ScheduleRetry();
+}
+
+/// <summary>
+///     Creates the IoT Hub client for the cached hub hostname, authenticating with the device
+///     certificate.
+/// </summary>
+static void CreateClient(void)
+{
+    if (!isIoTHubSecurityInitialized)
+    {
+        int result = iothub_security_init(IOTHUB_SECURITY_TYPE_X509);
+        if (result != 0)
+        {
+            LOG_ERROR("iothub_security_init failed with error %d.\n", result);
+            FailAttempt();
+            return;
+        }
+
+        isIoTHubSecurityInitialized = true;
+    }
+
+    client = IoTHubDeviceClient_LL_CreateWithAzureSphereFromDeviceAuth(hubHostname, MQTT_Protocol);
+    if (client == NULL)
+    {
+        LOG_ERROR("Could not create the IoT Hub client for %s.\n", hubHostname);
+        FailAttempt();
+        return;
+    }
+
+    if (IoTHubDeviceClient_LL_SetOption(client, "SetDeviceId", &deviceIdForDaaCertUsage) !=
+        IOTHUB_CLIENT_OK)
+    {
+        LOG_ERROR("Failure setting Azure IoT Hub client option \"SetDeviceId\".\n");
+        IoTHubDeviceClient_LL_Destroy(client);
+        client = NULL;
+        FailAttempt();
+        return;
+    }
+
+    clientHandlers->clientCreated(client);
+
+    connectionState = ConnectionState_Connecting;
+    ArmConnectionTimer(ConnectTimeoutMs);
+}
+
+/// <summary>
+///     Callback invoked from Prov_Device_LL_DoWork() when the DPS registration completes.
+/// </summary>
+static void RegisterDeviceCallback(PROV_DEVICE_RESULT registerResult, const char *iothubUri,
+                                   const char *deviceId, void *userContext)
+{
+    isProvisioningComplete = true;
+    provisioningResult = registerResult;
+
+    if (registerResult == PROV_DEVICE_RESULT_OK && iothubUri != NULL &&
+        strlen(iothubUri) < sizeof(hubHostname))
+    {
+        strcpy(hubHostname, iothubUri);
+    }
+}
+
+/// <summary>
+///     Starts an asynchronous DPS registration; the connection timer pumps it.
+/// </summary>
+static void StartProvisioning(void)
+{
+    int result = prov_dev_security_init(SECURE_DEVICE_TYPE_X509);
+    if (result != 0)
+    {
+        LOG_ERROR("prov_dev_security_init failed with error %d.\n", result);
+        FailAttempt();
+        return;
+    }
+
+    provisioningHandle =
+        Prov_Device_LL_Create(dpsGlobalEndpoint, dpsScopeId, Prov_Device_MQTT_Protocol);
+    if (provisioningHandle == NULL)
+    {
+        LOG_ERROR("Prov_Device_LL_Create returned NULL.\n");
+        prov_dev_security_deinit();
+        FailAttempt();
+        return;
+    }
+
+    isProvisioningComplete = false;
+
+    if (Prov_Device_LL_SetOption(provisioningHandle, PROV_OPTION_TIMEOUT,
+                                 &ProvisioningTimeoutSeconds) != PROV_DEVICE_RESULT_OK ||
+        Prov_Device_LL_SetOption(provisioningHandle, "SetDeviceId", &deviceIdForDaaCertUsage) !=
+            PROV_DEVICE_RESULT_OK ||
+        Prov_Device_LL_Register_Device(provisioningHandle, RegisterDeviceCallback, NULL, NULL,
+                                       NULL) != PROV_DEVICE_RESULT_OK)
+    {
+        LOG_ERROR("Could not start the DPS registration.\n");
+        FailAttempt();
+        return;
+    }
+
+    connectionState = ConnectionState_Provisioning;
+    ArmConnectionTimer(ProvisioningPumpPeriodMs);
+}
+
+/// <summary>
+///     Pumps the DPS registration, then connects to the assigned hub.
+/// </summary>
+static void PumpProvisioning(void)
+{
+    Prov_Device_LL_DoWork(provisioningHandle);
+
+    if (!isProvisioningComplete)
+    {
+        ArmConnectionTimer(ProvisioningPumpPeriodMs);
+        return;
+    }
+
+    EndProvisioning();
+
+    if (provisioningResult != PROV_DEVICE_RESULT_OK || hubHostname[0] == '\0')
+    {
+        LOG_ERROR("DPS registration failed with result %d.\n", provisioningResult);
+        hubHostname[0] = '\0';
+        FailAttempt();
+        return;
+    }
+
+    connectionStats.provisionings++;
+    LOG_INFO("DPS assigned IoT Hub %s.\n", hubHostname);
+
+    CreateClient();
+}
+
+/// <summary>
+///     Connects through the cached hub hostname when there is one, else through DPS.
+/// </summary>
+static void StartAttempt(void)
+{
+    if (!IsNetworkReady())
+    {
+        connectionState = ConnectionState_WaitingForNetwork;
+        ArmConnectionTimer(NetworkPollPeriodMs);
+        return;
+    }
+
+    connectionStats.attempts++;
+
+    if (hubHostname[0] != '\0')
+    {
+        connectionStats.fastPathConnects++;
+        CreateClient();
+        return;
+    }
+
+    StartProvisioning();
+}
+
+static void ConnectionTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0)
+    {
+        exitCode = IoTConnection_ExitCode_ConnectionTimer_Consume;
+        return;
+    }
+
+    switch (connectionState)
+    {
+    case ConnectionState_WaitingForNetwork:
+        if (IsNetworkReady())
+        {
+            connectionState = ConnectionState_WaitingToConnect;
+            ArmConnectionTimer(NextRandom() % NetworkUpJitterMs);
+        }
+        else
+        {
+            ArmConnectionTimer(NetworkPollPeriodMs);
+        }
+        break;
+
+    case ConnectionState_WaitingToConnect:
+        StartAttempt();
+        break;
+
+    case ConnectionState_Provisioning:
+        PumpProvisioning();
+        break;
+
+    case ConnectionState_Connecting:
+        // The cached hub may be stale: the next attempt goes through DPS.
+        LOG_ERROR("IoT Hub authentication timed out.\n");
+        hubHostname[0] = '\0';
+        FailAttempt();
+        break;
+
+    case ConnectionState_Resuming:
+        LOG_WARNING("IoT Hub connection was not resumed - recreating the client.\n");
+        FailAttempt();
+        break;
+
+    case ConnectionState_Disconnecting:
+        FailAttempt();
+        break;
+
+    case ConnectionState_Connected:
+        break;
+    }
+}
+
+IoTConnection_ExitCode IoTConnection_Init(EventLoop *eventLoop, const char *scopeId,
+                                          const IoTConnectionHandlers *handlers)
+{
+    dpsScopeId = scopeId;
+    clientHandlers = handlers;
+
+    // Seed the jitter from both clocks, so that devices booted together still differ.
+    struct timespec realtime, monotonic;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    clock_gettime(CLOCK_MONOTONIC, &monotonic);
+    randomState = (uint32_t)(realtime.tv_nsec ^ monotonic.tv_nsec ^ realtime.tv_sec) | 1;
+
+    connectionTimer = CreateEventLoopDisarmedTimer(eventLoop, &ConnectionTimerEventHandler);
+    if (connectionTimer == NULL)
+    {
+        return IoTConnection_ExitCode_Init_ConnectionTimer;
+    }
+
+    connectionState = ConnectionState_WaitingForNetwork;
+    ArmConnectionTimer(1);
+
+    return IoTConnection_ExitCode_Success;
+}
+
+void IoTConnection_OnStatus(IOTHUB_CLIENT_CONNECTION_STATUS result,
+                            IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
+{
+    if (result == IOTHUB_CLIENT_CONNECTION_AUTHENTICATED)
+    {
+        if (disconnectedAtUs != 0)
+        {
+            uint32_t reconnectMs = (uint32_t)((GetMonotonicMicroseconds() - disconnectedAtUs) / 1000);
+            connectionStats.lastReconnectMs = reconnectMs;
+            Metrics_Record(MetricHistogram_ReconnectMs, reconnectMs);
+            if (reconnectMs > connectionStats.maxReconnectMs)
+            {
+                connectionStats.maxReconnectMs = reconnectMs;
+            }
+
+            LOG_INFO("IoT Hub connection restored after %u ms.\n", reconnectMs);
+            disconnectedAtUs = 0;
+        }
+
+        connectionStats.connects++;
+        Metrics_Increment(MetricCounter_IoTConnects);
+        retryCount = 0;
+        connectionState = ConnectionState_Connected;
+        DisarmEventLoopTimer(connectionTimer);
+        return;
+    }
+
+    if (connectionState == ConnectionState_Connected)
+    {
+        connectionStats.disconnects++;
+        Metrics_Increment(MetricCounter_IoTDisconnects);
+        disconnectedAtUs = GetMonotonicMicroseconds();
+    }
+
+    switch (reason)
+    {
+    case IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL:
+    case IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED:
+        // The device may have been assigned to another hub: provision again.
+        hubHostname[0] = '\0';
+        // fall through
+    case IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN:
+    case IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED:
+        // The client cannot recover: destroy it from the timer, outside of DoWork.
+        connectionState = ConnectionState_Disconnecting;
+        ArmConnectionTimer(1);
+        break;
+
+    default:
+        // Transient: the client reconnects by itself, with the same hub.
+        if (connectionState == ConnectionState_Connected)
+        {
+            connectionState = ConnectionState_Resuming;
+            ArmConnectionTimer(ResumeTimeoutMs);
+        }
+        break;
+    }
+}
+
+void IoTConnection_GetStats(IoTConnectionStats *stats)
+{
+    *stats = connectionStats;
+}
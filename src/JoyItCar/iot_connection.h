@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+
+// Azure IoT SDK
+#include <iothub_device_client_ll.h>
+
+typedef enum
+{
+    IoTConnection_ExitCode_Success = 800,
+    IoTConnection_ExitCode_Init_ConnectionTimer = 801,
+    IoTConnection_ExitCode_ConnectionTimer_Consume = 802,
+    IoTConnection_ExitCode_InterfaceConnectionStatus_Failed = 803,
+} IoTConnection_ExitCode;
+
+/// <summary>
+///     Notifications to the owner of the IoT Hub client. clientCreated registers the client
+///     callbacks; clientDestroying drops every reference to the client before it is destroyed.
+/// </summary>
+typedef struct
+{
+    void (*clientCreated)(IOTHUB_DEVICE_CLIENT_LL_HANDLE client);
+    void (*clientDestroying)(void);
+} IoTConnectionHandlers;
+
+/// <summary>
+///     Connection counters. A reconnect is measured from the loss of an authenticated
+///     connection to the next authentication; fast-path connects skipped DPS by reusing the
+///     cached hub hostname.
+/// </summary>
+typedef struct
+{
+    uint32_t attempts;
+    uint32_t provisionings;
+    uint32_t fastPathConnects;
+    uint32_t failures;
+    uint32_t connects;
+    uint32_t disconnects;
+    uint32_t lastReconnectMs;
+    uint32_t maxReconnectMs;
+    uint32_t nextRetryMs;
+} IoTConnectionStats;
+
+/// <summary>
+///     Starts connecting to the IoT Hub assigned by DPS to this device, as soon as the network
+///     and device authentication are ready.
+/// </summary>
+IoTConnection_ExitCode IoTConnection_Init(EventLoop *eventLoop, const char *scopeId,
+                                          const IoTConnectionHandlers *handlers);
+
+/// <summary>
+///     Feeds the connection status reported by the IoT Hub client. It may be called from
+///     IoTHubDeviceClient_LL_DoWork(): the client is never destroyed from here.
+/// </summary>
+void IoTConnection_OnStatus(IOTHUB_CLIENT_CONNECTION_STATUS result,
+                            IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason);
+
+void IoTConnection_GetStats(IoTConnectionStats *stats);
@@ -0,0 +1,424 @@
+#include <string.h>
+
+#include "json_tokenizer.h"
+
+static bool IsWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static bool IsPrimitiveChar(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' ||
+           c == '.' || c == 'E';
+}
+
+int JsonTokenizer_Parse(const char *json, size_t length, JsonToken *tokens, size_t maxTokens)
+{
+    int stack[JSON_TOKENIZER_MAX_DEPTH];
+    int depth = 0;
+    int count = 0;
+    bool expectKey = false;
+
+    if (length > UINT16_MAX)
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < length; i++)
+    {
+        char c = json[i];
+
+        if (IsWhitespace(c) || c == ',')
+        {
+            continue;
+        }
+
+        if (c == ':')
+        {
+            expectKey = false;
+            continue;
+        }
+
+        if (c == '}' || c == ']')
+        {
+            JsonTokenType type = c == '}' ? JsonTokenType_Object : JsonTokenType_Array;
+            if (depth == 0 || tokens[stack[depth - 1]].type != type)
+            {
+                return -1;
+            }
+
+            tokens[stack[--depth]].end = (uint16_t)(i + 1);
+            expectKey = depth > 0 && tokens[stack[depth - 1]].type == JsonTokenType_Object;
+            continue;
+        }
+
+        if ((size_t)count == maxTokens)
+        {
+            return -1;
+        }
+
+        JsonToken *token = &tokens[count];
+        token->start = (uint16_t)i;
+        token->size = 0;
+
+        bool isKey = expectKey;
+
+        if (depth > 0 && !isKey)
+        {
+            // Keys are not counted: an object's size is its number of members.
+            tokens[stack[depth - 1]].size++;
+        }
+
+        if (c == '{' || c == '[')
+        {
+            if (isKey || depth == JSON_TOKENIZER_MAX_DEPTH)
+            {
+                return -1;
+            }
+
+            token->type = c == '{' ? JsonTokenType_Object : JsonTokenType_Array;
+            stack[depth++] = count;
+            expectKey = c == '{';
+        }
+        else if (c == '"')
+        {
+            token->type = JsonTokenType_String;
+            token->start = (uint16_t)(i + 1);
+
+            for (i++; i < length && json[i] != '"'; i++)
+            {
+                if (json[i] == '\\')
+                {
+                    i++;
+                }
+            }
+
+            if (i >= length)
+            {
+                return -1;
+            }
+
+            token->end = (uint16_t)i;
+            expectKey = false;
+        }
+        else if (IsPrimitiveChar(c) && !isKey)
+        {
+            token->type = JsonTokenType_Primitive;
+
+            while (i + 1 < length && IsPrimitiveChar(json[i + 1]))
+            {
+                i++;
+            }
+
+            token->end = (uint16_t)(i + 1);
+        }
+        else
+        {
+            return -1;
+        }
+
+        if (!isKey && token->type != JsonTokenType_Object && depth > 0)
+        {
+            expectKey = tokens[stack[depth - 1]].type == JsonTokenType_Object;
+        }
+
+        count++;
+    }
+
+    return depth == 0 ? count : -1;
+}
+
+int JsonTokenizer_Skip(const JsonToken *tokens, int count, int index)
+{
+    // Number of values still to skip; object members count twice (key and value).
+    int pending = 1;
+
+    while (pending > 0 && index < count)
+    {
+        const JsonToken *token = &tokens[index++];
+        pending--;
+
+        if (token->type == JsonTokenType_Object)
+        {
+            pending += 2 * token->size;
+        }
+        else if (token->type == JsonTokenType_Array)
+        {
+            pending += token->size;
+        }
+    }
+
+    return index;
+}
+
+int JsonTokenizer_FindMember(const char *json, const JsonToken *tokens, int count, int object,
+                             const char *key)
+{
+    if (object < 0 || object >= count || tokens[object].type != JsonTokenType_Object)
+    {
+        return -1;
+    }
+
+    int index = object + 1;
+
+    for (uint16_t member = 0; member < tokens[object].size && index + 1 < count; member++)
+    {
+        if (JsonTokenizer_Equals(json, &tokens[index], key))
+        {
+            return index + 1;
+        }
+
+        index = JsonTokenizer_Skip(tokens, count, index + 1);
+    }
+
+    return -1;
+}
+
+bool JsonTokenizer_Equals(const char *json, const JsonToken *token, const char *value)
+{
+    size_t length = strlen(value);
+
+    return (size_t)(token->end - token->start) == length &&
+           memcmp(json + token->start, value, length) == 0;
+}
+
+bool JsonTokenizer_GetInt(const char *json, const JsonToken *token, int64_t *value)
+{
+    if (token->type != JsonTokenType_Primitive)
+    {
+        return false;
+    }
+
+    uint16_t i = token->start;
+    bool negative = json[i] == '-';
+    if (negative)
+    {
+        i++;
+    }
+
+    if (i == token->end)
+    {
+        return false;
+    }
+
+    int64_t result = 0;
+    for (; i < token->end; i++)
+    {
+        char c = json[i];
+        if (c < '0' || c > '9' || result > (INT64_MAX - 9) / 10)
+        {
+            return false;
+        }
+
+        result = result * 10 + (c - '0');
+    }
+
+    *value = negative ? -result : result;
+    return true;
+}
+
+bool JsonTokenizer_GetBool(const char *json, const JsonToken *token, bool *value)
+{
+    if (token->type != JsonTokenType_Primitive)
+    {
+        return false;
+    }
+
+    if (JsonTokenizer_Equals(json, token, "true"))
+    {
+        *value = true;
+        return true;
+    }
+
+    if (JsonTokenizer_Equals(json, token, "false"))
+    {
+        *value = false;
+        return true;
+    }
+
+    return false;
+}
+
+static size_t SkipRawWhitespace(const char *json, size_t length, size_t i)
+{
+    while (i < length && IsWhitespace(json[i]))
+    {
+        i++;
+    }
+
+    return i;
+}
+
+/// <summary>
+///     Skips the string which starts at *i, leaving *i after its closing quote.
+/// </summary>
+static bool SkipRawString(const char *json, size_t length, size_t *i)
+{
+    for (size_t j = *i + 1; j < length; j++)
+    {
+        if (json[j] == '\\')
+        {
+            j++;
+        }
+        else if (json[j] == '"')
+        {
+            *i = j + 1;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/// <summary>
+///     Skips the value which starts at *i, leaving *i after it. Brackets are only balanced,
+///     not matched by type.
+/// </summary>
+static bool SkipRawValue(const char *json, size_t length, size_t *i)
+{
+    size_t j = *i;
+
+    if (j >= length)
+    {
+        return false;
+    }
+
+    if (json[j] == '"')
+    {
+        return SkipRawString(json, length, i);
+    }
+
+    if (json[j] == '{' || json[j] == '[')
+    {
+        size_t depth = 0;
+
+        while (j < length)
+        {
+            char c = json[j];
+
+            if (c == '"')
+            {
+                if (!SkipRawString(json, length, &j))
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            if (c == '{' || c == '[')
+            {
+                depth++;
+            }
+            else if ((c == '}' || c == ']') && --depth == 0)
+            {
+                *i = j + 1;
+                return true;
+            }
+
+            j++;
+        }
+
+        return false;
+    }
+
+    while (j < length && IsPrimitiveChar(json[j]))
+    {
+        j++;
+    }
+
+    if (j == *i)
+    {
+        return false;
+    }
+
+    *i = j;
+    return true;
+}
+
+int JsonTokenizer_NextRawMember(const char *json, size_t length, size_t *offset,
+                                JsonRawMember *member)
+{
+    size_t i = SkipRawWhitespace(json, length, *offset);
+
+    if (*offset == 0)
+    {
+        if (i >= length || json[i] != '{')
+        {
+            return -1;
+        }
+
+        i = SkipRawWhitespace(json, length, i + 1);
+    }
+    else if (i < length && json[i] == ',')
+    {
+        i = SkipRawWhitespace(json, length, i + 1);
+    }
+
+    if (i < length && json[i] == '}')
+    {
+        return 0;
+    }
+
+    if (i >= length || json[i] != '"')
+    {
+        return -1;
+    }
+
+    member->keyStart = i + 1;
+    if (!SkipRawString(json, length, &i))
+    {
+        return -1;
+    }
+    member->keyEnd = i - 1;
+
+    i = SkipRawWhitespace(json, length, i);
+    if (i >= length || json[i] != ':')
+    {
+        return -1;
+    }
+
+    i = SkipRawWhitespace(json, length, i + 1);
+    member->valueStart = i;
+    if (!SkipRawValue(json, length, &i))
+    {
+        return -1;
+    }
+    member->valueEnd = i;
+
+    *offset = i;
+    return 1;
+}
+
+bool JsonTokenizer_FindRawMember(const char *json, size_t length, const char *key,
+                                 JsonRawMember *member)
+{
+    size_t keyLength = strlen(key);
+    size_t offset = 0;
+
+    while (JsonTokenizer_NextRawMember(json, length, &offset, member) > 0)
+    {
+        if (member->keyEnd - member->keyStart == keyLength &&
+            memcmp(json + member->keyStart, key, keyLength) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool JsonTokenizer_GetRawInt(const char *json, const JsonRawMember *member, int64_t *value)
+{
+    if (member->valueEnd > UINT16_MAX)
+    {
+        return false;
+    }
+
+    JsonToken token = {.type = JsonTokenType_Primitive,
+                       .start = (uint16_t)member->valueStart,
+                       .end = (uint16_t)member->valueEnd,
+                       .size = 0};
+
+    return JsonTokenizer_GetInt(json, &token, value);
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+///     Maximum nesting depth accepted by <see cref="JsonTokenizer_Parse" />.
+/// </summary>
+#define JSON_TOKENIZER_MAX_DEPTH 16
+
+typedef enum
+{
+    JsonTokenType_Object = 1,
+    JsonTokenType_Array = 2,
+    JsonTokenType_String = 3,
+    JsonTokenType_Primitive = 4,
+} JsonTokenType;
+
+/// <summary>
+///     A JSON value located in the source buffer. Strings exclude their quotes and are not
+///     unescaped. size is the number of members of an object or elements of an array.
+/// </summary>
+typedef struct
+{
+    JsonTokenType type;
+    uint16_t start;
+    uint16_t end;
+    uint16_t size;
+} JsonToken;
+
+/// <summary>
+///     A member of an object located by a raw scan, as offsets into the scanned document.
+///     The key excludes its quotes; the value is the whole JSON text of the value, including
+///     the quotes of a string and the brackets of an object or array.
+/// </summary>
+typedef struct
+{
+    size_t keyStart;
+    size_t keyEnd;
+    size_t valueStart;
+    size_t valueEnd;
+} JsonRawMember;
+
+/// <summary>
+///     Tokenizes a JSON document in place into a caller-provided token array, without
+///     allocating. The document does not need to be NUL-terminated. Object keys are string
+///     tokens, each followed by the token of its value.
+/// </summary>
+/// <returns>The number of tokens, or -1 if the document is invalid, too deep, longer than
+/// 65535 bytes, or has more than maxTokens tokens.</returns>
+int JsonTokenizer_Parse(const char *json, size_t length, JsonToken *tokens, size_t maxTokens);
+
+/// <summary>
+///     Returns the index of the token following the value at index, skipping its children.
+/// </summary>
+int JsonTokenizer_Skip(const JsonToken *tokens, int count, int index);
+
+/// <summary>
+///     Finds the value of a member of the object at index.
+/// </summary>
+/// <returns>The index of the value token, or -1 if the member is absent.</returns>
+int JsonTokenizer_FindMember(const char *json, const JsonToken *tokens, int count, int object,
+                             const char *key);
+
+bool JsonTokenizer_Equals(const char *json, const JsonToken *token, const char *value);
+
+/// <summary>
+///     Reads an integer primitive. Fractions and exponents are rejected.
+/// </summary>
+bool JsonTokenizer_GetInt(const char *json, const JsonToken *token, int64_t *value);
+
+bool JsonTokenizer_GetBool(const char *json, const JsonToken *token, bool *value);
+
+/// <summary>
+///     Reads the next member of the object which forms the document, skipping over its value
+///     without tokenizing it, so that a document of any size or member count can be walked.
+///     Nested values are skipped but not validated.
+/// </summary>
+/// <param name="offset">0 before the first member; advanced past the member read.</param>
+/// <returns>1 if a member was read, 0 at the end of the object, or -1 if the document is
+/// not a well-formed object.</returns>
+int JsonTokenizer_NextRawMember(const char *json, size_t length, size_t *offset,
+                                JsonRawMember *member);
+
+/// <summary>
+///     Finds a member of the object which forms the document by a raw scan, see
+///     <see cref="JsonTokenizer_NextRawMember" />.
+/// </summary>
+/// <returns>true if the member was found.</returns>
+bool JsonTokenizer_FindRawMember(const char *json, size_t length, const char *key,
+                                 JsonRawMember *member);
+
+/// <summary>
+///     Reads the value of a raw member as an integer primitive.
+/// </summary>
+bool JsonTokenizer_GetRawInt(const char *json, const JsonRawMember *member, int64_t *value);
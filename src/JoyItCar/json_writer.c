@@ -0,0 +1,182 @@
+#include <string.h>
+
+#include "json_writer.h"
+
+static void WriteChar(JsonWriter *writer, char c)
+{
+    // Keep one byte for the NUL terminator written by JsonWriter_Finish.
+    if (writer->length + 1 >= writer->size)
+    {
+        writer->overflow = true;
+        return;
+    }
+
+    writer->buffer[writer->length++] = c;
+}
+
+static void WriteRaw(JsonWriter *writer, const char *text, size_t length)
+{
+    if (writer->length + length >= writer->size)
+    {
+        writer->overflow = true;
+        return;
+    }
+
+    memcpy(writer->buffer + writer->length, text, length);
+    writer->length += length;
+}
+
+static void WriteSeparator(JsonWriter *writer)
+{
+    if (writer->needsSeparator)
+    {
+        WriteChar(writer, ',');
+    }
+}
+
+static void WriteUnsigned(JsonWriter *writer, uint64_t value)
+{
+    char digits[20];
+    size_t count = 0;
+
+    do
+    {
+        digits[count++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    while (count > 0)
+    {
+        WriteChar(writer, digits[--count]);
+    }
+}
+
+void JsonWriter_Init(JsonWriter *writer, char *buffer, size_t size)
+{
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->needsSeparator = false;
+    writer->overflow = size == 0;
+}
+
+void JsonWriter_BeginObject(JsonWriter *writer)
+{
+    WriteSeparator(writer);
+    WriteChar(writer, '{');
+    writer->needsSeparator = false;
+}
+
+void JsonWriter_EndObject(JsonWriter *writer)
+{
+    WriteChar(writer, '}');
+    writer->needsSeparator = true;
+}
+
+void JsonWriter_BeginArray(JsonWriter *writer)
+{
+    WriteSeparator(writer);
+    WriteChar(writer, '[');
+    writer->needsSeparator = false;
+}
+
+void JsonWriter_EndArray(JsonWriter *writer)
+{
+    WriteChar(writer, ']');
+    writer->needsSeparator = true;
+}
+
+void JsonWriter_Key(JsonWriter *writer, const char *key)
+{
+    JsonWriter_String(writer, key);
+    WriteChar(writer, ':');
+    writer->needsSeparator = false;
+}
+
+void JsonWriter_Int(JsonWriter *writer, int64_t value)
+{
+    WriteSeparator(writer);
+
+    if (value < 0)
+    {
+        WriteChar(writer, '-');
+        WriteUnsigned(writer, (uint64_t)0 - (uint64_t)value);
+    }
+    else
+    {
+        WriteUnsigned(writer, (uint64_t)value);
+    }
+
+    writer->needsSeparator = true;
+}
+
+void JsonWriter_UInt(JsonWriter *writer, uint64_t value)
+{
+    WriteSeparator(writer);
+    WriteUnsigned(writer, value);
+    writer->needsSeparator = true;
+}
+
+void JsonWriter_Bool(JsonWriter *writer, bool value)
+{
+    WriteSeparator(writer);
+
+    if (value)
+    {
+        WriteRaw(writer, "true", 4);
+    }
+    else
+    {
+        WriteRaw(writer, "false", 5);
+    }
+
+    writer->needsSeparator = true;
+}
+
+void JsonWriter_String(JsonWriter *writer, const char *value)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+
+    WriteSeparator(writer);
+    WriteChar(writer, '"');
+
+    for (const char *c = value; *c != '\0'; c++)
+    {
+        unsigned char u = (unsigned char)*c;
+
+        if (u == '"' || u == '\\')
+        {
+            WriteChar(writer, '\\');
+            WriteChar(writer, (char)u);
+        }
+        else if (u < 0x20)
+        {
+            char escape[6] = {'\\', 'u', '0', '0', hexDigits[u >> 4], hexDigits[u & 0xF]};
+            WriteRaw(writer, escape, sizeof(escape));
+        }
+        else
+        {
+            WriteChar(writer, (char)u);
+        }
+    }
+
+    WriteChar(writer, '"');
+    writer->needsSeparator = true;
+}
+
+void JsonWriter_Value(JsonWriter *writer, const char *json, size_t length)
+{
+    WriteSeparator(writer);
+    WriteRaw(writer, json, length);
+    writer->needsSeparator = true;
+}
+
+size_t JsonWriter_Finish(JsonWriter *writer)
+{
+    if (writer->size > 0)
+    {
+        writer->buffer[writer->length] = '\0';
+    }
+
+    return writer->overflow ? 0 : writer->length;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+///     Allocation-free JSON writer over a caller-provided buffer.
+///     Separators are inserted automatically; once the buffer is full the writer
+///     stops writing and <see cref="JsonWriter_Finish" /> reports the overflow.
+/// </summary>
+typedef struct
+{
+    char *buffer;
+    size_t size;
+    size_t length;
+    bool needsSeparator;
+    bool overflow;
+} JsonWriter;
+
+void JsonWriter_Init(JsonWriter *writer, char *buffer, size_t size);
+
+void JsonWriter_BeginObject(JsonWriter *writer);
+
+void JsonWriter_EndObject(JsonWriter *writer);
+
+void JsonWriter_BeginArray(JsonWriter *writer);
+
+void JsonWriter_EndArray(JsonWriter *writer);
+
+void JsonWriter_Key(JsonWriter *writer, const char *key);
+
+void JsonWriter_Int(JsonWriter *writer, int64_t value);
+
+void JsonWriter_UInt(JsonWriter *writer, uint64_t value);
+
+void JsonWriter_Bool(JsonWriter *writer, bool value);
+
+void JsonWriter_String(JsonWriter *writer, const char *value);
+
+/// <summary>
+///     Writes a value which is already serialized, such as a cached document fragment.
+/// </summary>
+void JsonWriter_Value(JsonWriter *writer, const char *json, size_t length);
+
+/// <summary>
+///     Terminates the document with a NUL character.
+/// </summary>
+/// <returns>The document length without the terminator, or 0 if the buffer overflowed.</returns>
+size_t JsonWriter_Finish(JsonWriter *writer);
@@ -0,0 +1,92 @@
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "utils.h"
+
+#include "logger.h"
+
+typedef struct
+{
+    const char *format;
+    uint64_t timestampUs;
+    intptr_t args[LOGGER_MAX_ARGS];
+} LogRecord;
+
+// Single-producer, single-consumer ring: the producer only advances tail and the
+// consumer only advances head, both free-running and masked on access.
+static LogRecord ring[LOGGER_RING_SIZE];
+static atomic_uint ringHead = 0;
+static atomic_uint ringTail = 0;
+
+static atomic_uint deferredRecords = 0;
+static atomic_uint droppedRecords = 0;
+static uint32_t reportedDroppedRecords = 0;
+static uint32_t maxPendingRecords = 0;
+
+void Logger_Defer(const char *format, const intptr_t *args)
+{
+    unsigned int tail = atomic_load_explicit(&ringTail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ringHead, memory_order_acquire);
+
+    if (tail - head == LOGGER_RING_SIZE)
+    {
+        atomic_fetch_add_explicit(&droppedRecords, 1, memory_order_relaxed);
+        return;
+    }
+
+    LogRecord *record = &ring[tail & (LOGGER_RING_SIZE - 1)];
+    record->format = format;
+    record->timestampUs = GetMonotonicMicroseconds();
+    for (int i = 0; i < LOGGER_MAX_ARGS; i++)
+    {
+        record->args[i] = args[i];
+    }
+
+    atomic_store_explicit(&ringTail, tail + 1, memory_order_release);
+    atomic_fetch_add_explicit(&deferredRecords, 1, memory_order_relaxed);
+
+    if (tail + 1 - head > maxPendingRecords)
+    {
+        maxPendingRecords = tail + 1 - head;
+    }
+}
+
+size_t Logger_Drain(size_t maxRecords)
+{
+    unsigned int head = atomic_load_explicit(&ringHead, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ringTail, memory_order_acquire);
+    size_t drained = 0;
+
+    for (; head != tail && drained < maxRecords; head++, drained++)
+    {
+        const LogRecord *record = &ring[head & (LOGGER_RING_SIZE - 1)];
+        char line[160];
+
+        int length = snprintf(line, sizeof(line), "[%llu.%06llu] ",
+                              (unsigned long long)(record->timestampUs / 1000000u),
+                              (unsigned long long)(record->timestampUs % 1000000u));
+        snprintf(line + length, sizeof(line) - (size_t)length, record->format, record->args[0],
+                 record->args[1], record->args[2], record->args[3]);
+
+        // Release the slot only once the record has been read.
+        atomic_store_explicit(&ringHead, head + 1, memory_order_release);
+
+        Log_Debug("%s", line);
+    }
+
+    uint32_t dropped = atomic_load_explicit(&droppedRecords, memory_order_relaxed);
+    if (dropped != reportedDroppedRecords)
+    {
+        Log_Debug("WARNING: %u deferred log records dropped.\n", dropped - reportedDroppedRecords);
+        reportedDroppedRecords = dropped;
+    }
+
+    return drained;
+}
+
+void Logger_GetStats(LoggerStats *stats)
+{
+    stats->deferred = atomic_load_explicit(&deferredRecords, memory_order_relaxed);
+    stats->dropped = atomic_load_explicit(&droppedRecords, memory_order_relaxed);
+    stats->maxPending = maxPendingRecords;
+}
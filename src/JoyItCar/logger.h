@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <applibs/log.h>
+
+/// <summary>
+///     Log levels. Records above LOG_LEVEL are compiled out: their arguments are never
+///     evaluated and the compiler drops the call, which is only kept behind if (0) so that
+///     the format is still checked. LOG_LEVEL is set by the build; it defaults to
+///     LOG_LEVEL_DEBUG.
+/// </summary>
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARNING 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#endif
+
+/// <summary>
+///     Number of records held by the deferred log, a power of two, and the number of
+///     arguments of a deferred record.
+/// </summary>
+#define LOGGER_RING_SIZE 64
+#define LOGGER_MAX_ARGS 4
+
+/// <summary>
+///     Records output per main loop iteration, which bounds the delay logging adds before
+///     the next event is handled.
+/// </summary>
+#define LOGGER_DRAIN_BATCH 8
+
+/// <summary>
+///     Counters of the deferred log. A record is dropped when the ring is full.
+/// </summary>
+typedef struct
+{
+    uint32_t deferred;
+    uint32_t dropped;
+    uint32_t maxPending;
+} LoggerStats;
+
+/// <summary>
+///     Stores a record in the deferred log without formatting it. Use the LOG_DEFERRED_*
+///     macros rather than calling this directly.
+///     The format is kept by address and the arguments as raw integers, so the format must
+///     be a string literal and the arguments integers of at most int size, or pointers to
+///     static strings cast to intptr_t.
+///     Single producer, single consumer and lock-free: records may be added from one thread
+///     while another drains them.
+/// </summary>
+void Logger_Defer(const char *format, const intptr_t *args);
+
+/// <summary>
+///     Formats and outputs up to maxRecords deferred records, oldest first, followed by a
+///     warning if records were dropped since the last drain. Called by the main loop between
+///     events, and with SIZE_MAX to dump the log on exit.
+/// </summary>
+/// <returns>The number of records output.</returns>
+size_t Logger_Drain(size_t maxRecords);
+
+void Logger_GetStats(LoggerStats *stats);
+
+#define LOGGER_ARGS(...) ((const intptr_t[LOGGER_MAX_ARGS]){__VA_ARGS__})
+
+#define LOG_DISABLED(format, ...)             \
+    do                                        \
+    {                                         \
+        if (0)                                \
+        {                                     \
+            Log_Debug(format, ##__VA_ARGS__); \
+        }                                     \
+    } while (0)
+
+#define LOG_DEFERRED_DISABLED(format, ...)                  \
+    do                                                      \
+    {                                                       \
+        if (0)                                              \
+        {                                                   \
+            Logger_Defer(format, LOGGER_ARGS(__VA_ARGS__)); \
+        }                                                   \
+    } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(format, ...) Log_Debug("ERROR: " format, ##__VA_ARGS__)
+#define LOG_DEFERRED_ERROR(format, ...) Logger_Defer("ERROR: " format, LOGGER_ARGS(__VA_ARGS__))
+#else
+#define LOG_ERROR(format, ...) LOG_DISABLED(format, ##__VA_ARGS__)
+#define LOG_DEFERRED_ERROR(format, ...) LOG_DEFERRED_DISABLED(format, __VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARNING
+#define LOG_WARNING(format, ...) Log_Debug("WARNING: " format, ##__VA_ARGS__)
+#define LOG_DEFERRED_WARNING(format, ...) \
+    Logger_Defer("WARNING: " format, LOGGER_ARGS(__VA_ARGS__))
+#else
+#define LOG_WARNING(format, ...) LOG_DISABLED(format, ##__VA_ARGS__)
+#define LOG_DEFERRED_WARNING(format, ...) LOG_DEFERRED_DISABLED(format, __VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(format, ...) Log_Debug("INFO: " format, ##__VA_ARGS__)
+#define LOG_DEFERRED_INFO(format, ...) Logger_Defer("INFO: " format, LOGGER_ARGS(__VA_ARGS__))
+#else
+#define LOG_INFO(format, ...) LOG_DISABLED(format, ##__VA_ARGS__)
+#define LOG_DEFERRED_INFO(format, ...) LOG_DEFERRED_DISABLED(format, __VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(format, ...) Log_Debug("DEBUG: " format, ##__VA_ARGS__)
+#define LOG_DEFERRED_DEBUG(format, ...) Logger_Defer("DEBUG: " format, LOGGER_ARGS(__VA_ARGS__))
+#else
+#define LOG_DEBUG(format, ...) LOG_DISABLED(format, ##__VA_ARGS__)
+#define LOG_DEFERRED_DEBUG(format, ...) LOG_DEFERRED_DISABLED(format, __VA_ARGS__)
+#endif
@@ -6,7 +6,6 @@
 #include <sys/socket.h>
 #include <string.h>
 
-#include <applibs/log.h>
 #include <applibs/gpio.h>
 #include <applibs/application.h>
 #include <applibs/eventloop.h>
@@ -16,11 +15,16 @@
 
 #include "utils.h"
 #include "eventloop_timer_utilities.h"
+#include "logger.h"
 
 #include "button_behavior.h"
 #include "i2c_motor_driver.h"
 #include "azure_iot_client.h"
 #include "ble_commands.h"
+#include "command_bus.h"
+#include "telemetry.h"
+#include "motion_control.h"
+#include "motion_sequencer.h"
 
 /// <summary>
 /// Exit codes for this application. These are used for the
@@ -33,17 +37,19 @@ typedef enum
     ExitCode_TermHandler_SigTerm = 1,
     ExitCode_Init_EventLoop = 2,
     ExitCode_Main_EventLoopFail = 3,
+    ExitCode_Init_WorkQueue = 4,
 
 } ExitCode;
 
 static EventLoop *eventLoop = NULL;
+static EventLoopWorkQueue *workQueue = NULL;
 
 /// <summary>
 ///     Signal handler for termination requests. This handler must be async-signal-safe.
 /// </summary>
 static void TerminationHandler(int signalNumber)
 {
-    // Don't use Log_Debug here, as it is not guaranteed to be async-signal-safe.
+    // Don't log here, as it is not guaranteed to be async-signal-safe.
     exitCode = ExitCode_TermHandler_SigTerm;
 }
 
@@ -64,17 +70,38 @@ static ExitCode InitPeripheralsAndHandlers(void)
     eventLoop = EventLoop_Create();
     if (eventLoop == NULL)
     {
-        Log_Debug("Could not create event loop.\n");
+        LOG_ERROR("Could not create event loop.\n");
         return ExitCode_Init_EventLoop;
     }
 
-    I2CMotorDriverExitCode motorsInitResult = JoyitCar_InitMotors();
+    workQueue = CreateEventLoopWorkQueue(eventLoop);
+    if (workQueue == NULL)
+    {
+        LOG_ERROR("Could not create deferred work queue.\n");
+        return ExitCode_Init_WorkQueue;
+    }
+
+    I2CMotorDriverExitCode motorsInitResult = JoyitCar_InitMotors(eventLoop);
 
     if (motorsInitResult != I2CMotorDriver_ExitCode_Success)
     {
         return motorsInitResult;
     }
 
+    MotionControl_ExitCode motionControlInitResult = JoyitCar_InitMotionControl(eventLoop);
+
+    if (motionControlInitResult != MotionControl_ExitCode_Success)
+    {
+        return motionControlInitResult;
+    }
+
+    CommandBus_ExitCode commandBusInitResult = JoyitCar_InitCommandBus(eventLoop, workQueue);
+
+    if (commandBusInitResult != CommandBus_ExitCode_Success)
+    {
+        return commandBusInitResult;
+    }
+
     ButtonBehaviors_ExitCode buttonInitResult = JoyitCar_InitButtonsAndHandlers(eventLoop);
 
     if (buttonInitResult != ButtonBehaviors_ExitCode_Success)
@@ -89,7 +116,21 @@ static ExitCode InitPeripheralsAndHandlers(void)
         return bleCommandInitResult;
     }
 
-    JoyitCar_InitAzureIoT(eventLoop);
+    MotionSequencer_ExitCode sequencerInitResult = JoyitCar_InitMotionSequencer(eventLoop);
+
+    if (sequencerInitResult != MotionSequencer_ExitCode_Success)
+    {
+        return sequencerInitResult;
+    }
+
+    Telemetry_ExitCode telemetryInitResult = JoyitCar_InitTelemetry(eventLoop, workQueue);
+
+    if (telemetryInitResult != Telemetry_ExitCode_Success)
+    {
+        return telemetryInitResult;
+    }
+
+    JoyitCar_InitAzureIoT(eventLoop, workQueue);
 
     return ExitCode_Success;
 }
@@ -101,19 +142,25 @@ static ExitCode InitPeripheralsAndHandlers(void)
 static void ClosePeripheralsAndHandlers(void)
 {
     /// Dispose event loops
+    JoyitCar_CloseMotionSequencer();
+    JoyitCar_CloseCommandBus();
+    JoyitCar_CloseMotionControl();
+    JoyitCar_StopMotorRamp();
+    DisposeEventLoopWorkQueue(workQueue);
     EventLoop_Close(eventLoop);
 
+    JoyitCar_CloseTelemetry();
     JoyitCar_CloseMotors();
 }
 
 int main(int argc, char *argv[])
 {
-    Log_Debug("Application starting.\n");
+    LOG_INFO("Application starting.\n");
 
     bool isNetworkingReady = false;
     if ((Networking_IsNetworkingReady(&isNetworkingReady) == -1) || !isNetworkingReady)
     {
-        Log_Debug("WARNING: Network is not ready. Device cannot connect until network is ready.\n");
+        LOG_WARNING("Network is not ready. Device cannot connect until network is ready.\n");
     }
 
     exitCode = InitPeripheralsAndHandlers();
@@ -127,9 +174,13 @@ int main(int argc, char *argv[])
         {
             exitCode = ExitCode_Main_EventLoopFail;
         }
+
+        // Output the records deferred by the event handlers, outside of any handler.
+        Logger_Drain(LOGGER_DRAIN_BATCH);
     }
 
     ClosePeripheralsAndHandlers();
+    Logger_Drain(SIZE_MAX);
 
     return exitCode;
 }
\ No newline at end of file
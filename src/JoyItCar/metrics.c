@@ -0,0 +1,158 @@
+#include "metrics.h"
+
+uint32_t metricCounters[MetricCounter_Count];
+int32_t metricGauges[MetricGauge_Count];
+MetricHistogramData metricHistograms[MetricHistogram_Count];
+
+#define METRICS_KEY(name, key) key,
+
+static const char *const counterKeys[] = {METRICS_COUNTERS(METRICS_KEY)};
+static const char *const gaugeKeys[] = {METRICS_GAUGES(METRICS_KEY)};
+static const char *const histogramKeys[] = {METRICS_HISTOGRAMS(METRICS_KEY)};
+
+// Values of the last acknowledged report, and of the report being sent. A histogram is
+// compared by its count.
+static uint32_t exportedCounters[MetricCounter_Count];
+static int32_t exportedGauges[MetricGauge_Count];
+static uint32_t exportedHistogramCounts[MetricHistogram_Count];
+static bool gaugesExported = false;
+
+static uint32_t stagedCounters[MetricCounter_Count];
+static int32_t stagedGauges[MetricGauge_Count];
+static uint32_t stagedHistogramCounts[MetricHistogram_Count];
+
+/// <summary>
+///     Largest value which falls into a histogram bucket.
+/// </summary>
+static uint32_t GetHistogramBucketUpperBound(uint32_t bucket)
+{
+    if (bucket < 2 * METRICS_HISTOGRAM_SUB_BUCKETS)
+    {
+        return bucket;
+    }
+
+    uint32_t shift = bucket / METRICS_HISTOGRAM_SUB_BUCKETS - 1;
+    uint64_t mantissa = bucket % METRICS_HISTOGRAM_SUB_BUCKETS + METRICS_HISTOGRAM_SUB_BUCKETS;
+
+    return (uint32_t)(((mantissa + 1) << shift) - 1);
+}
+
+uint32_t Metrics_GetPercentile(MetricHistogram histogram, uint32_t perMille)
+{
+    const MetricHistogramData *data = &metricHistograms[histogram];
+
+    if (data->count == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the value, from 1 to count, rounded up.
+    uint64_t rank = ((uint64_t)data->count * perMille + 999) / 1000;
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t bucket = 0; bucket < METRICS_HISTOGRAM_BUCKETS; bucket++)
+    {
+        seen += data->buckets[bucket];
+        if (seen >= rank)
+        {
+            uint32_t upperBound = GetHistogramBucketUpperBound(bucket);
+            return upperBound < data->max ? upperBound : data->max;
+        }
+    }
+
+    return data->max;
+}
+
+uint32_t Metrics_WriteChanged(JsonWriter *writer)
+{
+    uint32_t written = 0;
+
+    for (int i = 0; i < MetricCounter_Count; i++)
+    {
+        stagedCounters[i] = metricCounters[i];
+        if (stagedCounters[i] != exportedCounters[i])
+        {
+            JsonWriter_Key(writer, counterKeys[i]);
+            JsonWriter_UInt(writer, stagedCounters[i]);
+            written++;
+        }
+    }
+
+    for (int i = 0; i < MetricGauge_Count; i++)
+    {
+        stagedGauges[i] = metricGauges[i];
+        if (!gaugesExported || stagedGauges[i] != exportedGauges[i])
+        {
+            JsonWriter_Key(writer, gaugeKeys[i]);
+            JsonWriter_Int(writer, stagedGauges[i]);
+            written++;
+        }
+    }
+
+    for (int i = 0; i < MetricHistogram_Count; i++)
+    {
+        const MetricHistogramData *data = &metricHistograms[i];
+
+        stagedHistogramCounts[i] = data->count;
+        if (stagedHistogramCounts[i] == exportedHistogramCounts[i])
+        {
+            continue;
+        }
+
+        JsonWriter_Key(writer, histogramKeys[i]);
+        JsonWriter_BeginObject(writer);
+        JsonWriter_Key(writer, "count");
+        JsonWriter_UInt(writer, data->count);
+        JsonWriter_Key(writer, "p50");
+        JsonWriter_UInt(writer, Metrics_GetPercentile((MetricHistogram)i, 500));
+        JsonWriter_Key(writer, "p90");
+        JsonWriter_UInt(writer, Metrics_GetPercentile((MetricHistogram)i, 900));
+        JsonWriter_Key(writer, "p99");
+        JsonWriter_UInt(writer, Metrics_GetPercentile((MetricHistogram)i, 990));
+        JsonWriter_Key(writer, "max");
+        JsonWriter_UInt(writer, data->max);
+        JsonWriter_EndObject(writer);
+        written++;
+    }
+
+    return written;
+}
+
+void Metrics_CommitExport(void)
+{
+    for (int i = 0; i < MetricCounter_Count; i++)
+    {
+        exportedCounters[i] = stagedCounters[i];
+    }
+
+    for (int i = 0; i < MetricGauge_Count; i++)
+    {
+        exportedGauges[i] = stagedGauges[i];
+    }
+
+    for (int i = 0; i < MetricHistogram_Count; i++)
+    {
+        exportedHistogramCounts[i] = stagedHistogramCounts[i];
+    }
+
+    gaugesExported = true;
+}
+
+void Metrics_ResetExport(void)
+{
+    for (int i = 0; i < MetricCounter_Count; i++)
+    {
+        exportedCounters[i] = 0;
+    }
+
+    for (int i = 0; i < MetricHistogram_Count; i++)
+    {
+        exportedHistogramCounts[i] = 0;
+    }
+
+    gaugesExported = false;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "json_writer.h"
+
+/// <summary>
+///     Metrics of the application, registered at compile time. Each entry is X(name, key):
+///     name forms the Metric* enumerator and key is the member in the "metrics" reported
+///     property. Counters are cumulative, gauges hold the last value set and histograms
+///     record latencies.
+/// </summary>
+#define METRICS_COUNTERS(X)                          \
+    X(I2cWrites, "i2cWrites")                        \
+    X(I2cErrors, "i2cErrors")                        \
+    X(MotorRampAborts, "motorRampAborts")            \
+    X(ButtonCommands, "buttonCommands")              \
+    X(BleCommands, "bleCommands")                    \
+    X(MethodsReceived, "methodsReceived")            \
+    X(MethodsDeduplicated, "methodsDeduplicated")    \
+    X(CloudCommandsApplied, "cloudCommandsApplied")  \
+    X(CloudCommandsDropped, "cloudCommandsDropped")  \
+    X(LoopStalls, "loopStalls")                      \
+    X(IoTConnects, "iotConnects")                    \
+    X(IoTDisconnects, "iotDisconnects")              \
+    X(IoTFailures, "iotFailures")                    \
+    X(TelemetryMessages, "telemetryMessages")        \
+    X(ReportedPatches, "reportedPatches")            \
+    X(ReportedUnchanged, "reportedUnchanged")        \
+    X(BusButtonAccepted, "busButtonAccepted")        \
+    X(BusButtonRejected, "busButtonRejected")        \
+    X(BusBleAccepted, "busBleAccepted")              \
+    X(BusBleRejected, "busBleRejected")              \
+    X(BusCloudAccepted, "busCloudAccepted")          \
+    X(BusCloudRejected, "busCloudRejected")          \
+    X(BusDropped, "busDropped")
+
+#define METRICS_GAUGES(X)                            \
+    X(TelemetryBacklog, "telemetryBacklog")          \
+    X(TelemetryIntervalSeconds, "telemetryIntervalS")
+
+#define METRICS_HISTOGRAMS(X)                        \
+    X(HandlerUs, "handlerUs")                        \
+    X(WorkQueueLatencyUs, "workQueueLatencyUs")      \
+    X(MethodLatencyUs, "methodLatencyUs")            \
+    X(MethodDispatchUs, "methodDispatchUs")          \
+    X(MethodI2cUs, "methodI2cUs")                    \
+    X(ArbitrationUs, "arbitrationUs")                \
+    X(ControlTickUs, "controlTickUs")                \
+    X(ControlJitterUs, "controlJitterUs")            \
+    X(ReconnectMs, "reconnectMs")
+
+#define METRICS_COUNTER_ENUMERATOR(name, key) MetricCounter_##name,
+#define METRICS_GAUGE_ENUMERATOR(name, key) MetricGauge_##name,
+#define METRICS_HISTOGRAM_ENUMERATOR(name, key) MetricHistogram_##name,
+
+typedef enum
+{
+    METRICS_COUNTERS(METRICS_COUNTER_ENUMERATOR)
+    MetricCounter_Count
+} MetricCounter;
+
+typedef enum
+{
+    METRICS_GAUGES(METRICS_GAUGE_ENUMERATOR)
+    MetricGauge_Count
+} MetricGauge;
+
+typedef enum
+{
+    METRICS_HISTOGRAMS(METRICS_HISTOGRAM_ENUMERATOR)
+    MetricHistogram_Count
+} MetricHistogram;
+
+/// <summary>
+///     Log-linear histogram buckets: values below 8 have a bucket each, and every power of
+///     two above is split into 4 buckets, so a bucket is at most 25% wide. 124 buckets cover
+///     the whole uint32_t range.
+/// </summary>
+#define METRICS_HISTOGRAM_SUB_BUCKET_BITS 2
+#define METRICS_HISTOGRAM_SUB_BUCKETS (1u << METRICS_HISTOGRAM_SUB_BUCKET_BITS)
+#define METRICS_HISTOGRAM_BUCKETS \
+    ((33u - METRICS_HISTOGRAM_SUB_BUCKET_BITS) * METRICS_HISTOGRAM_SUB_BUCKETS)
+
+/// <summary>
+///     Size of the buffer of the "metrics" reported property, which holds every metric at its
+///     largest.
+/// </summary>
+#define METRICS_REPORT_MAX_BYTES 2048
+
+typedef struct
+{
+    uint32_t count;
+    uint32_t max;
+    uint32_t buckets[METRICS_HISTOGRAM_BUCKETS];
+} MetricHistogramData;
+
+// The registry itself. Updated in place by the inline functions below, from the event loop
+// thread only, so that an update is a single unlocked store.
+extern uint32_t metricCounters[MetricCounter_Count];
+extern int32_t metricGauges[MetricGauge_Count];
+extern MetricHistogramData metricHistograms[MetricHistogram_Count];
+
+static inline void Metrics_Increment(MetricCounter counter)
+{
+    metricCounters[counter]++;
+}
+
+static inline void Metrics_Add(MetricCounter counter, uint32_t value)
+{
+    metricCounters[counter] += value;
+}
+
+static inline void Metrics_SetGauge(MetricGauge gauge, int32_t value)
+{
+    metricGauges[gauge] = value;
+}
+
+static inline uint32_t Metrics_GetHistogramBucket(uint32_t value)
+{
+    if (value < 2 * METRICS_HISTOGRAM_SUB_BUCKETS)
+    {
+        return value;
+    }
+
+    uint32_t shift = 31u - (uint32_t)__builtin_clz(value) - METRICS_HISTOGRAM_SUB_BUCKET_BITS;
+
+    return shift * METRICS_HISTOGRAM_SUB_BUCKETS + (value >> shift);
+}
+
+static inline void Metrics_Record(MetricHistogram histogram, uint32_t value)
+{
+    MetricHistogramData *data = &metricHistograms[histogram];
+
+    data->count++;
+    data->buckets[Metrics_GetHistogramBucket(value)]++;
+    if (value > data->max)
+    {
+        data->max = value;
+    }
+}
+
+/// <summary>
+///     Value below which the given per mille of the recorded values fall, as the upper bound
+///     of its bucket, capped by the maximum. 0 if nothing was recorded.
+/// </summary>
+uint32_t Metrics_GetPercentile(MetricHistogram histogram, uint32_t perMille);
+
+/// <summary>
+///     Writes the members of the metrics which changed since the last committed export into
+///     the current JSON object: counters and gauges as numbers, histograms as objects with
+///     count, p50, p90, p99 and max. The written values are staged until
+///     <see cref="Metrics_CommitExport" />.
+/// </summary>
+/// <returns>The number of members written.</returns>
+uint32_t Metrics_WriteChanged(JsonWriter *writer);
+
+/// <summary>
+///     Marks the values staged by the last <see cref="Metrics_WriteChanged" /> as exported,
+///     once the hub acknowledged their report.
+/// </summary>
+void Metrics_CommitExport(void);
+
+/// <summary>
+///     Forgets the exported values, so that the next export writes every metric.
+/// </summary>
+void Metrics_ResetExport(void);
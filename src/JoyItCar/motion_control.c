@@ -0,0 +1,233 @@
+#include <stdbool.h>
+
+#include "eventloop_timer_utilities.h"
+#include "utils.h"
+#include "logger.h"
+#include "metrics.h"
+
+#include "i2c_motor_driver.h"
+#include "motion_control.h"
+
+#define MIXING_TABLE_SIZE (2 * MOTION_CONTROL_SETPOINT_MAX + 1)
+
+static const struct timespec tickPeriod = {.tv_sec = 0,
+                                           .tv_nsec = MOTION_CONTROL_PERIOD_US * 1000};
+
+static EventLoopTimer *tickTimer = NULL;
+
+// Q8 wheel speed contributed by each setpoint, indexed by setpoint + SETPOINT_MAX.
+static int32_t linearMixingTable[MIXING_TABLE_SIZE];
+static int32_t angularMixingTable[MIXING_TABLE_SIZE];
+static bool mixingTablesBuilt = false;
+
+static MotionControlOutput motionControlOutput = JoyitCar_DriveChannel;
+
+static int linearSetpoint = 0;
+static int angularSetpoint = 0;
+
+// The tick timer is armed while running; outputs are unknown after another command wrote.
+static bool running = false;
+static bool outputsKnown = false;
+static int lastOutputs[MOTOR_CHANNEL_COUNT];
+static uint64_t lastTickAtUs = 0;
+
+static MotionControlStats motionControlStats;
+
+static void BuildMixingTables(void)
+{
+    for (int setpoint = -MOTION_CONTROL_SETPOINT_MAX; setpoint <= MOTION_CONTROL_SETPOINT_MAX;
+         setpoint++)
+    {
+        linearMixingTable[setpoint + MOTION_CONTROL_SETPOINT_MAX] =
+            setpoint * MOTION_CONTROL_LINEAR_GAIN_Q8;
+        angularMixingTable[setpoint + MOTION_CONTROL_SETPOINT_MAX] =
+            setpoint * MOTION_CONTROL_ANGULAR_GAIN_Q8;
+    }
+
+    mixingTablesBuilt = true;
+}
+
+static int ClampSetpoint(int setpoint)
+{
+    if (setpoint > MOTION_CONTROL_SETPOINT_MAX)
+    {
+        return MOTION_CONTROL_SETPOINT_MAX;
+    }
+
+    if (setpoint < -MOTION_CONTROL_SETPOINT_MAX)
+    {
+        return -MOTION_CONTROL_SETPOINT_MAX;
+    }
+
+    return setpoint;
+}
+
+/// <summary>
+///     Rounds a Q8 wheel speed to the nearest unit, then clamps it and applies the deadband.
+/// </summary>
+static int ToWheelSpeed(int32_t speedQ8)
+{
+    int32_t speed = (speedQ8 + (speedQ8 >= 0 ? 128 : -128)) / 256;
+
+    if (speed > 255)
+    {
+        return 255;
+    }
+
+    if (speed < -255)
+    {
+        return -255;
+    }
+
+    if (speed > -MOTION_CONTROL_DEADBAND && speed < MOTION_CONTROL_DEADBAND)
+    {
+        return 0;
+    }
+
+    return (int)speed;
+}
+
+void JoyitCar_MixVelocity(int linear, int angular, int *left, int *right)
+{
+    if (!mixingTablesBuilt)
+    {
+        BuildMixingTables();
+    }
+
+    int32_t linearQ8 = linearMixingTable[ClampSetpoint(linear) + MOTION_CONTROL_SETPOINT_MAX];
+    int32_t angularQ8 = angularMixingTable[ClampSetpoint(angular) + MOTION_CONTROL_SETPOINT_MAX];
+
+    *left = ToWheelSpeed(linearQ8 - angularQ8);
+    *right = ToWheelSpeed(linearQ8 + angularQ8);
+}
+
+/// <summary>
+///     Computes the outputs from the setpoints and writes the channels whose output changed.
+///     Stops ticking once both outputs are zero.
+/// </summary>
+static void ControlTick(void)
+{
+    uint64_t startedAtUs = GetMonotonicMicroseconds();
+    int outputs[MOTOR_CHANNEL_COUNT];
+
+    JoyitCar_MixVelocity(linearSetpoint, angularSetpoint, &outputs[MOTOR_CHA],
+                         &outputs[MOTOR_CHB]);
+
+    for (int channel = 0; channel < MOTOR_CHANNEL_COUNT; channel++)
+    {
+        if (!outputsKnown || outputs[channel] != lastOutputs[channel])
+        {
+            motionControlOutput((MotorChannel)channel, outputs[channel]);
+            lastOutputs[channel] = outputs[channel];
+            motionControlStats.writes++;
+        }
+    }
+
+    outputsKnown = true;
+
+    if (outputs[MOTOR_CHA] == 0 && outputs[MOTOR_CHB] == 0)
+    {
+        DisarmEventLoopTimer(tickTimer);
+        running = false;
+    }
+
+    uint32_t tickUs = (uint32_t)(GetMonotonicMicroseconds() - startedAtUs);
+
+    motionControlStats.ticks++;
+    motionControlStats.lastTickUs = tickUs;
+    Metrics_Record(MetricHistogram_ControlTickUs, tickUs);
+    if (tickUs > motionControlStats.maxTickUs)
+    {
+        motionControlStats.maxTickUs = tickUs;
+    }
+}
+
+static void TickTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0)
+    {
+        exitCode = MotionControl_ExitCode_TickTimer_Consume;
+        return;
+    }
+
+    uint64_t nowUs = GetMonotonicMicroseconds();
+    uint64_t intervalUs = nowUs - lastTickAtUs;
+    uint32_t jitterUs = (uint32_t)(intervalUs > MOTION_CONTROL_PERIOD_US
+                                       ? intervalUs - MOTION_CONTROL_PERIOD_US
+                                       : MOTION_CONTROL_PERIOD_US - intervalUs);
+
+    lastTickAtUs = nowUs;
+    motionControlStats.lastJitterUs = jitterUs;
+    Metrics_Record(MetricHistogram_ControlJitterUs, jitterUs);
+    if (jitterUs > motionControlStats.maxJitterUs)
+    {
+        motionControlStats.maxJitterUs = jitterUs;
+    }
+
+    ControlTick();
+}
+
+MotionControl_ExitCode JoyitCar_InitMotionControl(EventLoop *eventLoop)
+{
+    BuildMixingTables();
+
+    tickTimer = CreateEventLoopDisarmedTimer(eventLoop, &TickTimerEventHandler);
+
+    if (tickTimer == NULL)
+    {
+        return MotionControl_ExitCode_Init_TickTimer;
+    }
+
+    return MotionControl_ExitCode_Success;
+}
+
+void JoyitCar_CloseMotionControl(void)
+{
+    DisposeEventLoopTimer(tickTimer);
+    tickTimer = NULL;
+    running = false;
+}
+
+void JoyitCar_SetVelocity(int linear, int angular)
+{
+    linearSetpoint = ClampSetpoint(linear);
+    angularSetpoint = ClampSetpoint(angular);
+
+    if (running)
+    {
+        return;
+    }
+
+    // Applied at once rather than one period later; the timer keeps the rate afterwards.
+    running = true;
+    lastTickAtUs = GetMonotonicMicroseconds();
+    SetEventLoopTimerPeriod(tickTimer, &tickPeriod);
+
+    LOG_DEFERRED_DEBUG("Velocity control started at (%d, %d).\n", linearSetpoint,
+                       angularSetpoint);
+
+    ControlTick();
+}
+
+void JoyitCar_StopVelocityControl(void)
+{
+    if (tickTimer != NULL)
+    {
+        DisarmEventLoopTimer(tickTimer);
+    }
+
+    linearSetpoint = 0;
+    angularSetpoint = 0;
+    running = false;
+    outputsKnown = false;
+}
+
+void JoyitCar_SetMotionControlOutput(MotionControlOutput output)
+{
+    motionControlOutput = output != NULL ? output : JoyitCar_DriveChannel;
+}
+
+void JoyitCar_GetMotionControlStats(MotionControlStats *stats)
+{
+    *stats = motionControlStats;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+
+#include "i2c_motor_driver.h"
+
+// Period of the control tick: 100 Hz.
+#define MOTION_CONTROL_PERIOD_US 10000
+
+// Setpoints range over [-MOTION_CONTROL_SETPOINT_MAX, MOTION_CONTROL_SETPOINT_MAX].
+#define MOTION_CONTROL_SETPOINT_MAX 255
+
+// Mixing gains in Q8 fixed point: wheel speed per unit of linear and of angular setpoint.
+#define MOTION_CONTROL_LINEAR_GAIN_Q8 256
+#define MOTION_CONTROL_ANGULAR_GAIN_Q8 256
+
+// Wheel speeds below this magnitude do not turn the wheels and are sent as a stop.
+#define MOTION_CONTROL_DEADBAND 20
+
+/// <summary>
+///     Writes the speed of a channel, from -255 to 255. JoyitCar_DriveChannel() by default;
+///     a host build may install a fake bus instead.
+/// </summary>
+typedef void (*MotionControlOutput)(MotorChannel channel, int speed);
+
+/// <summary>
+///     Counters of the control loop. Jitter is the deviation of the interval between two
+///     timer ticks from the period; the tick cost is the time spent computing and writing.
+/// </summary>
+typedef struct
+{
+    uint32_t ticks;
+    uint32_t writes;
+    uint32_t lastJitterUs;
+    uint32_t maxJitterUs;
+    uint32_t lastTickUs;
+    uint32_t maxTickUs;
+} MotionControlStats;
+
+typedef enum
+{
+    MotionControl_ExitCode_Success = 1000,
+    MotionControl_ExitCode_Init_TickTimer = 1001,
+    MotionControl_ExitCode_TickTimer_Consume = 1002,
+} MotionControl_ExitCode;
+
+MotionControl_ExitCode JoyitCar_InitMotionControl(EventLoop *eventLoop);
+
+void JoyitCar_CloseMotionControl(void);
+
+/// <summary>
+///     Sets the velocity setpoints: linear is the forward speed and angular the turn rate,
+///     positive to the left. The tick runs at once, then at a fixed rate until the car is
+///     stopped; a zero setpoint stops it.
+/// </summary>
+void JoyitCar_SetVelocity(int linear, int angular);
+
+/// <summary>
+///     Leaves velocity control without writing to the motors, when another command takes
+///     over the motors.
+/// </summary>
+void JoyitCar_StopVelocityControl(void);
+
+/// <summary>
+///     Mixes the setpoints into wheel speeds, clamped to [-255, 255] and with the deadband
+///     applied. Pure: usable without the event loop.
+/// </summary>
+void JoyitCar_MixVelocity(int linear, int angular, int *left, int *right);
+
+void JoyitCar_SetMotionControlOutput(MotionControlOutput output);
+
+void JoyitCar_GetMotionControlStats(MotionControlStats *stats);
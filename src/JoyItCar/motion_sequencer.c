@@ -0,0 +1,219 @@
+#include <stdbool.h>
+
+#include "eventloop_timer_utilities.h"
+#include "utils.h"
+#include "logger.h"
+
+#include "i2c_motor_driver.h"
+#include "motion_sequencer.h"
+
+static EventLoopTimer *stepTimer = NULL;
+
+static const MotionStep *sequenceSteps = NULL;
+static size_t sequenceStepCount = 0;
+static size_t nextStep = 0;
+static MotionSequenceProgressHandler progressHandler = NULL;
+static void *progressContext = NULL;
+
+// The sequence ends with a brake, done when it finishes.
+static const MotionStep demoSequence[] = {
+    {JoyitCar_GoForward, 1000}, {JoyitCar_Break, 250},     {JoyitCar_GoBackward, 1000},
+    {JoyitCar_Break, 250},      {JoyitCar_TurnRight, 250}, {JoyitCar_Break, 250},
+    {JoyitCar_TurnLeft, 500},   {JoyitCar_Break, 250},     {JoyitCar_TurnRight, 250},
+};
+
+/// <summary>
+///     Ends the sequence and notifies its owner; the handler may start a new sequence.
+/// </summary>
+static void FinishSequence(MotionSequenceStatus status)
+{
+    MotionSequenceProgressHandler handler = progressHandler;
+    void *context = progressContext;
+    size_t completedSteps = nextStep;
+    size_t stepCount = sequenceStepCount;
+
+    DisarmEventLoopTimer(stepTimer);
+    JoyitCar_Break();
+
+    sequenceSteps = NULL;
+    sequenceStepCount = 0;
+    nextStep = 0;
+    progressHandler = NULL;
+    progressContext = NULL;
+
+    if (handler != NULL)
+    {
+        handler(completedSteps, stepCount, status, context);
+    }
+}
+
+/// <summary>
+///     Runs the next step and arms the timer for its duration.
+/// </summary>
+static void RunNextStep(void)
+{
+    if (nextStep == sequenceStepCount)
+    {
+        FinishSequence(MotionSequenceStatus_Completed);
+        return;
+    }
+
+    const MotionStep *step = &sequenceSteps[nextStep];
+
+    if (progressHandler != NULL)
+    {
+        progressHandler(nextStep, sequenceStepCount, MotionSequenceStatus_Running,
+                        progressContext);
+    }
+
+    if (step->action != NULL)
+    {
+        step->action();
+    }
+
+    nextStep++;
+
+    if (step->durationMs == 0)
+    {
+        RunNextStep();
+        return;
+    }
+
+    struct timespec duration = {.tv_sec = step->durationMs / 1000,
+                                .tv_nsec = (step->durationMs % 1000) * 1000 * 1000};
+    SetEventLoopTimerOneShot(stepTimer, &duration);
+}
+
+static void StepTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0)
+    {
+        exitCode = MotionSequencer_ExitCode_StepTimer_Consume;
+        return;
+    }
+
+    if (sequenceSteps != NULL)
+    {
+        RunNextStep();
+    }
+}
+
+MotionSequencer_ExitCode JoyitCar_InitMotionSequencer(EventLoop *eventLoop)
+{
+    stepTimer = CreateEventLoopDisarmedTimer(eventLoop, &StepTimerEventHandler);
+
+    if (stepTimer == NULL)
+    {
+        return MotionSequencer_ExitCode_Init_StepTimer;
+    }
+
+    return MotionSequencer_ExitCode_Success;
+}
+
+void JoyitCar_CloseMotionSequencer(void)
+{
+    DisposeEventLoopTimer(stepTimer);
+    stepTimer = NULL;
+}
+
+void JoyitCar_StartMotionSequence(const MotionStep *steps, size_t stepCount,
+                                  MotionSequenceProgressHandler handler, void *context)
+{
+    JoyitCar_CancelMotionSequence();
+
+    sequenceSteps = steps;
+    sequenceStepCount = stepCount;
+    nextStep = 0;
+    progressHandler = handler;
+    progressContext = context;
+
+    LOG_DEFERRED_INFO("Starting a motion sequence of %zu steps.\n", stepCount);
+
+    RunNextStep();
+}
+
+void JoyitCar_CancelMotionSequence(void)
+{
+    if (sequenceSteps == NULL)
+    {
+        return;
+    }
+
+    LOG_DEFERRED_INFO("Motion sequence cancelled after %zu of %zu steps.\n", nextStep,
+                      sequenceStepCount);
+
+    FinishSequence(MotionSequenceStatus_Cancelled);
+}
+
+/// <summary>
+///     Maneuver of a step letter of a compact sequence.
+/// </summary>
+static bool GetStepAction(char maneuver, void (**action)(void))
+{
+    switch (maneuver)
+    {
+    case 'F':
+        *action = JoyitCar_GoForward;
+        return true;
+    case 'B':
+        *action = JoyitCar_GoBackward;
+        return true;
+    case 'L':
+        *action = JoyitCar_TurnLeft;
+        return true;
+    case 'R':
+        *action = JoyitCar_TurnRight;
+        return true;
+    case 'S':
+        *action = JoyitCar_Break;
+        return true;
+    case 'W':
+        *action = NULL;
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool JoyitCar_ParseMotionSequence(const char *text, size_t length, MotionStep *steps,
+                                  size_t maxSteps, size_t *stepCount)
+{
+    size_t count = 0;
+    size_t i = 0;
+
+    while (i < length)
+    {
+        if (count == maxSteps || !GetStepAction(text[i++], &steps[count].action))
+        {
+            return false;
+        }
+
+        uint32_t durationMs = 0;
+        size_t digits = 0;
+
+        for (; i < length && text[i] >= '0' && text[i] <= '9'; i++, digits++)
+        {
+            durationMs = durationMs * 10 + (uint32_t)(text[i] - '0');
+            if (durationMs > MOTION_STEP_MAX_DURATION_MS)
+            {
+                return false;
+            }
+        }
+
+        if (digits == 0 || (i < length && text[i++] != ',') || (i == length && text[i - 1] == ','))
+        {
+            return false;
+        }
+
+        steps[count++].durationMs = durationMs;
+    }
+
+    *stepCount = count;
+    return count > 0;
+}
+
+const MotionStep *JoyitCar_GetDemoSequence(size_t *stepCount)
+{
+    *stepCount = sizeof(demoSequence) / sizeof(demoSequence[0]);
+    return demoSequence;
+}
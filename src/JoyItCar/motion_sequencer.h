@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+
+/// <summary>
+///     One step of a motion sequence: the maneuver, then how long it lasts before the next
+///     step runs. A NULL action keeps the motors as they are.
+/// </summary>
+typedef struct
+{
+    void (*action)(void);
+    uint32_t durationMs;
+} MotionStep;
+
+/// <summary>
+///     Longest sequence accepted from the cloud, and the longest step.
+/// </summary>
+#define MOTION_SEQUENCE_MAX_STEPS 16
+#define MOTION_STEP_MAX_DURATION_MS 10000
+
+typedef enum
+{
+    MotionSequenceStatus_Running = 0,
+    MotionSequenceStatus_Completed = 1,
+    MotionSequenceStatus_Cancelled = 2,
+} MotionSequenceStatus;
+
+/// <summary>
+///     Invoked from the event loop when a step starts, and once when the sequence completes or
+///     is cancelled. The motors are braked before the final notification.
+/// </summary>
+typedef void (*MotionSequenceProgressHandler)(size_t completedSteps, size_t stepCount,
+                                              MotionSequenceStatus status, void *context);
+
+typedef enum
+{
+    MotionSequencer_ExitCode_Success = 700,
+    MotionSequencer_ExitCode_Init_StepTimer = 701,
+    MotionSequencer_ExitCode_StepTimer_Consume = 702,
+} MotionSequencer_ExitCode;
+
+MotionSequencer_ExitCode JoyitCar_InitMotionSequencer(EventLoop *eventLoop);
+
+void JoyitCar_CloseMotionSequencer(void);
+
+/// <summary>
+///     Starts a sequence, driven by a one-shot timer instead of sleeping. A running sequence
+///     is cancelled first. The steps must stay valid until the sequence ends.
+/// </summary>
+void JoyitCar_StartMotionSequence(const MotionStep *steps, size_t stepCount,
+                                  MotionSequenceProgressHandler handler, void *context);
+
+/// <summary>
+///     Cancels the running sequence, if any, and brakes.
+/// </summary>
+void JoyitCar_CancelMotionSequence(void);
+
+/// <summary>
+///     Parses a compact sequence: comma-separated steps, each a maneuver letter followed by
+///     its duration in milliseconds, e.g. "F1500,L400,S0". The maneuvers are F (forward),
+///     B (backward), L (left), R (right), S (brake) and W (wait, motors unchanged).
+/// </summary>
+/// <returns>false if the text is malformed or has more than maxSteps steps.</returns>
+bool JoyitCar_ParseMotionSequence(const char *text, size_t length, MotionStep *steps,
+                                  size_t maxSteps, size_t *stepCount);
+
+/// <summary>
+///     The demonstration maneuver, formerly run inline by JoyitCar_StartDemo().
+/// </summary>
+const MotionStep *JoyitCar_GetDemoSequence(size_t *stepCount);
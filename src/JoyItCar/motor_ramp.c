@@ -0,0 +1,84 @@
+#include "motor_ramp.h"
+
+static int32_t ToQ8PerTick(uint64_t perSecondQ8, uint32_t periodUs)
+{
+    int32_t perTick = (int32_t)(perSecondQ8 * periodUs / 1000000);
+
+    return perTick > 0 ? perTick : 1;
+}
+
+void MotorRamp_SetLimits(MotorRampLimits *limits, uint32_t accelPerSecond,
+                         uint32_t jerkPerSecond2, uint32_t periodUs)
+{
+    if (accelPerSecond == 0)
+    {
+        limits->maxAccelQ8 = 0;
+        limits->maxJerkQ8 = 0;
+        return;
+    }
+
+    limits->maxAccelQ8 = ToQ8PerTick((uint64_t)accelPerSecond * 256, periodUs);
+    // Per tick squared: the period applies twice, the first one without rounding.
+    limits->maxJerkQ8 = ToQ8PerTick((uint64_t)jerkPerSecond2 * 256 * periodUs / 1000000, periodUs);
+}
+
+void MotorRamp_Reset(MotorRamp *ramp, int speed)
+{
+    ramp->speedQ8 = (int32_t)speed * 256;
+    ramp->accelQ8 = 0;
+}
+
+int MotorRamp_Step(MotorRamp *ramp, int target, const MotorRampLimits *limits)
+{
+    int32_t targetQ8 = (int32_t)target * 256;
+
+    if (limits->maxAccelQ8 == 0)
+    {
+        MotorRamp_Reset(ramp, target);
+        return target;
+    }
+
+    int32_t error = targetQ8 - ramp->speedQ8;
+    int32_t accel = ramp->accelQ8;
+
+    // Speed still gained while the acceleration is brought back to zero at the jerk limit.
+    int32_t settling =
+        (int32_t)((int64_t)accel * (accel < 0 ? -accel : accel) / (2 * limits->maxJerkQ8));
+
+    if (error > settling)
+    {
+        accel += limits->maxJerkQ8;
+    }
+    else if (error < settling)
+    {
+        accel -= limits->maxJerkQ8;
+    }
+
+    if (accel > limits->maxAccelQ8)
+    {
+        accel = limits->maxAccelQ8;
+    }
+    else if (accel < -limits->maxAccelQ8)
+    {
+        accel = -limits->maxAccelQ8;
+    }
+
+    // The target is reached within this tick: land on it and stop accelerating.
+    if ((error >= 0 && accel >= error) || (error <= 0 && accel <= error))
+    {
+        MotorRamp_Reset(ramp, target);
+        return target;
+    }
+
+    ramp->speedQ8 += accel;
+    ramp->accelQ8 = accel;
+
+    return MotorRamp_GetSpeed(ramp);
+}
+
+int MotorRamp_GetSpeed(const MotorRamp *ramp)
+{
+    int32_t speedQ8 = ramp->speedQ8;
+
+    return (int)((speedQ8 + (speedQ8 >= 0 ? 128 : -128)) / 256);
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+
+/// <summary>
+///     Limits of a speed ramp in Q8 fixed point: the change of speed per tick, and the change
+///     of that acceleration per tick. A zero acceleration disables ramping.
+/// </summary>
+typedef struct
+{
+    int32_t maxAccelQ8;
+    int32_t maxJerkQ8;
+} MotorRampLimits;
+
+/// <summary>
+///     State of the ramp of one channel: its current speed and acceleration in Q8.
+/// </summary>
+typedef struct
+{
+    int32_t speedQ8;
+    int32_t accelQ8;
+} MotorRamp;
+
+/// <summary>
+///     Converts limits in speed units per second, and per second squared, into per tick
+///     limits for the given tick period.
+/// </summary>
+void MotorRamp_SetLimits(MotorRampLimits *limits, uint32_t accelPerSecond,
+                         uint32_t jerkPerSecond2, uint32_t periodUs);
+
+/// <summary>
+///     Places the ramp at rest at the given speed, e.g. after an emergency brake.
+/// </summary>
+void MotorRamp_Reset(MotorRamp *ramp, int speed);
+
+/// <summary>
+///     Advances the ramp by one tick toward the target speed: the acceleration changes by at
+///     most the jerk limit and stays within the acceleration limit, and is brought back to
+///     zero so that the speed lands on the target without overshooting it.
+/// </summary>
+/// <returns>The speed after the tick, rounded to a whole speed unit.</returns>
+int MotorRamp_Step(MotorRamp *ramp, int target, const MotorRampLimits *limits);
+
+int MotorRamp_GetSpeed(const MotorRamp *ramp);
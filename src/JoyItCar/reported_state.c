@@ -0,0 +1,283 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "json_tokenizer.h"
+#include "json_writer.h"
+#include "logger.h"
+#include "metrics.h"
+#include "utils.h"
+
+#include "reported_state.h"
+
+/// <summary>
+///     A reported property. value is the latest value set; the hub holds it once acked is set
+///     and the hash of the acknowledged value is the hash of value.
+/// </summary>
+typedef struct
+{
+    char name[REPORTED_STATE_MAX_NAME];
+    char *value;
+    size_t length;
+    size_t capacity;
+    uint64_t hash;
+    uint64_t inFlightHash;
+    uint64_t ackedHash;
+    uint32_t inFlightPatchId;
+    bool queued;
+    bool acked;
+} ReportedProperty;
+
+static ReportedProperty properties[REPORTED_STATE_MAX_PROPERTIES];
+static size_t propertyCount = 0;
+
+static uint32_t lastPatchId = 0;
+static int64_t lastReportedVersion = -1;
+
+static ReportedProperty *FindProperty(const char *name, size_t nameLength)
+{
+    for (size_t i = 0; i < propertyCount; i++)
+    {
+        if (strlen(properties[i].name) == nameLength &&
+            memcmp(properties[i].name, name, nameLength) == 0)
+        {
+            return &properties[i];
+        }
+    }
+
+    if (propertyCount == REPORTED_STATE_MAX_PROPERTIES || nameLength >= REPORTED_STATE_MAX_NAME)
+    {
+        return NULL;
+    }
+
+    ReportedProperty *property = &properties[propertyCount++];
+    memcpy(property->name, name, nameLength);
+    property->name[nameLength] = '\0';
+
+    return property;
+}
+
+static bool SetProperty(const char *name, size_t nameLength, const char *value, size_t length)
+{
+    ReportedProperty *property = FindProperty(name, nameLength);
+    if (property == NULL)
+    {
+        LOG_ERROR("Cannot track the reported property %.*s.\n", (int)nameLength, name);
+        return false;
+    }
+
+    uint64_t hash = HashFnv1a64(value, length);
+
+    if (property->value != NULL && property->hash == hash && property->length == length)
+    {
+        Metrics_Increment(MetricCounter_ReportedUnchanged);
+        return true;
+    }
+
+    if (length > property->capacity)
+    {
+        char *grown = realloc(property->value, length);
+        if (grown == NULL)
+        {
+            LOG_ERROR("Cannot store the reported property %s.\n", property->name);
+            return false;
+        }
+
+        property->value = grown;
+        property->capacity = length;
+    }
+
+    memcpy(property->value, value, length);
+    property->length = length;
+    property->hash = hash;
+
+    // Back to the acknowledged value with nothing in flight: the hub already holds it.
+    property->queued =
+        !(property->acked && property->inFlightPatchId == 0 && property->ackedHash == hash);
+
+    return true;
+}
+
+bool ReportedState_SetPatch(const char *json, size_t length)
+{
+    // Scanned rather than tokenized: a patch holds any number of nested values.
+    JsonRawMember member;
+    size_t offset = 0;
+    bool stored = true;
+    int result;
+
+    while ((result = JsonTokenizer_NextRawMember(json, length, &offset, &member)) > 0)
+    {
+        stored = SetProperty(json + member.keyStart, member.keyEnd - member.keyStart,
+                             json + member.valueStart, member.valueEnd - member.valueStart) &&
+                 stored;
+    }
+
+    if (result < 0)
+    {
+        LOG_ERROR("Invalid reported properties patch.\n");
+        return false;
+    }
+
+    return stored;
+}
+
+size_t ReportedState_BuildPatch(char *buffer, size_t size, uint32_t *patchId)
+{
+    JsonWriter writer;
+    uint32_t written = 0;
+    uint32_t id = lastPatchId + 1 == 0 ? 1 : lastPatchId + 1;
+
+    JsonWriter_Init(&writer, buffer, size);
+    JsonWriter_BeginObject(&writer);
+
+    for (size_t i = 0; i < propertyCount; i++)
+    {
+        ReportedProperty *property = &properties[i];
+        if (!property->queued)
+        {
+            continue;
+        }
+
+        // Separator, quotes, colon and the closing brace.
+        size_t memberSize = strlen(property->name) + property->length + 5;
+        if (writer.length + memberSize >= size)
+        {
+            continue;
+        }
+
+        JsonWriter_Key(&writer, property->name);
+        JsonWriter_Value(&writer, property->value, property->length);
+
+        property->queued = false;
+        property->inFlightPatchId = id;
+        property->inFlightHash = property->hash;
+        written++;
+    }
+
+    JsonWriter_EndObject(&writer);
+
+    if (written == 0)
+    {
+        return 0;
+    }
+
+    lastPatchId = id;
+    *patchId = id;
+    Metrics_Increment(MetricCounter_ReportedPatches);
+
+    return JsonWriter_Finish(&writer);
+}
+
+void ReportedState_OnResult(uint32_t patchId, int statusCode)
+{
+    bool succeeded = statusCode >= 200 && statusCode < 300;
+
+    for (size_t i = 0; i < propertyCount; i++)
+    {
+        ReportedProperty *property = &properties[i];
+        if (property->inFlightPatchId != patchId)
+        {
+            continue;
+        }
+
+        property->inFlightPatchId = 0;
+
+        if (succeeded)
+        {
+            property->acked = true;
+            property->ackedHash = property->inFlightHash;
+        }
+        else
+        {
+            property->acked = false;
+            property->queued = true;
+        }
+    }
+}
+
+bool ReportedState_IsAcknowledged(const char *name)
+{
+    for (size_t i = 0; i < propertyCount; i++)
+    {
+        const ReportedProperty *property = &properties[i];
+        if (strcmp(property->name, name) == 0)
+        {
+            return property->acked && !property->queued && property->inFlightPatchId == 0 &&
+                   property->ackedHash == property->hash;
+        }
+    }
+
+    return false;
+}
+
+void ReportedState_OnConnectionLost(void)
+{
+    for (size_t i = 0; i < propertyCount; i++)
+    {
+        ReportedProperty *property = &properties[i];
+        if (property->inFlightPatchId != 0)
+        {
+            property->inFlightPatchId = 0;
+            property->acked = false;
+            property->queued = true;
+        }
+    }
+}
+
+/// <summary>
+///     Walks every member of an object, which the raw scan skips over without checking.
+/// </summary>
+static bool IsWellFormedObject(const char *json, size_t length)
+{
+    JsonRawMember member;
+    size_t offset = 0;
+    int result;
+
+    while ((result = JsonTokenizer_NextRawMember(json, length, &offset, &member)) > 0)
+    {
+    }
+
+    return result == 0;
+}
+
+bool ReportedState_OnCompleteTwin(const char *json, size_t length)
+{
+    JsonRawMember section;
+    bool hasReported = JsonTokenizer_FindRawMember(json, length, "reported", &section);
+    const char *reported = hasReported ? json + section.valueStart : json;
+    size_t reportedLength = hasReported ? section.valueEnd - section.valueStart : 0;
+
+    // A twin which cannot be read says nothing of what the hub holds: keep the cache.
+    if (!IsWellFormedObject(json, length) ||
+        (hasReported && !IsWellFormedObject(reported, reportedLength)))
+    {
+        LOG_ERROR("Could not read the reported properties of the device twin.\n");
+        return false;
+    }
+
+    JsonRawMember member;
+    int64_t version = -1;
+
+    if (hasReported && JsonTokenizer_FindRawMember(reported, reportedLength, "$version", &member))
+    {
+        JsonTokenizer_GetRawInt(reported, &member, &version);
+    }
+
+    bool reset = !hasReported || version < lastReportedVersion;
+    lastReportedVersion = version;
+
+    for (size_t i = 0; i < propertyCount; i++)
+    {
+        ReportedProperty *property = &properties[i];
+
+        if (reset || (property->acked && property->inFlightPatchId == 0 &&
+                      !JsonTokenizer_FindRawMember(reported, reportedLength, property->name,
+                                                   &member)))
+        {
+            property->acked = false;
+            property->queued = true;
+        }
+    }
+
+    return reset;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+///     Number of reported properties tracked, and the longest property name.
+/// </summary>
+#define REPORTED_STATE_MAX_PROPERTIES 32
+#define REPORTED_STATE_MAX_NAME 32
+
+/// <summary>
+///     Caches a reported properties patch: each top-level member is compared with the last
+///     value set for that property, and only a changed value is queued for the next patch.
+///     The values are copied.
+/// </summary>
+/// <returns>false if the patch is not a JSON object or a property could not be stored.</returns>
+bool ReportedState_SetPatch(const char *json, size_t length);
+
+/// <summary>
+///     Writes the queued properties as a single reported properties patch, and marks them as
+///     in flight under a new patch ID. Properties which do not fit stay queued for the next
+///     patch.
+/// </summary>
+/// <returns>The patch length, or 0 if nothing is queued.</returns>
+size_t ReportedState_BuildPatch(char *buffer, size_t size, uint32_t *patchId);
+
+/// <summary>
+///     Result of a patch from the reported state callback. A 2xx status acknowledges its
+///     properties; otherwise they are queued again.
+/// </summary>
+void ReportedState_OnResult(uint32_t patchId, int statusCode);
+
+/// <summary>
+///     Whether the hub acknowledged the latest value set for a property.
+/// </summary>
+bool ReportedState_IsAcknowledged(const char *name);
+
+/// <summary>
+///     Queues again the properties of the patches which will not be acknowledged, once the
+///     IoT Hub client is destroyed.
+/// </summary>
+void ReportedState_OnConnectionLost(void);
+
+/// <summary>
+///     Compares the acknowledged properties with the reported section of a complete twin.
+///     If the hub reset the reported properties, i.e. the twin has no reported section or
+///     its $version went backwards, every property is queued again; otherwise only the
+///     missing ones are. A twin which is not well-formed JSON is logged and leaves the cache
+///     unchanged.
+/// </summary>
+/// <returns>true if every property was queued again.</returns>
+bool ReportedState_OnCompleteTwin(const char *json, size_t length);
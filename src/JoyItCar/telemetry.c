@@ -0,0 +1,599 @@
+#include <errno.h>
+#include <string.h>
+
+#ifdef TELEMETRY_STORE_USE_MUTABLE_STORAGE
+#include <applibs/storage.h>
+#endif
+
+#include "utils.h"
+#include "logger.h"
+#include "cbor_writer.h"
+#include "json_writer.h"
+#include "metrics.h"
+
+#include "telemetry.h"
+#include "telemetry_store.h"
+#include "azure_iot_client.h"
+#include "ble_commands.h"
+#include "button_behavior.h"
+
+static EventLoopWorkQueue *telemetryWorkQueue = NULL;
+static EventLoopTimer *telemetrySampleTimer = NULL;
+
+static uint64_t startedAtUs = 0;
+static uint64_t batchStartedAtUs = 0;
+static uint32_t samplesCaptured = 0;
+static size_t batchHeaderSize = 0;
+
+static TelemetryBatchConfig batchConfig = {.samplePeriodMs = 1000,
+                                           .maxSamples = 10,
+                                           .maxAgeSeconds = 10,
+                                           .maxBytes = TELEMETRY_BATCH_MAX_BYTES,
+                                           .encoding = TelemetryEncoding_Json,
+                                           .heartbeatSeconds = 300,
+                                           .messagesPerHour = 360};
+
+static TelemetryBatch batch;
+
+// Effective rate, raised by motor driver transitions and decayed at every idle batch.
+static bool motionActive = false;
+static uint32_t lastI2cErrors = 0;
+static uint32_t uploadIntervalSeconds = 10;
+static uint32_t effectiveSamplePeriodMs = 1000;
+
+// Messages sent in the current hour of the message budget.
+static uint64_t budgetWindowStartedAtUs = 0;
+static uint32_t budgetWindowMessages = 0;
+
+// Row layout of a batch; every row holds the values of these columns in this order.
+static const char *const telemetryColumns[] = {
+    "up", "m0", "m1", "btn", "ble", "cloud", "i2cW", "i2cE",
+    "bleB", "bleF", "stalls", "maxHUs", "maxQUs", "maxMUs", "maxDUs", "maxIUs"};
+
+#define TELEMETRY_COLUMN_COUNT (sizeof(telemetryColumns) / sizeof(telemetryColumns[0]))
+
+// Number of entries of the batch object: period, interval, active, samples, messages,
+// backlog, evicted, dropped, cols and rows.
+#define TELEMETRY_BATCH_FIELD_COUNT 10
+
+/// <summary>
+///     Signed speed of a motor channel: positive clockwise, negative counter-clockwise.
+/// </summary>
+static int64_t GetSignedSpeed(const MotorChannelState *channel)
+{
+    return (int64_t)channel->direction * channel->speed;
+}
+
+/// <summary>
+///     Flattens a sample into the values of its row, shared by both encodings.
+/// </summary>
+static void GetSampleRowValues(const TelemetrySample *sample, int64_t *values)
+{
+    values[0] = sample->uptimeSeconds;
+    values[1] = GetSignedSpeed(&sample->motors.channels[MOTOR_CHA]);
+    values[2] = GetSignedSpeed(&sample->motors.channels[MOTOR_CHB]);
+    values[3] = sample->buttonCommands;
+    values[4] = sample->bleCommands;
+    values[5] = sample->cloudCommands;
+    values[6] = sample->motors.i2cWrites;
+    values[7] = sample->motors.i2cErrors;
+    values[8] = sample->bleBytes;
+    values[9] = sample->bleFrames;
+    values[10] = sample->loopStalls;
+    values[11] = sample->maxHandlerUs;
+    values[12] = sample->workQueueMaxLatencyUs;
+    values[13] = sample->methodMaxLatencyUs;
+    values[14] = sample->methodMaxDispatchUs;
+    values[15] = sample->methodMaxI2cUs;
+}
+
+static void WriteSampleRow(JsonWriter *writer, const TelemetrySample *sample)
+{
+    int64_t values[TELEMETRY_COLUMN_COUNT];
+    GetSampleRowValues(sample, values);
+
+    JsonWriter_BeginArray(writer);
+    for (size_t i = 0; i < TELEMETRY_COLUMN_COUNT; i++)
+    {
+        JsonWriter_Int(writer, values[i]);
+    }
+    JsonWriter_EndArray(writer);
+}
+
+/// <summary>
+///     JSON size of a sample row. The CBOR encoding of a row is never larger, so this bound
+///     holds for both encodings.
+/// </summary>
+static size_t GetSerializedRowSize(const TelemetrySample *sample)
+{
+    char row[256];
+    JsonWriter writer;
+
+    JsonWriter_Init(&writer, row, sizeof(row));
+    WriteSampleRow(&writer, sample);
+
+    return JsonWriter_Finish(&writer);
+}
+
+size_t JoyitCar_SerializeTelemetryBatchJson(const TelemetryBatch *batch, char *buffer, size_t size)
+{
+    JsonWriter writer;
+    JsonWriter_Init(&writer, buffer, size);
+
+    JsonWriter_BeginObject(&writer);
+
+    JsonWriter_Key(&writer, "period");
+    JsonWriter_UInt(&writer, batch->samplePeriodMs);
+    JsonWriter_Key(&writer, "interval");
+    JsonWriter_UInt(&writer, batch->uploadIntervalSeconds);
+    JsonWriter_Key(&writer, "active");
+    JsonWriter_Bool(&writer, batch->motionActive);
+
+    JsonWriter_Key(&writer, "samples");
+    JsonWriter_UInt(&writer, batch->samplesCaptured);
+    JsonWriter_Key(&writer, "messages");
+    JsonWriter_UInt(&writer, batch->messagesSent);
+    JsonWriter_Key(&writer, "backlog");
+    JsonWriter_UInt(&writer, batch->storeBacklog);
+    JsonWriter_Key(&writer, "evicted");
+    JsonWriter_UInt(&writer, batch->storeEvicted);
+    JsonWriter_Key(&writer, "dropped");
+    JsonWriter_UInt(&writer, batch->storeDropped);
+
+    JsonWriter_Key(&writer, "cols");
+    JsonWriter_BeginArray(&writer);
+    for (size_t i = 0; i < sizeof(telemetryColumns) / sizeof(telemetryColumns[0]); i++)
+    {
+        JsonWriter_String(&writer, telemetryColumns[i]);
+    }
+    JsonWriter_EndArray(&writer);
+
+    JsonWriter_Key(&writer, "rows");
+    JsonWriter_BeginArray(&writer);
+    for (uint32_t i = 0; i < batch->count; i++)
+    {
+        WriteSampleRow(&writer, &batch->samples[i]);
+    }
+    JsonWriter_EndArray(&writer);
+
+    JsonWriter_EndObject(&writer);
+
+    return JsonWriter_Finish(&writer);
+}
+
+size_t JoyitCar_SerializeTelemetryBatchCbor(const TelemetryBatch *batch, uint8_t *buffer,
+                                           size_t size)
+{
+    CborWriter writer;
+    CborWriter_Init(&writer, buffer, size);
+
+    CborWriter_BeginMap(&writer, TELEMETRY_BATCH_FIELD_COUNT);
+
+    CborWriter_String(&writer, "period");
+    CborWriter_UInt(&writer, batch->samplePeriodMs);
+    CborWriter_String(&writer, "interval");
+    CborWriter_UInt(&writer, batch->uploadIntervalSeconds);
+    CborWriter_String(&writer, "active");
+    CborWriter_Bool(&writer, batch->motionActive);
+
+    CborWriter_String(&writer, "samples");
+    CborWriter_UInt(&writer, batch->samplesCaptured);
+    CborWriter_String(&writer, "messages");
+    CborWriter_UInt(&writer, batch->messagesSent);
+    CborWriter_String(&writer, "backlog");
+    CborWriter_UInt(&writer, batch->storeBacklog);
+    CborWriter_String(&writer, "evicted");
+    CborWriter_UInt(&writer, batch->storeEvicted);
+    CborWriter_String(&writer, "dropped");
+    CborWriter_UInt(&writer, batch->storeDropped);
+
+    CborWriter_String(&writer, "cols");
+    CborWriter_BeginArray(&writer, TELEMETRY_COLUMN_COUNT);
+    for (size_t i = 0; i < TELEMETRY_COLUMN_COUNT; i++)
+    {
+        CborWriter_String(&writer, telemetryColumns[i]);
+    }
+
+    CborWriter_String(&writer, "rows");
+    CborWriter_BeginArray(&writer, batch->count);
+    for (uint32_t i = 0; i < batch->count; i++)
+    {
+        int64_t values[TELEMETRY_COLUMN_COUNT];
+        GetSampleRowValues(&batch->samples[i], values);
+
+        CborWriter_BeginArray(&writer, TELEMETRY_COLUMN_COUNT);
+        for (size_t j = 0; j < TELEMETRY_COLUMN_COUNT; j++)
+        {
+            CborWriter_Int(&writer, values[j]);
+        }
+    }
+
+    return CborWriter_Finish(&writer);
+}
+
+/// <summary>
+///     Size of the empty batch with its counters at their widest, so that the running size
+///     estimate of a batch never undershoots. Must be called while the batch is empty.
+/// </summary>
+static size_t GetSerializedBatchHeaderSize(void)
+{
+    char header[256];
+
+    batch.samplePeriodMs = UINT32_MAX;
+    batch.uploadIntervalSeconds = UINT32_MAX;
+    batch.motionActive = false;
+    batch.samplesCaptured = UINT32_MAX;
+    batch.messagesSent = UINT32_MAX;
+    batch.storeBacklog = UINT32_MAX;
+    batch.storeEvicted = UINT32_MAX;
+    batch.storeDropped = UINT32_MAX;
+
+    size_t size = JoyitCar_SerializeTelemetryBatchJson(&batch, header, sizeof(header));
+
+    batch.samplePeriodMs = batchConfig.samplePeriodMs;
+    batch.uploadIntervalSeconds = 0;
+    batch.samplesCaptured = 0;
+    batch.messagesSent = 0;
+    batch.storeBacklog = 0;
+    batch.storeEvicted = 0;
+    batch.storeDropped = 0;
+
+    return size;
+}
+
+void JoyitCar_SampleTelemetry(TelemetrySample *sample)
+{
+    BLECommandStats bleStats;
+    AzureIoTStats azureStats;
+    EventLoopStallStats stallStats;
+    EventLoopWorkQueueStats workQueueStats;
+
+    JoyitCar_GetBLECommandStats(&bleStats);
+    JoyitCar_GetAzureIoTStats(&azureStats);
+    GetEventLoopStallStats(&stallStats);
+    GetEventLoopWorkQueueStats(telemetryWorkQueue, &workQueueStats);
+
+    sample->uptimeSeconds = (uint32_t)((GetMonotonicMicroseconds() - startedAtUs) / 1000000u);
+    JoyitCar_GetMotorDriverState(&sample->motors);
+    sample->buttonCommands = JoyitCar_GetButtonCommandCount();
+    sample->bleCommands = bleStats.commands;
+    sample->cloudCommands = azureStats.methodsReceived + azureStats.cloudCommandsApplied;
+    sample->bleBytes = bleStats.bytesReceived;
+    sample->bleFrames = bleStats.framesReceived;
+    sample->loopStalls = stallStats.stalls;
+    sample->maxHandlerUs = stallStats.maxHandlerUs;
+    sample->workQueueMaxLatencyUs = workQueueStats.maxLatencyUs;
+    sample->methodMaxLatencyUs = azureStats.maxMethodLatencyUs;
+    sample->methodMaxDispatchUs = azureStats.maxMethodDispatchUs;
+    sample->methodMaxI2cUs = azureStats.maxMethodI2cUs;
+}
+
+/// <summary>
+///     Shortest upload interval allowed by the message budget.
+/// </summary>
+static uint32_t GetBudgetIntervalSeconds(void)
+{
+    return (3600u + batchConfig.messagesPerHour - 1) / batchConfig.messagesPerHour;
+}
+
+/// <summary>
+///     Upload interval while the car is active: the configured batch age, bounded by the
+///     message budget.
+/// </summary>
+static uint32_t GetActiveIntervalSeconds(void)
+{
+    uint32_t budgetInterval = GetBudgetIntervalSeconds();
+
+    return batchConfig.maxAgeSeconds > budgetInterval ? batchConfig.maxAgeSeconds : budgetInterval;
+}
+
+/// <summary>
+///     Sets the upload interval, clamped between the active interval and the heartbeat, and
+///     stretches the sample period so that a batch of maxSamples samples is not filled before
+///     the interval elapses, which would send more messages than the budget allows.
+/// </summary>
+static void SetTelemetryRate(uint32_t intervalSeconds)
+{
+    uint32_t activeInterval = GetActiveIntervalSeconds();
+    uint32_t heartbeat =
+        batchConfig.heartbeatSeconds > activeInterval ? batchConfig.heartbeatSeconds : activeInterval;
+
+    if (intervalSeconds < activeInterval)
+    {
+        intervalSeconds = activeInterval;
+    }
+    else if (intervalSeconds > heartbeat)
+    {
+        intervalSeconds = heartbeat;
+    }
+
+    uint32_t samplePeriodMs = (uint32_t)((uint64_t)intervalSeconds * 1000u / batchConfig.maxSamples);
+    if (samplePeriodMs < batchConfig.samplePeriodMs)
+    {
+        samplePeriodMs = batchConfig.samplePeriodMs;
+    }
+
+    uploadIntervalSeconds = intervalSeconds;
+    Metrics_SetGauge(MetricGauge_TelemetryIntervalSeconds, (int32_t)intervalSeconds);
+
+    if (samplePeriodMs == effectiveSamplePeriodMs)
+    {
+        return;
+    }
+
+    effectiveSamplePeriodMs = samplePeriodMs;
+
+    if (telemetrySampleTimer != NULL)
+    {
+        struct timespec samplePeriod = {.tv_sec = effectiveSamplePeriodMs / 1000,
+                                        .tv_nsec = (effectiveSamplePeriodMs % 1000) * 1000 * 1000};
+        SetEventLoopTimerPeriod(telemetrySampleTimer, &samplePeriod);
+    }
+}
+
+/// <summary>
+///     Motor driver transition: returns to the active rate when a motor starts or a bus
+///     error occurs. Stopping only clears motionActive; the rate then decays batch by batch.
+/// </summary>
+static void MotorStateChangedEventHandler(const MotorDriverState *state)
+{
+    bool moving = false;
+    for (int i = 0; i < MOTOR_CHANNEL_COUNT; i++)
+    {
+        moving = moving || state->channels[i].direction != 0;
+    }
+
+    bool failing = state->i2cErrors != lastI2cErrors;
+    lastI2cErrors = state->i2cErrors;
+
+    bool wasActive = motionActive;
+    motionActive = moving || failing;
+
+    if (motionActive && (!wasActive || uploadIntervalSeconds != GetActiveIntervalSeconds()))
+    {
+        SetTelemetryRate(0);
+    }
+}
+
+/// <summary>
+///     Counts a message against the hourly budget.
+/// </summary>
+/// <returns>false if the budget of the current hour is spent, unless force is set.</returns>
+static bool ConsumeMessageBudget(bool force)
+{
+    uint64_t now = GetMonotonicMicroseconds();
+
+    if (now - budgetWindowStartedAtUs >= 3600ull * 1000000u)
+    {
+        budgetWindowStartedAtUs = now;
+        budgetWindowMessages = 0;
+    }
+
+    if (!force && budgetWindowMessages >= batchConfig.messagesPerHour)
+    {
+        return false;
+    }
+
+    budgetWindowMessages++;
+    return true;
+}
+
+static void FlushTelemetryBatch(void)
+{
+    if (batch.count == 0)
+    {
+        return;
+    }
+
+    AzureIoTStats azureStats;
+    TelemetryStoreStats storeStats;
+    JoyitCar_GetAzureIoTStats(&azureStats);
+    TelemetryStore_GetStats(&storeStats);
+
+    batch.samplesCaptured = samplesCaptured;
+    batch.messagesSent = azureStats.messagesSent;
+    batch.storeBacklog = storeStats.pendingMessages;
+    Metrics_SetGauge(MetricGauge_TelemetryBacklog, (int32_t)storeStats.pendingMessages);
+    batch.storeEvicted = storeStats.evicted;
+    batch.storeDropped = storeStats.dropped;
+
+    SendTelemetry(&batch);
+
+    batch.count = 0;
+    batch.serializedSize = 0;
+
+    if (!motionActive)
+    {
+        SetTelemetryRate(uploadIntervalSeconds * 2);
+    }
+}
+
+static void CaptureTelemetrySample(void)
+{
+    TelemetrySample sample;
+
+    samplesCaptured++;
+    JoyitCar_SampleTelemetry(&sample);
+
+    size_t rowSize = GetSerializedRowSize(&sample);
+
+    // Flush first if the new row would not fit, so that a batch never exceeds the cap.
+    // Such a flush cannot be deferred and is counted against the budget regardless.
+    if (batch.count == TELEMETRY_BATCH_MAX_SAMPLES ||
+        (batch.count > 0 && batch.serializedSize + 1 + rowSize > batchConfig.maxBytes))
+    {
+        ConsumeMessageBudget(true);
+        FlushTelemetryBatch();
+    }
+
+    if (batch.count == 0)
+    {
+        batchStartedAtUs = GetMonotonicMicroseconds();
+        batch.samplePeriodMs = effectiveSamplePeriodMs;
+        batch.uploadIntervalSeconds = uploadIntervalSeconds;
+        batch.motionActive = motionActive;
+        batch.encoding = batchConfig.encoding;
+        batch.serializedSize = batchHeaderSize;
+    }
+    else
+    {
+        batch.serializedSize += 1; // row separator
+    }
+
+    batch.samples[batch.count++] = sample;
+    batch.serializedSize += rowSize;
+}
+
+/// <summary>
+///     Telemetry sample timer event: captures a sample and sends the batch when it is full
+///     or as old as the upload interval. When the hourly budget is spent the batch is held
+///     until the next hour, or until it is full.
+/// </summary>
+static void TelemetrySampleTimerEventHandler(EventLoopTimer *timer)
+{
+    if (ConsumeEventLoopTimerEvent(timer) != 0)
+    {
+        exitCode = Telemetry_ExitCode_SampleTimer_Consume;
+        return;
+    }
+
+    CaptureTelemetrySample();
+
+    uint64_t batchAgeUs = GetMonotonicMicroseconds() - batchStartedAtUs;
+
+    if ((batch.count >= batchConfig.maxSamples ||
+         batchAgeUs >= (uint64_t)uploadIntervalSeconds * 1000000u) &&
+        ConsumeMessageBudget(false))
+    {
+        FlushTelemetryBatch();
+    }
+}
+
+/// <summary>
+///     Deferred work: captures a last sample and sends the pending batch, if the hourly
+///     budget allows it.
+/// </summary>
+static void FlushTelemetryWork(void *context)
+{
+    CaptureTelemetrySample();
+
+    if (ConsumeMessageBudget(false))
+    {
+        FlushTelemetryBatch();
+    }
+}
+
+void JoyitCar_RequestTelemetryFlush(void)
+{
+    EnqueueEventLoopWork(telemetryWorkQueue, FlushTelemetryWork, NULL);
+}
+
+void JoyitCar_SetTelemetryBatchConfig(const TelemetryBatchConfig *config)
+{
+    batchConfig = *config;
+
+    if (batchConfig.maxSamples == 0 || batchConfig.maxSamples > TELEMETRY_BATCH_MAX_SAMPLES)
+    {
+        batchConfig.maxSamples = TELEMETRY_BATCH_MAX_SAMPLES;
+    }
+
+    if (batchConfig.maxBytes < 512 || batchConfig.maxBytes > TELEMETRY_BATCH_MAX_BYTES)
+    {
+        batchConfig.maxBytes = TELEMETRY_BATCH_MAX_BYTES;
+    }
+
+    if (batchConfig.samplePeriodMs == 0)
+    {
+        batchConfig.samplePeriodMs = 1000;
+    }
+
+    if (batchConfig.encoding != TelemetryEncoding_Cbor)
+    {
+        batchConfig.encoding = TelemetryEncoding_Json;
+    }
+
+    if (batchConfig.messagesPerHour == 0)
+    {
+        batchConfig.messagesPerHour = 360;
+    }
+
+    SetTelemetryRate(motionActive ? 0 : uploadIntervalSeconds);
+}
+
+#ifdef TELEMETRY_STORE_USE_MUTABLE_STORAGE
+/// <summary>
+///     Restores the telemetry saved to mutable storage by the previous run.
+/// </summary>
+static void LoadStoredTelemetry(void)
+{
+    int fd = Storage_OpenMutableFile();
+    if (fd == -1)
+    {
+        LOG_ERROR("Could not open mutable storage: %s (%d).\n", strerror(errno), errno);
+        return;
+    }
+
+    if (TelemetryStore_Load(fd) == -1)
+    {
+        LOG_ERROR("Could not load stored telemetry: %s (%d).\n", strerror(errno), errno);
+    }
+
+    CloseFd(fd, "MutableStorage");
+}
+
+/// <summary>
+///     Saves the unsent telemetry to mutable storage.
+/// </summary>
+static void SaveStoredTelemetry(void)
+{
+    int fd = Storage_OpenMutableFile();
+    if (fd == -1)
+    {
+        LOG_ERROR("Could not open mutable storage: %s (%d).\n", strerror(errno), errno);
+        return;
+    }
+
+    if (TelemetryStore_Save(fd) == -1)
+    {
+        LOG_ERROR("Could not save stored telemetry: %s (%d).\n", strerror(errno), errno);
+    }
+
+    CloseFd(fd, "MutableStorage");
+}
+#endif
+
+void JoyitCar_CloseTelemetry(void)
+{
+    FlushTelemetryBatch();
+
+#ifdef TELEMETRY_STORE_USE_MUTABLE_STORAGE
+    SaveStoredTelemetry();
+#endif
+}
+
+Telemetry_ExitCode JoyitCar_InitTelemetry(EventLoop *eventLoop, EventLoopWorkQueue *workQueue)
+{
+    telemetryWorkQueue = workQueue;
+    startedAtUs = GetMonotonicMicroseconds();
+    batchHeaderSize = GetSerializedBatchHeaderSize();
+
+#ifdef TELEMETRY_STORE_USE_MUTABLE_STORAGE
+    LoadStoredTelemetry();
+#endif
+
+    budgetWindowStartedAtUs = startedAtUs;
+    JoyitCar_SetMotorStateChangedHandler(MotorStateChangedEventHandler);
+    SetTelemetryRate(0);
+
+    struct timespec samplePeriod = {.tv_sec = effectiveSamplePeriodMs / 1000,
+                                    .tv_nsec = (effectiveSamplePeriodMs % 1000) * 1000 * 1000};
+    telemetrySampleTimer =
+        CreateEventLoopPeriodicTimer(eventLoop, &TelemetrySampleTimerEventHandler, &samplePeriod);
+
+    if (telemetrySampleTimer == NULL)
+    {
+        return Telemetry_ExitCode_Init_SampleTimer;
+    }
+
+    return Telemetry_ExitCode_Success;
+}
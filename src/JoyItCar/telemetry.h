@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <applibs/eventloop.h>
+
+#include "eventloop_timer_utilities.h"
+#include "i2c_motor_driver.h"
+
+/// <summary>
+///     Upper bounds of a telemetry batch. The effective limits are set with
+///     <see cref="JoyitCar_SetTelemetryBatchConfig" />.
+/// </summary>
+#define TELEMETRY_BATCH_MAX_SAMPLES 60
+#define TELEMETRY_BATCH_MAX_BYTES 4096
+
+typedef enum
+{
+    Telemetry_ExitCode_Success = 600,
+    Telemetry_ExitCode_Init_SampleTimer = 601,
+    Telemetry_ExitCode_SampleTimer_Consume = 602,
+} Telemetry_ExitCode;
+
+/// <summary>
+///     Encoding of the telemetry messages. Both carry the same batch object; CBOR is sent
+///     with the content type application/cbor and is not queryable by IoT Hub routing.
+/// </summary>
+typedef enum
+{
+    TelemetryEncoding_Json = 0,
+    TelemetryEncoding_Cbor = 1,
+} TelemetryEncoding;
+
+/// <summary>
+///     Snapshot of the vehicle state, sampled on the telemetry sample period.
+/// </summary>
+typedef struct
+{
+    uint32_t uptimeSeconds;
+    MotorDriverState motors;
+    uint32_t buttonCommands;
+    uint32_t bleCommands;
+    uint32_t cloudCommands;
+    uint32_t bleBytes;
+    uint32_t bleFrames;
+    uint32_t loopStalls;
+    uint32_t maxHandlerUs;
+    uint32_t workQueueMaxLatencyUs;
+    uint32_t methodMaxLatencyUs;
+    uint32_t methodMaxDispatchUs;
+    uint32_t methodMaxI2cUs;
+} TelemetrySample;
+
+/// <summary>
+///     Samples accumulated for a single IoT Hub message. samplePeriodMs and
+///     uploadIntervalSeconds are the effective rate when the batch was started; motionActive
+///     is set while the motors run or the motor driver reports errors.
+/// </summary>
+typedef struct
+{
+    uint32_t samplePeriodMs;
+    uint32_t uploadIntervalSeconds;
+    bool motionActive;
+    uint32_t samplesCaptured;
+    uint32_t messagesSent;
+    uint32_t storeBacklog;
+    uint32_t storeEvicted;
+    uint32_t storeDropped;
+    uint32_t count;
+    TelemetryEncoding encoding;
+    size_t serializedSize;
+    TelemetrySample samples[TELEMETRY_BATCH_MAX_SAMPLES];
+} TelemetryBatch;
+
+/// <summary>
+///     A batch is flushed when it holds maxSamples samples, when its first sample is
+///     maxAgeSeconds old, or before its serialized size would exceed maxBytes. encoding
+///     applies from the next batch.
+///     samplePeriodMs and maxAgeSeconds are the rate while the car is active. Once the motors
+///     stop, the upload interval doubles with every batch up to heartbeatSeconds, and the
+///     sample period stretches with it so that a batch keeps at most maxSamples samples.
+///     The rate never exceeds messagesPerHour messages.
+/// </summary>
+typedef struct
+{
+    uint32_t samplePeriodMs;
+    uint32_t maxSamples;
+    uint32_t maxAgeSeconds;
+    size_t maxBytes;
+    TelemetryEncoding encoding;
+    uint32_t heartbeatSeconds;
+    uint32_t messagesPerHour;
+} TelemetryBatchConfig;
+
+Telemetry_ExitCode JoyitCar_InitTelemetry(EventLoop *eventLoop, EventLoopWorkQueue *workQueue);
+
+/// <summary>
+///     Queues the pending batch and, when built with TELEMETRY_STORE_USE_MUTABLE_STORAGE,
+///     saves the unsent telemetry to mutable storage so it is sent after the next start.
+/// </summary>
+void JoyitCar_CloseTelemetry(void);
+
+void JoyitCar_SetTelemetryBatchConfig(const TelemetryBatchConfig *config);
+
+void JoyitCar_SampleTelemetry(TelemetrySample *sample);
+
+/// <summary>
+///     Takes a last sample and sends the pending batch on the next event loop iteration.
+///     Used for significant events such as an emergency stop.
+/// </summary>
+void JoyitCar_RequestTelemetryFlush(void);
+
+/// <summary>
+///     Serializes a batch as a JSON object with one column list and one row per sample,
+///     into a caller-provided buffer, without allocating.
+/// </summary>
+/// <returns>The JSON length, or 0 if the buffer is too small.</returns>
+size_t JoyitCar_SerializeTelemetryBatchJson(const TelemetryBatch *batch, char *buffer, size_t size);
+
+/// <summary>
+///     Serializes a batch as CBOR, with the same layout as the JSON object, into a
+///     caller-provided buffer, without allocating.
+/// </summary>
+/// <returns>The CBOR length, or 0 if the buffer is too small.</returns>
+size_t JoyitCar_SerializeTelemetryBatchCbor(const TelemetryBatch *batch, uint8_t *buffer,
+                                           size_t size);
@@ -0,0 +1,285 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "telemetry_store.h"
+
+#define TELEMETRY_STORE_FILE_MAGIC 0x4A435453 // "JCTS"
+
+/// <summary>
+///     Record header preceding each message in the ring.
+/// </summary>
+typedef struct
+{
+    uint32_t id;
+    uint32_t size;
+} TelemetryStoreRecord;
+
+static uint8_t ring[TELEMETRY_STORE_CAPACITY];
+static size_t head = 0;      // offset of the oldest record
+static size_t usedBytes = 0; // bytes of headers and messages in the ring
+static uint32_t nextId = 1;
+
+static TelemetryStoreStats storeStats;
+
+static void CopyIn(size_t offset, const void *data, size_t size)
+{
+    size_t first = TELEMETRY_STORE_CAPACITY - offset;
+    if (first > size)
+    {
+        first = size;
+    }
+
+    memcpy(ring + offset, data, first);
+    memcpy(ring, (const uint8_t *)data + first, size - first);
+}
+
+static void CopyOut(size_t offset, void *data, size_t size)
+{
+    size_t first = TELEMETRY_STORE_CAPACITY - offset;
+    if (first > size)
+    {
+        first = size;
+    }
+
+    memcpy(data, ring + offset, first);
+    memcpy((uint8_t *)data + first, ring, size - first);
+}
+
+static void RemoveOldest(void)
+{
+    TelemetryStoreRecord record;
+    CopyOut(head, &record, sizeof(record));
+
+    size_t recordBytes = sizeof(record) + record.size;
+    head = (head + recordBytes) % TELEMETRY_STORE_CAPACITY;
+    usedBytes -= recordBytes;
+
+    storeStats.pendingMessages--;
+    storeStats.pendingBytes -= record.size;
+}
+
+/// <summary>
+///     Evicts the oldest records until a record of the given size fits.
+/// </summary>
+static void MakeRoom(size_t recordBytes)
+{
+    while (TELEMETRY_STORE_CAPACITY - usedBytes < recordBytes)
+    {
+        RemoveOldest();
+        storeStats.evicted++;
+    }
+}
+
+/// <summary>
+///     Writes the header of a record whose message is already in the ring after the tail.
+/// </summary>
+static uint32_t CommitRecord(size_t tail, size_t size)
+{
+    TelemetryStoreRecord record = {.id = nextId++, .size = (uint32_t)size};
+    if (nextId == 0)
+    {
+        nextId = 1;
+    }
+
+    CopyIn(tail, &record, sizeof(record));
+    usedBytes += sizeof(record) + size;
+
+    storeStats.stored++;
+    storeStats.pendingMessages++;
+    storeStats.pendingBytes += size;
+
+    return record.id;
+}
+
+uint32_t TelemetryStore_Push(const uint8_t *message, size_t size)
+{
+    if (size == 0 || size > TELEMETRY_STORE_MAX_MESSAGE_BYTES)
+    {
+        storeStats.dropped++;
+        return 0;
+    }
+
+    MakeRoom(sizeof(TelemetryStoreRecord) + size);
+
+    size_t tail = (head + usedBytes) % TELEMETRY_STORE_CAPACITY;
+    CopyIn((tail + sizeof(TelemetryStoreRecord)) % TELEMETRY_STORE_CAPACITY, message, size);
+
+    return CommitRecord(tail, size);
+}
+
+size_t TelemetryStore_Peek(uint8_t *buffer, size_t size, uint32_t *id)
+{
+    if (usedBytes == 0)
+    {
+        return 0;
+    }
+
+    TelemetryStoreRecord record;
+    CopyOut(head, &record, sizeof(record));
+
+    if (record.size > size)
+    {
+        return 0;
+    }
+
+    CopyOut((head + sizeof(record)) % TELEMETRY_STORE_CAPACITY, buffer, record.size);
+    *id = record.id;
+
+    return record.size;
+}
+
+void TelemetryStore_Acknowledge(uint32_t id)
+{
+    if (usedBytes == 0)
+    {
+        return;
+    }
+
+    TelemetryStoreRecord record;
+    CopyOut(head, &record, sizeof(record));
+
+    if (record.id != id)
+    {
+        return;
+    }
+
+    RemoveOldest();
+    storeStats.forwarded++;
+}
+
+void TelemetryStore_GetStats(TelemetryStoreStats *stats)
+{
+    *stats = storeStats;
+}
+
+static int WriteAll(int fd, const void *data, size_t size)
+{
+    const uint8_t *bytes = data;
+
+    while (size > 0)
+    {
+        ssize_t written = write(fd, bytes, size);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return -1;
+        }
+
+        bytes += written;
+        size -= (size_t)written;
+    }
+
+    return 0;
+}
+
+int TelemetryStore_Save(int fd)
+{
+    uint32_t header[2] = {TELEMETRY_STORE_FILE_MAGIC, storeStats.pendingMessages};
+
+    if (lseek(fd, 0, SEEK_SET) == -1 || ftruncate(fd, 0) == -1 ||
+        WriteAll(fd, header, sizeof(header)) == -1)
+    {
+        return -1;
+    }
+
+    size_t offset = head;
+    size_t remaining = usedBytes;
+
+    while (remaining > 0)
+    {
+        TelemetryStoreRecord record;
+        CopyOut(offset, &record, sizeof(record));
+
+        if (WriteAll(fd, &record.size, sizeof(record.size)) == -1)
+        {
+            return -1;
+        }
+
+        // The message may wrap around the end of the ring.
+        size_t messageOffset = (offset + sizeof(record)) % TELEMETRY_STORE_CAPACITY;
+        size_t first = TELEMETRY_STORE_CAPACITY - messageOffset;
+        if (first > record.size)
+        {
+            first = record.size;
+        }
+
+        if (WriteAll(fd, ring + messageOffset, first) == -1 ||
+            WriteAll(fd, ring, record.size - first) == -1)
+        {
+            return -1;
+        }
+
+        size_t recordBytes = sizeof(record) + record.size;
+        offset = (offset + recordBytes) % TELEMETRY_STORE_CAPACITY;
+        remaining -= recordBytes;
+    }
+
+    return 0;
+}
+
+int TelemetryStore_Load(int fd)
+{
+    uint32_t header[2];
+
+    if (lseek(fd, 0, SEEK_SET) == -1)
+    {
+        return -1;
+    }
+
+    ssize_t readBytes = read(fd, header, sizeof(header));
+    if (readBytes < 0)
+    {
+        return -1;
+    }
+
+    if (readBytes != sizeof(header) || header[0] != TELEMETRY_STORE_FILE_MAGIC)
+    {
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < header[1]; i++)
+    {
+        uint32_t size;
+        if (read(fd, &size, sizeof(size)) != sizeof(size) || size == 0)
+        {
+            break;
+        }
+
+        // Stored by an older build or corrupt: skip it rather than let it block forwarding.
+        if (size > TELEMETRY_STORE_MAX_MESSAGE_BYTES)
+        {
+            storeStats.dropped++;
+            if (lseek(fd, size, SEEK_CUR) == -1)
+            {
+                break;
+            }
+            continue;
+        }
+
+        MakeRoom(sizeof(TelemetryStoreRecord) + size);
+
+        // Read the message straight into the ring; it may wrap around the end.
+        size_t tail = (head + usedBytes) % TELEMETRY_STORE_CAPACITY;
+        size_t messageOffset = (tail + sizeof(TelemetryStoreRecord)) % TELEMETRY_STORE_CAPACITY;
+        size_t first = TELEMETRY_STORE_CAPACITY - messageOffset;
+        if (first > size)
+        {
+            first = size;
+        }
+
+        if (read(fd, ring + messageOffset, first) != (ssize_t)first ||
+            read(fd, ring, size - first) != (ssize_t)(size - first))
+        {
+            // Truncated file: keep the messages read so far.
+            break;
+        }
+
+        CommitRecord(tail, size);
+    }
+
+    return 0;
+}
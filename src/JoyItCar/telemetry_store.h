@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// <summary>
+///     Size of the in-memory store-and-forward ring, in bytes.
+/// </summary>
+#define TELEMETRY_STORE_CAPACITY (32 * 1024)
+
+/// <summary>
+///     Largest message the store accepts: the size of the buffer a message is forwarded from.
+///     A larger message could never be peeked, and would hold back every message behind it.
+/// </summary>
+#define TELEMETRY_STORE_MAX_MESSAGE_BYTES 4096
+
+/// <summary>
+///     Counters of the telemetry store. Evicted messages were overwritten oldest-first to
+///     make room; dropped messages could not be stored at all.
+/// </summary>
+typedef struct
+{
+    uint32_t stored;
+    uint32_t forwarded;
+    uint32_t evicted;
+    uint32_t dropped;
+    uint32_t pendingMessages;
+    size_t pendingBytes;
+} TelemetryStoreStats;
+
+/// <summary>
+///     Appends a serialized message, evicting the oldest messages if the ring is full. An empty
+///     message, or one larger than TELEMETRY_STORE_MAX_MESSAGE_BYTES, is dropped.
+/// </summary>
+/// <returns>The id of the stored message, or 0 if the message was dropped.</returns>
+uint32_t TelemetryStore_Push(const uint8_t *message, size_t size);
+
+/// <summary>
+///     Copies the oldest message into a caller-provided buffer without removing it.
+/// </summary>
+/// <param name="id">Receives the id of the message.</param>
+/// <returns>The message size, or 0 if the store is empty or the buffer too small.</returns>
+size_t TelemetryStore_Peek(uint8_t *buffer, size_t size, uint32_t *id);
+
+/// <summary>
+///     Removes the oldest message once it has been delivered. Nothing is removed if the oldest
+///     message is not the given one, for example because it was evicted meanwhile.
+/// </summary>
+void TelemetryStore_Acknowledge(uint32_t id);
+
+void TelemetryStore_GetStats(TelemetryStoreStats *stats);
+
+/// <summary>
+///     Writes the pending messages to a file descriptor, oldest first.
+/// </summary>
+/// <returns>0 on success, -1 on failure, in which case errno contains more information.</returns>
+int TelemetryStore_Save(int fd);
+
+/// <summary>
+///     Appends the messages previously written by <see cref="TelemetryStore_Save" />. Messages
+///     larger than TELEMETRY_STORE_MAX_MESSAGE_BYTES are skipped and counted as dropped; a
+///     truncated file keeps the messages read before the end.
+/// </summary>
+/// <returns>0 on success or when the file holds no store, -1 on read failure.</returns>
+int TelemetryStore_Load(int fd);
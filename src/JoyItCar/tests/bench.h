@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/// <summary>
+///     Minimal timing for the host benchmarks. A case runs a warm-up batch, then
+///     BENCH_ROUNDS batches of the given number of calls; the fastest batch is kept, as the
+///     one least disturbed by the host. Results go through benchSink so that the compiler
+///     cannot drop the work.
+/// </summary>
+#define BENCH_ROUNDS 7
+
+static volatile uint64_t benchSink = 0;
+
+static uint64_t BenchNowNs(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/// <returns>The time of one call in nanoseconds, in the fastest batch.</returns>
+static double BenchNsPerCall(void (*run)(void), uint32_t calls)
+{
+    for (uint32_t i = 0; i < calls / 10 + 1; i++)
+    {
+        run();
+    }
+
+    uint64_t bestNs = UINT64_MAX;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        uint64_t startNs = BenchNowNs();
+        for (uint32_t i = 0; i < calls; i++)
+        {
+            run();
+        }
+        uint64_t elapsedNs = BenchNowNs() - startNs;
+
+        if (elapsedNs < bestNs)
+        {
+            bestNs = elapsedNs;
+        }
+    }
+
+    return (double)bestNs / calls;
+}
+
+#define BENCH_RUN(run, calls) printf("%-36s %9.1f ns/call\n", #run, BenchNsPerCall(run, calls))
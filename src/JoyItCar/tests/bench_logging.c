@@ -0,0 +1,128 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include <applibs/log.h>
+
+#include "logger.h"
+
+#include "bench.h"
+
+// The cost of one debug line at the call site, on the line the command bus logs when it
+// rejects a command: formatted in place by Log_Debug, recorded for Logger_Drain() by
+// LOG_DEFERRED, or compiled out below LOG_LEVEL. The formatting is also timed on its own,
+// without the output which Log_Debug adds to it.
+
+#define BENCH_CALLS 100000
+
+static const char *const owner = "button";
+static const char *const source = "cloud";
+
+static char line[160];
+
+static int FormatDebug(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+
+    return length;
+}
+
+static void Format_Vsnprintf(void)
+{
+    benchSink += (uint64_t)FormatDebug(
+        "DEBUG: Motor command from %s rejected, the motors are owned by %s.\n", source, owner);
+}
+
+static void LogDebug_Stderr(void)
+{
+    LOG_DEBUG("Motor command from %s rejected, the motors are owned by %s.\n", source, owner);
+}
+
+static void LogDeferred_Record(void)
+{
+    LOG_DEFERRED_DEBUG("Motor command from %s rejected, the motors are owned by %s.\n",
+                       (intptr_t)source, (intptr_t)owner);
+}
+
+static void LogDeferred_RecordAndDrain(void)
+{
+    static uint32_t pending = 0;
+
+    LogDeferred_Record();
+
+    if (++pending == LOGGER_DRAIN_BATCH)
+    {
+        benchSink += Logger_Drain(LOGGER_DRAIN_BATCH);
+        pending = 0;
+    }
+}
+
+static void CompiledOut(void)
+{
+    LOG_DISABLED("DEBUG: Motor command from %s rejected, the motors are owned by %s.\n", source,
+                 owner);
+}
+
+static void DeferredCompiledOut(void)
+{
+    LOG_DEFERRED_DISABLED("DEBUG: Motor command from %s rejected, the motors are owned by %s.\n",
+                          (intptr_t)source, (intptr_t)owner);
+}
+
+/// <summary>
+///     Times the records alone: the ring holds LOGGER_RING_SIZE of them, so it is filled and
+///     drained in turn, with only the filling timed.
+/// </summary>
+/// <returns>The time of one record in nanoseconds, in the fastest round.</returns>
+static double BenchDeferNsPerCall(uint32_t calls)
+{
+    uint64_t bestNs = UINT64_MAX;
+
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        uint64_t elapsedNs = 0;
+
+        for (uint32_t done = 0; done < calls; done += LOGGER_RING_SIZE)
+        {
+            uint64_t startNs = BenchNowNs();
+            for (uint32_t i = 0; i < LOGGER_RING_SIZE; i++)
+            {
+                LogDeferred_Record();
+            }
+            elapsedNs += BenchNowNs() - startNs;
+
+            benchSink += Logger_Drain(LOGGER_RING_SIZE);
+        }
+
+        if (elapsedNs < bestNs)
+        {
+            bestNs = elapsedNs;
+        }
+    }
+
+    return (double)bestNs / (calls / LOGGER_RING_SIZE * LOGGER_RING_SIZE);
+}
+
+int main(void)
+{
+    // The lines drained or logged are discarded; what they cost to write depends on the host.
+    if (freopen("/dev/null", "w", stderr) == NULL)
+    {
+        return 1;
+    }
+
+    BENCH_RUN(Format_Vsnprintf, BENCH_CALLS);
+    BENCH_RUN(LogDebug_Stderr, BENCH_CALLS);
+    printf("%-36s %9.1f ns/call\n", "LogDeferred_Record", BenchDeferNsPerCall(BENCH_CALLS));
+    BENCH_RUN(LogDeferred_RecordAndDrain, BENCH_CALLS);
+    BENCH_RUN(CompiledOut, BENCH_CALLS);
+    BENCH_RUN(DeferredCompiledOut, BENCH_CALLS);
+
+    LoggerStats stats;
+    Logger_GetStats(&stats);
+    printf("%u records deferred, %u dropped.\n", stats.deferred, stats.dropped);
+
+    return 0;
+}
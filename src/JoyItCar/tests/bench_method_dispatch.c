@@ -0,0 +1,175 @@
+#include <string.h>
+
+#include "json_tokenizer.h"
+#include "json_writer.h"
+#include "utils.h"
+
+#include "bench.h"
+
+// The path of a Drive Direct Method through DeviceMethodCallback() in azure_iot_client.c,
+// whose steps are static there and mirrored here: the envelope, the method lookup, the
+// arguments and the traced response. The payload is tokenized twice, as on the device.
+
+#define DEVICE_METHOD_MAX_TOKENS 16
+#define DEVICE_METHOD_TRACE_MAX 32
+
+static const char payload[] = "{\"left\":200,\"right\":-180,\"ms\":1500,"
+                              "\"key\":\"9c1e6f0a-4d2b-4b7e-a1f3-5e8d2c7b9a10\","
+                              "\"ts\":1760000000000,"
+                              "\"trace\":\"4bf92f3577b34da6a3ce929d0e0e4736\"}";
+
+// In the order of deviceMethodActions.
+static const char *const methodNames[] = {
+    "GoForward",   "GoBackward", "Break",           "TurnRight",    "TurnLeft",        "Drive",
+    "SetVelocity", "StartDemo",  "ExecuteSequence", "GetOperation", "CancelOperation",
+};
+
+static JsonToken tokens[DEVICE_METHOD_MAX_TOKENS];
+static char responseBuffer[256];
+
+static int FindMethod(const char *name, size_t length)
+{
+    for (size_t i = 0; i < sizeof(methodNames) / sizeof(methodNames[0]); i++)
+    {
+        if (strncmp(name, methodNames[i], length) == 0 && methodNames[i][length] == '\0')
+        {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
+static bool ReadIntArgument(int count, const char *key, int64_t min, int64_t max,
+                            bool isRequired, int64_t defaultValue, int64_t *value)
+{
+    int token = JsonTokenizer_FindMember(payload, tokens, count, 0, key);
+    if (token < 0)
+    {
+        *value = defaultValue;
+        return !isRequired;
+    }
+
+    return JsonTokenizer_GetInt(payload, &tokens[token], value) && *value >= min && *value <= max;
+}
+
+static uint64_t ReadEnvelope(int64_t *sentAtMs, char *trace)
+{
+    int count =
+        JsonTokenizer_Parse(payload, sizeof(payload) - 1, tokens, DEVICE_METHOD_MAX_TOKENS);
+    int keyToken = JsonTokenizer_FindMember(payload, tokens, count, 0, "key");
+    int tsToken = JsonTokenizer_FindMember(payload, tokens, count, 0, "ts");
+    int traceToken = JsonTokenizer_FindMember(payload, tokens, count, 0, "trace");
+
+    if (tsToken < 0 || !JsonTokenizer_GetInt(payload, &tokens[tsToken], sentAtMs))
+    {
+        *sentAtMs = 0;
+    }
+
+    trace[0] = '\0';
+    if (traceToken >= 0)
+    {
+        size_t length = (size_t)(tokens[traceToken].end - tokens[traceToken].start);
+        if (length <= DEVICE_METHOD_TRACE_MAX)
+        {
+            memcpy(trace, payload + tokens[traceToken].start, length);
+            trace[length] = '\0';
+        }
+    }
+
+    if (keyToken < 0)
+    {
+        return 0;
+    }
+
+    return HashFnv1a64(payload + tokens[keyToken].start,
+                       (size_t)(tokens[keyToken].end - tokens[keyToken].start));
+}
+
+static bool ParseDrive(int64_t *left, int64_t *right, int64_t *durationMs)
+{
+    int count =
+        JsonTokenizer_Parse(payload, sizeof(payload) - 1, tokens, DEVICE_METHOD_MAX_TOKENS);
+
+    return count > 0 && ReadIntArgument(count, "left", -255, 255, true, 0, left) &&
+           ReadIntArgument(count, "right", -255, 255, true, 0, right) &&
+           ReadIntArgument(count, "ms", 1, 10000, false, 1000, durationMs);
+}
+
+static size_t WriteResponse(const char *trace)
+{
+    JsonWriter writer;
+    JsonWriter_Init(&writer, responseBuffer, sizeof(responseBuffer));
+    JsonWriter_BeginObject(&writer);
+    JsonWriter_Key(&writer, "result");
+    JsonWriter_String(&writer, "OK");
+    JsonWriter_Key(&writer, "trace");
+    JsonWriter_String(&writer, trace);
+    JsonWriter_Key(&writer, "receivedAt");
+    JsonWriter_UInt(&writer, 1760000000123u);
+    JsonWriter_EndObject(&writer);
+
+    return JsonWriter_Finish(&writer);
+}
+
+static void Tokenize(void)
+{
+    benchSink += (uint64_t)JsonTokenizer_Parse(payload, sizeof(payload) - 1, tokens,
+                                               DEVICE_METHOD_MAX_TOKENS);
+}
+
+static void Envelope(void)
+{
+    int64_t sentAtMs;
+    char trace[DEVICE_METHOD_TRACE_MAX + 1];
+
+    benchSink += ReadEnvelope(&sentAtMs, trace) + (uint64_t)sentAtMs;
+}
+
+static void MethodLookup(void)
+{
+    benchSink += (uint64_t)FindMethod("Drive", 5);
+}
+
+static void DriveArguments(void)
+{
+    int64_t left, right, durationMs;
+
+    if (ParseDrive(&left, &right, &durationMs))
+    {
+        benchSink += (uint64_t)(left + right + durationMs);
+    }
+}
+
+static void Response(void)
+{
+    benchSink += WriteResponse("4bf92f3577b34da6a3ce929d0e0e4736");
+}
+
+static void WholeMethod(void)
+{
+    int64_t sentAtMs, left, right, durationMs;
+    char trace[DEVICE_METHOD_TRACE_MAX + 1];
+
+    uint64_t key = ReadEnvelope(&sentAtMs, trace);
+    int method = FindMethod("Drive", 5);
+
+    if (method >= 0 && ParseDrive(&left, &right, &durationMs))
+    {
+        benchSink += key + WriteResponse(trace);
+    }
+}
+
+int main(void)
+{
+    printf("Drive payload: %zu bytes\n", sizeof(payload) - 1);
+
+    BENCH_RUN(Tokenize, 200000);
+    BENCH_RUN(Envelope, 200000);
+    BENCH_RUN(MethodLookup, 1000000);
+    BENCH_RUN(DriveArguments, 200000);
+    BENCH_RUN(Response, 200000);
+    BENCH_RUN(WholeMethod, 200000);
+
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include <string.h>
+
+#include "azure_iot_client.h"
+#include "ble_commands.h"
+#include "button_behavior.h"
+#include "eventloop_timer_utilities.h"
+#include "i2c_motor_driver.h"
+#include "telemetry.h"
+
+#include "bench.h"
+
+// Size and encode time of telemetry batches in JSON and in CBOR, for the samples of a car
+// idling, driving, and running for days. Only the serializers are exercised; the rest of
+// telemetry.c links against the fakes below.
+
+static TelemetryBatch batch;
+static char jsonBuffer[16384];
+static uint8_t cborBuffer[16384];
+
+EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTimerHandler handler,
+                                             const struct timespec *period)
+{
+    return NULL;
+}
+
+int ConsumeEventLoopTimerEvent(EventLoopTimer *timer)
+{
+    return 0;
+}
+
+int SetEventLoopTimerPeriod(EventLoopTimer *timer, const struct timespec *period)
+{
+    return 0;
+}
+
+int EnqueueEventLoopWork(EventLoopWorkQueue *queue, EventLoopWorkHandler handler, void *context)
+{
+    return 0;
+}
+
+void GetEventLoopStallStats(EventLoopStallStats *stats) {}
+
+void GetEventLoopWorkQueueStats(const EventLoopWorkQueue *queue, EventLoopWorkQueueStats *stats)
+{
+}
+
+void JoyitCar_GetAzureIoTStats(AzureIoTStats *stats) {}
+
+void JoyitCar_GetBLECommandStats(BLECommandStats *stats) {}
+
+uint32_t JoyitCar_GetButtonCommandCount(void)
+{
+    return 0;
+}
+
+void JoyitCar_GetMotorDriverState(MotorDriverState *state) {}
+
+void JoyitCar_SetMotorStateChangedHandler(MotorStateChangedHandler handler) {}
+
+void SendTelemetry(const TelemetryBatch *batch) {}
+
+/// <summary>
+///     A car at rest shortly after boot: small counters, stopped motors.
+/// </summary>
+static void FillIdle(TelemetrySample *sample, uint32_t index)
+{
+    memset(sample, 0, sizeof(*sample));
+    sample->uptimeSeconds = 300 + index * 60;
+    sample->motors.i2cWrites = 42;
+    sample->cloudCommands = 3;
+    sample->maxHandlerUs = 180;
+    sample->workQueueMaxLatencyUs = 95;
+}
+
+/// <summary>
+///     A car being driven: motors running, commands and BLE traffic flowing.
+/// </summary>
+static void FillDriving(TelemetrySample *sample, uint32_t index)
+{
+    memset(sample, 0, sizeof(*sample));
+    sample->uptimeSeconds = 1800 + index;
+    sample->motors.channels[MOTOR_CHA].direction = 1;
+    sample->motors.channels[MOTOR_CHA].speed = 180 + (int)(index % 40);
+    sample->motors.channels[MOTOR_CHB].direction = index % 8 == 0 ? -1 : 1;
+    sample->motors.channels[MOTOR_CHB].speed = 160 + (int)(index % 60);
+    sample->motors.i2cWrites = 4200 + index * 25;
+    sample->motors.i2cErrors = index / 30;
+    sample->buttonCommands = 12;
+    sample->bleCommands = 340 + index;
+    sample->cloudCommands = 95 + index / 4;
+    sample->bleBytes = 5400 + index * 16;
+    sample->bleFrames = 340 + index;
+    sample->loopStalls = 2;
+    sample->maxHandlerUs = 2400 + index * 13;
+    sample->workQueueMaxLatencyUs = 850 + index * 7;
+    sample->methodMaxLatencyUs = 4300;
+    sample->methodMaxDispatchUs = 640;
+    sample->methodMaxI2cUs = 131000;
+}
+
+/// <summary>
+///     A car up for weeks: every counter large.
+/// </summary>
+static void FillLongRunning(TelemetrySample *sample, uint32_t index)
+{
+    FillDriving(sample, index);
+    sample->uptimeSeconds = 2500000 + index;
+    sample->motors.i2cWrites = 38000000 + index * 25;
+    sample->motors.i2cErrors = 1200;
+    sample->motors.rampAborts = 14;
+    sample->buttonCommands = 5400;
+    sample->bleCommands = 820000 + index;
+    sample->cloudCommands = 96000 + index;
+    sample->bleBytes = 13000000 + index * 16;
+    sample->bleFrames = 820000 + index;
+    sample->loopStalls = 310;
+}
+
+static void FillBatch(void (*fill)(TelemetrySample *, uint32_t), uint32_t count)
+{
+    memset(&batch, 0, sizeof(batch));
+    batch.samplePeriodMs = 1000;
+    batch.uploadIntervalSeconds = 60;
+    batch.motionActive = fill != FillIdle;
+    batch.samplesCaptured = 12000;
+    batch.messagesSent = 200;
+    batch.count = count;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        fill(&batch.samples[i], i);
+    }
+}
+
+static void EncodeJson(void)
+{
+    benchSink += JoyitCar_SerializeTelemetryBatchJson(&batch, jsonBuffer, sizeof(jsonBuffer));
+}
+
+static void EncodeCbor(void)
+{
+    benchSink += JoyitCar_SerializeTelemetryBatchCbor(&batch, cborBuffer, sizeof(cborBuffer));
+}
+
+static void Compare(const char *name, void (*fill)(TelemetrySample *, uint32_t), uint32_t count)
+{
+    FillBatch(fill, count);
+
+    size_t jsonSize = JoyitCar_SerializeTelemetryBatchJson(&batch, jsonBuffer, sizeof(jsonBuffer));
+    size_t cborSize = JoyitCar_SerializeTelemetryBatchCbor(&batch, cborBuffer, sizeof(cborBuffer));
+    uint32_t calls = 200000 / (count + 4);
+
+    printf("%-13s %2u samples: JSON %5zu bytes %8.0f ns, CBOR %5zu bytes %8.0f ns, size %3.0f%%\n",
+           name, count, jsonSize, BenchNsPerCall(EncodeJson, calls), cborSize,
+           BenchNsPerCall(EncodeCbor, calls), 100.0 * (double)cborSize / (double)jsonSize);
+}
+
+int main(void)
+{
+    static const uint32_t counts[] = {1, 10, TELEMETRY_BATCH_MAX_SAMPLES};
+
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+    {
+        Compare("idle", FillIdle, counts[i]);
+        Compare("driving", FillDriving, counts[i]);
+        Compare("long-running", FillLongRunning, counts[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <stdbool.h>
+
+// Host stand-in for the Azure Sphere application library: declarations only.
+int Application_IsDeviceAuthReady(bool *outIsReady);
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-in for the Azure Sphere GPIO library: declarations only.
+typedef int GPIO_Id;
+typedef uint8_t GPIO_Value_Type;
+typedef uint8_t GPIO_OutputMode_Type;
+
+enum
+{
+    GPIO_Value_Low = 0,
+    GPIO_Value_High = 1,
+};
+
+enum
+{
+    GPIO_OutputMode_PushPull = 0,
+};
+
+int GPIO_OpenAsOutput(GPIO_Id gpioId, GPIO_OutputMode_Type outputMode,
+                      GPIO_Value_Type initialValue);
+int GPIO_SetValue(int gpioFd, GPIO_Value_Type value);
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Host stand-in for the Azure Sphere networking library: declarations only.
+typedef uint32_t Networking_InterfaceConnectionStatus;
+
+enum
+{
+    Networking_InterfaceConnectionStatus_InterfaceUp = 1,
+    Networking_InterfaceConnectionStatus_ConnectedToNetwork = 2,
+    Networking_InterfaceConnectionStatus_IpAvailable = 4,
+    Networking_InterfaceConnectionStatus_ConnectedToInternet = 8,
+};
+
+int Networking_IsNetworkingReady(bool *outIsNetworkingReady);
+int Networking_GetInterfaceConnectionStatus(const char *networkInterfaceName,
+                                            Networking_InterfaceConnectionStatus *outStatus);
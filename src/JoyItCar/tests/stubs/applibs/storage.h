@@ -0,0 +1,5 @@
+#pragma once
+
+// Host stand-in for the Azure Sphere storage library: declarations only.
+int Storage_OpenMutableFile(void);
+int Storage_DeleteMutableFile(void);
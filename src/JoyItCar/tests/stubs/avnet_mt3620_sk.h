@@ -0,0 +1,15 @@
+#pragma once
+
+// Peripherals of the Avnet MT3620 Starter Kit used by the hardware definition.
+#define AVNET_MT3620_SK_GPIO0 0
+#define AVNET_MT3620_SK_GPIO2 2
+#define AVNET_MT3620_SK_GPIO16 16
+#define AVNET_MT3620_SK_GPIO34 34
+#define AVNET_MT3620_SK_GPIO42 42
+#define AVNET_MT3620_SK_ISU0_UART 0
+#define AVNET_MT3620_SK_ISU2_I2C 2
+#define AVNET_MT3620_SK_USER_LED_RED 8
+#define AVNET_MT3620_SK_USER_LED_GREEN 9
+#define AVNET_MT3620_SK_USER_LED_BLUE 10
+#define AVNET_MT3620_SK_USER_BUTTON_A 12
+#define AVNET_MT3620_SK_USER_BUTTON_B 13
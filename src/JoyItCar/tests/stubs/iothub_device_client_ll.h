@@ -0,0 +1,110 @@
+#pragma once
+
+// The SDK headers bring in the C library headers which the client code relies on.
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "iothub_message.h"
+
+// Host stand-in for the Azure IoT device client: the parts of its API the modules use.
+typedef struct IOTHUB_CLIENT_CORE_LL_HANDLE_DATA_TAG *IOTHUB_DEVICE_CLIENT_LL_HANDLE;
+typedef const void *(*IOTHUB_CLIENT_TRANSPORT_PROVIDER)(void);
+
+typedef enum
+{
+    IOTHUB_CLIENT_OK,
+    IOTHUB_CLIENT_INVALID_ARG,
+    IOTHUB_CLIENT_ERROR,
+} IOTHUB_CLIENT_RESULT;
+
+typedef enum
+{
+    IOTHUB_CLIENT_CONNECTION_AUTHENTICATED,
+    IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED,
+} IOTHUB_CLIENT_CONNECTION_STATUS;
+
+typedef enum
+{
+    IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN,
+    IOTHUB_CLIENT_CONNECTION_DEVICE_DISABLED,
+    IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL,
+    IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED,
+    IOTHUB_CLIENT_CONNECTION_NO_NETWORK,
+    IOTHUB_CLIENT_CONNECTION_COMMUNICATION_ERROR,
+    IOTHUB_CLIENT_CONNECTION_OK,
+    IOTHUB_CLIENT_CONNECTION_NO_PING_RESPONSE,
+} IOTHUB_CLIENT_CONNECTION_STATUS_REASON;
+
+typedef enum
+{
+    IOTHUB_CLIENT_CONFIRMATION_OK,
+    IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY,
+    IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT,
+    IOTHUB_CLIENT_CONFIRMATION_ERROR,
+} IOTHUB_CLIENT_CONFIRMATION_RESULT;
+
+typedef enum
+{
+    IOTHUB_CLIENT_SEND_STATUS_IDLE,
+    IOTHUB_CLIENT_SEND_STATUS_BUSY,
+} IOTHUB_CLIENT_STATUS;
+
+typedef enum
+{
+    DEVICE_TWIN_UPDATE_COMPLETE,
+    DEVICE_TWIN_UPDATE_PARTIAL,
+} DEVICE_TWIN_UPDATE_STATE;
+
+typedef enum
+{
+    IOTHUBMESSAGE_ACCEPTED,
+    IOTHUBMESSAGE_REJECTED,
+    IOTHUBMESSAGE_ABANDONED,
+} IOTHUBMESSAGE_DISPOSITION_RESULT;
+
+typedef void (*IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK)(IOTHUB_CLIENT_CONFIRMATION_RESULT result,
+                                                          void *userContextCallback);
+typedef void (*IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK)(
+    IOTHUB_CLIENT_CONNECTION_STATUS result, IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason,
+    void *userContextCallback);
+typedef void (*IOTHUB_CLIENT_REPORTED_STATE_CALLBACK)(int status_code, void *userContextCallback);
+typedef void (*IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK)(DEVICE_TWIN_UPDATE_STATE update_state,
+                                                   const unsigned char *payLoad, size_t size,
+                                                   void *userContextCallback);
+typedef int (*IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC)(const char *method_name,
+                                                          const unsigned char *payload,
+                                                          size_t size, unsigned char **response,
+                                                          size_t *response_size,
+                                                          void *userContextCallback);
+typedef IOTHUBMESSAGE_DISPOSITION_RESULT (*IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC)(
+    IOTHUB_MESSAGE_HANDLE message, void *userContextCallback);
+
+void IoTHubDeviceClient_LL_Destroy(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetOption(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle,
+                                                     const char *optionName, const void *value);
+void IoTHubDeviceClient_LL_DoWork(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_GetSendStatus(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle,
+                                                         IOTHUB_CLIENT_STATUS *status);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendEventAsync(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_MESSAGE_HANDLE message,
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback, void *context);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendReportedState(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, const unsigned char *reportedState, size_t size,
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK callback, void *context);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_GetTwinAsync(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle,
+                                                        IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK callback,
+                                                        void *context);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceTwinCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK callback,
+    void *context);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceMethodCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC callback,
+    void *context);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetMessageCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC callback,
+    void *context);
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetConnectionStatusCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK callback,
+    void *context);
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h>
+
+// Host stand-in for the Azure IoT message API: declarations only.
+typedef struct IOTHUB_MESSAGE_HANDLE_DATA_TAG *IOTHUB_MESSAGE_HANDLE;
+
+typedef enum
+{
+    IOTHUB_MESSAGE_OK,
+    IOTHUB_MESSAGE_INVALID_ARG,
+    IOTHUB_MESSAGE_INVALID_TYPE,
+    IOTHUB_MESSAGE_ERROR,
+} IOTHUB_MESSAGE_RESULT;
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char *byteArray,
+                                                        size_t size);
+IOTHUB_MESSAGE_RESULT IoTHubMessage_GetByteArray(IOTHUB_MESSAGE_HANDLE handle,
+                                                 const unsigned char **buffer, size_t *size);
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentTypeSystemProperty(IOTHUB_MESSAGE_HANDLE handle,
+                                                                 const char *contentType);
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentEncodingSystemProperty(
+    IOTHUB_MESSAGE_HANDLE handle, const char *contentEncoding);
+void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE handle);
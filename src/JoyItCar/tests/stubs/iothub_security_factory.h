@@ -0,0 +1,10 @@
+#pragma once
+
+typedef enum
+{
+    IOTHUB_SECURITY_TYPE_UNKNOWN,
+    IOTHUB_SECURITY_TYPE_SAS,
+    IOTHUB_SECURITY_TYPE_X509,
+} IOTHUB_SECURITY_TYPE;
+
+int iothub_security_init(IOTHUB_SECURITY_TYPE sec_type);
@@ -0,0 +1,3 @@
+#pragma once
+
+const void *MQTT_Protocol(void);
@@ -0,0 +1,19 @@
+#include <stdio.h>
+
+#include <applibs/log.h>
+
+// Logs go to stderr, where ctest shows them for a failing test.
+int Log_Debug(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int result = Log_DebugVarArgs(fmt, args);
+    va_end(args);
+
+    return result;
+}
+
+int Log_DebugVarArgs(const char *fmt, va_list args)
+{
+    return vfprintf(stderr, fmt, args);
+}
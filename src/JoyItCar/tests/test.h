@@ -0,0 +1,43 @@
+#pragma once
+
+#include <inttypes.h>
+#include <stdio.h>
+
+/// <summary>
+///     Minimal assertions for the host tests: a failed check is printed and counted, and the
+///     test program exits with a non-zero status if any check failed.
+/// </summary>
+static int testFailures = 0;
+
+#define EXPECT(condition)                                                            \
+    do                                                                               \
+    {                                                                                \
+        if (!(condition))                                                            \
+        {                                                                            \
+            fprintf(stderr, "%s:%d: expected %s\n", __FILE__, __LINE__, #condition); \
+            testFailures++;                                                          \
+        }                                                                            \
+    } while (0)
+
+#define EXPECT_EQ(expected, actual)                                                      \
+    do                                                                                   \
+    {                                                                                    \
+        int64_t expectedValue = (int64_t)(expected);                                     \
+        int64_t actualValue = (int64_t)(actual);                                         \
+        if (expectedValue != actualValue)                                                \
+        {                                                                                \
+            fprintf(stderr, "%s:%d: expected %s == %" PRId64 ", got %" PRId64 "\n",      \
+                    __FILE__, __LINE__, #actual, expectedValue, actualValue);            \
+            testFailures++;                                                              \
+        }                                                                                \
+    } while (0)
+
+#define RUN_TEST(test)                                                                   \
+    do                                                                                   \
+    {                                                                                    \
+        int failuresBefore = testFailures;                                               \
+        test();                                                                          \
+        fprintf(stderr, "%s %s\n", testFailures == failuresBefore ? "PASS" : "FAIL", #test); \
+    } while (0)
+
+#define TEST_EXIT_CODE() (testFailures == 0 ? 0 : 1)
@@ -0,0 +1,729 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <applibs/gpio.h>
+#include <applibs/networking.h>
+
+#include <iothub_device_client_ll.h>
+#include <iothub_message.h>
+
+#include "azure_iot_client.h"
+#include "command_bus.h"
+#include "device_config.h"
+#include "device_operations.h"
+#include "eventloop_timer_utilities.h"
+#include "i2c_motor_driver.h"
+#include "iot_connection.h"
+#include "metrics.h"
+#include "motion_control.h"
+#include "motion_sequencer.h"
+#include "telemetry.h"
+#include "telemetry_store.h"
+
+#include "test.h"
+
+#define MAX_WORK_ITEMS 8
+#define MAX_SENDS 16
+#define MAX_REPORTS 16
+
+// Fake monotonic clock, advanced by the tests.
+static uint64_t nowUs = 1000 * 1000 * 1000;
+
+// The DoWork timer, created first, and the metrics report timer, fired by hand.
+struct EventLoopTimer
+{
+    EventLoopTimerHandler handler;
+    bool armed;
+    uint32_t periodMs;
+    uint32_t elapsedMs;
+};
+
+static struct EventLoopTimer timers[2];
+static size_t timerCount = 0;
+static EventLoopTimer *const doWorkTimer = &timers[0];
+static EventLoopTimer *const metricsReportTimer = &timers[1];
+
+static EventLoopWorkHandler workHandlers[MAX_WORK_ITEMS];
+static void *workContexts[MAX_WORK_ITEMS];
+static size_t workCount = 0;
+
+static bool connectedToInternet = true;
+
+// Fake IoT Hub client: the handle is the address of a byte, which is never dereferenced.
+static char clientInstance;
+static const IoTConnectionHandlers *connectionHandlers = NULL;
+static IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK connectionStatusCallback = NULL;
+
+// Fake messages hold a copy of their body.
+struct IOTHUB_MESSAGE_HANDLE_DATA_TAG
+{
+    char body[TELEMETRY_BATCH_MAX_BYTES];
+    size_t size;
+};
+
+static struct IOTHUB_MESSAGE_HANDLE_DATA_TAG messageInstance;
+
+// Telemetry events handed to the client, in order.
+typedef struct
+{
+    char body[32];
+    uint64_t atUs;
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback;
+    void *context;
+} SentEvent;
+
+static SentEvent sentEvents[MAX_SENDS];
+static size_t sentCount = 0;
+
+// Reported state patches handed to the client, in order.
+typedef struct
+{
+    char body[4096];
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK callback;
+    void *context;
+    bool confirmed;
+} SentReport;
+
+static SentReport sentReports[MAX_REPORTS];
+static size_t reportCount = 0;
+
+uint64_t GetMonotonicMicroseconds(void)
+{
+    return nowUs;
+}
+
+// utils.c also defines the monotonic clock, which is faked above.
+uint64_t HashFnv1a64(const char *data, size_t length)
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ (uint8_t)data[i]) * 1099511628211ull;
+    }
+
+    return hash;
+}
+
+EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTimerHandler handler,
+                                             const struct timespec *period)
+{
+    EventLoopTimer *timer = &timers[timerCount++];
+    timer->handler = handler;
+    timer->armed = period != NULL;
+
+    return timer;
+}
+
+EventLoopTimer *CreateEventLoopDisarmedTimer(EventLoop *eventLoop, EventLoopTimerHandler handler)
+{
+    return CreateEventLoopPeriodicTimer(eventLoop, handler, NULL);
+}
+
+int ConsumeEventLoopTimerEvent(EventLoopTimer *timer)
+{
+    return 0;
+}
+
+int SetEventLoopTimerPeriod(EventLoopTimer *timer, const struct timespec *period)
+{
+    timer->armed = true;
+    timer->periodMs = (uint32_t)(period->tv_sec * 1000 + period->tv_nsec / (1000 * 1000));
+    timer->elapsedMs = 0;
+    return 0;
+}
+
+int DisarmEventLoopTimer(EventLoopTimer *timer)
+{
+    timer->armed = false;
+    return 0;
+}
+
+int EnqueueEventLoopWork(EventLoopWorkQueue *queue, EventLoopWorkHandler handler, void *context)
+{
+    if (workCount == MAX_WORK_ITEMS)
+    {
+        return -1;
+    }
+
+    workHandlers[workCount] = handler;
+    workContexts[workCount] = context;
+    workCount++;
+    return 0;
+}
+
+int GPIO_OpenAsOutput(GPIO_Id gpioId, GPIO_OutputMode_Type outputMode,
+                      GPIO_Value_Type initialValue)
+{
+    return 10 + gpioId;
+}
+
+int GPIO_SetValue(int gpioFd, GPIO_Value_Type value)
+{
+    return 0;
+}
+
+int Networking_GetInterfaceConnectionStatus(const char *networkInterfaceName,
+                                            Networking_InterfaceConnectionStatus *outStatus)
+{
+    *outStatus =
+        connectedToInternet ? Networking_InterfaceConnectionStatus_ConnectedToInternet : 0;
+    return 0;
+}
+
+IoTConnection_ExitCode IoTConnection_Init(EventLoop *eventLoop, const char *scopeId,
+                                          const IoTConnectionHandlers *handlers)
+{
+    connectionHandlers = handlers;
+    return IoTConnection_ExitCode_Success;
+}
+
+void IoTConnection_OnStatus(IOTHUB_CLIENT_CONNECTION_STATUS result,
+                            IOTHUB_CLIENT_CONNECTION_STATUS_REASON reason)
+{
+}
+
+void IoTConnection_GetStats(IoTConnectionStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void IoTHubDeviceClient_LL_DoWork(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle) {}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_GetSendStatus(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle,
+                                                         IOTHUB_CLIENT_STATUS *status)
+{
+    *status = IOTHUB_CLIENT_SEND_STATUS_IDLE;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendEventAsync(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_MESSAGE_HANDLE message,
+    IOTHUB_CLIENT_EVENT_CONFIRMATION_CALLBACK callback, void *context)
+{
+    EXPECT(sentCount < MAX_SENDS);
+    EXPECT(message->size < sizeof(sentEvents[0].body));
+
+    SentEvent *sent = &sentEvents[sentCount++ % MAX_SENDS];
+    memcpy(sent->body, message->body, message->size);
+    sent->body[message->size] = '\0';
+    sent->atUs = nowUs;
+    sent->callback = callback;
+    sent->context = context;
+
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SendReportedState(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, const unsigned char *reportedState, size_t size,
+    IOTHUB_CLIENT_REPORTED_STATE_CALLBACK callback, void *context)
+{
+    EXPECT(reportCount < MAX_REPORTS);
+    EXPECT(size < sizeof(sentReports[0].body));
+
+    SentReport *sent = &sentReports[reportCount++ % MAX_REPORTS];
+    memcpy(sent->body, reportedState, size);
+    sent->body[size] = '\0';
+    sent->callback = callback;
+    sent->context = context;
+    sent->confirmed = false;
+
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_GetTwinAsync(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle,
+                                                        IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK callback,
+                                                        void *context)
+{
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceTwinCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_CLIENT_DEVICE_TWIN_CALLBACK callback,
+    void *context)
+{
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetDeviceMethodCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_CLIENT_DEVICE_METHOD_CALLBACK_ASYNC callback,
+    void *context)
+{
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetMessageCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_CLIENT_MESSAGE_CALLBACK_ASYNC callback,
+    void *context)
+{
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetConnectionStatusCallback(
+    IOTHUB_DEVICE_CLIENT_LL_HANDLE handle, IOTHUB_CLIENT_CONNECTION_STATUS_CALLBACK callback,
+    void *context)
+{
+    connectionStatusCallback = callback;
+    return IOTHUB_CLIENT_OK;
+}
+
+IOTHUB_MESSAGE_HANDLE IoTHubMessage_CreateFromByteArray(const unsigned char *byteArray,
+                                                        size_t size)
+{
+    memcpy(messageInstance.body, byteArray, size);
+    messageInstance.size = size;
+
+    return &messageInstance;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_GetByteArray(IOTHUB_MESSAGE_HANDLE handle,
+                                                 const unsigned char **buffer, size_t *size)
+{
+    *buffer = (const unsigned char *)handle->body;
+    *size = handle->size;
+    return IOTHUB_MESSAGE_OK;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentTypeSystemProperty(IOTHUB_MESSAGE_HANDLE handle,
+                                                                 const char *contentType)
+{
+    return IOTHUB_MESSAGE_OK;
+}
+
+IOTHUB_MESSAGE_RESULT IoTHubMessage_SetContentEncodingSystemProperty(
+    IOTHUB_MESSAGE_HANDLE handle, const char *contentEncoding)
+{
+    return IOTHUB_MESSAGE_OK;
+}
+
+void IoTHubMessage_Destroy(IOTHUB_MESSAGE_HANDLE handle) {}
+
+// A batch serializes as its sample count, which tells the messages apart.
+size_t JoyitCar_SerializeTelemetryBatchJson(const TelemetryBatch *batch, char *buffer, size_t size)
+{
+    return (size_t)snprintf(buffer, size, "{\"n\":%u}", batch->count);
+}
+
+size_t JoyitCar_SerializeTelemetryBatchCbor(const TelemetryBatch *batch, uint8_t *buffer,
+                                           size_t size)
+{
+    return 0;
+}
+
+// The rest of the car, which the telemetry path does not reach.
+void JoyitCar_RequestTelemetryFlush(void) {}
+
+size_t JoyitCar_ApplyDesiredProperties(const char *json, size_t size, bool isCompleteTwin,
+                                       char *report, size_t reportSize)
+{
+    return 0;
+}
+
+DeviceOperation *DeviceOperations_Create(const char *name)
+{
+    return NULL;
+}
+
+DeviceOperation *DeviceOperations_Find(uint32_t id)
+{
+    return NULL;
+}
+
+bool DeviceOperations_IsFinished(const DeviceOperation *operation)
+{
+    return true;
+}
+
+void DeviceOperations_Update(DeviceOperation *operation, DeviceOperationState state,
+                             uint8_t progress)
+{
+}
+
+void DeviceOperations_Write(const DeviceOperation *operation, JsonWriter *writer) {}
+
+int JoyitCar_SubmitMotorCommand(const MotorCommand *command)
+{
+    return 0;
+}
+
+void JoyitCar_SetMotorTargetReachedHandler(MotorTargetReachedHandler handler) {}
+void JoyitCar_GoForward(void) {}
+void JoyitCar_GoBackward(void) {}
+void JoyitCar_TurnLeft(void) {}
+void JoyitCar_TurnRight(void) {}
+void JoyitCar_EmergencyBrake(void) {}
+void JoyitCar_Drive(int leftSpeed, int rightSpeed) {}
+void JoyitCar_SetVelocity(int linear, int angular) {}
+
+void JoyitCar_StartMotionSequence(const MotionStep *steps, size_t stepCount,
+                                  MotionSequenceProgressHandler handler, void *context)
+{
+}
+
+void JoyitCar_CancelMotionSequence(void) {}
+
+bool JoyitCar_ParseMotionSequence(const char *text, size_t length, MotionStep *steps,
+                                  size_t maxSteps, size_t *stepCount)
+{
+    return false;
+}
+
+const MotionStep *JoyitCar_GetDemoSequence(size_t *stepCount)
+{
+    *stepCount = 0;
+    return NULL;
+}
+
+static void RunDeferredWork(void)
+{
+    for (size_t i = 0; i < workCount; i++)
+    {
+        workHandlers[i](workContexts[i]);
+    }
+
+    workCount = 0;
+}
+
+/// <summary>
+///     Advances the clock in 10 ms steps, firing the DoWork timer at its current period.
+/// </summary>
+static void Advance(uint32_t ms)
+{
+    for (uint32_t step = 0; step < ms; step += 10)
+    {
+        nowUs += 10 * 1000;
+
+        if (doWorkTimer->armed && (doWorkTimer->elapsedMs += 10) >= doWorkTimer->periodMs)
+        {
+            doWorkTimer->elapsedMs = 0;
+            doWorkTimer->handler(doWorkTimer);
+            RunDeferredWork();
+        }
+    }
+}
+
+/// <summary>
+///     Starts a test with no send recorded, past the forwarding interval of the last test.
+/// </summary>
+static void BeginTest(void)
+{
+    memset(sentEvents, 0, sizeof(sentEvents));
+    sentCount = 0;
+    memset(sentReports, 0, sizeof(sentReports));
+    reportCount = 0;
+    nowUs += 1000 * 1000;
+}
+
+static void Connect(void)
+{
+    connectionHandlers->clientCreated((IOTHUB_DEVICE_CLIENT_LL_HANDLE)&clientInstance);
+    connectionStatusCallback(IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK,
+                             NULL);
+    RunDeferredWork();
+}
+
+/// <summary>
+///     Loses the connection for good: the connection manager destroys the client, whose
+///     pending sends are then confirmed as destroyed.
+/// </summary>
+static void Disconnect(void)
+{
+    connectionStatusCallback(IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED,
+                             IOTHUB_CLIENT_CONNECTION_NO_NETWORK, NULL);
+    connectionHandlers->clientDestroying();
+}
+
+static void Confirm(size_t send, IOTHUB_CLIENT_CONFIRMATION_RESULT result)
+{
+    sentEvents[send].callback(result, sentEvents[send].context);
+}
+
+static void QueueBatch(uint32_t count)
+{
+    TelemetryBatch batch = {.count = count, .encoding = TelemetryEncoding_Json};
+    SendTelemetry(&batch);
+}
+
+static uint32_t PendingMessages(void)
+{
+    TelemetryStoreStats stats;
+    TelemetryStore_GetStats(&stats);
+
+    return stats.pendingMessages;
+}
+
+static void ExpectSent(size_t send, uint32_t count)
+{
+    char body[32];
+    snprintf(body, sizeof(body), "{\"n\":%u}", count);
+
+    EXPECT(send < sentCount);
+    EXPECT_EQ(0, strcmp(body, sentEvents[send].body));
+}
+
+/// <summary>
+///     Checks that a send followed the previous one after the forwarding interval, at the
+///     first DoWork tick past it.
+/// </summary>
+static void ExpectPaced(size_t send)
+{
+    uint64_t gapUs = sentEvents[send].atUs - sentEvents[send - 1].atUs;
+
+    EXPECT(gapUs >= 250 * 1000);
+    EXPECT(gapUs <= (250 + 100) * 1000);
+}
+
+static void Forwarding_DrainsTheBacklogOneMessageAtATime(void)
+{
+    BeginTest();
+
+    // Batched while offline: nothing is sent.
+    for (uint32_t count = 1; count <= 4; count++)
+    {
+        QueueBatch(count);
+    }
+    Advance(1000);
+    EXPECT_EQ(0, sentCount);
+    EXPECT_EQ(4, PendingMessages());
+
+    Connect();
+    Advance(100);
+    EXPECT_EQ(1, sentCount);
+    ExpectSent(0, 1);
+
+    // The next message waits for both the confirmation and the interval.
+    Advance(1000);
+    EXPECT_EQ(1, sentCount);
+
+    // Each confirmation lets exactly one more message go, oldest first.
+    for (size_t send = 0; send < 4; send++)
+    {
+        Confirm(send, IOTHUB_CLIENT_CONFIRMATION_OK);
+        EXPECT_EQ(3 - send, PendingMessages());
+
+        Advance(1000);
+        EXPECT_EQ(send + 1 < 4 ? send + 2 : 4, sentCount);
+        if (send + 1 < 4)
+        {
+            ExpectSent(send + 1, (uint32_t)send + 2);
+        }
+    }
+
+    EXPECT_EQ(4, sentCount);
+    EXPECT_EQ(0, PendingMessages());
+    Disconnect();
+}
+
+static void Forwarding_SendsAtTheForwardingInterval(void)
+{
+    BeginTest();
+    Connect();
+
+    for (uint32_t count = 1; count <= 3; count++)
+    {
+        QueueBatch(count);
+    }
+
+    // Each message is confirmed as soon as it is sent: the interval alone paces the backlog.
+    for (size_t send = 0; send < 3; send++)
+    {
+        while (sentCount == send)
+        {
+            Advance(10);
+        }
+        Confirm(send, IOTHUB_CLIENT_CONFIRMATION_OK);
+        ExpectSent(send, (uint32_t)send + 1);
+        if (send > 0)
+        {
+            ExpectPaced(send);
+        }
+    }
+
+    EXPECT_EQ(0, PendingMessages());
+    Disconnect();
+}
+
+static void Forwarding_ResendsAMessageWhoseConfirmationFailed(void)
+{
+    BeginTest();
+    QueueBatch(7);
+    Connect();
+    Advance(300);
+    EXPECT_EQ(1, sentCount);
+
+    Confirm(0, IOTHUB_CLIENT_CONFIRMATION_MESSAGE_TIMEOUT);
+    EXPECT_EQ(1, PendingMessages());
+
+    Advance(300);
+    EXPECT_EQ(2, sentCount);
+    ExpectSent(1, 7);
+    EXPECT(sentEvents[1].context == sentEvents[0].context);
+
+    Confirm(1, IOTHUB_CLIENT_CONFIRMATION_OK);
+    EXPECT_EQ(0, PendingMessages());
+    Disconnect();
+}
+
+static void Forwarding_ResumesThePaceAfterAReconnect(void)
+{
+    BeginTest();
+    Connect();
+    for (uint32_t count = 11; count <= 13; count++)
+    {
+        QueueBatch(count);
+    }
+    Advance(100);
+    Confirm(0, IOTHUB_CLIENT_CONFIRMATION_OK);
+    Advance(300);
+    EXPECT_EQ(2, sentCount);
+    ExpectSent(1, 12);
+
+    // Lost in flight: the destroyed client confirms it as such, after the store forgot it
+    // was in flight.
+    Disconnect();
+    Confirm(1, IOTHUB_CLIENT_CONFIRMATION_BECAUSE_DESTROY);
+    EXPECT_EQ(2, PendingMessages());
+    EXPECT(!doWorkTimer->armed);
+
+    // Offline for a while: nothing is sent, and nothing is lost.
+    nowUs += 5 * 1000 * 1000;
+    QueueBatch(14);
+    EXPECT_EQ(2, sentCount);
+    EXPECT_EQ(3, PendingMessages());
+
+    Connect();
+    Advance(100);
+    EXPECT_EQ(3, sentCount);
+    ExpectSent(2, 12);
+
+    for (size_t send = 2; send < 5; send++)
+    {
+        Confirm(send, IOTHUB_CLIENT_CONFIRMATION_OK);
+        while (sentCount == send + 1 && PendingMessages() > 0)
+        {
+            Advance(10);
+        }
+        if (send + 1 < 5)
+        {
+            ExpectSent(send + 1, (uint32_t)send + 11);
+            ExpectPaced(send + 1);
+        }
+    }
+
+    EXPECT_EQ(5, sentCount);
+    EXPECT_EQ(0, PendingMessages());
+    Disconnect();
+}
+
+static void Forwarding_HoldsTheBacklogWithoutInternet(void)
+{
+    BeginTest();
+    connectedToInternet = false;
+    Connect();
+    QueueBatch(21);
+    Advance(1000);
+    EXPECT_EQ(0, sentCount);
+    EXPECT_EQ(1, PendingMessages());
+
+    connectedToInternet = true;
+    Advance(100);
+    EXPECT_EQ(1, sentCount);
+    ExpectSent(0, 21);
+    Confirm(0, IOTHUB_CLIENT_CONFIRMATION_OK);
+    EXPECT_EQ(0, PendingMessages());
+    Disconnect();
+}
+
+/// <summary>
+///     Confirms the reported state patches which are not confirmed yet, with a status code.
+/// </summary>
+static void ConfirmReports(int statusCode)
+{
+    for (size_t i = 0; i < reportCount; i++)
+    {
+        if (!sentReports[i].confirmed)
+        {
+            sentReports[i].confirmed = true;
+            sentReports[i].callback(statusCode, sentReports[i].context);
+        }
+    }
+}
+
+/// <summary>
+///     Fires the metrics report timer, and lets DoWork send the patch.
+/// </summary>
+/// <returns>Whether the patch sent reports the metric.</returns>
+static bool ReportMetrics(const char *key)
+{
+    size_t reportsBefore = reportCount;
+
+    metricsReportTimer->handler(metricsReportTimer);
+    Advance(100);
+
+    EXPECT_EQ(reportsBefore + 1, reportCount);
+    return reportCount > reportsBefore && strstr(sentReports[reportCount - 1].body, key) != NULL;
+}
+
+static void Metrics_RepeatsAReportUntilTheHubAcknowledgesIt(void)
+{
+    BeginTest();
+    Connect();
+    Advance(100);
+    ConfirmReports(200);
+
+    Metrics_Increment(MetricCounter_CloudCommandsDropped);
+    EXPECT(ReportMetrics("\"cloudCommandsDropped\""));
+
+    // Rejected by the hub: the next report carries the value again.
+    ConfirmReports(500);
+    EXPECT(ReportMetrics("\"cloudCommandsDropped\""));
+
+    // Not yet confirmed: still carried.
+    EXPECT(ReportMetrics("\"cloudCommandsDropped\""));
+
+    ConfirmReports(200);
+    EXPECT(!ReportMetrics("\"cloudCommandsDropped\""));
+    ConfirmReports(200);
+    Disconnect();
+}
+
+static void Metrics_ResendsAReportLostWithTheClient(void)
+{
+    BeginTest();
+    Connect();
+    Advance(100);
+    ConfirmReports(200);
+
+    Metrics_Increment(MetricCounter_BusDropped);
+    EXPECT(ReportMetrics("\"busDropped\""));
+
+    // The destroyed client confirms the patch as failed; the next client sends it again.
+    Disconnect();
+    ConfirmReports(0);
+    size_t reportsBefore = reportCount;
+    Connect();
+    Advance(100);
+    EXPECT_EQ(reportsBefore + 1, reportCount);
+    EXPECT(strstr(sentReports[reportCount - 1].body, "\"busDropped\"") != NULL);
+
+    ConfirmReports(200);
+    EXPECT(!ReportMetrics("\"busDropped\""));
+    ConfirmReports(200);
+    Disconnect();
+}
+
+int main(void)
+{
+    EXPECT_EQ(IoTDevice_ExitCode_Success, JoyitCar_InitAzureIoT(NULL, NULL));
+
+    RUN_TEST(Forwarding_DrainsTheBacklogOneMessageAtATime);
+    RUN_TEST(Forwarding_SendsAtTheForwardingInterval);
+    RUN_TEST(Forwarding_ResendsAMessageWhoseConfirmationFailed);
+    RUN_TEST(Forwarding_ResumesThePaceAfterAReconnect);
+    RUN_TEST(Forwarding_HoldsTheBacklogWithoutInternet);
+    RUN_TEST(Metrics_RepeatsAReportUntilTheHubAcknowledgesIt);
+    RUN_TEST(Metrics_ResendsAReportLostWithTheClient);
+
+    return TEST_EXIT_CODE();
+}
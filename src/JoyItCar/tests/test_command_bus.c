@@ -0,0 +1,300 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "ble_commands.h"
+#include "command_bus.h"
+#include "eventloop_timer_utilities.h"
+#include "i2c_motor_driver.h"
+#include "motion_control.h"
+#include "motion_sequencer.h"
+
+#include "test.h"
+
+// Fake monotonic clock, advanced by the tests.
+static uint64_t nowUs = 1000 * 1000 * 1000;
+
+// The run timer, fired by Advance() once due.
+struct EventLoopTimer
+{
+    EventLoopTimerHandler handler;
+    bool armed;
+    uint64_t dueUs;
+};
+
+static struct EventLoopTimer runTimer;
+
+static EventLoopWorkHandler drainHandler = NULL;
+
+// What reached the motors: the commands run or rejected, and the brakes and stops of the bus.
+static const char *lastApplied = NULL;
+static const char *lastRejected = NULL;
+static size_t appliedCount = 0;
+static size_t rejectedCount = 0;
+static size_t brakeCount = 0;
+static size_t stopCount = 0;
+
+uint64_t GetMonotonicMicroseconds(void)
+{
+    return nowUs;
+}
+
+EventLoopTimer *CreateEventLoopDisarmedTimer(EventLoop *eventLoop, EventLoopTimerHandler handler)
+{
+    runTimer.handler = handler;
+    runTimer.armed = false;
+
+    return &runTimer;
+}
+
+void DisposeEventLoopTimer(EventLoopTimer *timer) {}
+
+int ConsumeEventLoopTimerEvent(EventLoopTimer *timer)
+{
+    return 0;
+}
+
+int SetEventLoopTimerOneShot(EventLoopTimer *timer, const struct timespec *delay)
+{
+    timer->armed = true;
+    timer->dueUs =
+        nowUs + (uint64_t)delay->tv_sec * 1000 * 1000 + (uint64_t)delay->tv_nsec / 1000;
+    return 0;
+}
+
+int DisarmEventLoopTimer(EventLoopTimer *timer)
+{
+    timer->armed = false;
+    return 0;
+}
+
+int EnqueueEventLoopWork(EventLoopWorkQueue *queue, EventLoopWorkHandler handler, void *context)
+{
+    drainHandler = handler;
+    return 0;
+}
+
+void JoyitCar_Break(void)
+{
+    brakeCount++;
+}
+
+void JoyitCar_StopVelocityControl(void)
+{
+    stopCount++;
+}
+
+void JoyitCar_CancelMotionSequence(void) {}
+
+static void Applied(void *context)
+{
+    lastApplied = context;
+    appliedCount++;
+}
+
+static void Rejected(void *context)
+{
+    lastRejected = context;
+    rejectedCount++;
+}
+
+/// <summary>
+///     Advances the clock in 1 ms steps, firing the run timer once due.
+/// </summary>
+static void Advance(uint32_t ms)
+{
+    for (uint32_t step = 0; step < ms; step++)
+    {
+        nowUs += 1000;
+
+        if (runTimer.armed && nowUs >= runTimer.dueUs)
+        {
+            runTimer.armed = false;
+            runTimer.handler(&runTimer);
+        }
+    }
+}
+
+/// <summary>
+///     Submits a command named after what it does, and lets the consumer arbitrate it.
+/// </summary>
+/// <returns>true if the command was applied.</returns>
+static bool Submit(CommandSource source, MotorCommandType type, const char *name,
+                   uint32_t durationMs)
+{
+    MotorCommand command = {.source = source,
+                            .type = type,
+                            .action = Applied,
+                            .rejected = Rejected,
+                            .context = (void *)name,
+                            .durationMs = durationMs};
+    size_t appliedBefore = appliedCount;
+    size_t rejectedBefore = rejectedCount;
+    size_t brakesBefore = brakeCount;
+
+    EXPECT_EQ(0, JoyitCar_SubmitMotorCommand(&command));
+    drainHandler(NULL);
+
+    // A release runs no action: it brakes, or is rejected.
+    bool applied = type == MotorCommandType_Release ? brakeCount > brakesBefore
+                                                    : appliedCount > appliedBefore;
+    EXPECT(applied != (rejectedCount > rejectedBefore));
+    EXPECT(applied || lastRejected == name);
+
+    return applied;
+}
+
+static bool Action(CommandSource source, const char *name)
+{
+    return Submit(source, MotorCommandType_Action, name, 0);
+}
+
+/// <summary>
+///     Starts a test with nobody owning the motors: the button, which nothing outranks,
+///     brakes and its hold expires.
+/// </summary>
+static void BeginTest(void)
+{
+    Submit(CommandSource_Button, MotorCommandType_Brake, "stop", 0);
+    Advance(2000);
+}
+
+static void CommandBus_RanksButtonOverBleOverCloud(void)
+{
+    CommandBusStats before;
+    CommandBusStats after;
+
+    BeginTest();
+    JoyitCar_GetCommandBusStats(&before);
+
+    EXPECT(Action(CommandSource_Cloud, "cloud forward"));
+    EXPECT(Action(CommandSource_Ble, "BLE left"));
+    EXPECT(!Action(CommandSource_Cloud, "cloud backward"));
+    EXPECT(Action(CommandSource_Button, "button forward"));
+    EXPECT(!Action(CommandSource_Ble, "BLE right"));
+    EXPECT(!Action(CommandSource_Cloud, "cloud forward"));
+    EXPECT_EQ(0, strcmp("button forward", lastApplied));
+
+    // The owner itself is never outranked.
+    EXPECT(Action(CommandSource_Button, "button left"));
+
+    JoyitCar_GetCommandBusStats(&after);
+    EXPECT_EQ(before.accepted[CommandSource_Cloud] + 1, after.accepted[CommandSource_Cloud]);
+    EXPECT_EQ(before.rejected[CommandSource_Cloud] + 2, after.rejected[CommandSource_Cloud]);
+    EXPECT_EQ(before.accepted[CommandSource_Ble] + 1, after.accepted[CommandSource_Ble]);
+    EXPECT_EQ(before.rejected[CommandSource_Ble] + 1, after.rejected[CommandSource_Ble]);
+    EXPECT_EQ(before.accepted[CommandSource_Button] + 2, after.accepted[CommandSource_Button]);
+    EXPECT_EQ(before.rejected[CommandSource_Button], after.rejected[CommandSource_Button]);
+
+    EXPECT(Submit(CommandSource_Button, MotorCommandType_Release, "button up", 0));
+}
+
+static void CommandBus_HoldsTheMotorsAfterTheOwnerStops(void)
+{
+    BeginTest();
+
+    // A released button keeps the motors for a second.
+    EXPECT(Action(CommandSource_Button, "button forward"));
+    EXPECT(Submit(CommandSource_Button, MotorCommandType_Release, "button up", 0));
+    Advance(999);
+    EXPECT(!Action(CommandSource_Ble, "BLE left"));
+    EXPECT(!Action(CommandSource_Cloud, "cloud forward"));
+    Advance(1);
+    EXPECT(Action(CommandSource_Cloud, "cloud forward"));
+
+    // A BLE maneuver keeps them for a second after its run ends.
+    EXPECT(Action(CommandSource_Ble, "BLE left"));
+    Advance(BLE_COMMAND_DEFAULT_RUN_MS + 999);
+    EXPECT(!Action(CommandSource_Cloud, "cloud backward"));
+    Advance(1);
+    EXPECT(Action(CommandSource_Cloud, "cloud backward"));
+
+    // The cloud holds nothing: BLE takes over while its action runs.
+    EXPECT(Action(CommandSource_Ble, "BLE right"));
+}
+
+static void CommandBus_BrakesABleActionAfterItsMaxRun(void)
+{
+    BeginTest();
+
+    size_t brakesBefore = brakeCount;
+    EXPECT(Action(CommandSource_Ble, "BLE forward"));
+    Advance(BLE_COMMAND_DEFAULT_RUN_MS - 1);
+    EXPECT_EQ(brakesBefore, brakeCount);
+    Advance(1);
+    EXPECT_EQ(brakesBefore + 1, brakeCount);
+
+    // A duration of its own bounds the action instead.
+    EXPECT(Submit(CommandSource_Ble, MotorCommandType_Action, "BLE spin", 100));
+    Advance(100);
+    EXPECT_EQ(brakesBefore + 2, brakeCount);
+
+    // Without a maximum, the action runs until the next command.
+    JoyitCar_SetCommandSourceMaxRun(CommandSource_Ble, 0);
+    EXPECT(Action(CommandSource_Ble, "BLE backward"));
+    Advance(10 * 1000);
+    EXPECT_EQ(brakesBefore + 2, brakeCount);
+    JoyitCar_SetCommandSourceMaxRun(CommandSource_Ble, BLE_COMMAND_DEFAULT_RUN_MS);
+
+    // A later command stops the running one, and its timer with it.
+    EXPECT(Action(CommandSource_Ble, "BLE forward"));
+    EXPECT(Submit(CommandSource_Ble, MotorCommandType_Action, "BLE spin", 1000));
+    Advance(BLE_COMMAND_DEFAULT_RUN_MS);
+    EXPECT_EQ(brakesBefore + 2, brakeCount);
+    Advance(1000);
+    EXPECT_EQ(brakesBefore + 3, brakeCount);
+}
+
+static void CommandBus_AlwaysAcceptsABrake(void)
+{
+    BeginTest();
+
+    EXPECT(Action(CommandSource_Button, "button forward"));
+
+    // An emergency stop from the cloud stops the button's action...
+    size_t stopsBefore = stopCount;
+    EXPECT(Submit(CommandSource_Cloud, MotorCommandType_Brake, "cloud stop", 0));
+    EXPECT_EQ(0, strcmp("cloud stop", lastApplied));
+    EXPECT_EQ(stopsBefore + 1, stopCount);
+
+    // ...but leaves it the motors for its hold.
+    EXPECT(!Action(CommandSource_Cloud, "cloud forward"));
+    EXPECT(!Action(CommandSource_Ble, "BLE forward"));
+    EXPECT(Action(CommandSource_Button, "button left"));
+
+    EXPECT(Submit(CommandSource_Ble, MotorCommandType_Brake, "BLE stop", 0));
+    EXPECT(Submit(CommandSource_Button, MotorCommandType_Brake, "button stop", 0));
+
+    // A brake from the owner, or from nobody outranked, takes the hold itself.
+    Advance(1000);
+    EXPECT(Submit(CommandSource_Ble, MotorCommandType_Brake, "BLE stop", 0));
+    EXPECT(!Action(CommandSource_Cloud, "cloud forward"));
+}
+
+static void CommandBus_ReleasesOnlyForTheOwner(void)
+{
+    BeginTest();
+
+    EXPECT(!Submit(CommandSource_Ble, MotorCommandType_Release, "BLE up", 0));
+
+    EXPECT(Action(CommandSource_Ble, "BLE forward"));
+    EXPECT(!Submit(CommandSource_Cloud, MotorCommandType_Release, "cloud up", 0));
+    EXPECT(!Submit(CommandSource_Button, MotorCommandType_Release, "button up", 0));
+    EXPECT(runTimer.armed);
+
+    EXPECT(Submit(CommandSource_Ble, MotorCommandType_Release, "BLE up", 0));
+    EXPECT(!runTimer.armed);
+    EXPECT(!Action(CommandSource_Cloud, "cloud forward"));
+}
+
+int main(void)
+{
+    EXPECT_EQ(CommandBus_ExitCode_Success, JoyitCar_InitCommandBus(NULL, NULL));
+
+    RUN_TEST(CommandBus_RanksButtonOverBleOverCloud);
+    RUN_TEST(CommandBus_HoldsTheMotorsAfterTheOwnerStops);
+    RUN_TEST(CommandBus_BrakesABleActionAfterItsMaxRun);
+    RUN_TEST(CommandBus_AlwaysAcceptsABrake);
+    RUN_TEST(CommandBus_ReleasesOnlyForTheOwner);
+
+    return TEST_EXIT_CODE();
+}
@@ -0,0 +1,314 @@
+#include <limits.h>
+#include <string.h>
+
+#include "ble_commands.h"
+#include "button_behavior.h"
+#include "device_config.h"
+#include "i2c_motor_driver.h"
+#include "json_tokenizer.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "reported_state.h"
+#include "telemetry.h"
+
+#include "test.h"
+
+// Upper bounds of the other reported properties: the static device properties, "operation"
+// and "lastTrace", as the size of the buffers azure_iot_client.c writes them into.
+static const size_t otherPropertySizes[] = {384, 256, 256};
+
+static int appliedMotorSpeed = -1;
+static uint32_t appliedJerkPerSecond2 = 0;
+
+void JoyitCar_SetMotorSpeed(int speed)
+{
+    appliedMotorSpeed = speed;
+}
+
+void JoyitCar_SetMotorRampLimits(uint32_t accelPerSecond, uint32_t jerkPerSecond2)
+{
+    appliedJerkPerSecond2 = jerkPerSecond2;
+}
+
+void JoyitCar_SetBLECommandTiming(uint32_t pollPeriodMs, uint32_t runDurationMs) {}
+
+void JoyitCar_SetButtonPollPeriod(uint32_t periodUs) {}
+
+void JoyitCar_SetTelemetryBatchConfig(const TelemetryBatchConfig *config) {}
+
+void JoyitCar_SetCloudCommandMaxAge(uint32_t maxAgeMs) {}
+
+static char desired[1024];
+static char invalidPatch[1024];
+static char acknowledgements[DEVICE_CONFIG_REPORT_MAX_BYTES];
+static char metricsReport[METRICS_REPORT_MAX_BYTES];
+static char otherProperties[3][512];
+static char twin[2 * DEVICE_TWIN_MAX_BYTES];
+static JsonToken countingTokens[4096];
+
+/// <summary>
+///     Writes desired properties setting every configuration field to its maximum, or to an
+///     invalid value. A positive motorSpeed replaces the maximum of that field.
+/// </summary>
+static void WriteDesired(char *buffer, size_t size, bool invalid, int motorSpeed)
+{
+    // Field maxima, in the order of DeviceConfig.
+    static const struct
+    {
+        const char *name;
+        int64_t max;
+    } fields[] = {
+        {"motorSpeed", 255},
+        {"motorAccelPerSecond", 10000},
+        {"motorJerkPerSecond2", 1000000},
+        {"bleRunDurationMs", 2000},
+        {"blePollPeriodMs", 1000},
+        {"buttonPollPeriodUs", 100000},
+        {"telemetrySamplePeriodMs", 60000},
+        {"telemetryMaxSamples", TELEMETRY_BATCH_MAX_SAMPLES},
+        {"telemetryMaxAgeSeconds", 3600},
+        {"telemetryMaxBytes", TELEMETRY_BATCH_MAX_BYTES},
+        {"telemetryEncoding", TelemetryEncoding_Cbor},
+        {"telemetryHeartbeatSeconds", 3600},
+        {"telemetryMessagesPerHour", 3600},
+        {"cloudCommandMaxAgeMs", 60000},
+    };
+
+    JsonWriter writer;
+    JsonWriter_Init(&writer, buffer, size);
+    JsonWriter_BeginObject(&writer);
+
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++)
+    {
+        JsonWriter_Key(&writer, fields[i].name);
+        if (invalid)
+        {
+            JsonWriter_Int(&writer, -1);
+        }
+        else if (i == 0 && motorSpeed > 0)
+        {
+            JsonWriter_Int(&writer, motorSpeed);
+        }
+        else
+        {
+            JsonWriter_Int(&writer, fields[i].max);
+        }
+    }
+
+    JsonWriter_Key(&writer, "$version");
+    JsonWriter_Int(&writer, INT32_MAX);
+    JsonWriter_EndObject(&writer);
+
+    EXPECT(JsonWriter_Finish(&writer) > 0);
+}
+
+/// <summary>
+///     Sets every metric to its longest representation.
+/// </summary>
+static void FillMetrics(void)
+{
+    for (int i = 0; i < MetricCounter_Count; i++)
+    {
+        metricCounters[i] = UINT32_MAX;
+    }
+
+    for (int i = 0; i < MetricGauge_Count; i++)
+    {
+        metricGauges[i] = INT32_MIN;
+    }
+
+    for (int i = 0; i < MetricHistogram_Count; i++)
+    {
+        MetricHistogramData *data = &metricHistograms[i];
+        data->count = UINT32_MAX;
+        data->max = UINT32_MAX;
+        data->buckets[Metrics_GetHistogramBucket(UINT32_MAX)] = UINT32_MAX;
+    }
+}
+
+/// <summary>
+///     Writes a reported property whose patch fills a buffer of the given size.
+/// </summary>
+static void WriteOtherProperty(char *buffer, size_t size, const char *name)
+{
+    char value[512];
+    // Braces, quotes, colon and the NUL terminator.
+    size_t length = size - strlen(name) - 8;
+
+    memset(value, 'x', length);
+    value[length] = '\0';
+
+    JsonWriter writer;
+    JsonWriter_Init(&writer, buffer, 512);
+    JsonWriter_BeginObject(&writer);
+    JsonWriter_Key(&writer, name);
+    JsonWriter_String(&writer, value);
+    JsonWriter_EndObject(&writer);
+
+    EXPECT_EQ(size - 1, JsonWriter_Finish(&writer));
+}
+
+/// <summary>
+///     Copies the members of a patch into the object being written.
+/// </summary>
+static void WriteMembers(JsonWriter *writer, const char *patch)
+{
+    JsonRawMember member;
+    size_t offset = 0;
+
+    while (JsonTokenizer_NextRawMember(patch, strlen(patch), &offset, &member) > 0)
+    {
+        char key[64];
+        size_t keyLength = member.keyEnd - member.keyStart;
+
+        memcpy(key, patch + member.keyStart, keyLength);
+        key[keyLength] = '\0';
+        JsonWriter_Key(writer, key);
+        JsonWriter_Value(writer, patch + member.valueStart, member.valueEnd - member.valueStart);
+    }
+}
+
+/// <summary>
+///     Caches a patch in the reported state and acknowledges it, as the hub would.
+/// </summary>
+static void ReportAndAcknowledge(const char *patch)
+{
+    static char sent[DEVICE_TWIN_MAX_BYTES];
+    uint32_t patchId;
+
+    EXPECT(ReportedState_SetPatch(patch, strlen(patch)));
+    EXPECT(ReportedState_BuildPatch(sent, sizeof(sent), &patchId) > 0);
+    ReportedState_OnResult(patchId, 200);
+}
+
+/// <summary>
+///     Builds the largest complete twin the device can hold: every configuration field at
+///     its maximum, each acknowledged with the longest description, every metric at its
+///     longest and the other reported properties as large as their buffers.
+/// </summary>
+static size_t BuildFullTwin(int motorSpeed)
+{
+    WriteDesired(desired, sizeof(desired), false, motorSpeed);
+
+    JsonWriter writer;
+    JsonWriter_Init(&writer, twin, sizeof(twin));
+    JsonWriter_BeginObject(&writer);
+    JsonWriter_Key(&writer, "desired");
+    JsonWriter_Value(&writer, desired, strlen(desired));
+    JsonWriter_Key(&writer, "reported");
+    JsonWriter_BeginObject(&writer);
+    WriteMembers(&writer, acknowledgements);
+    WriteMembers(&writer, metricsReport);
+    for (size_t i = 0; i < 3; i++)
+    {
+        WriteMembers(&writer, otherProperties[i]);
+    }
+    JsonWriter_Key(&writer, "$version");
+    JsonWriter_Int(&writer, INT32_MAX);
+    JsonWriter_EndObject(&writer);
+    JsonWriter_EndObject(&writer);
+
+    return JsonWriter_Finish(&writer);
+}
+
+static void ApplyDesiredProperties_AcknowledgesEveryField(void)
+{
+    WriteDesired(desired, sizeof(desired), false, 0);
+
+    // The largest acknowledgements: every field at its maximum, rejected.
+    WriteDesired(invalidPatch, sizeof(invalidPatch), true, 0);
+    EXPECT(JoyitCar_ApplyDesiredProperties(desired, strlen(desired), false, acknowledgements,
+                                           sizeof(acknowledgements)) > 0);
+    size_t length = JoyitCar_ApplyDesiredProperties(invalidPatch, strlen(invalidPatch), false,
+                                                    acknowledgements, sizeof(acknowledgements));
+
+    fprintf(stderr, "acknowledgements: %zu of %d bytes\n", length,
+            DEVICE_CONFIG_REPORT_MAX_BYTES);
+    EXPECT(length > 0);
+    EXPECT(strstr(acknowledgements, "\"cloudCommandMaxAgeMs\":{\"value\":60000,\"ac\":400") !=
+           NULL);
+    EXPECT_EQ(1000000, JoyitCar_GetDeviceConfig()->motorJerkPerSecond2);
+    EXPECT_EQ(1000000, appliedJerkPerSecond2);
+}
+
+static void ApplyDesiredProperties_AcknowledgesUnchangedFields(void)
+{
+    static const char first[] = "{\"motorSpeed\":123,\"$version\":5}";
+    static const char second[] = "{\"motorSpeed\":123,\"$version\":6}";
+    char report[DEVICE_CONFIG_REPORT_MAX_BYTES];
+
+    EXPECT(JoyitCar_ApplyDesiredProperties(first, strlen(first), false, report, sizeof(report)) >
+           0);
+    EXPECT_EQ(123, appliedMotorSpeed);
+
+    // The same value at a new version is acknowledged at that version, but not applied again.
+    appliedMotorSpeed = -1;
+    EXPECT(JoyitCar_ApplyDesiredProperties(second, strlen(second), false, report,
+                                           sizeof(report)) > 0);
+    EXPECT(strstr(report, "\"motorSpeed\":{\"value\":123,\"ac\":200,\"av\":6") != NULL);
+    EXPECT_EQ(-1, appliedMotorSpeed);
+}
+
+static void Metrics_ReportFitsWithEveryMetricAtItsLongest(void)
+{
+    FillMetrics();
+
+    JsonWriter writer;
+    JsonWriter_Init(&writer, metricsReport, sizeof(metricsReport));
+    JsonWriter_BeginObject(&writer);
+    JsonWriter_Key(&writer, "metrics");
+    JsonWriter_BeginObject(&writer);
+    EXPECT_EQ(MetricCounter_Count + MetricGauge_Count + MetricHistogram_Count,
+              Metrics_WriteChanged(&writer));
+    JsonWriter_EndObject(&writer);
+    JsonWriter_EndObject(&writer);
+
+    size_t length = JsonWriter_Finish(&writer);
+
+    fprintf(stderr, "metrics: %zu of %d bytes\n", length, METRICS_REPORT_MAX_BYTES);
+    EXPECT(length > 0);
+}
+
+static void CompleteTwin_FitsAndParsesWithEveryReportedProperty(void)
+{
+    WriteOtherProperty(otherProperties[0], otherPropertySizes[0], "connection");
+    WriteOtherProperty(otherProperties[1], otherPropertySizes[1], "operation");
+    WriteOtherProperty(otherProperties[2], otherPropertySizes[2], "lastTrace");
+
+    ReportAndAcknowledge(acknowledgements);
+    ReportAndAcknowledge(metricsReport);
+    for (size_t i = 0; i < 3; i++)
+    {
+        ReportAndAcknowledge(otherProperties[i]);
+    }
+
+    // A changed motor speed shows that the desired section was read.
+    size_t length = BuildFullTwin(200);
+    int tokens = JsonTokenizer_Parse(twin, length, countingTokens,
+                                     sizeof(countingTokens) / sizeof(countingTokens[0]));
+
+    fprintf(stderr, "complete twin: %zu of %d bytes, %d tokens\n", length,
+            DEVICE_TWIN_MAX_BYTES, tokens);
+    EXPECT(length > 0 && length <= DEVICE_TWIN_MAX_BYTES);
+
+    // Nothing was lost: no reset, and nothing to report again.
+    char patch[DEVICE_TWIN_MAX_BYTES];
+    uint32_t patchId;
+    EXPECT(!ReportedState_OnCompleteTwin(twin, length));
+    EXPECT_EQ(0, ReportedState_BuildPatch(patch, sizeof(patch), &patchId));
+
+    char report[DEVICE_CONFIG_REPORT_MAX_BYTES];
+    EXPECT(JoyitCar_ApplyDesiredProperties(twin, length, true, report, sizeof(report)) > 0);
+    EXPECT(strstr(report, "\"motorSpeed\":{\"value\":200,\"ac\":200") != NULL);
+    EXPECT_EQ(200, appliedMotorSpeed);
+}
+
+int main(void)
+{
+    RUN_TEST(ApplyDesiredProperties_AcknowledgesEveryField);
+    RUN_TEST(ApplyDesiredProperties_AcknowledgesUnchangedFields);
+    RUN_TEST(Metrics_ReportFitsWithEveryMetricAtItsLongest);
+    RUN_TEST(CompleteTwin_FitsAndParsesWithEveryReportedProperty);
+
+    return TEST_EXIT_CODE();
+}
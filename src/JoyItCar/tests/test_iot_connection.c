@@ -0,0 +1,365 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include <applibs/application.h>
+#include <applibs/networking.h>
+
+#include <azure_sphere_provisioning.h>
+#include <iothub_security_factory.h>
+#include <iothubtransportmqtt.h>
+#include <azure_prov_client/prov_device_ll_client.h>
+#include <azure_prov_client/prov_security_factory.h>
+#include <azure_prov_client/prov_transport_mqtt_client.h>
+
+#include "eventloop_timer_utilities.h"
+#include "iot_connection.h"
+
+#include "test.h"
+
+static const char assignedHub[] = "joyitcar-hub.azure-devices.net";
+
+// The connection timer, fired by hand; delayMs is the last one-shot delay it was armed with.
+struct EventLoopTimer
+{
+    EventLoopTimerHandler handler;
+    bool armed;
+    uint32_t delayMs;
+};
+
+static struct EventLoopTimer connectionTimer;
+
+static bool networkReady = false;
+
+// Fake IoT Hub client: the handle is the address of a byte, which is never dereferenced.
+static char clientInstance;
+static bool failClientCreates = false;
+static size_t clientCreates = 0;
+static size_t clientDestroys = 0;
+static char lastHubUri[128];
+
+// Fake DPS registration, which completes after a number of pumps.
+static char provisioningInstance;
+static PROV_DEVICE_CLIENT_REGISTER_DEVICE_CALLBACK registerCallback = NULL;
+static size_t provisioningCreates = 0;
+static int pumpsBeforeRegistration = 0;
+
+// Owner notifications.
+static size_t clientsCreated = 0;
+static size_t clientsDestroying = 0;
+
+int Networking_GetInterfaceConnectionStatus(const char *networkInterfaceName,
+                                            Networking_InterfaceConnectionStatus *outStatus)
+{
+    *outStatus = networkReady ? Networking_InterfaceConnectionStatus_ConnectedToInternet : 0;
+    return 0;
+}
+
+int Application_IsDeviceAuthReady(bool *outIsReady)
+{
+    *outIsReady = true;
+    return 0;
+}
+
+const void *MQTT_Protocol(void)
+{
+    return NULL;
+}
+
+const void *Prov_Device_MQTT_Protocol(void)
+{
+    return NULL;
+}
+
+int iothub_security_init(IOTHUB_SECURITY_TYPE sec_type)
+{
+    return 0;
+}
+
+IOTHUB_DEVICE_CLIENT_LL_HANDLE
+IoTHubDeviceClient_LL_CreateWithAzureSphereFromDeviceAuth(const char *iothub_uri,
+                                                          IOTHUB_CLIENT_TRANSPORT_PROVIDER protocol)
+{
+    clientCreates++;
+    strcpy(lastHubUri, iothub_uri);
+
+    return failClientCreates ? NULL : (IOTHUB_DEVICE_CLIENT_LL_HANDLE)&clientInstance;
+}
+
+IOTHUB_CLIENT_RESULT IoTHubDeviceClient_LL_SetOption(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle,
+                                                     const char *optionName, const void *value)
+{
+    return IOTHUB_CLIENT_OK;
+}
+
+void IoTHubDeviceClient_LL_Destroy(IOTHUB_DEVICE_CLIENT_LL_HANDLE handle)
+{
+    EXPECT(handle == (IOTHUB_DEVICE_CLIENT_LL_HANDLE)&clientInstance);
+    clientDestroys++;
+}
+
+int prov_dev_security_init(SECURE_DEVICE_TYPE hsm_type)
+{
+    return 0;
+}
+
+void prov_dev_security_deinit(void) {}
+
+PROV_DEVICE_LL_HANDLE Prov_Device_LL_Create(const char *uri, const char *scope_id,
+                                            PROV_DEVICE_TRANSPORT_PROVIDER_FUNCTION protocol)
+{
+    provisioningCreates++;
+    return (PROV_DEVICE_LL_HANDLE)&provisioningInstance;
+}
+
+void Prov_Device_LL_Destroy(PROV_DEVICE_LL_HANDLE handle) {}
+
+PROV_DEVICE_RESULT Prov_Device_LL_SetOption(PROV_DEVICE_LL_HANDLE handle, const char *optionName,
+                                            const void *value)
+{
+    return PROV_DEVICE_RESULT_OK;
+}
+
+PROV_DEVICE_RESULT
+Prov_Device_LL_Register_Device(PROV_DEVICE_LL_HANDLE handle,
+                               PROV_DEVICE_CLIENT_REGISTER_DEVICE_CALLBACK register_callback,
+                               void *user_context,
+                               PROV_DEVICE_CLIENT_REGISTER_STATUS_CALLBACK reg_status_cb,
+                               void *status_user_ctext)
+{
+    registerCallback = register_callback;
+    return PROV_DEVICE_RESULT_OK;
+}
+
+void Prov_Device_LL_DoWork(PROV_DEVICE_LL_HANDLE handle)
+{
+    if (pumpsBeforeRegistration > 0)
+    {
+        pumpsBeforeRegistration--;
+        return;
+    }
+
+    registerCallback(PROV_DEVICE_RESULT_OK, assignedHub, "joyitcar", NULL);
+}
+
+EventLoopTimer *CreateEventLoopDisarmedTimer(EventLoop *eventLoop, EventLoopTimerHandler handler)
+{
+    connectionTimer.handler = handler;
+    connectionTimer.armed = false;
+
+    return &connectionTimer;
+}
+
+int ConsumeEventLoopTimerEvent(EventLoopTimer *timer)
+{
+    return 0;
+}
+
+int SetEventLoopTimerOneShot(EventLoopTimer *timer, const struct timespec *delay)
+{
+    timer->armed = true;
+    timer->delayMs = (uint32_t)(delay->tv_sec * 1000 + delay->tv_nsec / (1000 * 1000));
+    return 0;
+}
+
+int DisarmEventLoopTimer(EventLoopTimer *timer)
+{
+    timer->armed = false;
+    return 0;
+}
+
+static void OnClientCreated(IOTHUB_DEVICE_CLIENT_LL_HANDLE client)
+{
+    clientsCreated++;
+}
+
+static void OnClientDestroying(void)
+{
+    clientsDestroying++;
+}
+
+static const IoTConnectionHandlers handlers = {
+    .clientCreated = OnClientCreated,
+    .clientDestroying = OnClientDestroying,
+};
+
+/// <summary>
+///     Fires the connection timer, which every state but Connected keeps armed.
+/// </summary>
+static void FireTimer(void)
+{
+    EXPECT(connectionTimer.armed);
+
+    connectionTimer.armed = false;
+    connectionTimer.handler(&connectionTimer);
+}
+
+static IoTConnectionStats GetStats(void)
+{
+    IoTConnectionStats stats;
+    IoTConnection_GetStats(&stats);
+
+    return stats;
+}
+
+/// <summary>
+///     Checks that a retry is scheduled after the given number of consecutive failures, within
+///     the full jitter window: at least a second, at most the exponential ceiling.
+/// </summary>
+static void ExpectRetryScheduled(uint32_t failures)
+{
+    uint32_t ceilingMs = failures <= 9 ? 2000u << (failures - 1) : 600000;
+
+    EXPECT(connectionTimer.armed);
+    EXPECT_EQ(connectionTimer.delayMs, GetStats().nextRetryMs);
+    EXPECT(connectionTimer.delayMs >= 1000 && connectionTimer.delayMs <= ceilingMs);
+}
+
+static void Connection_ConnectsThroughDps(void)
+{
+    EXPECT_EQ(IoTConnection_ExitCode_Success, IoTConnection_Init(NULL, "0ne000FFFFF", &handlers));
+    EXPECT_EQ(1, connectionTimer.delayMs);
+
+    // Offline: the network is polled.
+    FireTimer();
+    EXPECT_EQ(1000, connectionTimer.delayMs);
+
+    // Online: the attempt starts after a random delay, and registers with DPS.
+    networkReady = true;
+    FireTimer();
+    EXPECT(connectionTimer.delayMs < 2000);
+    FireTimer();
+    EXPECT_EQ(1, provisioningCreates);
+    EXPECT_EQ(100, connectionTimer.delayMs);
+
+    // The registration is pumped until it completes, then the client connects to the hub.
+    pumpsBeforeRegistration = 2;
+    FireTimer();
+    FireTimer();
+    EXPECT_EQ(0, clientCreates);
+    FireTimer();
+    EXPECT_EQ(1, clientCreates);
+    EXPECT_EQ(1, clientsCreated);
+    EXPECT(strcmp(assignedHub, lastHubUri) == 0);
+    EXPECT_EQ(30000, connectionTimer.delayMs);
+
+    IoTConnection_OnStatus(IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK);
+
+    IoTConnectionStats stats = GetStats();
+    EXPECT(!connectionTimer.armed);
+    EXPECT_EQ(1, stats.attempts);
+    EXPECT_EQ(1, stats.provisionings);
+    EXPECT_EQ(0, stats.fastPathConnects);
+    EXPECT_EQ(1, stats.connects);
+    EXPECT_EQ(0, stats.failures);
+}
+
+static void Connection_BacksOffAfterFatalDisconnect(void)
+{
+    IoTConnection_OnStatus(IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED,
+                           IOTHUB_CLIENT_CONNECTION_RETRY_EXPIRED);
+
+    // The client is not destroyed from its own callback, but from the timer.
+    EXPECT_EQ(0, clientDestroys);
+    EXPECT_EQ(1, connectionTimer.delayMs);
+    FireTimer();
+    EXPECT_EQ(1, clientDestroys);
+    EXPECT_EQ(1, clientsDestroying);
+    EXPECT_EQ(1, GetStats().disconnects);
+    EXPECT_EQ(1, GetStats().failures);
+    ExpectRetryScheduled(1);
+
+    // Every failed attempt doubles the ceiling of the delay, up to ten minutes.
+    failClientCreates = true;
+    for (uint32_t failures = 2; failures <= 12; failures++)
+    {
+        FireTimer();
+        EXPECT_EQ(failures, GetStats().failures);
+        ExpectRetryScheduled(failures);
+    }
+    failClientCreates = false;
+
+    EXPECT_EQ(1, GetStats().provisionings);
+}
+
+static void Connection_ReconnectsThroughTheCachedHub(void)
+{
+    size_t createsBefore = clientCreates;
+
+    FireTimer();
+    EXPECT_EQ(createsBefore + 1, clientCreates);
+    EXPECT(strcmp(assignedHub, lastHubUri) == 0);
+    IoTConnection_OnStatus(IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK);
+
+    IoTConnectionStats stats = GetStats();
+    EXPECT(!connectionTimer.armed);
+    EXPECT_EQ(2, stats.connects);
+    EXPECT_EQ(1, stats.provisionings);
+    EXPECT_EQ(12, stats.fastPathConnects);
+    EXPECT(stats.maxReconnectMs >= stats.lastReconnectMs);
+
+    // The connection reset the back-off.
+    IoTConnection_OnStatus(IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED,
+                           IOTHUB_CLIENT_CONNECTION_EXPIRED_SAS_TOKEN);
+    FireTimer();
+    ExpectRetryScheduled(1);
+    FireTimer();
+    IoTConnection_OnStatus(IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK);
+    EXPECT_EQ(3, GetStats().connects);
+}
+
+static void Connection_ResumesAfterTransientLoss(void)
+{
+    size_t createsBefore = clientCreates;
+    size_t destroysBefore = clientDestroys;
+
+    // The client reconnects by itself.
+    IoTConnection_OnStatus(IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED,
+                           IOTHUB_CLIENT_CONNECTION_NO_NETWORK);
+    EXPECT_EQ(60000, connectionTimer.delayMs);
+    IoTConnection_OnStatus(IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK);
+    EXPECT(!connectionTimer.armed);
+    EXPECT_EQ(createsBefore, clientCreates);
+    EXPECT_EQ(destroysBefore, clientDestroys);
+    EXPECT_EQ(4, GetStats().connects);
+
+    // Until it gives up resuming: then it is recreated.
+    IoTConnection_OnStatus(IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED,
+                           IOTHUB_CLIENT_CONNECTION_NO_PING_RESPONSE);
+    FireTimer();
+    EXPECT_EQ(destroysBefore + 1, clientDestroys);
+    ExpectRetryScheduled(1);
+    FireTimer();
+    EXPECT_EQ(createsBefore + 1, clientCreates);
+    IoTConnection_OnStatus(IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK);
+    EXPECT_EQ(5, GetStats().connects);
+}
+
+static void Connection_ProvisionsAgainAfterBadCredential(void)
+{
+    IoTConnection_OnStatus(IOTHUB_CLIENT_CONNECTION_UNAUTHENTICATED,
+                           IOTHUB_CLIENT_CONNECTION_BAD_CREDENTIAL);
+    FireTimer();
+    ExpectRetryScheduled(1);
+
+    // The device may have moved to another hub: the cached hostname is not reused.
+    FireTimer();
+    EXPECT_EQ(2, provisioningCreates);
+    FireTimer();
+    IoTConnection_OnStatus(IOTHUB_CLIENT_CONNECTION_AUTHENTICATED, IOTHUB_CLIENT_CONNECTION_OK);
+
+    IoTConnectionStats stats = GetStats();
+    EXPECT_EQ(2, stats.provisionings);
+    EXPECT_EQ(6, stats.connects);
+    EXPECT_EQ(stats.connects - 1, stats.disconnects);
+}
+
+int main(void)
+{
+    RUN_TEST(Connection_ConnectsThroughDps);
+    RUN_TEST(Connection_BacksOffAfterFatalDisconnect);
+    RUN_TEST(Connection_ReconnectsThroughTheCachedHub);
+    RUN_TEST(Connection_ResumesAfterTransientLoss);
+    RUN_TEST(Connection_ProvisionsAgainAfterBadCredential);
+
+    return TEST_EXIT_CODE();
+}
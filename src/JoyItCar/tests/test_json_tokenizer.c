@@ -0,0 +1,84 @@
+#include <string.h>
+
+#include "json_tokenizer.h"
+
+#include "test.h"
+
+static bool KeyIs(const char *json, const JsonRawMember *member, const char *key)
+{
+    return member->keyEnd - member->keyStart == strlen(key) &&
+           memcmp(json + member->keyStart, key, strlen(key)) == 0;
+}
+
+static bool ValueIs(const char *json, const JsonRawMember *member, const char *value)
+{
+    return member->valueEnd - member->valueStart == strlen(value) &&
+           memcmp(json + member->valueStart, value, strlen(value)) == 0;
+}
+
+static void NextRawMember_WalksTopLevelMembers(void)
+{
+    const char json[] = " { \"a\" : 1, \"b\":{\"c\":[1,{\"d\":\"}\"}]}, "
+                        "\"e\":\"x\\\"{\" ,\"f\":true } ";
+    JsonRawMember member;
+    size_t offset = 0;
+
+    EXPECT_EQ(1, JsonTokenizer_NextRawMember(json, strlen(json), &offset, &member));
+    EXPECT(KeyIs(json, &member, "a") && ValueIs(json, &member, "1"));
+    EXPECT_EQ(1, JsonTokenizer_NextRawMember(json, strlen(json), &offset, &member));
+    EXPECT(KeyIs(json, &member, "b") && ValueIs(json, &member, "{\"c\":[1,{\"d\":\"}\"}]}"));
+    EXPECT_EQ(1, JsonTokenizer_NextRawMember(json, strlen(json), &offset, &member));
+    EXPECT(KeyIs(json, &member, "e") && ValueIs(json, &member, "\"x\\\"{\""));
+    EXPECT_EQ(1, JsonTokenizer_NextRawMember(json, strlen(json), &offset, &member));
+    EXPECT(KeyIs(json, &member, "f") && ValueIs(json, &member, "true"));
+    EXPECT_EQ(0, JsonTokenizer_NextRawMember(json, strlen(json), &offset, &member));
+}
+
+static void NextRawMember_RejectsMalformedDocuments(void)
+{
+    const char *documents[] = {"", "[1]", "{\"a\"}", "{\"a\":{\"b\":1}", "{\"a\":\"x}", "{a:1}"};
+
+    for (size_t i = 0; i < sizeof(documents) / sizeof(documents[0]); i++)
+    {
+        JsonRawMember member;
+        size_t offset = 0;
+        int result;
+
+        while ((result = JsonTokenizer_NextRawMember(documents[i], strlen(documents[i]), &offset,
+                                                     &member)) > 0)
+        {
+        }
+
+        EXPECT_EQ(-1, result);
+    }
+
+    JsonRawMember member;
+    size_t offset = 0;
+    EXPECT_EQ(0, JsonTokenizer_NextRawMember("{ }", 3, &offset, &member));
+}
+
+static void FindRawMember_SkipsNestedKeys(void)
+{
+    const char json[] = "{\"desired\":{\"$version\":3},\"reported\":{\"$version\":12}}";
+    JsonRawMember member;
+    int64_t version = 0;
+
+    EXPECT(JsonTokenizer_FindRawMember(json, strlen(json), "reported", &member));
+
+    const char *reported = json + member.valueStart;
+    size_t reportedLength = member.valueEnd - member.valueStart;
+
+    EXPECT(JsonTokenizer_FindRawMember(reported, reportedLength, "$version", &member));
+    EXPECT(JsonTokenizer_GetRawInt(reported, &member, &version));
+    EXPECT_EQ(12, version);
+    EXPECT(!JsonTokenizer_FindRawMember(json, strlen(json), "$version", &member));
+}
+
+int main(void)
+{
+    RUN_TEST(NextRawMember_WalksTopLevelMembers);
+    RUN_TEST(NextRawMember_RejectsMalformedDocuments);
+    RUN_TEST(FindRawMember_SkipsNestedKeys);
+
+    return TEST_EXIT_CODE();
+}
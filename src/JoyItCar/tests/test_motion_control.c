@@ -0,0 +1,231 @@
+#include <stdbool.h>
+
+#include "eventloop_timer_utilities.h"
+#include "i2c_motor_driver.h"
+#include "motion_control.h"
+
+#include "test.h"
+
+#define MAX_WRITES 64
+
+// Fake monotonic clock, advanced by the control ticks.
+static uint64_t nowUs = 1000 * 1000 * 1000;
+
+// The tick timer, fired by hand.
+struct EventLoopTimer
+{
+    EventLoopTimerHandler handler;
+    bool armed;
+    uint32_t periodUs;
+};
+
+static struct EventLoopTimer tickTimer;
+
+// Speeds written on the fake bus, per channel, in order.
+typedef struct
+{
+    MotorChannel channel;
+    int speed;
+} Write;
+
+static Write writes[MAX_WRITES];
+static size_t writeCount = 0;
+
+uint64_t GetMonotonicMicroseconds(void)
+{
+    return nowUs;
+}
+
+EventLoopTimer *CreateEventLoopDisarmedTimer(EventLoop *eventLoop, EventLoopTimerHandler handler)
+{
+    tickTimer.handler = handler;
+    tickTimer.armed = false;
+
+    return &tickTimer;
+}
+
+void DisposeEventLoopTimer(EventLoopTimer *timer) {}
+
+int ConsumeEventLoopTimerEvent(EventLoopTimer *timer)
+{
+    return 0;
+}
+
+int SetEventLoopTimerPeriod(EventLoopTimer *timer, const struct timespec *period)
+{
+    timer->armed = true;
+    timer->periodUs = (uint32_t)(period->tv_sec * 1000 * 1000 + period->tv_nsec / 1000);
+    return 0;
+}
+
+int DisarmEventLoopTimer(EventLoopTimer *timer)
+{
+    timer->armed = false;
+    return 0;
+}
+
+// The default output, which the fake bus replaces.
+void JoyitCar_DriveChannel(MotorChannel channel, int speed)
+{
+    EXPECT(false);
+}
+
+static void WriteToFakeBus(MotorChannel channel, int speed)
+{
+    EXPECT(writeCount < MAX_WRITES);
+
+    writes[writeCount % MAX_WRITES].channel = channel;
+    writes[writeCount % MAX_WRITES].speed = speed;
+    writeCount++;
+}
+
+/// <summary>
+///     Fires the tick timer one period later, if it is armed.
+/// </summary>
+static void Tick(void)
+{
+    nowUs += MOTION_CONTROL_PERIOD_US;
+
+    if (tickTimer.armed)
+    {
+        tickTimer.handler(&tickTimer);
+    }
+}
+
+/// <summary>
+///     Checks that count speeds were written since the given write: left on channel A and
+///     right on channel B.
+/// </summary>
+static void ExpectWrites(size_t since, size_t count, int left, int right)
+{
+    EXPECT_EQ(since + count, writeCount);
+
+    for (size_t i = since; i < writeCount; i++)
+    {
+        EXPECT_EQ(writes[i].channel == MOTOR_CHA ? left : right, writes[i].speed);
+    }
+}
+
+static void ExpectMix(int linear, int angular, int left, int right)
+{
+    int mixedLeft;
+    int mixedRight;
+
+    JoyitCar_MixVelocity(linear, angular, &mixedLeft, &mixedRight);
+    EXPECT_EQ(left, mixedLeft);
+    EXPECT_EQ(right, mixedRight);
+}
+
+/// <summary>
+///     Starts a test stopped, with the outputs unknown as after another command.
+/// </summary>
+static void BeginTest(void)
+{
+    JoyitCar_StopVelocityControl();
+    writeCount = 0;
+}
+
+static void MotionControl_MixesEachDirection(void)
+{
+    ExpectMix(100, 0, 100, 100);
+    ExpectMix(-100, 0, -100, -100);
+
+    // Positive angular turns to the left: the left wheel slows down.
+    ExpectMix(0, 100, -100, 100);
+    ExpectMix(0, -100, 100, -100);
+    ExpectMix(100, 50, 50, 150);
+    ExpectMix(-100, 50, -150, -50);
+
+    // The tick writes the left wheel on channel A and the right one on channel B.
+    BeginTest();
+    JoyitCar_SetVelocity(100, 50);
+    ExpectWrites(0, 2, 50, 150);
+}
+
+static void MotionControl_ClampsAndAppliesTheDeadband(void)
+{
+    // Setpoints, then wheel speeds, are clamped to the range of the driver.
+    ExpectMix(1000, 0, 255, 255);
+    ExpectMix(-1000, 0, -255, -255);
+    ExpectMix(255, 255, 0, 255);
+    ExpectMix(-200, -200, 0, -255);
+
+    ExpectMix(MOTION_CONTROL_DEADBAND - 1, 0, 0, 0);
+    ExpectMix(MOTION_CONTROL_DEADBAND, 0, MOTION_CONTROL_DEADBAND, MOTION_CONTROL_DEADBAND);
+    ExpectMix(-MOTION_CONTROL_DEADBAND + 1, 0, 0, 0);
+    ExpectMix(-MOTION_CONTROL_DEADBAND, 0, -MOTION_CONTROL_DEADBAND, -MOTION_CONTROL_DEADBAND);
+    ExpectMix(30, 15, 0, 45);
+}
+
+static void MotionControl_WritesOnlyTheChangedOutputs(void)
+{
+    BeginTest();
+
+    JoyitCar_SetVelocity(100, 0);
+    ExpectWrites(0, 2, 100, 100);
+
+    for (int i = 0; i < 10; i++)
+    {
+        Tick();
+    }
+    ExpectWrites(2, 0, 0, 0);
+
+    // A new setpoint is applied at the next tick, on the channels it changes.
+    JoyitCar_SetVelocity(110, 30);
+    ExpectWrites(2, 0, 0, 0);
+    Tick();
+    ExpectWrites(2, 2, 80, 140);
+    JoyitCar_SetVelocity(120, 40);
+    Tick();
+    ExpectWrites(4, 1, 80, 160);
+
+    // Another command wrote to the motors: both channels are written again.
+    JoyitCar_StopVelocityControl();
+    JoyitCar_SetVelocity(120, 40);
+    ExpectWrites(5, 2, 80, 160);
+}
+
+static void MotionControl_DisarmsTheTimerAtAZeroSetpoint(void)
+{
+    MotionControlStats before;
+    MotionControlStats after;
+
+    BeginTest();
+
+    JoyitCar_SetVelocity(100, 0);
+    EXPECT(tickTimer.armed);
+    EXPECT_EQ(MOTION_CONTROL_PERIOD_US, tickTimer.periodUs);
+
+    JoyitCar_SetVelocity(0, 0);
+    Tick();
+    ExpectWrites(2, 2, 0, 0);
+    EXPECT(!tickTimer.armed);
+
+    // Within the deadband the car is stopped too: nothing to write, and no timer.
+    JoyitCar_GetMotionControlStats(&before);
+    JoyitCar_SetVelocity(10, 5);
+    EXPECT(!tickTimer.armed);
+    ExpectWrites(4, 0, 0, 0);
+    JoyitCar_GetMotionControlStats(&after);
+    EXPECT_EQ(before.ticks + 1, after.ticks);
+
+    // Started again by the next setpoint.
+    JoyitCar_SetVelocity(0, 100);
+    EXPECT(tickTimer.armed);
+    ExpectWrites(4, 2, -100, 100);
+    JoyitCar_StopVelocityControl();
+    EXPECT(!tickTimer.armed);
+}
+
+int main(void)
+{
+    EXPECT_EQ(MotionControl_ExitCode_Success, JoyitCar_InitMotionControl(NULL));
+    JoyitCar_SetMotionControlOutput(WriteToFakeBus);
+
+    RUN_TEST(MotionControl_MixesEachDirection);
+    RUN_TEST(MotionControl_ClampsAndAppliesTheDeadband);
+    RUN_TEST(MotionControl_WritesOnlyTheChangedOutputs);
+    RUN_TEST(MotionControl_DisarmsTheTimerAtAZeroSetpoint);
+
+    return TEST_EXIT_CODE();
+}
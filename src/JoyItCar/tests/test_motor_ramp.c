@@ -0,0 +1,245 @@
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <applibs/i2c.h>
+
+#include "eventloop_timer_utilities.h"
+#include "i2c_motor_driver.h"
+
+#include "test.h"
+
+#define MAX_FRAMES 256
+#define MAX_TICKS 1000
+
+// Frames written on the fake bus, as signed speeds: CW positive, CCW negative, stop 0.
+typedef struct
+{
+    MotorChannel channel;
+    int speed;
+} Frame;
+
+static Frame frames[MAX_FRAMES];
+static size_t frameCount = 0;
+static size_t writeAttempts = 0;
+static bool failWrites = false;
+
+// The ramp timer, ticked by hand.
+struct EventLoopTimer
+{
+    EventLoopTimerHandler handler;
+    bool armed;
+};
+
+static struct EventLoopTimer rampTimer;
+
+static size_t targetReachedCount = 0;
+
+int I2CMaster_Open(I2C_InterfaceId id)
+{
+    return 3;
+}
+
+int I2CMaster_SetBusSpeed(int fd, uint32_t speedInHz)
+{
+    return 0;
+}
+
+int I2CMaster_SetTimeout(int fd, uint32_t timeoutInMs)
+{
+    return 0;
+}
+
+ssize_t I2CMaster_Write(int fd, I2C_DeviceAddress address, const uint8_t *data, size_t length)
+{
+    writeAttempts++;
+
+    if (failWrites)
+    {
+        return -1;
+    }
+
+    Frame *frame = &frames[frameCount++ % MAX_FRAMES];
+    frame->channel = (MotorChannel)data[1];
+    frame->speed = data[0] == GROVE_MOTOR_DRIVER_I2C_CMD_STOP ? 0
+                   : data[0] == GROVE_MOTOR_DRIVER_I2C_CMD_CW ? data[2]
+                                                              : -data[2];
+
+    return (ssize_t)length;
+}
+
+EventLoopTimer *CreateEventLoopDisarmedTimer(EventLoop *eventLoop, EventLoopTimerHandler handler)
+{
+    rampTimer.handler = handler;
+    rampTimer.armed = false;
+
+    return &rampTimer;
+}
+
+void DisposeEventLoopTimer(EventLoopTimer *timer) {}
+
+int ConsumeEventLoopTimerEvent(EventLoopTimer *timer)
+{
+    return 0;
+}
+
+int SetEventLoopTimerPeriod(EventLoopTimer *timer, const struct timespec *period)
+{
+    timer->armed = true;
+    return 0;
+}
+
+int DisarmEventLoopTimer(EventLoopTimer *timer)
+{
+    timer->armed = false;
+    return 0;
+}
+
+static void OnTargetReached(uint64_t lastWriteAtUs)
+{
+    targetReachedCount++;
+}
+
+/// <summary>
+///     Places both channels at the given speeds without ramping, and forgets their frames.
+/// </summary>
+static void StartFrom(int speedA, int speedB)
+{
+    JoyitCar_SetMotorRampLimits(0, 0);
+    JoyitCar_Drive(speedA, speedB);
+    JoyitCar_SetMotorRampLimits(MOTOR_RAMP_DEFAULT_ACCELERATION, MOTOR_RAMP_DEFAULT_JERK);
+
+    frameCount = 0;
+    writeAttempts = 0;
+    targetReachedCount = 0;
+}
+
+/// <summary>
+///     Ticks the ramp timer until it stops.
+/// </summary>
+/// <returns>The number of timer ticks.</returns>
+static int TickUntilStopped(void)
+{
+    int ticks = 0;
+
+    while (rampTimer.armed && ticks < MAX_TICKS)
+    {
+        rampTimer.handler(&rampTimer);
+        ticks++;
+    }
+
+    return ticks;
+}
+
+static int RunRamp(int fromA, int fromB, int toA, int toB)
+{
+    StartFrom(fromA, fromB);
+    JoyitCar_Drive(toA, toB);
+
+    return TickUntilStopped();
+}
+
+static size_t CountFrames(MotorChannel channel)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        count += frames[i].channel == channel;
+    }
+
+    return count;
+}
+
+/// <summary>
+///     Checks that the frames of a channel move monotonically from one speed to the other,
+///     never beyond the target, and end on it.
+/// </summary>
+static void ExpectMonotonicFrames(MotorChannel channel, int from, int to)
+{
+    int last = from;
+    int direction = to > from ? 1 : -1;
+
+    for (size_t i = 0; i < frameCount; i++)
+    {
+        if (frames[i].channel != channel)
+        {
+            continue;
+        }
+
+        EXPECT((frames[i].speed - last) * direction > 0);
+        EXPECT((to - frames[i].speed) * direction >= 0);
+        last = frames[i].speed;
+    }
+
+    EXPECT_EQ(to, last);
+}
+
+static void Ramp_FromRestToDefaultSpeed(void)
+{
+    int ticks = RunRamp(0, 0, 100, 100);
+
+    EXPECT_EQ(12, ticks);
+    EXPECT_EQ(10, CountFrames(MOTOR_CHA));
+    EXPECT_EQ(10, CountFrames(MOTOR_CHB));
+    ExpectMonotonicFrames(MOTOR_CHA, 0, 100);
+    ExpectMonotonicFrames(MOTOR_CHB, 0, 100);
+    EXPECT_EQ(1, targetReachedCount);
+}
+
+static void Ramp_ReversesThroughZero(void)
+{
+    int ticks = RunRamp(100, 100, -100, 100);
+
+    EXPECT_EQ(18, ticks);
+    EXPECT_EQ(16, CountFrames(MOTOR_CHA));
+    EXPECT_EQ(0, CountFrames(MOTOR_CHB));
+    ExpectMonotonicFrames(MOTOR_CHA, 100, -100);
+    EXPECT_EQ(1, targetReachedCount);
+}
+
+static void Ramp_ReversesAcrossTheFullRange(void)
+{
+    int ticks = RunRamp(-255, -255, 255, 255);
+
+    EXPECT_EQ(32, ticks);
+    EXPECT_EQ(CountFrames(MOTOR_CHA), CountFrames(MOTOR_CHB));
+    EXPECT_EQ(31, CountFrames(MOTOR_CHA));
+    ExpectMonotonicFrames(MOTOR_CHA, -255, 255);
+    ExpectMonotonicFrames(MOTOR_CHB, -255, 255);
+}
+
+static void Ramp_GivesUpAfterConsecutiveWriteFailures(void)
+{
+    MotorDriverState before;
+    MotorDriverState after;
+    JoyitCar_GetMotorDriverState(&before);
+
+    StartFrom(0, 0);
+    failWrites = true;
+    JoyitCar_Drive(100, 100);
+    TickUntilStopped();
+    failWrites = false;
+
+    JoyitCar_GetMotorDriverState(&after);
+    EXPECT(!rampTimer.armed);
+    EXPECT_EQ(MOTOR_CHANNEL_COUNT * MOTOR_RAMP_MAX_WRITE_FAILURES, writeAttempts);
+    EXPECT_EQ(before.rampAborts + MOTOR_CHANNEL_COUNT, after.rampAborts);
+
+    // The next command tries the channels again.
+    RunRamp(0, 0, 50, 50);
+    ExpectMonotonicFrames(MOTOR_CHA, 0, 50);
+    ExpectMonotonicFrames(MOTOR_CHB, 0, 50);
+}
+
+int main(void)
+{
+    EXPECT_EQ(I2CMotorDriver_ExitCode_Success, JoyitCar_InitMotors(NULL));
+    JoyitCar_SetMotorTargetReachedHandler(OnTargetReached);
+
+    RUN_TEST(Ramp_FromRestToDefaultSpeed);
+    RUN_TEST(Ramp_ReversesThroughZero);
+    RUN_TEST(Ramp_ReversesAcrossTheFullRange);
+    RUN_TEST(Ramp_GivesUpAfterConsecutiveWriteFailures);
+
+    return TEST_EXIT_CODE();
+}
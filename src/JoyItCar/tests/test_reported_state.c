@@ -0,0 +1,103 @@
+#include <string.h>
+
+#include "reported_state.h"
+
+#include "test.h"
+
+static char patch[1024];
+
+static void ReportAndAcknowledge(const char *json)
+{
+    uint32_t patchId;
+
+    EXPECT(ReportedState_SetPatch(json, strlen(json)));
+    EXPECT(ReportedState_BuildPatch(patch, sizeof(patch), &patchId) > 0);
+    ReportedState_OnResult(patchId, 200);
+}
+
+static size_t BuildQueuedPatch(void)
+{
+    uint32_t patchId;
+    size_t length = ReportedState_BuildPatch(patch, sizeof(patch), &patchId);
+
+    if (length > 0)
+    {
+        ReportedState_OnResult(patchId, 200);
+    }
+
+    return length;
+}
+
+static bool OnCompleteTwin(const char *json)
+{
+    return ReportedState_OnCompleteTwin(json, strlen(json));
+}
+
+static void OnCompleteTwin_KeepsThePropertiesTheHubHolds(void)
+{
+    ReportAndAcknowledge("{\"model\":\"Joy-It Car\",\"metrics\":{\"i2cWrites\":3}}");
+
+    EXPECT(!OnCompleteTwin("{\"desired\":{\"$version\":1},\"reported\":{\"model\":\"Joy-It Car\","
+                           "\"metrics\":{\"i2cWrites\":3},\"$version\":4}}"));
+    EXPECT_EQ(0, BuildQueuedPatch());
+}
+
+static void OnCompleteTwin_QueuesAgainAMissingProperty(void)
+{
+    EXPECT(!OnCompleteTwin("{\"desired\":{\"$version\":1},\"reported\":{\"model\":\"Joy-It Car\","
+                           "\"$version\":5}}"));
+    EXPECT(BuildQueuedPatch() > 0);
+    EXPECT_EQ(0, strcmp(patch, "{\"metrics\":{\"i2cWrites\":3}}"));
+}
+
+static void OnCompleteTwin_KeepsTheCacheOfAnUnreadableTwin(void)
+{
+    // Truncated, and with a malformed reported section.
+    EXPECT(!OnCompleteTwin("{\"desired\":{\"$version\":1},\"reported\":{\"model\":\"Joy-It"));
+    EXPECT(!OnCompleteTwin("{\"desired\":{\"$version\":1},\"reported\":{\"model\" \"x\"}}"));
+    EXPECT_EQ(0, BuildQueuedPatch());
+}
+
+static void OnCompleteTwin_QueuesEverythingAfterAReset(void)
+{
+    // $version went backwards: the device was registered again.
+    EXPECT(OnCompleteTwin("{\"desired\":{\"$version\":1},\"reported\":{\"$version\":1}}"));
+    EXPECT(BuildQueuedPatch() > 0);
+
+    EXPECT(OnCompleteTwin("{\"desired\":{\"$version\":1}}"));
+    EXPECT(BuildQueuedPatch() > 0);
+}
+
+static void IsAcknowledged_OnlyForTheLatestValue(void)
+{
+    uint32_t first;
+    uint32_t second;
+
+    EXPECT(!ReportedState_IsAcknowledged("speed"));
+
+    // Changed while in flight: the acknowledgement is for the older value.
+    EXPECT(ReportedState_SetPatch("{\"speed\":1}", 11));
+    EXPECT(ReportedState_BuildPatch(patch, sizeof(patch), &first) > 0);
+    EXPECT(!ReportedState_IsAcknowledged("speed"));
+    EXPECT(ReportedState_SetPatch("{\"speed\":2}", 11));
+    ReportedState_OnResult(first, 200);
+    EXPECT(!ReportedState_IsAcknowledged("speed"));
+
+    EXPECT(ReportedState_BuildPatch(patch, sizeof(patch), &second) > 0);
+    ReportedState_OnResult(second, 500);
+    EXPECT(!ReportedState_IsAcknowledged("speed"));
+
+    EXPECT(BuildQueuedPatch() > 0);
+    EXPECT(ReportedState_IsAcknowledged("speed"));
+}
+
+int main(void)
+{
+    RUN_TEST(OnCompleteTwin_KeepsThePropertiesTheHubHolds);
+    RUN_TEST(OnCompleteTwin_QueuesAgainAMissingProperty);
+    RUN_TEST(OnCompleteTwin_KeepsTheCacheOfAnUnreadableTwin);
+    RUN_TEST(OnCompleteTwin_QueuesEverythingAfterAReset);
+    RUN_TEST(IsAcknowledged_OnlyForTheLatestValue);
+
+    return TEST_EXIT_CODE();
+}
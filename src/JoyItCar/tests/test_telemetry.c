@@ -0,0 +1,300 @@
+#include <stdbool.h>
+#include <string.h>
+
+#include "azure_iot_client.h"
+#include "ble_commands.h"
+#include "button_behavior.h"
+#include "eventloop_timer_utilities.h"
+#include "i2c_motor_driver.h"
+#include "telemetry.h"
+
+#include "test.h"
+
+#define MAX_MESSAGES 256
+#define HOUR_US (3600ull * 1000 * 1000)
+
+// Fake monotonic clock, advanced by the sample timer.
+static uint64_t nowUs = 1000 * 1000 * 1000;
+
+// The sample timer, fired at its period by Advance().
+struct EventLoopTimer
+{
+    EventLoopTimerHandler handler;
+    uint32_t periodMs;
+    uint64_t nextFireUs;
+};
+
+static struct EventLoopTimer sampleTimer;
+
+static EventLoopWorkHandler workHandler = NULL;
+static MotorStateChangedHandler motorStateChangedHandler = NULL;
+
+// Messages handed to the IoT Hub client: when, and at which rate their batch was taken.
+typedef struct
+{
+    uint64_t atUs;
+    uint32_t count;
+    uint32_t samplePeriodMs;
+    uint32_t uploadIntervalSeconds;
+    bool motionActive;
+} SentBatch;
+
+static SentBatch sentBatches[MAX_MESSAGES];
+static size_t sentCount = 0;
+
+uint64_t GetMonotonicMicroseconds(void)
+{
+    return nowUs;
+}
+
+EventLoopTimer *CreateEventLoopPeriodicTimer(EventLoop *eventLoop, EventLoopTimerHandler handler,
+                                             const struct timespec *period)
+{
+    sampleTimer.handler = handler;
+    SetEventLoopTimerPeriod(&sampleTimer, period);
+
+    return &sampleTimer;
+}
+
+int ConsumeEventLoopTimerEvent(EventLoopTimer *timer)
+{
+    return 0;
+}
+
+int SetEventLoopTimerPeriod(EventLoopTimer *timer, const struct timespec *period)
+{
+    timer->periodMs = (uint32_t)(period->tv_sec * 1000 + period->tv_nsec / (1000 * 1000));
+    timer->nextFireUs = nowUs + (uint64_t)timer->periodMs * 1000;
+    return 0;
+}
+
+int EnqueueEventLoopWork(EventLoopWorkQueue *queue, EventLoopWorkHandler handler, void *context)
+{
+    workHandler = handler;
+    return 0;
+}
+
+void GetEventLoopStallStats(EventLoopStallStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void GetEventLoopWorkQueueStats(const EventLoopWorkQueue *queue, EventLoopWorkQueueStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void JoyitCar_GetAzureIoTStats(AzureIoTStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+void JoyitCar_GetBLECommandStats(BLECommandStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+uint32_t JoyitCar_GetButtonCommandCount(void)
+{
+    return 0;
+}
+
+// The samples never change: the car is parked unless a test starts the motors.
+void JoyitCar_GetMotorDriverState(MotorDriverState *state)
+{
+    memset(state, 0, sizeof(*state));
+}
+
+void JoyitCar_SetMotorStateChangedHandler(MotorStateChangedHandler handler)
+{
+    motorStateChangedHandler = handler;
+}
+
+void SendTelemetry(const TelemetryBatch *batch)
+{
+    EXPECT(sentCount < MAX_MESSAGES);
+
+    SentBatch *sent = &sentBatches[sentCount++ % MAX_MESSAGES];
+    sent->atUs = nowUs;
+    sent->count = batch->count;
+    sent->samplePeriodMs = batch->samplePeriodMs;
+    sent->uploadIntervalSeconds = batch->uploadIntervalSeconds;
+    sent->motionActive = batch->motionActive;
+}
+
+/// <summary>
+///     Advances the clock, firing the sample timer at its period, which may change as it fires.
+/// </summary>
+static void Advance(uint64_t us)
+{
+    uint64_t endUs = nowUs + us;
+
+    while (sampleTimer.nextFireUs <= endUs)
+    {
+        nowUs = sampleTimer.nextFireUs;
+        sampleTimer.nextFireUs = nowUs + (uint64_t)sampleTimer.periodMs * 1000;
+        sampleTimer.handler(&sampleTimer);
+    }
+
+    nowUs = endUs;
+}
+
+static void RequestFlush(void)
+{
+    JoyitCar_RequestTelemetryFlush();
+    workHandler(NULL);
+}
+
+static void SetMotorsRunning(bool running)
+{
+    MotorDriverState state;
+    memset(&state, 0, sizeof(state));
+    state.channels[MOTOR_CHA].direction = running ? 1 : 0;
+    state.channels[MOTOR_CHA].speed = running ? 200 : 0;
+
+    motorStateChangedHandler(&state);
+}
+
+/// <summary>
+///     Starts a test with the given budget and heartbeat: sends the batch of the last test,
+///     and lets its budget hour expire without a sample.
+/// </summary>
+static void BeginTest(uint32_t messagesPerHour, uint32_t heartbeatSeconds, bool running)
+{
+    TelemetryBatchConfig config = {.samplePeriodMs = 1000,
+                                   .maxSamples = 10,
+                                   .maxAgeSeconds = 10,
+                                   .maxBytes = TELEMETRY_BATCH_MAX_BYTES,
+                                   .encoding = TelemetryEncoding_Json,
+                                   .heartbeatSeconds = heartbeatSeconds,
+                                   .messagesPerHour = messagesPerHour};
+
+    JoyitCar_CloseTelemetry();
+    SetMotorsRunning(running);
+    JoyitCar_SetTelemetryBatchConfig(&config);
+
+    nowUs += 2 * HOUR_US;
+    sampleTimer.nextFireUs = nowUs + (uint64_t)sampleTimer.periodMs * 1000;
+    sentCount = 0;
+}
+
+/// <summary>
+///     Counts the messages sent in each hour since the first one.
+/// </summary>
+static void CountPerHour(uint32_t *counts, size_t hours)
+{
+    memset(counts, 0, hours * sizeof(counts[0]));
+
+    for (size_t i = 0; i < sentCount; i++)
+    {
+        size_t hour = (size_t)((sentBatches[i].atUs - sentBatches[0].atUs) / HOUR_US);
+        if (hour < hours)
+        {
+            counts[hour]++;
+        }
+    }
+}
+
+static void Rate_StretchesTheActiveIntervalToTheBudget(void)
+{
+    uint32_t counts[3];
+
+    // Six messages an hour: one every 600 s, however short maxAgeSeconds is.
+    BeginTest(6, 300, true);
+    Advance(3 * HOUR_US);
+
+    CountPerHour(counts, 2);
+    EXPECT_EQ(6, counts[0]);
+    EXPECT_EQ(6, counts[1]);
+
+    for (size_t i = 1; i < sentCount; i++)
+    {
+        EXPECT_EQ(600, sentBatches[i].uploadIntervalSeconds);
+        EXPECT_EQ(60000, sentBatches[i].samplePeriodMs);
+        EXPECT(sentBatches[i].motionActive);
+        EXPECT_EQ(600 * 1000 * 1000, sentBatches[i].atUs - sentBatches[i - 1].atUs);
+    }
+}
+
+static void Rate_HoldsFlushRequestsOnceTheHourIsSpent(void)
+{
+    uint32_t counts[3];
+
+    // An emergency stop every five minutes asks for more than the budget of four an hour.
+    BeginTest(4, 300, true);
+    for (int i = 0; i < 3 * 12; i++)
+    {
+        RequestFlush();
+        Advance(5 * 60 * 1000 * 1000);
+    }
+
+    CountPerHour(counts, 3);
+    EXPECT_EQ(4, counts[0]);
+    EXPECT_EQ(4, counts[1]);
+    EXPECT_EQ(4, counts[2]);
+
+    // Held samples are sent with the next message, not dropped.
+    EXPECT(sentBatches[sentCount - 1].count > 1);
+}
+
+static void Heartbeat_SendsWhileNothingChanges(void)
+{
+    uint32_t heartbeatSeconds = 300;
+
+    BeginTest(360, heartbeatSeconds, true);
+    Advance(60 * 1000 * 1000);
+    SetMotorsRunning(false);
+    Advance(HOUR_US);
+
+    // Once parked, the interval doubles with every batch up to the heartbeat...
+    size_t first = 0;
+    while (first < sentCount && sentBatches[first].motionActive)
+    {
+        first++;
+    }
+    for (size_t i = first + 1; i < sentCount; i++)
+    {
+        EXPECT(sentBatches[i].uploadIntervalSeconds >= sentBatches[i - 1].uploadIntervalSeconds);
+        EXPECT(sentBatches[i].uploadIntervalSeconds <= heartbeatSeconds);
+    }
+
+    // ...where unchanged samples still go out once per heartbeat.
+    EXPECT_EQ(heartbeatSeconds, sentBatches[sentCount - 1].uploadIntervalSeconds);
+    for (size_t i = sentCount - 5; i < sentCount; i++)
+    {
+        EXPECT_EQ((uint64_t)heartbeatSeconds * 1000 * 1000,
+                  sentBatches[i].atUs - sentBatches[i - 1].atUs);
+    }
+
+    size_t sentBefore = sentCount;
+    Advance((uint64_t)heartbeatSeconds * 1000 * 1000);
+    EXPECT_EQ(sentBefore + 1, sentCount);
+}
+
+static void Heartbeat_ReturnsToTheActiveRateWhenTheMotorsStart(void)
+{
+    BeginTest(360, 300, false);
+    Advance(HOUR_US);
+    EXPECT_EQ(300, sentBatches[sentCount - 1].uploadIntervalSeconds);
+
+    size_t sentBefore = sentCount;
+    SetMotorsRunning(true);
+    Advance(11 * 1000 * 1000);
+
+    EXPECT(sentCount > sentBefore);
+    EXPECT(sentBatches[sentCount - 1].motionActive);
+    EXPECT_EQ(10, sentBatches[sentCount - 1].uploadIntervalSeconds);
+    EXPECT_EQ(1000, sentBatches[sentCount - 1].samplePeriodMs);
+}
+
+int main(void)
+{
+    EXPECT_EQ(Telemetry_ExitCode_Success, JoyitCar_InitTelemetry(NULL, NULL));
+
+    RUN_TEST(Rate_StretchesTheActiveIntervalToTheBudget);
+    RUN_TEST(Rate_HoldsFlushRequestsOnceTheHourIsSpent);
+    RUN_TEST(Heartbeat_SendsWhileNothingChanges);
+    RUN_TEST(Heartbeat_ReturnsToTheActiveRateWhenTheMotorsStart);
+
+    return TEST_EXIT_CODE();
+}
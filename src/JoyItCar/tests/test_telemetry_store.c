@@ -0,0 +1,307 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "telemetry_store.h"
+
+#include "test.h"
+
+#define RECORD_HEADER_BYTES 8
+
+static uint8_t message[TELEMETRY_STORE_MAX_MESSAGE_BYTES + 1];
+static uint8_t peeked[TELEMETRY_STORE_MAX_MESSAGE_BYTES];
+
+/// <summary>
+///     Fills the message buffer with a pattern which tells messages, and their bytes, apart.
+/// </summary>
+static const uint8_t *Fill(uint8_t seed, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        message[i] = (uint8_t)(seed + i * 7);
+    }
+
+    return message;
+}
+
+static uint32_t Push(uint8_t seed, size_t size)
+{
+    return TelemetryStore_Push(Fill(seed, size), size);
+}
+
+/// <summary>
+///     Checks that the oldest message is the one pushed with the given seed and size.
+/// </summary>
+/// <returns>The id of the oldest message.</returns>
+static uint32_t ExpectOldest(uint8_t seed, size_t size)
+{
+    uint32_t id = 0;
+
+    EXPECT_EQ(size, TelemetryStore_Peek(peeked, sizeof(peeked), &id));
+    EXPECT_EQ(0, memcmp(Fill(seed, size), peeked, size));
+
+    return id;
+}
+
+static void ForwardOldest(uint8_t seed, size_t size)
+{
+    TelemetryStore_Acknowledge(ExpectOldest(seed, size));
+}
+
+/// <summary>
+///     Empties the store, so that a test starts from wherever the previous one left the ring.
+/// </summary>
+static void Drain(void)
+{
+    uint32_t id;
+
+    while (TelemetryStore_Peek(peeked, sizeof(peeked), &id) > 0)
+    {
+        TelemetryStore_Acknowledge(id);
+    }
+}
+
+static uint32_t PendingMessages(void)
+{
+    TelemetryStoreStats stats;
+    TelemetryStore_GetStats(&stats);
+
+    return stats.pendingMessages;
+}
+
+static void Store_EvictsTheOldestMessagesWhenFull(void)
+{
+    TelemetryStoreStats before;
+    TelemetryStoreStats after;
+    size_t size = 4000;
+    uint32_t fitting = TELEMETRY_STORE_CAPACITY / (RECORD_HEADER_BYTES + size);
+
+    Drain();
+    TelemetryStore_GetStats(&before);
+
+    for (uint32_t i = 0; i < fitting + 2; i++)
+    {
+        EXPECT(Push((uint8_t)i, size) != 0);
+    }
+
+    TelemetryStore_GetStats(&after);
+    EXPECT_EQ(fitting, after.pendingMessages);
+    EXPECT_EQ(fitting * size, after.pendingBytes);
+    EXPECT_EQ(before.evicted + 2, after.evicted);
+    EXPECT_EQ(before.stored + fitting + 2, after.stored);
+    EXPECT_EQ(before.dropped, after.dropped);
+
+    for (uint32_t i = 2; i < fitting + 2; i++)
+    {
+        ForwardOldest((uint8_t)i, size);
+    }
+    EXPECT_EQ(0, PendingMessages());
+}
+
+static void Store_DropsEmptyAndOversizedMessages(void)
+{
+    TelemetryStoreStats before;
+    TelemetryStoreStats after;
+
+    Drain();
+    TelemetryStore_GetStats(&before);
+
+    EXPECT_EQ(0, Push(1, 0));
+    EXPECT_EQ(0, Push(2, TELEMETRY_STORE_MAX_MESSAGE_BYTES + 1));
+    EXPECT(Push(3, TELEMETRY_STORE_MAX_MESSAGE_BYTES) != 0);
+
+    TelemetryStore_GetStats(&after);
+    EXPECT_EQ(before.dropped + 2, after.dropped);
+    EXPECT_EQ(1, after.pendingMessages);
+    ForwardOldest(3, TELEMETRY_STORE_MAX_MESSAGE_BYTES);
+}
+
+static void Store_RemovesOnlyTheAcknowledgedMessage(void)
+{
+    TelemetryStoreStats before;
+    TelemetryStoreStats after;
+
+    Drain();
+    TelemetryStore_GetStats(&before);
+
+    uint32_t first = Push(10, 100);
+    uint32_t second = Push(11, 200);
+
+    // Acknowledging a message which is not the oldest removes nothing, and peeking twice
+    // returns the same message.
+    TelemetryStore_Acknowledge(second);
+    EXPECT_EQ(2, PendingMessages());
+    EXPECT_EQ(first, ExpectOldest(10, 100));
+    EXPECT_EQ(first, ExpectOldest(10, 100));
+
+    TelemetryStore_Acknowledge(first);
+    EXPECT_EQ(1, PendingMessages());
+    EXPECT_EQ(second, ExpectOldest(11, 200));
+
+    // Acknowledged again, as by a late confirmation: the next message stays.
+    TelemetryStore_Acknowledge(first);
+    EXPECT_EQ(1, PendingMessages());
+
+    TelemetryStore_Acknowledge(second);
+    TelemetryStore_GetStats(&after);
+    EXPECT_EQ(0, after.pendingMessages);
+    EXPECT_EQ(before.forwarded + 2, after.forwarded);
+}
+
+static void Store_KeepsTheNextMessageWhenTheForwardedOneWasEvicted(void)
+{
+    size_t size = TELEMETRY_STORE_MAX_MESSAGE_BYTES;
+    uint32_t fitting = TELEMETRY_STORE_CAPACITY / (RECORD_HEADER_BYTES + size);
+
+    Drain();
+
+    uint32_t forwarded = Push(20, size);
+    for (uint32_t i = 1; i <= fitting; i++)
+    {
+        Push((uint8_t)(20 + i), size);
+    }
+
+    // The confirmation of the evicted message arrives once the ring has moved on.
+    TelemetryStore_Acknowledge(forwarded);
+    EXPECT_EQ(fitting, PendingMessages());
+    ExpectOldest(21, size);
+}
+
+static void Store_WrapsRecordsAroundTheEndOfTheRing(void)
+{
+    TelemetryStoreStats stats;
+
+    Drain();
+
+    // Sizes which are not multiples of the header place headers and messages across the end
+    // of the ring on successive passes, with a backlog of several messages each time.
+    for (int pass = 0; pass < 40; pass++)
+    {
+        for (int i = 0; i < 5; i++)
+        {
+            Push((uint8_t)(pass * 5 + i), 1001 + (size_t)(pass * 5 + i) * 13);
+        }
+
+        for (int i = 0; i < 5; i++)
+        {
+            ForwardOldest((uint8_t)(pass * 5 + i), 1001 + (size_t)(pass * 5 + i) * 13);
+        }
+    }
+
+    TelemetryStore_GetStats(&stats);
+    EXPECT_EQ(0, stats.pendingMessages);
+    EXPECT_EQ(0, stats.pendingBytes);
+}
+
+/// <summary>
+///     Pushes the messages of the save and load tests, of sizes which wrap around the ring.
+/// </summary>
+static void PushBacklog(uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++)
+    {
+        Push((uint8_t)(40 + i), 3001 + i * 97);
+    }
+}
+
+static void ExpectBacklog(uint32_t count)
+{
+    EXPECT_EQ(count, PendingMessages());
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        ForwardOldest((uint8_t)(40 + i), 3001 + i * 97);
+    }
+}
+
+static void Store_SavesAndLoadsTheBacklog(void)
+{
+    FILE *file = tmpfile();
+    int fd = fileno(file);
+
+    Drain();
+    PushBacklog(9);
+    EXPECT_EQ(0, TelemetryStore_Save(fd));
+    Drain();
+
+    EXPECT_EQ(0, TelemetryStore_Load(fd));
+    ExpectBacklog(9);
+
+    fclose(file);
+}
+
+static void Store_LoadsTheMessagesBeforeATruncation(void)
+{
+    FILE *file = tmpfile();
+    int fd = fileno(file);
+
+    Drain();
+    PushBacklog(3);
+    EXPECT_EQ(0, TelemetryStore_Save(fd));
+    Drain();
+
+    // Cut in the middle of the third message.
+    off_t length = lseek(fd, 0, SEEK_END);
+    EXPECT_EQ(0, ftruncate(fd, length - 100));
+
+    EXPECT_EQ(0, TelemetryStore_Load(fd));
+    ExpectBacklog(2);
+
+    fclose(file);
+}
+
+static void Store_SkipsOversizedMessagesOnLoad(void)
+{
+    TelemetryStoreStats before;
+    TelemetryStoreStats after;
+    FILE *file = tmpfile();
+    int fd = fileno(file);
+
+    // A file written by a build which stored larger messages.
+    uint32_t header[2] = {0x4A435453, 3};
+    uint32_t sizes[3] = {3001, TELEMETRY_STORE_MAX_MESSAGE_BYTES + 1, 3001 + 97};
+    EXPECT_EQ(sizeof(header), write(fd, header, sizeof(header)));
+    for (int i = 0; i < 3; i++)
+    {
+        EXPECT_EQ(sizeof(sizes[i]), write(fd, &sizes[i], sizeof(sizes[i])));
+        EXPECT_EQ(sizes[i], write(fd, Fill((uint8_t)(39 + i), sizes[i]), sizes[i]));
+    }
+
+    Drain();
+    TelemetryStore_GetStats(&before);
+    EXPECT_EQ(0, TelemetryStore_Load(fd));
+    TelemetryStore_GetStats(&after);
+
+    EXPECT_EQ(before.dropped + 1, after.dropped);
+    EXPECT_EQ(2, after.pendingMessages);
+    ForwardOldest(39, 3001);
+    ForwardOldest(41, 3001 + 97);
+
+    fclose(file);
+}
+
+static void Store_LoadsNothingFromAnEmptyFile(void)
+{
+    FILE *file = tmpfile();
+
+    Drain();
+    EXPECT_EQ(0, TelemetryStore_Load(fileno(file)));
+    EXPECT_EQ(0, PendingMessages());
+
+    fclose(file);
+}
+
+int main(void)
+{
+    RUN_TEST(Store_EvictsTheOldestMessagesWhenFull);
+    RUN_TEST(Store_DropsEmptyAndOversizedMessages);
+    RUN_TEST(Store_RemovesOnlyTheAcknowledgedMessage);
+    RUN_TEST(Store_KeepsTheNextMessageWhenTheForwardedOneWasEvicted);
+    RUN_TEST(Store_WrapsRecordsAroundTheEndOfTheRing);
+    RUN_TEST(Store_SavesAndLoadsTheBacklog);
+    RUN_TEST(Store_LoadsTheMessagesBeforeATruncation);
+    RUN_TEST(Store_SkipsOversizedMessagesOnLoad);
+    RUN_TEST(Store_LoadsNothingFromAnEmptyFile);
+
+    return TEST_EXIT_CODE();
+}
@@ -2,8 +2,10 @@
 #include <errno.h>
 #include <unistd.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
 
-#include <applibs/log.h>
+#include "logger.h"
 
 void CloseFd(int fd, const char *fdName)
 {
@@ -16,6 +18,27 @@ void CloseFd(int fd, const char *fdName)
 
     if (result != 0)
     {
-        Log_Debug("ERROR: Could not close fd %s: %s (%d).\n", fdName, strerror(errno), errno);
+        LOG_ERROR("Could not close fd %s: %s (%d).\n", fdName, strerror(errno), errno);
     }
-}
\ No newline at end of file
+}
+
+uint64_t GetMonotonicMicroseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u;
+}
+
+uint64_t HashFnv1a64(const char *data, size_t length)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
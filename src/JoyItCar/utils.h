@@ -2,9 +2,18 @@
 #pragma once
 
 #include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #include <applibs/eventloop.h>
 
 static volatile sig_atomic_t exitCode = 0;
 
-void CloseFd(int fd, const char *fdName);
\ No newline at end of file
+void CloseFd(int fd, const char *fdName);
+
+uint64_t GetMonotonicMicroseconds(void);
+
+/// <summary>
+///     64-bit FNV-1a hash, used to compare strings without keeping copies of them.
+/// </summary>
+uint64_t HashFnv1a64(const char *data, size_t length);
@@ -0,0 +1,61 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Linq;
+using JoyItCar.Function.Intents.GoogleDialogFlow;
+using JoyItCar.Services;
+using Newtonsoft.Json.Linq;
+
+namespace JoyItCar.Function.Intents
+{
+    /// <summary>
+    /// Builds the steps of the ExecuteSequence intent from its list parameters: "maneuvers",
+    /// e.g. ["forward", "left"], and the matching "durations" in seconds. A missing duration
+    /// defaults to one second.
+    /// </summary>
+    public static class SequenceIntent
+    {
+        public const string Name = "ExecuteSequence";
+
+        private static readonly TimeSpan DefaultStepDuration = TimeSpan.FromSeconds(1);
+
+        private static readonly Dictionary<string, Maneuver> Maneuvers = new Dictionary<string, Maneuver>(StringComparer.OrdinalIgnoreCase)
+        {
+            ["forward"] = Maneuver.Forward,
+            ["backward"] = Maneuver.Backward,
+            ["left"] = Maneuver.Left,
+            ["right"] = Maneuver.Right,
+            ["stop"] = Maneuver.Break,
+            ["break"] = Maneuver.Break,
+            ["wait"] = Maneuver.Wait
+        };
+
+        public static IReadOnlyList<SequenceStep> GetSteps(Intent intent)
+        {
+            var maneuvers = GetValues(intent, "maneuvers");
+            var durations = GetValues(intent, "durations");
+
+            return maneuvers
+                .Select((maneuver, index) => new SequenceStep(
+                    Maneuvers.TryGetValue(maneuver.Value<string>(), out var value)
+                        ? value
+                        : throw new ArgumentException($"Maneuver {maneuver} is not handled!"),
+                    index < durations.Count ? TimeSpan.FromSeconds(durations[index].Value<double>()) : DefaultStepDuration))
+                .ToList();
+        }
+
+        /// <summary>
+        /// Values of a parameter, which is resolved to a single value when only one was said.
+        /// </summary>
+        private static IReadOnlyList<JToken> GetValues(Intent intent, string parameter)
+        {
+            if (intent.Params == null || !intent.Params.TryGetValue(parameter, out var value) || value.Resolved == null)
+            {
+                return Array.Empty<JToken>();
+            }
+
+            JToken resolved = value.Resolved is JToken token ? token : JToken.FromObject(value.Resolved);
+
+            return resolved is JArray array ? array.ToList() : new List<JToken> { resolved };
+        }
+    }
+}
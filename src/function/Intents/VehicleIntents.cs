@@ -0,0 +1,42 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Threading.Tasks;
+using JoyItCar.Function.Intents.GoogleDialogFlow;
+using JoyItCar.Services;
+
+namespace JoyItCar.Function.Intents
+{
+    /// <summary>
+    /// Sends the command of an intent to the cars of the group. The main intent, which only
+    /// opens the conversation, sends none.
+    /// </summary>
+    public static class VehicleIntents
+    {
+        public const string Main = "actions.intent.MAIN";
+
+        /// <returns>The result on each device, or null if the intent is not handled.</returns>
+        /// <exception cref="ArgumentException">The parameters of the intent are invalid.</exception>
+        public static async Task<IReadOnlyList<DeviceMethodResult>> Handle(VehicleService vehicleService, Intent intent, CommandTrace trace)
+        {
+            switch (intent.Name)
+            {
+                case Main:
+                    return Array.Empty<DeviceMethodResult>();
+                case "GoForward":
+                    return await vehicleService.GoForward(trace);
+                case "GoBackward":
+                    return await vehicleService.GoBackward(trace);
+                case "TurnLeft":
+                    return await vehicleService.TurnLeft(trace);
+                case "TurnRight":
+                    return await vehicleService.TurnRight(trace);
+                case "Break":
+                    return await vehicleService.Break(trace);
+                case SequenceIntent.Name:
+                    return await vehicleService.ExecuteSequence(SequenceIntent.GetSteps(intent), trace);
+                default:
+                    return null;
+            }
+        }
+    }
+}
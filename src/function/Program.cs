@@ -39,10 +39,16 @@ namespace function
         {
             var ioTHubConnectionString = context.Configuration.GetValue<string>("IoTHubConnectionString");
 
-            services.AddScoped<VehicleService>();
-            
+            services.AddSingleton<DeviceStateCache>();
+            services.AddSingleton<DeviceGroup>();
+            services.AddSingleton<VehicleService>();
+            services.AddSingleton<WebhookStatistics>();
+
             services.AddSingleton(sp => ServiceClient.CreateFromConnectionString(ioTHubConnectionString));
             services.AddSingleton(sp => RegistryManager.CreateFromConnectionString(ioTHubConnectionString));
+            services.AddSingleton<IIoTHub, IoTHub>();
+
+            services.AddHostedService<ServiceClientWarmup>();
         }
     }
 }
\ No newline at end of file
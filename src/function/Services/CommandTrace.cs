@@ -0,0 +1,23 @@
+using System;
+using System.Diagnostics;
+
+namespace JoyItCar.Services
+{
+    /// <summary>
+    /// Trace context of a voice command, created when the webhook receives it. The trace ID
+    /// travels in the direct method payload; the device returns it with its receipt time and
+    /// reports its dispatch and I2C timings under the same ID in the "lastTrace" property.
+    /// </summary>
+    public class CommandTrace
+    {
+        public CommandTrace()
+        {
+            this.TraceId = ActivityTraceId.CreateRandom().ToHexString();
+            this.ReceivedAt = DateTimeOffset.UtcNow;
+        }
+
+        public string TraceId { get; }
+
+        public DateTimeOffset ReceivedAt { get; }
+    }
+}
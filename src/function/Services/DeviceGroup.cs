@@ -0,0 +1,77 @@
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
+using Microsoft.Extensions.Configuration;
+
+namespace JoyItCar.Services
+{
+    /// <summary>
+    /// Devices targeted by the voice commands: the comma-separated DEVICE_IDS, or the devices
+    /// whose twin tag "group" equals DEVICE_GROUP_TAG, or else the single DEVICE_ID. The
+    /// result of the registry query is cached for DEVICE_GROUP_TTL_SECONDS.
+    /// </summary>
+    public class DeviceGroup
+    {
+        private const int DefaultTimeToLiveSeconds = 60;
+
+        private readonly IIoTHub ioTHub;
+
+        private readonly IReadOnlyList<string> configuredDeviceIds;
+
+        private readonly string groupTag;
+
+        private readonly TimeSpan timeToLive;
+
+        private readonly SemaphoreSlim refreshLock = new SemaphoreSlim(1, 1);
+
+        private IReadOnlyList<string> queriedDeviceIds;
+
+        private DateTime expiresAt;
+
+        public DeviceGroup(IConfiguration configuration, IIoTHub ioTHub)
+        {
+            this.ioTHub = ioTHub;
+            this.groupTag = configuration.GetValue<string>("DEVICE_GROUP_TAG");
+            this.timeToLive = TimeSpan.FromSeconds(configuration.GetValue("DEVICE_GROUP_TTL_SECONDS", DefaultTimeToLiveSeconds));
+
+            var deviceIds = configuration.GetValue<string>("DEVICE_IDS") ?? configuration.GetValue<string>("DEVICE_ID") ?? string.Empty;
+
+            this.configuredDeviceIds = deviceIds
+                .Split(',', StringSplitOptions.RemoveEmptyEntries | StringSplitOptions.TrimEntries)
+                .ToList();
+        }
+
+        public async ValueTask<IReadOnlyList<string>> GetDeviceIdsAsync()
+        {
+            if (string.IsNullOrEmpty(this.groupTag))
+            {
+                return this.configuredDeviceIds;
+            }
+
+            if (this.queriedDeviceIds != null && this.expiresAt > DateTime.UtcNow)
+            {
+                return this.queriedDeviceIds;
+            }
+
+            await this.refreshLock.WaitAsync();
+
+            try
+            {
+                if (this.queriedDeviceIds == null || this.expiresAt <= DateTime.UtcNow)
+                {
+                    this.queriedDeviceIds = await this.ioTHub.QueryDeviceIdsAsync(this.groupTag);
+                    this.expiresAt = DateTime.UtcNow + this.timeToLive;
+                }
+
+                return this.queriedDeviceIds;
+            }
+            finally
+            {
+                this.refreshLock.Release();
+            }
+        }
+
+    }
+}
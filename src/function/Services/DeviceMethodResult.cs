@@ -0,0 +1,43 @@
+using System;
+
+namespace JoyItCar.Services
+{
+    /// <summary>
+    /// Outcome of a direct method on one device of the group. Status is the method status,
+    /// or 0 if the method could not be invoked, in which case Error says why. A coalesced
+    /// command shares the result of an identical one sent just before; a deduplicated one was
+    /// sent, but the device had already applied its idempotency key. SentAt and RespondedAt
+    /// frame the direct method call; DeviceReceivedAt is the receipt time on the device clock,
+    /// for a traced command.
+    /// </summary>
+    public class DeviceMethodResult
+    {
+        public string DeviceId { get; set; }
+
+        public int Status { get; set; }
+
+        public string Error { get; set; }
+
+        public TimeSpan Elapsed { get; set; }
+
+        public bool Coalesced { get; set; }
+
+        public bool Deduplicated { get; set; }
+
+        public DateTimeOffset? SentAt { get; set; }
+
+        public DateTimeOffset? RespondedAt { get; set; }
+
+        public DateTimeOffset? DeviceReceivedAt { get; set; }
+
+        public bool Succeeded => this.Status >= 200 && this.Status < 300;
+
+        public DeviceMethodResult AsCoalesced()
+        {
+            var result = (DeviceMethodResult)this.MemberwiseClone();
+            result.Coalesced = true;
+
+            return result;
+        }
+    }
+}
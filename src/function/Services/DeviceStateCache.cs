@@ -0,0 +1,91 @@
+using System;
+using System.Collections.Concurrent;
+using System.Threading.Tasks;
+using Microsoft.Azure.Devices;
+using Microsoft.Extensions.Configuration;
+
+namespace JoyItCar.Services
+{
+    /// <summary>
+    /// Connection state of the devices, shared by all invocations of the function so that a
+    /// command does not wait for a registry lookup. An entry is refreshed from the registry
+    /// once it is older than DEVICE_STATE_TTL_SECONDS, replaced by the device connection
+    /// events, and dropped when a method invocation fails.
+    /// </summary>
+    public class DeviceStateCache
+    {
+        private const int DefaultTimeToLiveSeconds = 10;
+
+        private readonly IIoTHub ioTHub;
+
+        private readonly TimeSpan timeToLive;
+
+        private readonly ConcurrentDictionary<string, DeviceStateEntry> entries = new ConcurrentDictionary<string, DeviceStateEntry>();
+
+        private readonly ConcurrentDictionary<string, Task<DeviceStateEntry>> refreshes = new ConcurrentDictionary<string, Task<DeviceStateEntry>>();
+
+        private sealed class DeviceStateEntry
+        {
+            public DeviceStateEntry(DeviceConnectionState connectionState, DateTime expiresAt)
+            {
+                this.ConnectionState = connectionState;
+                this.ExpiresAt = expiresAt;
+            }
+
+            public DeviceConnectionState ConnectionState { get; }
+
+            public DateTime ExpiresAt { get; }
+        }
+
+        public DeviceStateCache(IConfiguration configuration, IIoTHub ioTHub)
+        {
+            this.ioTHub = ioTHub;
+            this.timeToLive = TimeSpan.FromSeconds(configuration.GetValue("DEVICE_STATE_TTL_SECONDS", DefaultTimeToLiveSeconds));
+        }
+
+        public async ValueTask<DeviceConnectionState> GetConnectionStateAsync(string deviceId)
+        {
+            if (this.entries.TryGetValue(deviceId, out var entry) && entry.ExpiresAt > DateTime.UtcNow)
+            {
+                return entry.ConnectionState;
+            }
+
+            // Concurrent requests for the same device share a single registry lookup.
+            var refresh = this.refreshes.GetOrAdd(deviceId, this.RefreshAsync);
+
+            try
+            {
+                return (await refresh).ConnectionState;
+            }
+            finally
+            {
+                this.refreshes.TryRemove(deviceId, out _);
+            }
+        }
+
+        public void SetConnectionState(string deviceId, DeviceConnectionState connectionState)
+        {
+            this.entries[deviceId] = new DeviceStateEntry(connectionState, DateTime.UtcNow + this.timeToLive);
+        }
+
+        public void Invalidate(string deviceId)
+        {
+            this.entries.TryRemove(deviceId, out _);
+        }
+
+        private async Task<DeviceStateEntry> RefreshAsync(string deviceId)
+        {
+            var connectionState = await this.ioTHub.GetConnectionStateAsync(deviceId);
+
+            if (connectionState == null)
+            {
+                throw new InvalidOperationException("Device is not present in the registry!");
+            }
+
+            var entry = new DeviceStateEntry(connectionState.Value, DateTime.UtcNow + this.timeToLive);
+            this.entries[deviceId] = entry;
+
+            return entry;
+        }
+    }
+}
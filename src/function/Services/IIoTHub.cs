@@ -0,0 +1,45 @@
+using System;
+using System.Collections.Generic;
+using System.Threading;
+using System.Threading.Tasks;
+using Microsoft.Azure.Devices;
+
+namespace JoyItCar.Services
+{
+    /// <summary>
+    /// Response of a direct method: the status set by the device and its JSON payload.
+    /// </summary>
+    public class DeviceMethodResponse
+    {
+        public int Status { get; set; }
+
+        public string Payload { get; set; }
+    }
+
+    /// <summary>
+    /// The IoT Hub operations used by the function, implemented by <see cref="IoTHub" />. The
+    /// load test tool in src/loadtest implements them without a hub.
+    /// </summary>
+    public interface IIoTHub
+    {
+        /// <summary>
+        /// Opens the connections used by the direct methods.
+        /// </summary>
+        Task OpenAsync();
+
+        /// <summary>
+        /// Keeps the connections opened by <see cref="OpenAsync" /> from idling out.
+        /// </summary>
+        Task KeepAliveAsync();
+
+        /// <returns>The connection state, or null if the device is not in the registry.</returns>
+        Task<DeviceConnectionState?> GetConnectionStateAsync(string deviceId);
+
+        Task<IReadOnlyList<string>> QueryDeviceIdsAsync(string groupTag);
+
+        /// <exception cref="Microsoft.Azure.Devices.Common.Exceptions.DeviceNotFoundException">
+        /// The device is not connected.
+        /// </exception>
+        Task<DeviceMethodResponse> InvokeMethodAsync(string deviceId, string methodName, string payload, TimeSpan timeout, CancellationToken cancellationToken);
+    }
+}
@@ -0,0 +1,73 @@
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
+using Microsoft.Azure.Devices;
+
+namespace JoyItCar.Services
+{
+    public class IoTHub : IIoTHub
+    {
+        private readonly ServiceClient serviceClient;
+
+        private readonly RegistryManager registryManager;
+
+        public IoTHub(ServiceClient serviceClient, RegistryManager registryManager)
+        {
+            this.serviceClient = serviceClient;
+            this.registryManager = registryManager;
+        }
+
+        public async Task OpenAsync()
+        {
+            await this.serviceClient.OpenAsync();
+
+            // Direct methods go over HTTPS rather than the AMQP connection opened above, so a
+            // service statistics request primes the HTTPS connection they use.
+            await this.serviceClient.GetServiceStatisticsAsync();
+        }
+
+        public async Task KeepAliveAsync()
+        {
+            await this.serviceClient.GetServiceStatisticsAsync();
+        }
+
+        public async Task<DeviceConnectionState?> GetConnectionStateAsync(string deviceId)
+        {
+            var device = await this.registryManager.GetDeviceAsync(deviceId);
+
+            return device?.ConnectionState;
+        }
+
+        public async Task<IReadOnlyList<string>> QueryDeviceIdsAsync(string groupTag)
+        {
+            var query = this.registryManager.CreateQuery(
+                $"SELECT * FROM devices WHERE tags.group = '{groupTag.Replace("'", "''")}'");
+            var deviceIds = new List<string>();
+
+            while (query.HasMoreResults)
+            {
+                var twins = await query.GetNextAsTwinAsync();
+
+                deviceIds.AddRange(twins.Select(twin => twin.DeviceId));
+            }
+
+            return deviceIds;
+        }
+
+        public async Task<DeviceMethodResponse> InvokeMethodAsync(string deviceId, string methodName, string payload, TimeSpan timeout, CancellationToken cancellationToken)
+        {
+            var method = new CloudToDeviceMethod(methodName, timeout, timeout);
+
+            if (payload != null)
+            {
+                method.SetPayloadJson(payload);
+            }
+
+            var result = await this.serviceClient.InvokeDeviceMethodAsync(deviceId, method, cancellationToken);
+
+            return new DeviceMethodResponse { Status = result.Status, Payload = result.GetPayloadAsJson() };
+        }
+    }
+}
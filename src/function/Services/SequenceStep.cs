@@ -0,0 +1,30 @@
+using System;
+
+namespace JoyItCar.Services
+{
+    /// <summary>
+    /// Maneuvers of a sequence, valued as the step letters of the ExecuteSequence payload.
+    /// </summary>
+    public enum Maneuver
+    {
+        Forward = 'F',
+        Backward = 'B',
+        Left = 'L',
+        Right = 'R',
+        Break = 'S',
+        Wait = 'W'
+    }
+
+    public class SequenceStep
+    {
+        public SequenceStep(Maneuver maneuver, TimeSpan duration)
+        {
+            this.Maneuver = maneuver;
+            this.Duration = duration;
+        }
+
+        public Maneuver Maneuver { get; }
+
+        public TimeSpan Duration { get; }
+    }
+}
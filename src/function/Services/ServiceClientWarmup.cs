@@ -0,0 +1,102 @@
+using System;
+using System.Diagnostics;
+using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
+using Microsoft.Extensions.Configuration;
+using Microsoft.Extensions.Hosting;
+using Microsoft.Extensions.Logging;
+
+namespace JoyItCar.Services
+{
+    /// <summary>
+    /// Opens the IoT Hub connections when the worker starts rather than on the first voice
+    /// command, and logs how long each cold-start phase took. The connections are kept alive
+    /// every WARMUP_KEEPALIVE_SECONDS so that they do not idle out between commands.
+    /// </summary>
+    public class ServiceClientWarmup : IHostedService, IDisposable
+    {
+        private const int DefaultKeepAliveSeconds = 50;
+
+        private readonly IIoTHub ioTHub;
+
+        private readonly DeviceGroup deviceGroup;
+
+        private readonly DeviceStateCache deviceStateCache;
+
+        private readonly ILogger<ServiceClientWarmup> log;
+
+        private readonly TimeSpan keepAliveInterval;
+
+        private Timer keepAliveTimer;
+
+        public ServiceClientWarmup(IConfiguration configuration, IIoTHub ioTHub, DeviceGroup deviceGroup, DeviceStateCache deviceStateCache, ILogger<ServiceClientWarmup> log)
+        {
+            this.ioTHub = ioTHub;
+            this.deviceGroup = deviceGroup;
+            this.deviceStateCache = deviceStateCache;
+            this.log = log;
+            this.keepAliveInterval = TimeSpan.FromSeconds(configuration.GetValue("WARMUP_KEEPALIVE_SECONDS", DefaultKeepAliveSeconds));
+        }
+
+        public Task StartAsync(CancellationToken cancellationToken)
+        {
+            // Not awaited: the worker accepts invocations while the connections open, and a
+            // command racing the warm-up only opens them itself, as it did before.
+            _ = this.WarmUpAsync();
+
+            return Task.CompletedTask;
+        }
+
+        public Task StopAsync(CancellationToken cancellationToken)
+        {
+            this.keepAliveTimer?.Change(Timeout.Infinite, Timeout.Infinite);
+
+            return Task.CompletedTask;
+        }
+
+        public void Dispose()
+        {
+            this.keepAliveTimer?.Dispose();
+        }
+
+        private async Task WarmUpAsync()
+        {
+            var processStartTime = Process.GetCurrentProcess().StartTime.ToUniversalTime();
+            var hostStartedMs = (DateTime.UtcNow - processStartTime).TotalMilliseconds;
+            var stopwatch = Stopwatch.StartNew();
+
+            try
+            {
+                await this.ioTHub.OpenAsync();
+                var openMs = stopwatch.Elapsed.TotalMilliseconds;
+
+                var deviceIds = await this.deviceGroup.GetDeviceIdsAsync();
+                await Task.WhenAll(deviceIds.Select(deviceId => this.deviceStateCache.GetConnectionStateAsync(deviceId).AsTask()));
+                var registryMs = stopwatch.Elapsed.TotalMilliseconds - openMs;
+
+                this.log.LogInformation(
+                    "Cold start: host started {HostStartedMs} ms after process start, service client open {OpenMs} ms, registry for {DeviceCount} devices {RegistryMs} ms",
+                    hostStartedMs, openMs, deviceIds.Count, registryMs);
+            }
+            catch (Exception exception)
+            {
+                this.log.LogWarning(exception, "Warm-up failed after {ElapsedMs} ms; the first command opens the connections", stopwatch.Elapsed.TotalMilliseconds);
+            }
+
+            this.keepAliveTimer = new Timer(this.KeepAlive, null, this.keepAliveInterval, this.keepAliveInterval);
+        }
+
+        private async void KeepAlive(object state)
+        {
+            try
+            {
+                await this.ioTHub.KeepAliveAsync();
+            }
+            catch (Exception exception)
+            {
+                this.log.LogWarning(exception, "Service client keep-alive failed");
+            }
+        }
+    }
+}
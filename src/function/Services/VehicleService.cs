@@ -1,90 +1,250 @@
 using System;
+using System.Collections.Generic;
+using System.Diagnostics;
 using System.Linq;
+using System.Threading;
 using System.Threading.Tasks;
 using Microsoft.Azure.Devices;
+using Microsoft.Azure.Devices.Common.Exceptions;
 using Microsoft.Azure.Devices.Shared;
 using Microsoft.Extensions.Configuration;
+using Newtonsoft.Json.Linq;
 
 namespace JoyItCar.Services
 {
     public class VehicleService
     {
-        private readonly IConfiguration configuration;
+        // Limits of the sequences accepted by the ExecuteSequence method of the device.
+        public const int MaxSequenceSteps = 16;
 
-        private readonly RegistryManager registryManager;
+        public static readonly TimeSpan MaxStepDuration = TimeSpan.FromSeconds(10);
 
-        private readonly ServiceClient serviceClient;
+        private const int DefaultMethodConcurrency = 8;
 
-        private Device device;
+        private const int DefaultMethodTimeoutSeconds = 5;
 
-        public VehicleService(IConfiguration configuration, RegistryManager registryManager, ServiceClient serviceClient)
+        private const int DefaultCoalescingWindowMs = 500;
+
+        private readonly DeviceStateCache deviceStateCache;
+
+        private readonly DeviceGroup deviceGroup;
+
+        private readonly IIoTHub ioTHub;
+
+        private readonly int methodConcurrency;
+
+        private readonly TimeSpan methodTimeout;
+
+        private readonly TimeSpan coalescingWindow;
+
+        // Commands sent within the coalescing window, by device, method and arguments.
+        private readonly Dictionary<string, RecentCommand> recentCommands = new Dictionary<string, RecentCommand>();
+
+        private sealed class RecentCommand
         {
-            this.configuration = configuration;
-            this.registryManager = registryManager;
-            this.serviceClient = serviceClient;
+            public RecentCommand(Lazy<Task<DeviceMethodResult>> result, DateTime sentAt)
+            {
+                this.Result = result;
+                this.SentAt = sentAt;
+            }
+
+            public Lazy<Task<DeviceMethodResult>> Result { get; }
+
+            public DateTime SentAt { get; }
         }
 
-        private void EnsureIsConnected()
+        public VehicleService(IConfiguration configuration, DeviceStateCache deviceStateCache, DeviceGroup deviceGroup, IIoTHub ioTHub)
         {
-            if (device == null)
-            {
-                throw new InvalidProgramException("Service not initialized. Please call ConnectToDeviceAsync method before!");
+            this.deviceStateCache = deviceStateCache;
+            this.deviceGroup = deviceGroup;
+            this.ioTHub = ioTHub;
+            this.methodConcurrency = Math.Max(1, configuration.GetValue("METHOD_CONCURRENCY", DefaultMethodConcurrency));
+            this.methodTimeout = TimeSpan.FromSeconds(configuration.GetValue("METHOD_TIMEOUT_SECONDS", DefaultMethodTimeoutSeconds));
+            this.coalescingWindow = TimeSpan.FromMilliseconds(configuration.GetValue("COALESCING_WINDOW_MS", DefaultCoalescingWindowMs));
+        }
 
-            }
+        private async ValueTask EnsureIsConnected(string deviceId)
+        {
+            var connectionState = await this.deviceStateCache.GetConnectionStateAsync(deviceId);
 
-            if (device.ConnectionState == DeviceConnectionState.Disconnected)
+            if (connectionState == DeviceConnectionState.Disconnected)
             {
                 throw new InvalidOperationException("Device is not connected!");
             }
         }
 
-        public async Task ConnectToDeviceAsync()
+        public async Task<IReadOnlyList<DeviceMethodResult>> GoForward(CommandTrace trace = null)
         {
-            device = await registryManager.GetDeviceAsync(this.configuration.GetValue<string>("DEVICE_ID"));
+            return await this.SendMethod(nameof(GoForward), trace);
+        }
 
-            if (device == null)
-            {
-                throw new InvalidOperationException("Device is not present in the registry!");
-            }
+        public async Task<IReadOnlyList<DeviceMethodResult>> GoBackward(CommandTrace trace = null)
+        {
+            return await this.SendMethod(nameof(GoBackward), trace);
+        }
 
-            if (device.ConnectionState == DeviceConnectionState.Disconnected)
-            {
-                throw new InvalidOperationException("Device is not connected!");
-            }
+        public async Task<IReadOnlyList<DeviceMethodResult>> Break(CommandTrace trace = null)
+        {
+            return await this.SendMethod(nameof(Break), trace);
         }
 
-        public async Task GoForward()
+        public async Task<IReadOnlyList<DeviceMethodResult>> TurnLeft(CommandTrace trace = null)
         {
-            await this.SendMethod(nameof(GoForward));
+            return await this.SendMethod(nameof(TurnLeft), trace);
         }
 
-        public async Task GoBackward()
+        public async Task<IReadOnlyList<DeviceMethodResult>> TurnRight(CommandTrace trace = null)
         {
-            await this.SendMethod(nameof(GoBackward));
+            return await this.SendMethod(nameof(TurnRight), trace);
         }
 
-        public async Task Break()
+        /// <summary>
+        /// Runs the steps on each device in a single direct method; a device brakes once the
+        /// last step ends.
+        /// </summary>
+        public async Task<IReadOnlyList<DeviceMethodResult>> ExecuteSequence(IReadOnlyList<SequenceStep> steps, CommandTrace trace = null)
         {
-            await this.SendMethod(nameof(Break));
+            if (steps.Count == 0 || steps.Count > MaxSequenceSteps)
+            {
+                throw new ArgumentException($"A sequence has 1 to {MaxSequenceSteps} steps.", nameof(steps));
+            }
+
+            if (steps.Any(step => step.Duration < TimeSpan.Zero || step.Duration > MaxStepDuration))
+            {
+                throw new ArgumentException($"A step lasts at most {MaxStepDuration.TotalSeconds} seconds.", nameof(steps));
+            }
+
+            var sequence = string.Join(",", steps.Select(step => $"{(char)step.Maneuver}{(int)step.Duration.TotalMilliseconds}"));
+
+            return await this.SendMethod(nameof(ExecuteSequence), trace, $"\"steps\":\"{sequence}\"");
         }
 
-        public async Task TurnLeft()
+        /// <summary>
+        /// Invokes the method on every device of the group, at most METHOD_CONCURRENCY at a
+        /// time, each within METHOD_TIMEOUT_SECONDS. A failing device does not fail the others.
+        /// The payload carries the arguments, given as JSON members, plus an idempotency key and
+        /// the send time, so that the device can skip a retry, and the trace ID if any. A
+        /// command identical to one sent to the same device within COALESCING_WINDOW_MS is not
+        /// sent again; it shares the result of the first one.
+        /// </summary>
+        private async Task<IReadOnlyList<DeviceMethodResult>> SendMethod(string methodName, CommandTrace trace, string arguments = null)
         {
-            await this.SendMethod(nameof(TurnLeft));
+            var deviceIds = await this.deviceGroup.GetDeviceIdsAsync();
+
+            if (deviceIds.Count == 0)
+            {
+                throw new InvalidOperationException("No device is configured!");
+            }
+
+            var key = Guid.NewGuid().ToString("N").Substring(0, 16);
+            var payload = $"{{\"key\":\"{key}\",\"ts\":{DateTimeOffset.UtcNow.ToUnixTimeMilliseconds()}"
+                + (trace == null ? string.Empty : $",\"trace\":\"{trace.TraceId}\"")
+                + (arguments == null ? string.Empty : "," + arguments)
+                + "}";
+
+            using (var throttle = new SemaphoreSlim(this.methodConcurrency))
+            {
+                var results = deviceIds.Select(deviceId => this.SendCoalescedDeviceMethod(deviceId, methodName, arguments, async () =>
+                {
+                    await throttle.WaitAsync();
+
+                    try
+                    {
+                        return await this.SendDeviceMethod(deviceId, methodName, payload);
+                    }
+                    finally
+                    {
+                        throttle.Release();
+                    }
+                }));
+
+                return await Task.WhenAll(results);
+            }
         }
 
-        public async Task TurnRight()
+        private async Task<DeviceMethodResult> SendCoalescedDeviceMethod(string deviceId, string methodName, string arguments, Func<Task<DeviceMethodResult>> send)
         {
-            await this.SendMethod(nameof(TurnRight));
+            var commandKey = $"{deviceId}/{methodName}/{arguments}";
+            var now = DateTime.UtcNow;
+            RecentCommand command;
+            bool coalesced;
+
+            lock (this.recentCommands)
+            {
+                coalesced = this.recentCommands.TryGetValue(commandKey, out command) && now - command.SentAt < this.coalescingWindow;
+
+                if (!coalesced)
+                {
+                    foreach (var expired in this.recentCommands.Where(entry => now - entry.Value.SentAt >= this.coalescingWindow).Select(entry => entry.Key).ToList())
+                    {
+                        this.recentCommands.Remove(expired);
+                    }
+
+                    command = new RecentCommand(new Lazy<Task<DeviceMethodResult>>(send), now);
+                    this.recentCommands[commandKey] = command;
+                }
+            }
+
+            var result = await command.Result.Value;
+
+            if (!coalesced)
+            {
+                return result;
+            }
+
+            return result.AsCoalesced();
         }
 
-        private async Task SendMethod(string methodName)
+        private async Task<DeviceMethodResult> SendDeviceMethod(string deviceId, string methodName, string payload)
         {
-            this.EnsureIsConnected();
-            
-            var response = await this.serviceClient.InvokeDeviceMethodAsync(
-                deviceId: this.device.Id, 
-                new CloudToDeviceMethod(methodName));
+            var result = new DeviceMethodResult { DeviceId = deviceId };
+            var stopwatch = Stopwatch.StartNew();
+
+            try
+            {
+                await this.EnsureIsConnected(deviceId);
+
+                using (var timeout = new CancellationTokenSource(this.methodTimeout))
+                {
+                    result.SentAt = DateTimeOffset.UtcNow;
+
+                    var response = await this.ioTHub.InvokeMethodAsync(deviceId, methodName, payload, this.methodTimeout, timeout.Token);
+
+                    result.RespondedAt = DateTimeOffset.UtcNow;
+                    result.Status = response.Status;
+
+                    if (!string.IsNullOrEmpty(response.Payload) && JToken.Parse(response.Payload) is JObject responsePayload)
+                    {
+                        var receivedAt = (long?)responsePayload["receivedAt"] ?? 0;
+
+                        result.Deduplicated = (string)responsePayload["result"] == "Duplicate";
+
+                        // 0 while the device clock is not synchronized.
+                        result.DeviceReceivedAt = receivedAt > 0 ? DateTimeOffset.FromUnixTimeMilliseconds(receivedAt) : (DateTimeOffset?)null;
+                    }
+                }
+            }
+            catch (DeviceNotFoundException exception)
+            {
+                // The hub reports an offline device as not found: skip the invocation until the
+                // entry expires or the device connects again.
+                this.deviceStateCache.SetConnectionState(deviceId, DeviceConnectionState.Disconnected);
+                result.Error = exception.Message;
+            }
+            catch (OperationCanceledException)
+            {
+                this.deviceStateCache.Invalidate(deviceId);
+                result.Error = "Device did not respond in time!";
+            }
+            catch (Exception exception)
+            {
+                this.deviceStateCache.Invalidate(deviceId);
+                result.Error = exception.Message;
+            }
+
+            result.Elapsed = stopwatch.Elapsed;
+
+            return result;
         }
     }
 }
\ No newline at end of file
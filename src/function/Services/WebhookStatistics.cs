@@ -0,0 +1,97 @@
+using System;
+using System.Collections.Generic;
+using Microsoft.Extensions.Configuration;
+using Microsoft.Extensions.Logging;
+
+namespace JoyItCar.Services
+{
+    /// <summary>
+    /// Throughput, latency percentiles and error rate of the webhook, logged once per
+    /// STATISTICS_INTERVAL_SECONDS window by the first request after the window ends. Gives the
+    /// function's side of a run of the load test tool in src/loadtest.
+    /// </summary>
+    public class WebhookStatistics
+    {
+        private const int DefaultIntervalSeconds = 60;
+
+        private readonly ILogger<WebhookStatistics> log;
+
+        private readonly TimeSpan interval;
+
+        private readonly List<double> latenciesMs = new List<double>();
+
+        private int failures;
+
+        private int coalescedCommands;
+
+        private int deduplicatedCommands;
+
+        private DateTime windowStart = DateTime.UtcNow;
+
+        public WebhookStatistics(IConfiguration configuration, ILogger<WebhookStatistics> log)
+        {
+            this.log = log;
+            this.interval = TimeSpan.FromSeconds(configuration.GetValue("STATISTICS_INTERVAL_SECONDS", DefaultIntervalSeconds));
+        }
+
+        /// <param name="coalesced">Commands of the request which were not sent, see <see cref="DeviceMethodResult.Coalesced" />.</param>
+        /// <param name="deduplicated">Commands of the request which the devices skipped.</param>
+        public void Record(TimeSpan elapsed, bool succeeded, int coalesced, int deduplicated)
+        {
+            double[] window = null;
+            int windowFailures = 0;
+            int windowCoalesced = 0;
+            int windowDeduplicated = 0;
+            TimeSpan windowLength = TimeSpan.Zero;
+
+            lock (this.latenciesMs)
+            {
+                this.latenciesMs.Add(elapsed.TotalMilliseconds);
+                this.failures += succeeded ? 0 : 1;
+                this.coalescedCommands += coalesced;
+                this.deduplicatedCommands += deduplicated;
+
+                var now = DateTime.UtcNow;
+
+                if (now - this.windowStart >= this.interval)
+                {
+                    window = this.latenciesMs.ToArray();
+                    windowFailures = this.failures;
+                    windowCoalesced = this.coalescedCommands;
+                    windowDeduplicated = this.deduplicatedCommands;
+                    windowLength = now - this.windowStart;
+
+                    this.latenciesMs.Clear();
+                    this.failures = 0;
+                    this.coalescedCommands = 0;
+                    this.deduplicatedCommands = 0;
+                    this.windowStart = now;
+                }
+            }
+
+            if (window != null)
+            {
+                Array.Sort(window);
+
+                this.log.LogInformation(
+                    "Webhook: {Requests} requests, {RequestsPerSecond:F1}/s, p50 {P50Ms:F0} ms, p90 {P90Ms:F0} ms, p99 {P99Ms:F0} ms, max {MaxMs:F0} ms, errors {ErrorPercent:F1}%, commands coalesced {Coalesced}, deduplicated by the devices {Deduplicated}",
+                    window.Length,
+                    window.Length / windowLength.TotalSeconds,
+                    GetPercentile(window, 0.50),
+                    GetPercentile(window, 0.90),
+                    GetPercentile(window, 0.99),
+                    window[window.Length - 1],
+                    100.0 * windowFailures / window.Length,
+                    windowCoalesced,
+                    windowDeduplicated);
+            }
+        }
+
+        private static double GetPercentile(double[] sorted, double percentile)
+        {
+            var index = (int)Math.Ceiling(percentile * sorted.Length) - 1;
+
+            return sorted[Math.Max(0, index)];
+        }
+    }
+}
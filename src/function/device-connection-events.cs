@@ -0,0 +1,57 @@
+using System;
+using System.Text.Json;
+using JoyItCar.Services;
+using Microsoft.Azure.Devices;
+using Microsoft.Azure.Functions.Worker;
+using Microsoft.Extensions.Logging;
+
+namespace JoyItCar.Function
+{
+    public class DeviceConnectionEvent
+    {
+        public string EventType { get; set; }
+
+        public DateTime EventTime { get; set; }
+
+        public JsonElement Data { get; set; }
+    }
+
+    /// <summary>
+    /// Keeps the device state cache current from the IoT Hub DeviceConnected and
+    /// DeviceDisconnected events, routed by an Event Grid subscription to this function.
+    /// </summary>
+    public class device_connection_events
+    {
+        private readonly DeviceStateCache deviceStateCache;
+
+        public device_connection_events(DeviceStateCache deviceStateCache)
+        {
+            this.deviceStateCache = deviceStateCache;
+        }
+
+        [Function("device_connection_events")]
+        public void Run([EventGridTrigger] DeviceConnectionEvent connectionEvent, FunctionContext executionContext)
+        {
+            ILogger log = executionContext.GetLogger("device_connection_events");
+
+            if (!connectionEvent.Data.TryGetProperty("deviceId", out var deviceId))
+            {
+                return;
+            }
+
+            switch (connectionEvent.EventType)
+            {
+                case "Microsoft.Devices.DeviceConnected":
+                    this.deviceStateCache.SetConnectionState(deviceId.GetString(), DeviceConnectionState.Connected);
+                    break;
+                case "Microsoft.Devices.DeviceDisconnected":
+                    this.deviceStateCache.SetConnectionState(deviceId.GetString(), DeviceConnectionState.Disconnected);
+                    break;
+                default:
+                    return;
+            }
+
+            log.LogInformation($"Device {deviceId.GetString()}: {connectionEvent.EventType} at {connectionEvent.EventTime:O}");
+        }
+    }
+}
\ No newline at end of file
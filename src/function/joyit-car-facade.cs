@@ -1,5 +1,8 @@
+using System;
 using System.Collections.Generic;
+using System.Diagnostics;
 using System.IO;
+using System.Linq;
 using System.Net;
 using System.Threading.Tasks;
 using JoyItCar.Function.Intents;
@@ -17,9 +20,12 @@ namespace JoyItCar.Function
     {
         private readonly VehicleService vehicleService;
 
-        public joyit_car_facade(VehicleService vehicleService)
+        private readonly WebhookStatistics webhookStatistics;
+
+        public joyit_car_facade(VehicleService vehicleService, WebhookStatistics webhookStatistics)
         {
             this.vehicleService = vehicleService;
+            this.webhookStatistics = webhookStatistics;
         }
 
         [Function("joyit_car_facade")]
@@ -27,6 +33,7 @@ namespace JoyItCar.Function
             FunctionContext executionContext)
         {
             ILogger log = executionContext.GetLogger("joyit_car_facade");
+            var trace = new CommandTrace();
 
             using (var reader = new StreamReader(req.Body))
             {
@@ -35,38 +42,53 @@ namespace JoyItCar.Function
 
                 var dialogResponse = GoogleDialogFlowResponse.FromQuery(query);
 
-                await vehicleService.ConnectToDeviceAsync();
+                var stopwatch = Stopwatch.StartNew();
+                IReadOnlyList<DeviceMethodResult> results;
+
+                try
+                {
+                    results = await VehicleIntents.Handle(vehicleService, query.Intent, trace);
+                }
+                catch (ArgumentException exception)
+                {
+                    var badRequest = req.CreateResponse(HttpStatusCode.BadRequest);
+
+                    await badRequest.WriteStringAsync(exception.Message);
+
+                    return badRequest;
+                }
+
+                if (results == null)
+                {
+                    var response = req.CreateResponse(HttpStatusCode.NotFound);
+
+                    await response.WriteStringAsync($"Intent {query.Intent.Name} is not handled!");
+
+                    return response;
+                }
+
+                // Per intent, so that the p50/p99 of the command round trip can be queried.
+                log.LogInformation("Intent {Intent} handled on {DeviceCount} devices in {ElapsedMs} ms, trace {TraceId}", query.Intent.Name, results.Count, stopwatch.Elapsed.TotalMilliseconds, trace.TraceId);
+
+                foreach (var result in results.Where(result => result.SentAt.HasValue && result.RespondedAt.HasValue && !result.Coalesced))
+                {
+                    LogTrace(log, trace, result);
+                }
 
-                switch (query.Intent.Name)
+                foreach (var result in results.Where(result => !result.Succeeded))
                 {
-                    case "actions.intent.MAIN":
-                        break;
-                    case "GoForward":
-                        await vehicleService.GoForward();
-                        break;
-                    case "GoBackward":
-                        await vehicleService.GoBackward();
-                        break;
-                    case "TurnLeft":
-                        await vehicleService.TurnLeft();
-                        break;
-                    case "TurnRight":
-                        await vehicleService.TurnRight();
-                        break;
-                    case "Break":
-                        await vehicleService.Break();
-                        break;
-                    default:                
-                        var response = req.CreateResponse(HttpStatusCode.NotFound);
-
-                        await response.WriteStringAsync($"Intent {query.Intent.Name} is not handled!");
-
-                        return response;
+                    log.LogWarning("Intent {Intent} failed on {DeviceId} after {ElapsedMs} ms: {Status} {Error}", query.Intent.Name, result.DeviceId, result.Elapsed.TotalMilliseconds, result.Status, result.Error);
                 }
 
+                webhookStatistics.Record(
+                    stopwatch.Elapsed,
+                    results.All(result => result.Succeeded),
+                    results.Count(result => result.Coalesced),
+                    results.Count(result => result.Deduplicated));
+
                 dialogResponse.Prompt.FirstSimple = new Simple
                 {
-                    Speech = "Ok"
+                    Speech = GetSpeech(results)
                 };
 
                 dialogResponse.Prompt.Override = false;
@@ -77,5 +99,49 @@ namespace JoyItCar.Function
                 return httpResponse;
             }
         }
+
+        /// <summary>
+        /// Per-hop latency of a command on a device: from the webhook to the direct method call,
+        /// then through IoT Hub to the device, including its DoWork cadence, and back. The
+        /// device hops are measured across clocks, so they are only as exact as its NTP sync.
+        /// The device's own dispatch and I2C timings are in its "lastTrace" reported property.
+        /// </summary>
+        private static void LogTrace(ILogger log, CommandTrace trace, DeviceMethodResult result)
+        {
+            var functionMs = (result.SentAt.Value - trace.ReceivedAt).TotalMilliseconds;
+            var roundTripMs = (result.RespondedAt.Value - result.SentAt.Value).TotalMilliseconds;
+
+            if (result.DeviceReceivedAt.HasValue)
+            {
+                log.LogInformation(
+                    "Trace {TraceId} on {DeviceId}: function {FunctionMs} ms, to device {ToDeviceMs} ms, response {ResponseMs} ms",
+                    trace.TraceId,
+                    result.DeviceId,
+                    functionMs,
+                    (result.DeviceReceivedAt.Value - result.SentAt.Value).TotalMilliseconds,
+                    (result.RespondedAt.Value - result.DeviceReceivedAt.Value).TotalMilliseconds);
+            }
+            else
+            {
+                log.LogInformation(
+                    "Trace {TraceId} on {DeviceId}: function {FunctionMs} ms, direct method {RoundTripMs} ms",
+                    trace.TraceId,
+                    result.DeviceId,
+                    functionMs,
+                    roundTripMs);
+            }
+        }
+
+        private static string GetSpeech(IReadOnlyList<DeviceMethodResult> results)
+        {
+            var succeeded = results.Count(result => result.Succeeded);
+
+            if (succeeded == results.Count)
+            {
+                return "Ok";
+            }
+
+            return results.Count == 1 ? "The car did not respond" : $"{succeeded} of {results.Count} cars responded";
+        }
     }
 }
@@ -0,0 +1,46 @@
+using System;
+using System.Net.Http;
+using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
+using Newtonsoft.Json.Linq;
+
+namespace JoyItCar.LoadTest
+{
+    /// <summary>
+    /// Posts the payloads to a running function, e.g. http://localhost:7071/api/joyit_car_facade
+    /// under func start, or a deployed one with its key in the code query parameter.
+    /// </summary>
+    public class HttpLoadTarget : ILoadTarget
+    {
+        private const string AllResponded = "Ok";
+
+        private readonly HttpClient httpClient;
+
+        private readonly Uri url;
+
+        public HttpLoadTarget(Uri url, TimeSpan timeout)
+        {
+            this.url = url;
+            this.httpClient = new HttpClient { Timeout = timeout };
+        }
+
+        public async Task<string> SendAsync(string payload, CancellationToken cancellationToken)
+        {
+            using (var content = new StringContent(payload, Encoding.UTF8, "application/json"))
+            using (var response = await this.httpClient.PostAsync(this.url, content, cancellationToken))
+            {
+                if (!response.IsSuccessStatusCode)
+                {
+                    return $"HTTP {(int)response.StatusCode}";
+                }
+
+                // The speech is "Ok" only if every car of the group responded.
+                var body = JObject.Parse(await response.Content.ReadAsStringAsync());
+                var speech = (string)body.SelectToken("prompt.firstSimple.speech");
+
+                return speech == AllResponded ? null : "not every car responded";
+            }
+        }
+    }
+}
@@ -0,0 +1,17 @@
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace JoyItCar.LoadTest
+{
+    /// <summary>
+    /// The webhook under load: a function listening on a URL, or its intents run in process.
+    /// </summary>
+    public interface ILoadTarget
+    {
+        /// <summary>
+        /// Sends a GoogleDialogFlowQuery payload and waits for the answer.
+        /// </summary>
+        /// <returns>null if every car responded, else why the request failed.</returns>
+        Task<string> SendAsync(string payload, CancellationToken cancellationToken);
+    }
+}
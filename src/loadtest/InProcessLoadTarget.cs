@@ -0,0 +1,51 @@
+using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
+using JoyItCar.Function.Intents;
+using JoyItCar.Function.Intents.GoogleDialogFlow;
+using JoyItCar.Services;
+using Microsoft.Extensions.Configuration;
+using Newtonsoft.Json;
+
+namespace JoyItCar.LoadTest
+{
+    /// <summary>
+    /// Runs the payloads through the intents and services of the webhook, against the
+    /// <see cref="SimulatedIoTHub" />: the function's own cost, without the Functions host, the
+    /// network or a car.
+    /// </summary>
+    public class InProcessLoadTarget : ILoadTarget
+    {
+        private readonly VehicleService vehicleService;
+
+        public InProcessLoadTarget(IConfiguration configuration)
+        {
+            var ioTHub = new SimulatedIoTHub(configuration);
+
+            this.vehicleService = new VehicleService(
+                configuration,
+                new DeviceStateCache(configuration, ioTHub),
+                new DeviceGroup(configuration, ioTHub),
+                ioTHub);
+        }
+
+        public async Task<string> SendAsync(string payload, CancellationToken cancellationToken)
+        {
+            var query = JsonConvert.DeserializeObject<GoogleDialogFlowQuery>(payload);
+            var dialogResponse = GoogleDialogFlowResponse.FromQuery(query);
+            var results = await VehicleIntents.Handle(this.vehicleService, query.Intent, new CommandTrace());
+
+            if (results == null)
+            {
+                return $"intent {query.Intent.Name} not handled";
+            }
+
+            var allResponded = results.All(result => result.Succeeded);
+
+            dialogResponse.Prompt.FirstSimple = new Simple { Speech = allResponded ? "Ok" : "Not every car responded" };
+            JsonConvert.SerializeObject(dialogResponse);
+
+            return allResponded ? null : "not every car responded";
+        }
+    }
+}
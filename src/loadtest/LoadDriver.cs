@@ -0,0 +1,90 @@
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Threading;
+using System.Threading.Tasks;
+
+namespace JoyItCar.LoadTest
+{
+    /// <summary>
+    /// Latency of a request from its scheduled send time, and why it failed, or null.
+    /// </summary>
+    public class LoadSample
+    {
+        public LoadSample(TimeSpan latency, string error)
+        {
+            this.Latency = latency;
+            this.Error = error;
+        }
+
+        public TimeSpan Latency { get; }
+
+        public string Error { get; }
+    }
+
+    /// <summary>
+    /// Sends payloads to a target at a fixed rate, open loop: a request leaves at its scheduled
+    /// time whether or not the previous ones were answered, and its latency runs from that
+    /// time. A slow webhook then shows in the latencies instead of lowering the rate.
+    /// </summary>
+    public class LoadDriver
+    {
+        private readonly ILoadTarget target;
+
+        public LoadDriver(ILoadTarget target)
+        {
+            this.target = target;
+        }
+
+        /// <summary>
+        /// Sends the payloads in turn for the duration, or until cancelled, then waits for the
+        /// requests in flight.
+        /// </summary>
+        public async Task<LoadReport> RunAsync(IReadOnlyList<string> payloads, double requestsPerSecond, TimeSpan duration, CancellationToken cancellationToken)
+        {
+            var requestCount = (int)Math.Ceiling(requestsPerSecond * duration.TotalSeconds);
+            var requests = new List<Task<LoadSample>>(requestCount);
+            var stopwatch = Stopwatch.StartNew();
+
+            for (var i = 0; i < requestCount && !cancellationToken.IsCancellationRequested; i++)
+            {
+                var scheduledAt = TimeSpan.FromSeconds(i / requestsPerSecond);
+                var wait = scheduledAt - stopwatch.Elapsed;
+
+                if (wait > TimeSpan.Zero)
+                {
+                    await Task.Delay(wait);
+                }
+
+                requests.Add(this.SendAsync(payloads[i % payloads.Count], scheduledAt, stopwatch));
+            }
+
+            var samples = await Task.WhenAll(requests);
+
+            return new LoadReport(samples, stopwatch.Elapsed);
+        }
+
+        private async Task<LoadSample> SendAsync(string payload, TimeSpan scheduledAt, Stopwatch stopwatch)
+        {
+            // Off the schedule loop, which a target completing synchronously would hold up.
+            await Task.Yield();
+
+            string error;
+
+            try
+            {
+                error = await this.target.SendAsync(payload, CancellationToken.None);
+            }
+            catch (TaskCanceledException)
+            {
+                error = "timeout";
+            }
+            catch (Exception exception)
+            {
+                error = exception.GetType().Name;
+            }
+
+            return new LoadSample(stopwatch.Elapsed - scheduledAt, error);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+using System;
+using System.Collections.Generic;
+using System.IO;
+using System.Linq;
+
+namespace JoyItCar.LoadTest
+{
+    /// <summary>
+    /// Throughput, latency percentiles and error rate of a load run. The percentiles use the
+    /// nearest rank, as the WebhookStatistics of the function do, and include failed requests.
+    /// </summary>
+    public class LoadReport
+    {
+        private readonly double[] sortedLatenciesMs;
+
+        public LoadReport(IReadOnlyList<LoadSample> samples, TimeSpan elapsed)
+        {
+            this.Requests = samples.Count;
+            this.Elapsed = elapsed;
+            this.sortedLatenciesMs = samples.Select(sample => sample.Latency.TotalMilliseconds).OrderBy(latency => latency).ToArray();
+            this.ErrorsByKind = samples
+                .Where(sample => sample.Error != null)
+                .GroupBy(sample => sample.Error)
+                .OrderByDescending(group => group.Count())
+                .ToDictionary(group => group.Key, group => group.Count());
+            this.Errors = this.ErrorsByKind.Values.Sum();
+        }
+
+        public int Requests { get; }
+
+        public int Errors { get; }
+
+        public TimeSpan Elapsed { get; }
+
+        public IReadOnlyDictionary<string, int> ErrorsByKind { get; }
+
+        public double RequestsPerSecond => this.Requests / this.Elapsed.TotalSeconds;
+
+        public double ErrorPercent => this.Requests == 0 ? 0 : 100.0 * this.Errors / this.Requests;
+
+        public double GetPercentileMs(double percentile)
+        {
+            if (this.sortedLatenciesMs.Length == 0)
+            {
+                return 0;
+            }
+
+            var index = (int)Math.Ceiling(percentile * this.sortedLatenciesMs.Length) - 1;
+
+            return this.sortedLatenciesMs[Math.Max(0, index)];
+        }
+
+        public void Write(TextWriter writer)
+        {
+            writer.WriteLine($"Requests:   {this.Requests} in {this.Elapsed.TotalSeconds:F1} s, {this.RequestsPerSecond:F1}/s");
+            writer.WriteLine($"Latency:    p50 {this.GetPercentileMs(0.50):F0} ms, p95 {this.GetPercentileMs(0.95):F0} ms, p99 {this.GetPercentileMs(0.99):F0} ms, max {this.GetPercentileMs(1.0):F0} ms");
+            writer.WriteLine($"Errors:     {this.Errors} ({this.ErrorPercent:F1}%)");
+
+            foreach (var error in this.ErrorsByKind)
+            {
+                writer.WriteLine($"  {error.Value,8}  {error.Key}");
+            }
+        }
+    }
+}
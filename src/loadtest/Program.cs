@@ -0,0 +1,74 @@
+using System;
+using System.Collections.Generic;
+using System.Threading;
+using System.Threading.Tasks;
+using JoyItCar.Function.Intents;
+using Microsoft.Extensions.Configuration;
+
+namespace JoyItCar.LoadTest
+{
+    /// <summary>
+    /// Load test of the webhook with synthetic Google Assistant queries:
+    ///
+    ///   dotnet run -- --rate 50 --durationSeconds 60 [--url https://.../api/joyit_car_facade?code=...]
+    ///
+    /// Without a url, the intents and services of the function run in process against the
+    /// <see cref="SimulatedIoTHub" />, set up by the SIMULATION_* settings; the function's own
+    /// settings, e.g. METHOD_CONCURRENCY, apply too. Settings come from the environment or the
+    /// command line. intents is a comma separated mix, sent in turn from sessionCount sessions.
+    /// </summary>
+    public static class Program
+    {
+        private const string DefaultIntents = "GoForward,TurnLeft,GoForward,TurnRight,GoBackward,Break," + SequenceIntent.Name;
+
+        private static readonly Dictionary<string, string> Defaults = new Dictionary<string, string>
+        {
+            // The simulated group, queried by its tag.
+            ["DEVICE_GROUP_TAG"] = "loadtest"
+        };
+
+        public static async Task<int> Main(string[] args)
+        {
+            var configuration = new ConfigurationBuilder()
+                .AddInMemoryCollection(Defaults)
+                .AddEnvironmentVariables()
+                .AddCommandLine(args)
+                .Build();
+
+            var requestsPerSecond = configuration.GetValue("rate", 10.0);
+            var duration = TimeSpan.FromSeconds(configuration.GetValue("durationSeconds", 30));
+            var url = configuration.GetValue<string>("url");
+            var intents = configuration.GetValue("intents", DefaultIntents)
+                .Split(',', StringSplitOptions.RemoveEmptyEntries | StringSplitOptions.TrimEntries);
+            var sessionCount = configuration.GetValue("sessionCount", 16);
+
+            if (requestsPerSecond <= 0 || duration <= TimeSpan.Zero || intents.Length == 0 || sessionCount <= 0)
+            {
+                Console.Error.WriteLine("rate, durationSeconds, intents and sessionCount must be positive.");
+                return 1;
+            }
+
+            ILoadTarget target = url != null
+                ? new HttpLoadTarget(new Uri(url), TimeSpan.FromSeconds(configuration.GetValue("timeoutSeconds", 30)))
+                : new InProcessLoadTarget(configuration);
+
+            Console.WriteLine($"Sending {requestsPerSecond}/s for {duration.TotalSeconds} s to {(url != null ? new Uri(url).GetLeftPart(UriPartial.Path) : "the webhook in process, against the simulated hub")}");
+
+            // Ctrl+C stops sending, and reports on the requests sent so far.
+            using (var stop = new CancellationTokenSource())
+            {
+                Console.CancelKeyPress += (sender, eventArgs) =>
+                {
+                    eventArgs.Cancel = true;
+                    stop.Cancel();
+                };
+
+                var report = await new LoadDriver(target).RunAsync(SyntheticQueries.Create(intents, sessionCount), requestsPerSecond, duration, stop.Token);
+
+                report.Write(Console.Out);
+            }
+
+            return 0;
+        }
+    }
+}
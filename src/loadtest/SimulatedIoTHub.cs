@@ -0,0 +1,98 @@
+using System;
+using System.Collections.Generic;
+using System.Linq;
+using System.Threading;
+using System.Threading.Tasks;
+using JoyItCar.Services;
+using Microsoft.Azure.Devices;
+using Microsoft.Azure.Devices.Common.Exceptions;
+using Microsoft.Extensions.Configuration;
+
+namespace JoyItCar.LoadTest
+{
+    /// <summary>
+    /// Stand-in for IoT Hub, to load the webhook in process without a hub or a car. Every
+    /// device is registered and connected; a group has SIMULATION_DEVICE_COUNT devices. A
+    /// direct method takes SIMULATION_LATENCY_MS, plus up to SIMULATION_JITTER_MS, and fails
+    /// with the ratio SIMULATION_FAILURE_RATE, half of the failures as an offline device and
+    /// half as a timeout.
+    /// </summary>
+    public class SimulatedIoTHub : IIoTHub
+    {
+        private const string OkResponse = "{\"result\":\"OK\"}";
+
+        private readonly int latencyMs;
+
+        private readonly int jitterMs;
+
+        private readonly double failureRate;
+
+        private readonly int deviceCount;
+
+        private readonly Random random = new Random();
+
+        public SimulatedIoTHub(IConfiguration configuration)
+        {
+            this.latencyMs = configuration.GetValue("SIMULATION_LATENCY_MS", 150);
+            this.jitterMs = configuration.GetValue("SIMULATION_JITTER_MS", 100);
+            this.failureRate = configuration.GetValue("SIMULATION_FAILURE_RATE", 0.0);
+            this.deviceCount = configuration.GetValue("SIMULATION_DEVICE_COUNT", 3);
+        }
+
+        public Task OpenAsync()
+        {
+            return Task.Delay(this.latencyMs);
+        }
+
+        public Task KeepAliveAsync()
+        {
+            return Task.CompletedTask;
+        }
+
+        public async Task<DeviceConnectionState?> GetConnectionStateAsync(string deviceId)
+        {
+            await Task.Delay(this.NextLatency());
+
+            return DeviceConnectionState.Connected;
+        }
+
+        public async Task<IReadOnlyList<string>> QueryDeviceIdsAsync(string groupTag)
+        {
+            await Task.Delay(this.NextLatency());
+
+            return Enumerable.Range(1, this.deviceCount).Select(index => $"{groupTag}-{index}").ToList();
+        }
+
+        public async Task<DeviceMethodResponse> InvokeMethodAsync(string deviceId, string methodName, string payload, TimeSpan timeout, CancellationToken cancellationToken)
+        {
+            double outcome;
+
+            lock (this.random)
+            {
+                outcome = this.random.NextDouble();
+            }
+
+            if (outcome < this.failureRate / 2)
+            {
+                throw new DeviceNotFoundException(deviceId);
+            }
+
+            if (outcome < this.failureRate)
+            {
+                await Task.Delay(timeout, cancellationToken);
+            }
+
+            await Task.Delay(this.NextLatency(), cancellationToken);
+
+            return new DeviceMethodResponse { Status = 200, Payload = OkResponse };
+        }
+
+        private int NextLatency()
+        {
+            lock (this.random)
+            {
+                return this.latencyMs + this.random.Next(this.jitterMs + 1);
+            }
+        }
+    }
+}
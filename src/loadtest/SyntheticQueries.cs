@@ -0,0 +1,64 @@
+using System.Collections.Generic;
+using System.Linq;
+using JoyItCar.Function.Intents;
+using JoyItCar.Function.Intents.GoogleDialogFlow;
+using Newtonsoft.Json;
+using Newtonsoft.Json.Linq;
+using Newtonsoft.Json.Serialization;
+
+namespace JoyItCar.LoadTest
+{
+    /// <summary>
+    /// GoogleDialogFlowQuery payloads as Google Assistant sends them to the webhook: one per
+    /// intent and session, so that the sessions of a run differ as real users' would.
+    /// </summary>
+    public static class SyntheticQueries
+    {
+        private static readonly JsonSerializerSettings SerializerSettings = new JsonSerializerSettings
+        {
+            ContractResolver = new CamelCasePropertyNamesContractResolver(),
+            NullValueHandling = NullValueHandling.Ignore
+        };
+
+        public static IReadOnlyList<string> Create(IReadOnlyList<string> intents, int sessionCount)
+        {
+            return Enumerable.Range(1, sessionCount)
+                .SelectMany(session => intents.Select(intent => JsonConvert.SerializeObject(CreateQuery(intent, $"loadtest-session-{session}"), SerializerSettings)))
+                .ToList();
+        }
+
+        private static GoogleDialogFlowQuery CreateQuery(string intent, string sessionId)
+        {
+            return new GoogleDialogFlowQuery
+            {
+                Handler = new Handler { Name = "joyit_car_facade" },
+                Intent = new Intent
+                {
+                    Name = intent,
+                    Query = intent,
+                    Params = intent == SequenceIntent.Name ? CreateSequenceParams() : new Dictionary<string, IntentParameter>()
+                },
+                Scene = new Scene { Name = "Drive", SlotFillingStatus = "FINAL" },
+                Session = new Session { Id = sessionId, Params = new Dictionary<string, dynamic>() },
+                Device = new Device { Capabilities = new List<string> { "SPEECH", "RICH_RESPONSE" } }
+            };
+        }
+
+        private static Dictionary<string, IntentParameter> CreateSequenceParams()
+        {
+            return new Dictionary<string, IntentParameter>
+            {
+                ["maneuvers"] = new IntentParameter
+                {
+                    Original = "forward, left, forward, stop",
+                    Resolved = new JArray("forward", "left", "forward", "stop")
+                },
+                ["durations"] = new IntentParameter
+                {
+                    Original = "1, 0.5, 1",
+                    Resolved = new JArray(1, 0.5, 1)
+                }
+            };
+        }
+    }
+}